@@ -6,6 +6,7 @@
 @copyright Copyright © 2020 Wannes Meert. Apache License, Version 2.0, see LICENSE for details.
 */
 #include "dd_dtw.h"
+#include "dd_dtw_simd.h"
 
 
 //#define DTWDEBUG
@@ -66,6 +67,42 @@ void dtw_settings_print(DTWSettings *settings) {
     printf("}\n");
 }
 
+// MARK: Workspace
+
+/* Create an empty workspace, memory is allocated by the first call that uses it. */
+DTWWorkspace dtw_workspace_empty(void) {
+    DTWWorkspace ws = {
+        .buffer = NULL,
+        .size = 0
+    };
+    return ws;
+}
+
+/*!
+ Make sure the workspace has room for size bytes and return the buffer.
+ The buffer only grows, its content is not preserved when it grows.
+
+ @return Pointer to the buffer, NULL if memory cannot be allocated.
+ */
+void * dtw_workspace_reserve(DTWWorkspace *ws, size_t size) {
+    if (size > ws->size) {
+        free(ws->buffer);
+        ws->buffer = malloc(size);
+        if (!ws->buffer) {
+            ws->size = 0;
+            return NULL;
+        }
+        ws->size = size;
+    }
+    return ws->buffer;
+}
+
+void dtw_workspace_free(DTWWorkspace *ws) {
+    free(ws->buffer);
+    ws->buffer = NULL;
+    ws->size = 0;
+}
+
 // MARK: DTW
 
 
@@ -78,12 +115,16 @@ Use the Squared Euclidean inner distance.
 @param s2 Second sequence
 @param l2 Length of second sequence. 
 @param settings A DTWSettings struct with options for the DTW algorithm.
+@param ws Workspace that provides (and keeps) the memory for the cost matrix rows.
 */
-seq_t dtw_distance(seq_t *s1, idx_t l1,
+seq_t dtw_distance_ws(seq_t *s1, idx_t l1,
                       seq_t *s2, idx_t l2, 
-                      DTWSettings *settings) {
+                      DTWSettings *settings, DTWWorkspace *ws) {
     if (settings->inner_dist == 1) {
-        return dtw_distance_euclidean(s1, l1, s2, l2,  settings);
+        return dtw_distance_euclidean_ws(s1, l1, s2, l2,  settings, ws);
+    }
+    if (dtw_simd_level() != DTW_SIMD_NONE && dtw_simd_settings_supported(l1, l2, settings)) {
+        return dtw_distance_wavefront_ws(s1, l1, s2, l2, settings, ws);
     }
     assert(settings->psi_1b <= l1 && settings->psi_1e <= l1 &&
            settings->psi_2b <= l2 && settings->psi_2e <= l2);
@@ -97,6 +138,7 @@ seq_t dtw_distance(seq_t *s1, idx_t l1,
     // signal(SIGINT, dtw_int_handler); // not compatible with OMP
 
     idx_t window = settings->window;
+
     seq_t max_step = settings->max_step;
     seq_t max_dist = settings->max_dist;
     seq_t penalty = settings->penalty;
@@ -137,7 +179,7 @@ seq_t dtw_distance(seq_t *s1, idx_t l1,
     // rows is for series 1, columns is for series 2
     idx_t length = MIN(l2+1, ldiff + 2*window + 1);
     assert(length > 0);
-    seq_t * dtw = (seq_t *)malloc(sizeof(seq_t) * length * 2);
+    seq_t * dtw = (seq_t *)dtw_workspace_reserve(ws, sizeof(seq_t) * length * 2);
     if (!dtw) {
         printf("Error: dtw_distance - Cannot allocate memory (size=%zu)\n", length*2);
         return 0;
@@ -293,7 +335,6 @@ seq_t dtw_distance(seq_t *s1, idx_t l1,
         }
         result = sqrt(psi_shortest);
     }
-    free(dtw);
     // signal(SIGINT, SIG_DFL);  // not compatible with OMP
     if (settings->max_dist !=0 && result > settings->max_dist) {
         // DTWPruned keeps the last value larger than max_dist. Correct for this.
@@ -302,6 +343,20 @@ seq_t dtw_distance(seq_t *s1, idx_t l1,
     return result;
 }
 
+/**
+Compute the DTW between two series.
+Allocates a temporary workspace, use dtw_distance_ws to reuse memory over calls.
+
+@see dtw_distance_ws
+*/
+seq_t dtw_distance(seq_t *s1, idx_t l1,
+                      seq_t *s2, idx_t l2, 
+                      DTWSettings *settings) {
+    DTWWorkspace ws = dtw_workspace_empty();
+    seq_t result = dtw_distance_ws(s1, l1, s2, l2, settings, &ws);
+    dtw_workspace_free(&ws);
+    return result;
+}
 
 
 /**
@@ -314,12 +369,13 @@ Use the Squared Euclidean inner distance.
 @param l2 Length of second sequence. In tuples, real length should be length*ndim.
 @param ndim Number of dimensions
 @param settings A DTWSettings struct with options for the DTW algorithm.
+@param ws Workspace that provides (and keeps) the memory for the cost matrix rows.
 */
-seq_t dtw_distance_ndim(seq_t *s1, idx_t l1,
+seq_t dtw_distance_ndim_ws(seq_t *s1, idx_t l1,
                       seq_t *s2, idx_t l2, int ndim,
-                      DTWSettings *settings) {
+                      DTWSettings *settings, DTWWorkspace *ws) {
     if (settings->inner_dist == 1) {
-        return dtw_distance_ndim_euclidean(s1, l1, s2, l2, ndim,  settings);
+        return dtw_distance_ndim_euclidean_ws(s1, l1, s2, l2, ndim,  settings, ws);
     }
     assert(settings->psi_1b <= l1 && settings->psi_1e <= l1 &&
            settings->psi_2b <= l2 && settings->psi_2e <= l2);
@@ -333,6 +389,7 @@ seq_t dtw_distance_ndim(seq_t *s1, idx_t l1,
     // signal(SIGINT, dtw_int_handler); // not compatible with OMP
 
     idx_t window = settings->window;
+
     seq_t max_step = settings->max_step;
     seq_t max_dist = settings->max_dist;
     seq_t penalty = settings->penalty;
@@ -373,7 +430,7 @@ seq_t dtw_distance_ndim(seq_t *s1, idx_t l1,
     // rows is for series 1, columns is for series 2
     idx_t length = MIN(l2+1, ldiff + 2*window + 1);
     assert(length > 0);
-    seq_t * dtw = (seq_t *)malloc(sizeof(seq_t) * length * 2);
+    seq_t * dtw = (seq_t *)dtw_workspace_reserve(ws, sizeof(seq_t) * length * 2);
     if (!dtw) {
         printf("Error: dtw_distance_ndim - Cannot allocate memory (size=%zu)\n", length*2);
         return 0;
@@ -447,35 +504,905 @@ seq_t dtw_distance_ndim(seq_t *s1, idx_t l1,
         }
         smaller_found = false;
         ec_next = i;
-        // Deal with psi-relaxation in first column
-        if (settings->psi_1b != 0 && maxj == 0 && i < settings->psi_1b) {
-            dtw[i1*length + 0] = 0;
-        }
+        // Deal with psi-relaxation in first column
+        if (settings->psi_1b != 0 && maxj == 0 && i < settings->psi_1b) {
+            dtw[i1*length + 0] = 0;
+        }
+        #ifdef DTWDEBUG
+        printf("i=%zu, maxj=%zu, minj=%zu\n", i, maxj, minj);
+        #endif
+        for (j=maxj; j<minj; j++) {
+            j_idx = j * ndim;
+            #ifdef DTWDEBUG
+            printf("ri=%zu,ci=%zu, s1[i] = s1[%zu] = %f , s2[j] = s2[%zu] = %f\n", i, j, i, s1[i], j, s2[j]);
+            #endif
+            d = 0;
+            for (int d_i=0; d_i<ndim; d_i++) {
+                d += SEDIST(s1[i_idx + d_i], s2[j_idx + d_i]);
+            }
+            if (d > max_step) {
+                // Let the value be INFINITY as initialized
+                continue;
+            }
+            curidx = i0 * length + j - skipp;
+            minv = dtw[curidx];
+            curidx += 1;
+            tempv = dtw[curidx] + penalty;
+            if (tempv < minv) {
+                minv = tempv;
+            }
+            curidx = i1 * length + j - skip;
+            tempv = dtw[curidx] + penalty;
+            if (tempv < minv) {
+                minv = tempv;
+            }
+            #ifdef DTWDEBUG
+            printf("d = %f, minv = %f\n", d, minv);
+            #endif
+            curidx += 1;
+            dtw[curidx] = d + minv;
+            #ifdef DTWDEBUG
+            printf("%zu, %zu, %zu\n",i0*length + j - skipp,i0*length + j + 1 - skipp,i1*length + j - skip);
+            printf("%f, %f, %f\n",dtw[i0*length + j - skipp],dtw[i0*length + j + 1 - skipp],dtw[i1*length + j - skip]);
+            printf("i=%zu, j=%zu, d=%f, skip=%zu, skipp=%zu\n",i,j,d,skip,skipp);
+            #endif
+            // PrunedDTW
+            if (dtw[curidx] > max_dist) {
+                #ifdef DTWDEBUG
+                printf("dtw[%zu] = %f > %f\n", curidx, dtw[curidx], max_dist);
+                #endif
+                if (!smaller_found) {
+                    sc = j + 1;
+                }
+                if (j >= ec) {
+                    #ifdef DTWDEBUG
+                    printf("Break because of pruning with j=%zu, ec=%zu (saved %zu computations)\n", j, ec, minj-j);
+                    #endif
+                    break;
+                }
+            } else {
+                smaller_found = true;
+                ec_next = j + 1;
+            }
+        }
+        ec = ec_next;
+        // Deal with Psi-relaxation in last column
+        if (settings->psi_1e != 0 && minj == l2 && l1 - 1 - i <= settings->psi_1e) {
+            assert(!(settings->window == 0 || settings->window == l2) || (i1 + 1)*length - 1 == curidx);
+            if (dtw[curidx] < psi_shortest) {
+                // curidx is the last value
+                psi_shortest = dtw[curidx];
+            }
+        }
+        #ifdef DTWDEBUG
+        dtw_print_twoline(dtw, l1, l2, length, i0, i1, skip, skipp, maxj, minj);
+        #endif
+    }
+    if (window - 1 < 0) {
+        l2 += window - 1;
+    }
+    seq_t result = sqrt(dtw[length * i1 + l2 - skip]);
+    // Deal with psi-relaxation in the last row
+    if (settings->psi_1e != 0 || settings->psi_2e != 0) {
+        if (settings->psi_2e != 0) {
+            for (i=l2 - skip - settings->psi_2e; i<l2 - skip + 1; i++) { // iterate over vci
+                if (dtw[i1*length + i] < psi_shortest) {
+                    psi_shortest = dtw[i1*length + i];
+                }
+            }
+        }
+        result = sqrt(psi_shortest);
+    }
+    // signal(SIGINT, SIG_DFL);  // not compatible with OMP
+    if (settings->max_dist !=0 && result > settings->max_dist) {
+        // DTWPruned keeps the last value larger than max_dist. Correct for this.
+        result = INFINITY;
+    }
+    return result;
+}
+
+/**
+Compute the DTW between two n-dimensional series.
+Allocates a temporary workspace, use dtw_distance_ndim_ws to reuse memory over calls.
+
+@see dtw_distance_ndim_ws
+*/
+seq_t dtw_distance_ndim(seq_t *s1, idx_t l1,
+                      seq_t *s2, idx_t l2, int ndim,
+                      DTWSettings *settings) {
+    DTWWorkspace ws = dtw_workspace_empty();
+    seq_t result = dtw_distance_ndim_ws(s1, l1, s2, l2, ndim, settings, &ws);
+    dtw_workspace_free(&ws);
+    return result;
+}
+
+
+/**
+Compute the DTW between two series.
+Use the Euclidean inner distance.
+
+@param s1 First sequence
+@param l1 Length of first sequence. 
+@param s2 Second sequence
+@param l2 Length of second sequence. 
+@param settings A DTWSettings struct with options for the DTW algorithm.
+@param ws Workspace that provides (and keeps) the memory for the cost matrix rows.
+*/
+seq_t dtw_distance_euclidean_ws(seq_t *s1, idx_t l1,
+                      seq_t *s2, idx_t l2, 
+                      DTWSettings *settings, DTWWorkspace *ws) {
+    assert(settings->psi_1b <= l1 && settings->psi_1e <= l1 &&
+           settings->psi_2b <= l2 && settings->psi_2e <= l2);
+    idx_t ldiff;
+    idx_t dl;
+    // DTWPruned
+    idx_t sc = 0;
+    idx_t ec = 0;
+    bool smaller_found;
+    idx_t ec_next;
+    // signal(SIGINT, dtw_int_handler); // not compatible with OMP
+
+    idx_t window = settings->window;
+
+    seq_t max_step = settings->max_step;
+    seq_t max_dist = settings->max_dist;
+    seq_t penalty = settings->penalty;
+
+    #ifdef DTWDEBUG
+    printf("r=%zu, c=%zu\n", l1, l2);
+    #endif
+    if (settings->use_pruning || settings->only_ub) {
+        max_dist = ub_euclidean_euclidean(s1, l1, s2, l2);
+        if (settings->only_ub) {
+            return max_dist;
+        }
+    } else if (max_dist == 0) {
+        max_dist = INFINITY;
+    } else {
+        max_dist = pow(max_dist, 2);
+    }
+    if (l1 > l2) {
+        ldiff = l1 - l2;
+        dl = ldiff;
+    } else {
+        ldiff  = l2 - l1;
+        dl = 0;
+    }
+    if (settings->max_length_diff != 0 && ldiff > settings->max_length_diff) {
+        return INFINITY;
+    }
+    if (window == 0) {
+        window = MAX(l1, l2);
+    }
+    if (max_step == 0) {
+        max_step = INFINITY;
+    } else {
+        max_step = pow(max_step, 2);
+    }
+    penalty = pow(penalty, 2);
+    // rows is for series 1, columns is for series 2
+    idx_t length = MIN(l2+1, ldiff + 2*window + 1);
+    assert(length > 0);
+    seq_t * dtw = (seq_t *)dtw_workspace_reserve(ws, sizeof(seq_t) * length * 2);
+    if (!dtw) {
+        printf("Error: dtw_distance - Cannot allocate memory (size=%zu)\n", length*2);
+        return 0;
+    }
+    idx_t i;
+    idx_t j;
+    for (j=0; j<length*2; j++) {
+        dtw[j] = INFINITY;
+    }
+    // Deal with psi-relaxation in first row
+    for (i=0; i<settings->psi_2b + 1; i++) {
+        dtw[i] = 0;
+    }
+    idx_t skip = 0;
+    idx_t skipp = 0;
+    int i0 = 1;
+    int i1 = 0;
+    idx_t minj;
+    idx_t maxj;
+    idx_t curidx = 0;
+    idx_t dl_window = dl + window - 1;
+    idx_t ldiff_window = window;
+    if (l2 > l1) {
+        ldiff_window += ldiff;
+    }
+    seq_t minv;
+    seq_t d;
+    seq_t tempv;
+    seq_t psi_shortest = INFINITY;
+    // keepRunning = 1;
+    for (i=0; i<l1; i++) {
+        // if (!keepRunning){  // not compatible with OMP
+        //     free(dtw);
+        //     printf("Stop computing DTW...\n");
+        //     return INFINITY;
+        // }
+        // maxj = i;
+        // if (maxj > dl_window) {
+        //     maxj -= dl_window;
+        // } else {
+        //     maxj = 0;
+        // }
+        maxj = (i - dl_window) * (i > dl_window);
+        // No risk for overflow/modulo because we also need to store dtw of size
+        // MIN(l2+1, ldiff + 2*window + 1) ?
+        minj = i + ldiff_window;
+        if (minj > l2) {
+            minj = l2;
+        }
+        skipp = skip;
+        skip = maxj;
+        i0 = 1 - i0;
+        i1 = 1 - i1;
+        // Reset new line i1
+        for (j=0; j<length; j++) {
+            dtw[length * i1 + j] = INFINITY;
+        }
+        // if (length == l2 + 1) {
+        //     skip = 0;
+        // }
+        skip = skip * (length != l2 + 1);
+        // PrunedDTW
+        if (sc > maxj) {
+            #ifdef DTWDEBUG
+            printf("correct maxj to sc: %zu -> %zu (saved %zu computations)\n", maxj, sc, sc-maxj);
+            #endif
+            maxj = sc;
+        }
+        smaller_found = false;
+        ec_next = i;
+        // Deal with psi-relaxation in first column
+        if (settings->psi_1b != 0 && maxj == 0 && i < settings->psi_1b) {
+            dtw[i1*length + 0] = 0;
+        }
+        #ifdef DTWDEBUG
+        printf("i=%zu, maxj=%zu, minj=%zu\n", i, maxj, minj);
+        #endif
+        for (j=maxj; j<minj; j++) {
+            #ifdef DTWDEBUG
+            printf("ri=%zu,ci=%zu, s1[i] = s1[%zu] = %f , s2[j] = s2[%zu] = %f\n", i, j, i, s1[i], j, s2[j]);
+            #endif
+            d = fabs(s1[i] - s2[j]);
+            if (d > max_step) {
+                // Let the value be INFINITY as initialized
+                continue;
+            }
+            curidx = i0 * length + j - skipp;
+            minv = dtw[curidx];
+            curidx += 1;
+            tempv = dtw[curidx] + penalty;
+            if (tempv < minv) {
+                minv = tempv;
+            }
+            curidx = i1 * length + j - skip;
+            tempv = dtw[curidx] + penalty;
+            if (tempv < minv) {
+                minv = tempv;
+            }
+            #ifdef DTWDEBUG
+            printf("d = %f, minv = %f\n", d, minv);
+            #endif
+            curidx += 1;
+            dtw[curidx] = d + minv;
+            #ifdef DTWDEBUG
+            printf("%zu, %zu, %zu\n",i0*length + j - skipp,i0*length + j + 1 - skipp,i1*length + j - skip);
+            printf("%f, %f, %f\n",dtw[i0*length + j - skipp],dtw[i0*length + j + 1 - skipp],dtw[i1*length + j - skip]);
+            printf("i=%zu, j=%zu, d=%f, skip=%zu, skipp=%zu\n",i,j,d,skip,skipp);
+            #endif
+            // PrunedDTW
+            if (dtw[curidx] > max_dist) {
+                #ifdef DTWDEBUG
+                printf("dtw[%zu] = %f > %f\n", curidx, dtw[curidx], max_dist);
+                #endif
+                if (!smaller_found) {
+                    sc = j + 1;
+                }
+                if (j >= ec) {
+                    #ifdef DTWDEBUG
+                    printf("Break because of pruning with j=%zu, ec=%zu (saved %zu computations)\n", j, ec, minj-j);
+                    #endif
+                    break;
+                }
+            } else {
+                smaller_found = true;
+                ec_next = j + 1;
+            }
+        }
+        ec = ec_next;
+        // Deal with Psi-relaxation in last column
+        if (settings->psi_1e != 0 && minj == l2 && l1 - 1 - i <= settings->psi_1e) {
+            assert(!(settings->window == 0 || settings->window == l2) || (i1 + 1)*length - 1 == curidx);
+            if (dtw[curidx] < psi_shortest) {
+                // curidx is the last value
+                psi_shortest = dtw[curidx];
+            }
+        }
+        #ifdef DTWDEBUG
+        dtw_print_twoline(dtw, l1, l2, length, i0, i1, skip, skipp, maxj, minj);
+        #endif
+    }
+    if (window - 1 < 0) {
+        l2 += window - 1;
+    }
+    seq_t result = dtw[length * i1 + l2 - skip];
+    // Deal with psi-relaxation in the last row
+    if (settings->psi_1e != 0 || settings->psi_2e != 0) {
+        if (settings->psi_2e != 0) {
+            for (i=l2 - skip - settings->psi_2e; i<l2 - skip + 1; i++) { // iterate over vci
+                if (dtw[i1*length + i] < psi_shortest) {
+                    psi_shortest = dtw[i1*length + i];
+                }
+            }
+        }
+        result = psi_shortest;
+    }
+    // signal(SIGINT, SIG_DFL);  // not compatible with OMP
+    if (settings->max_dist !=0 && result > settings->max_dist) {
+        // DTWPruned keeps the last value larger than max_dist. Correct for this.
+        result = INFINITY;
+    }
+    return result;
+}
+
+/**
+Compute the DTW between two series.
+Allocates a temporary workspace, use dtw_distance_euclidean_ws to reuse memory over calls.
+
+@see dtw_distance_euclidean_ws
+*/
+seq_t dtw_distance_euclidean(seq_t *s1, idx_t l1,
+                      seq_t *s2, idx_t l2, 
+                      DTWSettings *settings) {
+    DTWWorkspace ws = dtw_workspace_empty();
+    seq_t result = dtw_distance_euclidean_ws(s1, l1, s2, l2, settings, &ws);
+    dtw_workspace_free(&ws);
+    return result;
+}
+
+
+/**
+Compute the DTW between two n-dimensional series.
+Use the Euclidean inner distance.
+
+@param s1 First sequence
+@param l1 Length of first sequence. In tuples, real length should be length*ndim.
+@param s2 Second sequence
+@param l2 Length of second sequence. In tuples, real length should be length*ndim.
+@param ndim Number of dimensions
+@param settings A DTWSettings struct with options for the DTW algorithm.
+@param ws Workspace that provides (and keeps) the memory for the cost matrix rows.
+*/
+seq_t dtw_distance_ndim_euclidean_ws(seq_t *s1, idx_t l1,
+                      seq_t *s2, idx_t l2, int ndim,
+                      DTWSettings *settings, DTWWorkspace *ws) {
+    assert(settings->psi_1b <= l1 && settings->psi_1e <= l1 &&
+           settings->psi_2b <= l2 && settings->psi_2e <= l2);
+    idx_t ldiff;
+    idx_t dl;
+    // DTWPruned
+    idx_t sc = 0;
+    idx_t ec = 0;
+    bool smaller_found;
+    idx_t ec_next;
+    // signal(SIGINT, dtw_int_handler); // not compatible with OMP
+
+    idx_t window = settings->window;
+
+    seq_t max_step = settings->max_step;
+    seq_t max_dist = settings->max_dist;
+    seq_t penalty = settings->penalty;
+
+    #ifdef DTWDEBUG
+    printf("r=%zu, c=%zu\n", l1, l2);
+    #endif
+    if (settings->use_pruning || settings->only_ub) {
+        max_dist = ub_euclidean_ndim_euclidean(s1, l1, s2, l2, ndim);
+        if (settings->only_ub) {
+            return max_dist;
+        }
+    } else if (max_dist == 0) {
+        max_dist = INFINITY;
+    } else {
+        max_dist = pow(max_dist, 2);
+    }
+    if (l1 > l2) {
+        ldiff = l1 - l2;
+        dl = ldiff;
+    } else {
+        ldiff  = l2 - l1;
+        dl = 0;
+    }
+    if (settings->max_length_diff != 0 && ldiff > settings->max_length_diff) {
+        return INFINITY;
+    }
+    if (window == 0) {
+        window = MAX(l1, l2);
+    }
+    if (max_step == 0) {
+        max_step = INFINITY;
+    } else {
+        max_step = pow(max_step, 2);
+    }
+    penalty = pow(penalty, 2);
+    // rows is for series 1, columns is for series 2
+    idx_t length = MIN(l2+1, ldiff + 2*window + 1);
+    assert(length > 0);
+    seq_t * dtw = (seq_t *)dtw_workspace_reserve(ws, sizeof(seq_t) * length * 2);
+    if (!dtw) {
+        printf("Error: dtw_distance_ndim - Cannot allocate memory (size=%zu)\n", length*2);
+        return 0;
+    }
+    idx_t i;
+    idx_t j;
+    idx_t i_idx;
+    idx_t j_idx;
+    for (j=0; j<length*2; j++) {
+        dtw[j] = INFINITY;
+    }
+    // Deal with psi-relaxation in first row
+    for (i=0; i<settings->psi_2b + 1; i++) {
+        dtw[i] = 0;
+    }
+    idx_t skip = 0;
+    idx_t skipp = 0;
+    int i0 = 1;
+    int i1 = 0;
+    idx_t minj;
+    idx_t maxj;
+    idx_t curidx = 0;
+    idx_t dl_window = dl + window - 1;
+    idx_t ldiff_window = window;
+    if (l2 > l1) {
+        ldiff_window += ldiff;
+    }
+    seq_t minv;
+    seq_t d;
+    seq_t tempv;
+    seq_t psi_shortest = INFINITY;
+    // keepRunning = 1;
+    for (i=0; i<l1; i++) {
+        // if (!keepRunning){  // not compatible with OMP
+        //     free(dtw);
+        //     printf("Stop computing DTW...\n");
+        //     return INFINITY;
+        // }
+        i_idx = i * ndim;
+        // maxj = i;
+        // if (maxj > dl_window) {
+        //     maxj -= dl_window;
+        // } else {
+        //     maxj = 0;
+        // }
+        maxj = (i - dl_window) * (i > dl_window);
+        // No risk for overflow/modulo because we also need to store dtw of size
+        // MIN(l2+1, ldiff + 2*window + 1) ?
+        minj = i + ldiff_window;
+        if (minj > l2) {
+            minj = l2;
+        }
+        skipp = skip;
+        skip = maxj;
+        i0 = 1 - i0;
+        i1 = 1 - i1;
+        // Reset new line i1
+        for (j=0; j<length; j++) {
+            dtw[length * i1 + j] = INFINITY;
+        }
+        // if (length == l2 + 1) {
+        //     skip = 0;
+        // }
+        skip = skip * (length != l2 + 1);
+        // PrunedDTW
+        if (sc > maxj) {
+            #ifdef DTWDEBUG
+            printf("correct maxj to sc: %zu -> %zu (saved %zu computations)\n", maxj, sc, sc-maxj);
+            #endif
+            maxj = sc;
+        }
+        smaller_found = false;
+        ec_next = i;
+        // Deal with psi-relaxation in first column
+        if (settings->psi_1b != 0 && maxj == 0 && i < settings->psi_1b) {
+            dtw[i1*length + 0] = 0;
+        }
+        #ifdef DTWDEBUG
+        printf("i=%zu, maxj=%zu, minj=%zu\n", i, maxj, minj);
+        #endif
+        for (j=maxj; j<minj; j++) {
+            j_idx = j * ndim;
+            #ifdef DTWDEBUG
+            printf("ri=%zu,ci=%zu, s1[i] = s1[%zu] = %f , s2[j] = s2[%zu] = %f\n", i, j, i, s1[i], j, s2[j]);
+            #endif
+            d = 0;
+            for (int d_i=0; d_i<ndim; d_i++) {
+                d += SEDIST(s1[i_idx + d_i], s2[j_idx + d_i]);
+            }
+            d = sqrt(d);
+            if (d > max_step) {
+                // Let the value be INFINITY as initialized
+                continue;
+            }
+            curidx = i0 * length + j - skipp;
+            minv = dtw[curidx];
+            curidx += 1;
+            tempv = dtw[curidx] + penalty;
+            if (tempv < minv) {
+                minv = tempv;
+            }
+            curidx = i1 * length + j - skip;
+            tempv = dtw[curidx] + penalty;
+            if (tempv < minv) {
+                minv = tempv;
+            }
+            #ifdef DTWDEBUG
+            printf("d = %f, minv = %f\n", d, minv);
+            #endif
+            curidx += 1;
+            dtw[curidx] = d + minv;
+            #ifdef DTWDEBUG
+            printf("%zu, %zu, %zu\n",i0*length + j - skipp,i0*length + j + 1 - skipp,i1*length + j - skip);
+            printf("%f, %f, %f\n",dtw[i0*length + j - skipp],dtw[i0*length + j + 1 - skipp],dtw[i1*length + j - skip]);
+            printf("i=%zu, j=%zu, d=%f, skip=%zu, skipp=%zu\n",i,j,d,skip,skipp);
+            #endif
+            // PrunedDTW
+            if (dtw[curidx] > max_dist) {
+                #ifdef DTWDEBUG
+                printf("dtw[%zu] = %f > %f\n", curidx, dtw[curidx], max_dist);
+                #endif
+                if (!smaller_found) {
+                    sc = j + 1;
+                }
+                if (j >= ec) {
+                    #ifdef DTWDEBUG
+                    printf("Break because of pruning with j=%zu, ec=%zu (saved %zu computations)\n", j, ec, minj-j);
+                    #endif
+                    break;
+                }
+            } else {
+                smaller_found = true;
+                ec_next = j + 1;
+            }
+        }
+        ec = ec_next;
+        // Deal with Psi-relaxation in last column
+        if (settings->psi_1e != 0 && minj == l2 && l1 - 1 - i <= settings->psi_1e) {
+            assert(!(settings->window == 0 || settings->window == l2) || (i1 + 1)*length - 1 == curidx);
+            if (dtw[curidx] < psi_shortest) {
+                // curidx is the last value
+                psi_shortest = dtw[curidx];
+            }
+        }
+        #ifdef DTWDEBUG
+        dtw_print_twoline(dtw, l1, l2, length, i0, i1, skip, skipp, maxj, minj);
+        #endif
+    }
+    if (window - 1 < 0) {
+        l2 += window - 1;
+    }
+    seq_t result = dtw[length * i1 + l2 - skip];
+    // Deal with psi-relaxation in the last row
+    if (settings->psi_1e != 0 || settings->psi_2e != 0) {
+        if (settings->psi_2e != 0) {
+            for (i=l2 - skip - settings->psi_2e; i<l2 - skip + 1; i++) { // iterate over vci
+                if (dtw[i1*length + i] < psi_shortest) {
+                    psi_shortest = dtw[i1*length + i];
+                }
+            }
+        }
+        result = psi_shortest;
+    }
+    // signal(SIGINT, SIG_DFL);  // not compatible with OMP
+    if (settings->max_dist !=0 && result > settings->max_dist) {
+        // DTWPruned keeps the last value larger than max_dist. Correct for this.
+        result = INFINITY;
+    }
+    return result;
+}
+
+/**
+Compute the DTW between two n-dimensional series.
+Allocates a temporary workspace, use dtw_distance_ndim_euclidean_ws to reuse memory over calls.
+
+@see dtw_distance_ndim_euclidean_ws
+*/
+seq_t dtw_distance_ndim_euclidean(seq_t *s1, idx_t l1,
+                      seq_t *s2, idx_t l2, int ndim,
+                      DTWSettings *settings) {
+    DTWWorkspace ws = dtw_workspace_empty();
+    seq_t result = dtw_distance_ndim_euclidean_ws(s1, l1, s2, l2, ndim, settings, &ws);
+    dtw_workspace_free(&ws);
+    return result;
+}
+
+
+
+/**
+Compute the DTW between two series.
+Use the Squared Euclidean inner distance.
+
+Specialised for the settings without psi-relaxation, max_step, penalty and
+upper bound pruning, and without a window (settings->window is ignored).
+The branches for these options are removed from the inner loop. Use
+dtw_distance_kernel to select the variant for a DTWSettings struct.
+
+@param s1 First sequence
+@param l1 Length of first sequence. 
+@param s2 Second sequence
+@param l2 Length of second sequence. 
+@param settings A DTWSettings struct with options for the DTW algorithm.
+@param ws Workspace that provides (and keeps) the memory for the cost matrix rows.
+*/
+seq_t dtw_distance_full_ws(seq_t *s1, idx_t l1,
+                      seq_t *s2, idx_t l2, 
+                      DTWSettings *settings, DTWWorkspace *ws) {
+    idx_t ldiff;
+    // DTWPruned
+    idx_t sc = 0;
+    idx_t ec = 0;
+    bool smaller_found;
+    idx_t ec_next;
+    // signal(SIGINT, dtw_int_handler); // not compatible with OMP
+
+
+    seq_t max_dist = settings->max_dist;
+
+    #ifdef DTWDEBUG
+    printf("r=%zu, c=%zu\n", l1, l2);
+    #endif
+    if (max_dist == 0) {
+        max_dist = INFINITY;
+    } else {
+        max_dist = pow(max_dist, 2);
+    }
+    ldiff = (l1 > l2) ? (l1 - l2) : (l2 - l1);
+    if (settings->max_length_diff != 0 && ldiff > settings->max_length_diff) {
+        return INFINITY;
+    }
+    // rows is for series 1, columns is for series 2
+    idx_t length = l2 + 1;
+    assert(length > 0);
+    seq_t * dtw = (seq_t *)dtw_workspace_reserve(ws, sizeof(seq_t) * length * 2);
+    if (!dtw) {
+        printf("Error: dtw_distance_full - Cannot allocate memory (size=%zu)\n", length*2);
+        return 0;
+    }
+    idx_t i;
+    idx_t j;
+    for (j=0; j<length*2; j++) {
+        dtw[j] = INFINITY;
+    }
+    dtw[0] = 0;
+    int i0 = 1;
+    int i1 = 0;
+    idx_t minj;
+    idx_t maxj;
+    idx_t curidx = 0;
+    seq_t minv;
+    seq_t d;
+    seq_t tempv;
+    // keepRunning = 1;
+    for (i=0; i<l1; i++) {
+        // if (!keepRunning){  // not compatible with OMP
+        //     free(dtw);
+        //     printf("Stop computing DTW...\n");
+        //     return INFINITY;
+        // }
+        // Without a window the rows span all columns: skip = skipp = 0
+        maxj = 0;
+        minj = l2;
+        i0 = 1 - i0;
+        i1 = 1 - i1;
+        // Reset new line i1
+        for (j=0; j<length; j++) {
+            dtw[length * i1 + j] = INFINITY;
+        }
+        // PrunedDTW
+        if (sc > maxj) {
+            #ifdef DTWDEBUG
+            printf("correct maxj to sc: %zu -> %zu (saved %zu computations)\n", maxj, sc, sc-maxj);
+            #endif
+            maxj = sc;
+        }
+        smaller_found = false;
+        ec_next = i;
+        #ifdef DTWDEBUG
+        printf("i=%zu, maxj=%zu, minj=%zu\n", i, maxj, minj);
+        #endif
+        for (j=maxj; j<minj; j++) {
+            #ifdef DTWDEBUG
+            printf("ri=%zu,ci=%zu, s1[i] = s1[%zu] = %f , s2[j] = s2[%zu] = %f\n", i, j, i, s1[i], j, s2[j]);
+            #endif
+            d = SEDIST(s1[i], s2[j]);
+            curidx = i0 * length + j;
+            minv = dtw[curidx];
+            curidx += 1;
+            tempv = dtw[curidx];
+            if (tempv < minv) {
+                minv = tempv;
+            }
+            curidx = i1 * length + j;
+            tempv = dtw[curidx];
+            if (tempv < minv) {
+                minv = tempv;
+            }
+            #ifdef DTWDEBUG
+            printf("d = %f, minv = %f\n", d, minv);
+            #endif
+            curidx += 1;
+            dtw[curidx] = d + minv;
+            // PrunedDTW
+            if (dtw[curidx] > max_dist) {
+                #ifdef DTWDEBUG
+                printf("dtw[%zu] = %f > %f\n", curidx, dtw[curidx], max_dist);
+                #endif
+                if (!smaller_found) {
+                    sc = j + 1;
+                }
+                if (j >= ec) {
+                    #ifdef DTWDEBUG
+                    printf("Break because of pruning with j=%zu, ec=%zu (saved %zu computations)\n", j, ec, minj-j);
+                    #endif
+                    break;
+                }
+            } else {
+                smaller_found = true;
+                ec_next = j + 1;
+            }
+        }
+        ec = ec_next;
+    }
+    seq_t result = sqrt(dtw[length * i1 + l2]);
+    // signal(SIGINT, SIG_DFL);  // not compatible with OMP
+    if (settings->max_dist !=0 && result > settings->max_dist) {
+        // DTWPruned keeps the last value larger than max_dist. Correct for this.
+        result = INFINITY;
+    }
+    return result;
+}
+
+/**
+Compute the DTW between two series.
+Use the Squared Euclidean inner distance.
+
+Specialised for the settings without psi-relaxation, max_step, penalty and
+upper bound pruning, with a window.
+The branches for these options are removed from the inner loop. Use
+dtw_distance_kernel to select the variant for a DTWSettings struct.
+
+@param s1 First sequence
+@param l1 Length of first sequence. 
+@param s2 Second sequence
+@param l2 Length of second sequence. 
+@param settings A DTWSettings struct with options for the DTW algorithm.
+@param ws Workspace that provides (and keeps) the memory for the cost matrix rows.
+*/
+seq_t dtw_distance_banded_ws(seq_t *s1, idx_t l1,
+                      seq_t *s2, idx_t l2, 
+                      DTWSettings *settings, DTWWorkspace *ws) {
+    idx_t ldiff;
+    idx_t dl;
+    // DTWPruned
+    idx_t sc = 0;
+    idx_t ec = 0;
+    bool smaller_found;
+    idx_t ec_next;
+    // signal(SIGINT, dtw_int_handler); // not compatible with OMP
+
+    idx_t window = settings->window;
+
+    seq_t max_dist = settings->max_dist;
+
+    #ifdef DTWDEBUG
+    printf("r=%zu, c=%zu\n", l1, l2);
+    #endif
+    if (max_dist == 0) {
+        max_dist = INFINITY;
+    } else {
+        max_dist = pow(max_dist, 2);
+    }
+    if (l1 > l2) {
+        ldiff = l1 - l2;
+        dl = ldiff;
+    } else {
+        ldiff  = l2 - l1;
+        dl = 0;
+    }
+    if (settings->max_length_diff != 0 && ldiff > settings->max_length_diff) {
+        return INFINITY;
+    }
+    if (window == 0) {
+        window = MAX(l1, l2);
+    }
+    // rows is for series 1, columns is for series 2
+    idx_t length = MIN(l2+1, ldiff + 2*window + 1);
+    assert(length > 0);
+    seq_t * dtw = (seq_t *)dtw_workspace_reserve(ws, sizeof(seq_t) * length * 2);
+    if (!dtw) {
+        printf("Error: dtw_distance_banded - Cannot allocate memory (size=%zu)\n", length*2);
+        return 0;
+    }
+    idx_t i;
+    idx_t j;
+    for (j=0; j<length*2; j++) {
+        dtw[j] = INFINITY;
+    }
+    dtw[0] = 0;
+    idx_t skip = 0;
+    idx_t skipp = 0;
+    int i0 = 1;
+    int i1 = 0;
+    idx_t minj;
+    idx_t maxj;
+    idx_t curidx = 0;
+    idx_t dl_window = dl + window - 1;
+    idx_t ldiff_window = window;
+    if (l2 > l1) {
+        ldiff_window += ldiff;
+    }
+    seq_t minv;
+    seq_t d;
+    seq_t tempv;
+    // keepRunning = 1;
+    for (i=0; i<l1; i++) {
+        // if (!keepRunning){  // not compatible with OMP
+        //     free(dtw);
+        //     printf("Stop computing DTW...\n");
+        //     return INFINITY;
+        // }
+        // maxj = i;
+        // if (maxj > dl_window) {
+        //     maxj -= dl_window;
+        // } else {
+        //     maxj = 0;
+        // }
+        maxj = (i - dl_window) * (i > dl_window);
+        // No risk for overflow/modulo because we also need to store dtw of size
+        // MIN(l2+1, ldiff + 2*window + 1) ?
+        minj = i + ldiff_window;
+        if (minj > l2) {
+            minj = l2;
+        }
+        skipp = skip;
+        skip = maxj;
+        i0 = 1 - i0;
+        i1 = 1 - i1;
+        // Reset new line i1
+        for (j=0; j<length; j++) {
+            dtw[length * i1 + j] = INFINITY;
+        }
+        // if (length == l2 + 1) {
+        //     skip = 0;
+        // }
+        skip = skip * (length != l2 + 1);
+        // PrunedDTW
+        if (sc > maxj) {
+            #ifdef DTWDEBUG
+            printf("correct maxj to sc: %zu -> %zu (saved %zu computations)\n", maxj, sc, sc-maxj);
+            #endif
+            maxj = sc;
+        }
+        smaller_found = false;
+        ec_next = i;
         #ifdef DTWDEBUG
         printf("i=%zu, maxj=%zu, minj=%zu\n", i, maxj, minj);
         #endif
         for (j=maxj; j<minj; j++) {
-            j_idx = j * ndim;
             #ifdef DTWDEBUG
             printf("ri=%zu,ci=%zu, s1[i] = s1[%zu] = %f , s2[j] = s2[%zu] = %f\n", i, j, i, s1[i], j, s2[j]);
             #endif
-            d = 0;
-            for (int d_i=0; d_i<ndim; d_i++) {
-                d += SEDIST(s1[i_idx + d_i], s2[j_idx + d_i]);
-            }
-            if (d > max_step) {
-                // Let the value be INFINITY as initialized
-                continue;
-            }
+            d = SEDIST(s1[i], s2[j]);
             curidx = i0 * length + j - skipp;
             minv = dtw[curidx];
             curidx += 1;
-            tempv = dtw[curidx] + penalty;
+            tempv = dtw[curidx];
             if (tempv < minv) {
                 minv = tempv;
             }
             curidx = i1 * length + j - skip;
-            tempv = dtw[curidx] + penalty;
+            tempv = dtw[curidx];
             if (tempv < minv) {
                 minv = tempv;
             }
@@ -509,14 +1436,6 @@ seq_t dtw_distance_ndim(seq_t *s1, idx_t l1,
             }
         }
         ec = ec_next;
-        // Deal with Psi-relaxation in last column
-        if (settings->psi_1e != 0 && minj == l2 && l1 - 1 - i <= settings->psi_1e) {
-            assert(!(settings->window == 0 || settings->window == l2) || (i1 + 1)*length - 1 == curidx);
-            if (dtw[curidx] < psi_shortest) {
-                // curidx is the last value
-                psi_shortest = dtw[curidx];
-            }
-        }
         #ifdef DTWDEBUG
         dtw_print_twoline(dtw, l1, l2, length, i0, i1, skip, skipp, maxj, minj);
         #endif
@@ -525,18 +1444,6 @@ seq_t dtw_distance_ndim(seq_t *s1, idx_t l1,
         l2 += window - 1;
     }
     seq_t result = sqrt(dtw[length * i1 + l2 - skip]);
-    // Deal with psi-relaxation in the last row
-    if (settings->psi_1e != 0 || settings->psi_2e != 0) {
-        if (settings->psi_2e != 0) {
-            for (i=l2 - skip - settings->psi_2e; i<l2 - skip + 1; i++) { // iterate over vci
-                if (dtw[i1*length + i] < psi_shortest) {
-                    psi_shortest = dtw[i1*length + i];
-                }
-            }
-        }
-        result = sqrt(psi_shortest);
-    }
-    free(dtw);
     // signal(SIGINT, SIG_DFL);  // not compatible with OMP
     if (settings->max_dist !=0 && result > settings->max_dist) {
         // DTWPruned keeps the last value larger than max_dist. Correct for this.
@@ -546,24 +1453,26 @@ seq_t dtw_distance_ndim(seq_t *s1, idx_t l1,
 }
 
 
-
 /**
 Compute the DTW between two series.
 Use the Euclidean inner distance.
 
+Specialised for the settings without psi-relaxation, max_step, penalty and
+upper bound pruning, and without a window (settings->window is ignored).
+The branches for these options are removed from the inner loop. Use
+dtw_distance_kernel to select the variant for a DTWSettings struct.
+
 @param s1 First sequence
 @param l1 Length of first sequence. 
 @param s2 Second sequence
 @param l2 Length of second sequence. 
 @param settings A DTWSettings struct with options for the DTW algorithm.
+@param ws Workspace that provides (and keeps) the memory for the cost matrix rows.
 */
-seq_t dtw_distance_euclidean(seq_t *s1, idx_t l1,
+seq_t dtw_distance_euclidean_full_ws(seq_t *s1, idx_t l1,
                       seq_t *s2, idx_t l2, 
-                      DTWSettings *settings) {
-    assert(settings->psi_1b <= l1 && settings->psi_1e <= l1 &&
-           settings->psi_2b <= l2 && settings->psi_2e <= l2);
+                      DTWSettings *settings, DTWWorkspace *ws) {
     idx_t ldiff;
-    idx_t dl;
     // DTWPruned
     idx_t sc = 0;
     idx_t ec = 0;
@@ -571,49 +1480,27 @@ seq_t dtw_distance_euclidean(seq_t *s1, idx_t l1,
     idx_t ec_next;
     // signal(SIGINT, dtw_int_handler); // not compatible with OMP
 
-    idx_t window = settings->window;
-    seq_t max_step = settings->max_step;
+
     seq_t max_dist = settings->max_dist;
-    seq_t penalty = settings->penalty;
 
     #ifdef DTWDEBUG
     printf("r=%zu, c=%zu\n", l1, l2);
     #endif
-    if (settings->use_pruning || settings->only_ub) {
-        max_dist = ub_euclidean_euclidean(s1, l1, s2, l2);
-        if (settings->only_ub) {
-            return max_dist;
-        }
-    } else if (max_dist == 0) {
+    if (max_dist == 0) {
         max_dist = INFINITY;
     } else {
         max_dist = pow(max_dist, 2);
     }
-    if (l1 > l2) {
-        ldiff = l1 - l2;
-        dl = ldiff;
-    } else {
-        ldiff  = l2 - l1;
-        dl = 0;
-    }
+    ldiff = (l1 > l2) ? (l1 - l2) : (l2 - l1);
     if (settings->max_length_diff != 0 && ldiff > settings->max_length_diff) {
         return INFINITY;
     }
-    if (window == 0) {
-        window = MAX(l1, l2);
-    }
-    if (max_step == 0) {
-        max_step = INFINITY;
-    } else {
-        max_step = pow(max_step, 2);
-    }
-    penalty = pow(penalty, 2);
     // rows is for series 1, columns is for series 2
-    idx_t length = MIN(l2+1, ldiff + 2*window + 1);
+    idx_t length = l2 + 1;
     assert(length > 0);
-    seq_t * dtw = (seq_t *)malloc(sizeof(seq_t) * length * 2);
+    seq_t * dtw = (seq_t *)dtw_workspace_reserve(ws, sizeof(seq_t) * length * 2);
     if (!dtw) {
-        printf("Error: dtw_distance - Cannot allocate memory (size=%zu)\n", length*2);
+        printf("Error: dtw_distance_euclidean_full - Cannot allocate memory (size=%zu)\n", length*2);
         return 0;
     }
     idx_t i;
@@ -621,26 +1508,15 @@ seq_t dtw_distance_euclidean(seq_t *s1, idx_t l1,
     for (j=0; j<length*2; j++) {
         dtw[j] = INFINITY;
     }
-    // Deal with psi-relaxation in first row
-    for (i=0; i<settings->psi_2b + 1; i++) {
-        dtw[i] = 0;
-    }
-    idx_t skip = 0;
-    idx_t skipp = 0;
+    dtw[0] = 0;
     int i0 = 1;
     int i1 = 0;
     idx_t minj;
     idx_t maxj;
     idx_t curidx = 0;
-    idx_t dl_window = dl + window - 1;
-    idx_t ldiff_window = window;
-    if (l2 > l1) {
-        ldiff_window += ldiff;
-    }
     seq_t minv;
     seq_t d;
     seq_t tempv;
-    seq_t psi_shortest = INFINITY;
     // keepRunning = 1;
     for (i=0; i<l1; i++) {
         // if (!keepRunning){  // not compatible with OMP
@@ -648,31 +1524,15 @@ seq_t dtw_distance_euclidean(seq_t *s1, idx_t l1,
         //     printf("Stop computing DTW...\n");
         //     return INFINITY;
         // }
-        // maxj = i;
-        // if (maxj > dl_window) {
-        //     maxj -= dl_window;
-        // } else {
-        //     maxj = 0;
-        // }
-        maxj = (i - dl_window) * (i > dl_window);
-        // No risk for overflow/modulo because we also need to store dtw of size
-        // MIN(l2+1, ldiff + 2*window + 1) ?
-        minj = i + ldiff_window;
-        if (minj > l2) {
-            minj = l2;
-        }
-        skipp = skip;
-        skip = maxj;
+        // Without a window the rows span all columns: skip = skipp = 0
+        maxj = 0;
+        minj = l2;
         i0 = 1 - i0;
         i1 = 1 - i1;
         // Reset new line i1
         for (j=0; j<length; j++) {
             dtw[length * i1 + j] = INFINITY;
         }
-        // if (length == l2 + 1) {
-        //     skip = 0;
-        // }
-        skip = skip * (length != l2 + 1);
         // PrunedDTW
         if (sc > maxj) {
             #ifdef DTWDEBUG
@@ -682,10 +1542,6 @@ seq_t dtw_distance_euclidean(seq_t *s1, idx_t l1,
         }
         smaller_found = false;
         ec_next = i;
-        // Deal with psi-relaxation in first column
-        if (settings->psi_1b != 0 && maxj == 0 && i < settings->psi_1b) {
-            dtw[i1*length + 0] = 0;
-        }
         #ifdef DTWDEBUG
         printf("i=%zu, maxj=%zu, minj=%zu\n", i, maxj, minj);
         #endif
@@ -694,19 +1550,15 @@ seq_t dtw_distance_euclidean(seq_t *s1, idx_t l1,
             printf("ri=%zu,ci=%zu, s1[i] = s1[%zu] = %f , s2[j] = s2[%zu] = %f\n", i, j, i, s1[i], j, s2[j]);
             #endif
             d = fabs(s1[i] - s2[j]);
-            if (d > max_step) {
-                // Let the value be INFINITY as initialized
-                continue;
-            }
-            curidx = i0 * length + j - skipp;
+            curidx = i0 * length + j;
             minv = dtw[curidx];
             curidx += 1;
-            tempv = dtw[curidx] + penalty;
+            tempv = dtw[curidx];
             if (tempv < minv) {
                 minv = tempv;
             }
-            curidx = i1 * length + j - skip;
-            tempv = dtw[curidx] + penalty;
+            curidx = i1 * length + j;
+            tempv = dtw[curidx];
             if (tempv < minv) {
                 minv = tempv;
             }
@@ -715,11 +1567,6 @@ seq_t dtw_distance_euclidean(seq_t *s1, idx_t l1,
             #endif
             curidx += 1;
             dtw[curidx] = d + minv;
-            #ifdef DTWDEBUG
-            printf("%zu, %zu, %zu\n",i0*length + j - skipp,i0*length + j + 1 - skipp,i1*length + j - skip);
-            printf("%f, %f, %f\n",dtw[i0*length + j - skipp],dtw[i0*length + j + 1 - skipp],dtw[i1*length + j - skip]);
-            printf("i=%zu, j=%zu, d=%f, skip=%zu, skipp=%zu\n",i,j,d,skip,skipp);
-            #endif
             // PrunedDTW
             if (dtw[curidx] > max_dist) {
                 #ifdef DTWDEBUG
@@ -740,34 +1587,8 @@ seq_t dtw_distance_euclidean(seq_t *s1, idx_t l1,
             }
         }
         ec = ec_next;
-        // Deal with Psi-relaxation in last column
-        if (settings->psi_1e != 0 && minj == l2 && l1 - 1 - i <= settings->psi_1e) {
-            assert(!(settings->window == 0 || settings->window == l2) || (i1 + 1)*length - 1 == curidx);
-            if (dtw[curidx] < psi_shortest) {
-                // curidx is the last value
-                psi_shortest = dtw[curidx];
-            }
-        }
-        #ifdef DTWDEBUG
-        dtw_print_twoline(dtw, l1, l2, length, i0, i1, skip, skipp, maxj, minj);
-        #endif
-    }
-    if (window - 1 < 0) {
-        l2 += window - 1;
-    }
-    seq_t result = dtw[length * i1 + l2 - skip];
-    // Deal with psi-relaxation in the last row
-    if (settings->psi_1e != 0 || settings->psi_2e != 0) {
-        if (settings->psi_2e != 0) {
-            for (i=l2 - skip - settings->psi_2e; i<l2 - skip + 1; i++) { // iterate over vci
-                if (dtw[i1*length + i] < psi_shortest) {
-                    psi_shortest = dtw[i1*length + i];
-                }
-            }
-        }
-        result = psi_shortest;
     }
-    free(dtw);
+    seq_t result = dtw[length * i1 + l2];
     // signal(SIGINT, SIG_DFL);  // not compatible with OMP
     if (settings->max_dist !=0 && result > settings->max_dist) {
         // DTWPruned keeps the last value larger than max_dist. Correct for this.
@@ -776,24 +1597,25 @@ seq_t dtw_distance_euclidean(seq_t *s1, idx_t l1,
     return result;
 }
 
-
-
 /**
-Compute the DTW between two n-dimensional series.
+Compute the DTW between two series.
 Use the Euclidean inner distance.
 
+Specialised for the settings without psi-relaxation, max_step, penalty and
+upper bound pruning, with a window.
+The branches for these options are removed from the inner loop. Use
+dtw_distance_kernel to select the variant for a DTWSettings struct.
+
 @param s1 First sequence
-@param l1 Length of first sequence. In tuples, real length should be length*ndim.
+@param l1 Length of first sequence. 
 @param s2 Second sequence
-@param l2 Length of second sequence. In tuples, real length should be length*ndim.
-@param ndim Number of dimensions
+@param l2 Length of second sequence. 
 @param settings A DTWSettings struct with options for the DTW algorithm.
+@param ws Workspace that provides (and keeps) the memory for the cost matrix rows.
 */
-seq_t dtw_distance_ndim_euclidean(seq_t *s1, idx_t l1,
-                      seq_t *s2, idx_t l2, int ndim,
-                      DTWSettings *settings) {
-    assert(settings->psi_1b <= l1 && settings->psi_1e <= l1 &&
-           settings->psi_2b <= l2 && settings->psi_2e <= l2);
+seq_t dtw_distance_euclidean_banded_ws(seq_t *s1, idx_t l1,
+                      seq_t *s2, idx_t l2, 
+                      DTWSettings *settings, DTWWorkspace *ws) {
     idx_t ldiff;
     idx_t dl;
     // DTWPruned
@@ -804,19 +1626,13 @@ seq_t dtw_distance_ndim_euclidean(seq_t *s1, idx_t l1,
     // signal(SIGINT, dtw_int_handler); // not compatible with OMP
 
     idx_t window = settings->window;
-    seq_t max_step = settings->max_step;
+
     seq_t max_dist = settings->max_dist;
-    seq_t penalty = settings->penalty;
 
     #ifdef DTWDEBUG
     printf("r=%zu, c=%zu\n", l1, l2);
     #endif
-    if (settings->use_pruning || settings->only_ub) {
-        max_dist = ub_euclidean_ndim_euclidean(s1, l1, s2, l2, ndim);
-        if (settings->only_ub) {
-            return max_dist;
-        }
-    } else if (max_dist == 0) {
+    if (max_dist == 0) {
         max_dist = INFINITY;
     } else {
         max_dist = pow(max_dist, 2);
@@ -834,31 +1650,20 @@ seq_t dtw_distance_ndim_euclidean(seq_t *s1, idx_t l1,
     if (window == 0) {
         window = MAX(l1, l2);
     }
-    if (max_step == 0) {
-        max_step = INFINITY;
-    } else {
-        max_step = pow(max_step, 2);
-    }
-    penalty = pow(penalty, 2);
     // rows is for series 1, columns is for series 2
     idx_t length = MIN(l2+1, ldiff + 2*window + 1);
     assert(length > 0);
-    seq_t * dtw = (seq_t *)malloc(sizeof(seq_t) * length * 2);
+    seq_t * dtw = (seq_t *)dtw_workspace_reserve(ws, sizeof(seq_t) * length * 2);
     if (!dtw) {
-        printf("Error: dtw_distance_ndim - Cannot allocate memory (size=%zu)\n", length*2);
+        printf("Error: dtw_distance_euclidean_banded - Cannot allocate memory (size=%zu)\n", length*2);
         return 0;
     }
     idx_t i;
     idx_t j;
-    idx_t i_idx;
-    idx_t j_idx;
     for (j=0; j<length*2; j++) {
         dtw[j] = INFINITY;
     }
-    // Deal with psi-relaxation in first row
-    for (i=0; i<settings->psi_2b + 1; i++) {
-        dtw[i] = 0;
-    }
+    dtw[0] = 0;
     idx_t skip = 0;
     idx_t skipp = 0;
     int i0 = 1;
@@ -874,7 +1679,6 @@ seq_t dtw_distance_ndim_euclidean(seq_t *s1, idx_t l1,
     seq_t minv;
     seq_t d;
     seq_t tempv;
-    seq_t psi_shortest = INFINITY;
     // keepRunning = 1;
     for (i=0; i<l1; i++) {
         // if (!keepRunning){  // not compatible with OMP
@@ -882,7 +1686,6 @@ seq_t dtw_distance_ndim_euclidean(seq_t *s1, idx_t l1,
         //     printf("Stop computing DTW...\n");
         //     return INFINITY;
         // }
-        i_idx = i * ndim;
         // maxj = i;
         // if (maxj > dl_window) {
         //     maxj -= dl_window;
@@ -917,36 +1720,23 @@ seq_t dtw_distance_ndim_euclidean(seq_t *s1, idx_t l1,
         }
         smaller_found = false;
         ec_next = i;
-        // Deal with psi-relaxation in first column
-        if (settings->psi_1b != 0 && maxj == 0 && i < settings->psi_1b) {
-            dtw[i1*length + 0] = 0;
-        }
         #ifdef DTWDEBUG
         printf("i=%zu, maxj=%zu, minj=%zu\n", i, maxj, minj);
         #endif
         for (j=maxj; j<minj; j++) {
-            j_idx = j * ndim;
             #ifdef DTWDEBUG
             printf("ri=%zu,ci=%zu, s1[i] = s1[%zu] = %f , s2[j] = s2[%zu] = %f\n", i, j, i, s1[i], j, s2[j]);
             #endif
-            d = 0;
-            for (int d_i=0; d_i<ndim; d_i++) {
-                d += SEDIST(s1[i_idx + d_i], s2[j_idx + d_i]);
-            }
-            d = sqrt(d);
-            if (d > max_step) {
-                // Let the value be INFINITY as initialized
-                continue;
-            }
+            d = fabs(s1[i] - s2[j]);
             curidx = i0 * length + j - skipp;
             minv = dtw[curidx];
             curidx += 1;
-            tempv = dtw[curidx] + penalty;
+            tempv = dtw[curidx];
             if (tempv < minv) {
                 minv = tempv;
             }
             curidx = i1 * length + j - skip;
-            tempv = dtw[curidx] + penalty;
+            tempv = dtw[curidx];
             if (tempv < minv) {
                 minv = tempv;
             }
@@ -980,14 +1770,6 @@ seq_t dtw_distance_ndim_euclidean(seq_t *s1, idx_t l1,
             }
         }
         ec = ec_next;
-        // Deal with Psi-relaxation in last column
-        if (settings->psi_1e != 0 && minj == l2 && l1 - 1 - i <= settings->psi_1e) {
-            assert(!(settings->window == 0 || settings->window == l2) || (i1 + 1)*length - 1 == curidx);
-            if (dtw[curidx] < psi_shortest) {
-                // curidx is the last value
-                psi_shortest = dtw[curidx];
-            }
-        }
         #ifdef DTWDEBUG
         dtw_print_twoline(dtw, l1, l2, length, i0, i1, skip, skipp, maxj, minj);
         #endif
@@ -996,18 +1778,6 @@ seq_t dtw_distance_ndim_euclidean(seq_t *s1, idx_t l1,
         l2 += window - 1;
     }
     seq_t result = dtw[length * i1 + l2 - skip];
-    // Deal with psi-relaxation in the last row
-    if (settings->psi_1e != 0 || settings->psi_2e != 0) {
-        if (settings->psi_2e != 0) {
-            for (i=l2 - skip - settings->psi_2e; i<l2 - skip + 1; i++) { // iterate over vci
-                if (dtw[i1*length + i] < psi_shortest) {
-                    psi_shortest = dtw[i1*length + i];
-                }
-            }
-        }
-        result = psi_shortest;
-    }
-    free(dtw);
     // signal(SIGINT, SIG_DFL);  // not compatible with OMP
     if (settings->max_dist !=0 && result > settings->max_dist) {
         // DTWPruned keeps the last value larger than max_dist. Correct for this.
@@ -1017,6 +1787,38 @@ seq_t dtw_distance_ndim_euclidean(seq_t *s1, idx_t l1,
 }
 
 
+/*!
+Select the DTW function for the given settings.
+
+The options of DTWSettings are checked once, e.g. for a distance matrix, instead
+of for every pair. Settings that use psi-relaxation, max_step, penalty or upper
+bound pruning get the generic dtw_distance_ws, the others a variant where the
+branches for these options are removed. Without a window and with the squared
+Euclidean inner distance the wavefront (SIMD) version is used when available.
+
+@param settings A DTWSettings struct with options for the DTW algorithm.
+@return Function with the same result as dtw_distance_ws for these settings.
+*/
+DTWWsFnPtr dtw_distance_kernel(DTWSettings *settings) {
+    if (settings->psi_1b != 0 || settings->psi_1e != 0 || settings->psi_2b != 0 || settings->psi_2e != 0 ||
+        settings->max_step != 0 || settings->penalty != 0 || settings->use_pruning || settings->only_ub) {
+        return dtw_distance_ws;
+    }
+    if (settings->inner_dist == 1) {
+        if (settings->window == 0) {
+            return dtw_distance_euclidean_full_ws;
+        }
+        return dtw_distance_euclidean_banded_ws;
+    }
+    if (settings->window == 0) {
+        if (dtw_simd_level() != DTW_SIMD_NONE) {
+            return dtw_distance_wavefront_ws;
+        }
+        return dtw_distance_full_ws;
+    }
+    return dtw_distance_banded_ws;
+}
+
 // MARK: WPS
 
 /*!
@@ -1048,6 +1850,31 @@ seq_t dtw_warping_paths(seq_t *wps,
                              settings);
 }
 
+/*!
+Compute all warping paths between two series in the memory of a workspace.
+
+@param wps Is set to the warping paths matrix, which is stored in ws and valid until
+    the next call that uses ws.
+@param ws Workspace that provides (and keeps) the memory for the warping paths.
+
+@see dtw_warping_paths
+*/
+seq_t dtw_warping_paths_ws(seq_t **wps,
+                           seq_t *s1, idx_t l1,
+                           seq_t *s2, idx_t l2,
+                           bool return_dtw, bool keep_int_repr, bool psi_neg,
+                           DTWSettings *settings, DTWWorkspace *ws) {
+    idx_t wps_length = dtw_settings_wps_length(l1, l2, settings);
+    *wps = (seq_t *)dtw_workspace_reserve(ws, sizeof(seq_t) * wps_length);
+    if (!*wps) {
+        printf("Error: dtw_warping_paths_ws - Cannot allocate memory (size=%zu)\n", wps_length);
+        return 0;
+    }
+    return dtw_warping_paths(*wps, s1, l1, s2, l2,
+                             return_dtw, keep_int_repr, psi_neg,
+                             settings);
+}
+
 
 
 seq_t dtw_warping_paths_ndim(seq_t *wps,
@@ -4115,7 +4942,6 @@ seq_t ub_euclidean_ndim_euclidean(seq_t *s1, idx_t l1, seq_t *s2, idx_t l2, int
 }
 
 
-
 /*!
  Keogh lower bound for DTW.
  */
@@ -4173,7 +4999,6 @@ seq_t lb_keogh(seq_t *s1, idx_t l1, seq_t *s2, idx_t l2, DTWSettings *settings)
     return t;
 }
 
-
 /*!
  Keogh lower bound for DTW.
  */
@@ -4302,6 +5127,9 @@ idx_t dtw_distances_ptrs(seq_t **ptrs, idx_t nb_ptrs, idx_t* lengths,
     idx_t length;
     idx_t i;
     seq_t value;
+    // The settings are the same for all pairs, select the DTW variant once
+    DTWWsFnPtr dtw_fn = dtw_distance_kernel(settings);
+    DTWWorkspace ws = dtw_workspace_empty();
 
     length = dtw_distances_length(block, nb_ptrs, nb_ptrs);
     if (length == 0) {
@@ -4324,13 +5152,14 @@ idx_t dtw_distances_ptrs(seq_t **ptrs, idx_t nb_ptrs, idx_t* lengths,
             cb = block->cb;
         }
         for (c=cb; c<block->ce; c++) {
-            value = dtw_distance(ptrs[r], lengths[r],
-                                 ptrs[c], lengths[c], settings);
+            value = dtw_fn(ptrs[r], lengths[r],
+                           ptrs[c], lengths[c], settings, &ws);
             // printf("i=%zu - r=%zu - c=%zu - value=%.4f\n", i, r, c, value);
             output[i] = value;
             i += 1;
         }
     }
+    dtw_workspace_free(&ws);
     assert(length == i);
     return length;
 }
@@ -4354,6 +5183,9 @@ idx_t dtw_distances_matrix(seq_t *matrix, idx_t nb_rows, idx_t nb_cols,
     idx_t length;
     idx_t i;
     seq_t value;
+    // The settings are the same for all pairs, select the DTW variant once
+    DTWWsFnPtr dtw_fn = dtw_distance_kernel(settings);
+    DTWWorkspace ws = dtw_workspace_empty();
 
     length = dtw_distances_length(block, nb_rows, nb_rows);
     if (length == 0) {
@@ -4376,13 +5208,14 @@ idx_t dtw_distances_matrix(seq_t *matrix, idx_t nb_rows, idx_t nb_cols,
             cb = block->cb;
         }
         for (c=cb; c<block->ce; c++) {
-            value = dtw_distance(&matrix[r*nb_cols], nb_cols,
-                                 &matrix[c*nb_cols], nb_cols, settings);
+            value = dtw_fn(&matrix[r*nb_cols], nb_cols,
+                           &matrix[c*nb_cols], nb_cols, settings, &ws);
             // printf("i=%zu - r=%zu - c=%zu - value=%.4f\n", i, r, c, value);
             output[i] = value;
             i += 1;
         }
     }
+    dtw_workspace_free(&ws);
     assert(length == i);
     return length;
 }
@@ -4508,6 +5341,9 @@ idx_t dtw_distances_matrices(seq_t *matrix_r, idx_t nb_rows_r, idx_t nb_cols_r,
     idx_t length;
     idx_t i;
     seq_t value;
+    // The settings are the same for all pairs, select the DTW variant once
+    DTWWsFnPtr dtw_fn = dtw_distance_kernel(settings);
+    DTWWorkspace ws = dtw_workspace_empty();
 
     length = dtw_distances_length(block, nb_rows_r, nb_rows_c);
     if (length == 0) {
@@ -4530,13 +5366,14 @@ idx_t dtw_distances_matrices(seq_t *matrix_r, idx_t nb_rows_r, idx_t nb_cols_r,
             cb = block->cb;
         }
         for (c=cb; c<block->ce; c++) {
-            value = dtw_distance(&matrix_r[r*nb_cols_r], nb_cols_r,
-                                 &matrix_c[c*nb_cols_c], nb_cols_c, settings);
+            value = dtw_fn(&matrix_r[r*nb_cols_r], nb_cols_r,
+                           &matrix_c[c*nb_cols_c], nb_cols_c, settings, &ws);
             // printf("i=%zu - r=%zu - c=%zu - value=%.4f\n", i, r, c, value);
             output[i] = value;
             i += 1;
         }
     }
+    dtw_workspace_free(&ws);
     assert(length == i);
     return length;
 }
@@ -4680,6 +5517,75 @@ idx_t dtw_distances_length(DTWBlock *block, idx_t nb_series_r, idx_t nb_series_c
     return length;
 }
 
+
+/*!
+Split the upper triangle of the distance matrix of nb_series series in nb_parts
+contiguous ranges of pairs with about the same cost.
+
+The pairs are in the order of the output of dtw_distances_ptrs with a triu block,
+(0,1), (0,2), ..., (1,2), ... and the cost of pair (r, c) is lengths[r] * lengths[c],
+the number of cells of its cost matrix. The split only depends on lengths, every
+process thus computes the same ranges without communication.
+
+@param lengths Array of length nb_series with the lengths of the series.
+@param nb_series Number of series
+@param nb_parts Number of ranges
+@param bounds Array of length nb_parts + 1, range p is pairs [bounds[p], bounds[p+1])
+@return Number of pairs, 0 if there are no pairs
+*/
+idx_t dtw_distances_partition(idx_t *lengths, idx_t nb_series, idx_t nb_parts, idx_t *bounds) {
+    DTWBlock block = {.rb=0, .re=0, .cb=0, .ce=0, .triu=true};
+    idx_t nb_pairs = (nb_series > 1) ? dtw_distances_length(&block, nb_series, nb_series) : 0;
+    for (idx_t p=0; p<=nb_parts; p++) {
+        bounds[p] = nb_pairs;
+    }
+    bounds[0] = 0;
+    if (nb_pairs == 0 || nb_parts < 1) {
+        return nb_pairs;
+    }
+    idx_t *prefix = (idx_t *)malloc(sizeof(idx_t) * (nb_series + 1));
+    if (!prefix) {
+        printf("Error: dtw_distances_partition - cannot allocate memory (prefix length = %zu)\n", nb_series + 1);
+        return 0;
+    }
+    prefix[0] = 0;
+    for (idx_t i=0; i<nb_series; i++) {
+        prefix[i + 1] = prefix[i] + lengths[i];
+    }
+    idx_t total = 0;
+    for (idx_t r=0; r<nb_series; r++) {
+        total += lengths[r] * (prefix[nb_series] - prefix[r + 1]);
+    }
+
+    // Target of range p is p * total / nb_parts, written to avoid overflow
+    idx_t p = 1;
+    idx_t acc = 0;
+    idx_t base = 0;  // index of pair (r, r+1)
+    for (idx_t r=0; r<nb_series && p<nb_parts; r++) {
+        idx_t row_cost = lengths[r] * (prefix[nb_series] - prefix[r + 1]);
+        idx_t target = (total / nb_parts) * p + ((total % nb_parts) * p) / nb_parts;
+        while (p < nb_parts && acc + row_cost >= target) {
+            // Smallest c such that the pairs (r, r+1) .. (r, c-1) reach the target
+            idx_t lo = r + 1, hi = nb_series;
+            while (lo < hi) {
+                idx_t mid = lo + (hi - lo) / 2;
+                if (acc + lengths[r] * (prefix[mid] - prefix[r + 1]) >= target) {
+                    hi = mid;
+                } else {
+                    lo = mid + 1;
+                }
+            }
+            bounds[p] = base + (lo - r - 1);
+            p++;
+            target = (total / nb_parts) * p + ((total % nb_parts) * p) / nb_parts;
+        }
+        acc += row_cost;
+        base += nb_series - r - 1;
+    }
+    free(prefix);
+    return nb_pairs;
+}
+
 // MARK: DBA
 
 /*!
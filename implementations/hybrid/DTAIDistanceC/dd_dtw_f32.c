@@ -0,0 +1,818 @@
+/*!
+@file dtw_f32.c
+@brief DTAIDistance.dtw : Single-precision Dynamic Time Warping
+
+The functions in this file are the float (seq32_t) counterparts of the functions
+with the same name without the _f32 suffix in dtw.c. They follow the same code
+path, only the cost matrix, the series and the result are stored in single
+precision. This halves the memory traffic and doubles the number of SIMD lanes.
+
+See dtw_f32.h for the error bound with respect to the double-precision version.
+
+@copyright Apache License, Version 2.0, see LICENSE for details.
+*/
+
+#include "dd_dtw_f32.h"
+
+
+// MARK: Conversion
+
+/*!
+ Copy a double-precision series into a single-precision series.
+
+ @param src Series of length l
+ @param l Length of the series
+ @param dst Array of length l to store the converted values
+ */
+void dtw_seq_to_f32(seq_t *src, idx_t l, seq32_t *dst) {
+    for (idx_t i=0; i<l; i++) {
+        dst[i] = (seq32_t)src[i];
+    }
+}
+
+
+/*!
+ Upper bound on |dtw_distance_f32 - dtw_distance| for two series without penalty,
+ max_step or psi-relaxation, to first order in the unit roundoff u = 2^-24.
+
+ Every path in the cost matrix has at most L = l1 + l2 - 1 cells. The single-precision
+ cost of a path is the sum of L squared differences, with one rounding for each
+ subtraction, multiplication and addition, and every value of the series is rounded
+ once when converted to float. The minimum over all paths does not amplify these
+ errors, which gives
+
+   |d32 - d64| <= (l1 + l2 + 3) / 2 * u * d64 + 2 * u * max_abs * sqrt(l1 + l2 - 1)
+
+ @param l1 Length of first sequence
+ @param l2 Length of second sequence
+ @param max_abs Largest absolute value in both series
+ @param d64 The DTW distance computed in double precision
+ */
+seq_t dtw_distance_f32_error_bound(idx_t l1, idx_t l2, seq_t max_abs, seq_t d64) {
+    const seq_t u = 5.9604644775390625e-08; // 2^-24
+    if (l1 == 0 || l2 == 0) {
+        return 0;
+    }
+    return (seq_t)(l1 + l2 + 3) / 2 * u * d64 + 2 * u * max_abs * sqrt((seq_t)(l1 + l2 - 1));
+}
+
+
+// MARK: DTW
+
+/**
+Compute the DTW between two single-precision series.
+Use the Squared Euclidean inner distance.
+
+@param s1 First sequence
+@param l1 Length of first sequence. 
+@param s2 Second sequence
+@param l2 Length of second sequence. 
+@param settings A DTWSettings struct with options for the DTW algorithm.
+@param ws Workspace that provides (and keeps) the memory for the cost matrix rows.
+*/
+seq32_t dtw_distance_f32_ws(seq32_t *s1, idx_t l1,
+                      seq32_t *s2, idx_t l2, 
+                      DTWSettings *settings, DTWWorkspace *ws) {
+    if (settings->inner_dist == 1) {
+        return dtw_distance_euclidean_f32_ws(s1, l1, s2, l2,  settings, ws);
+    }
+    if (dtw_simd_level() != DTW_SIMD_NONE && dtw_simd_settings_supported(l1, l2, settings)) {
+        return dtw_distance_wavefront_f32_ws(s1, l1, s2, l2, settings, ws);
+    }
+    assert(settings->psi_1b <= l1 && settings->psi_1e <= l1 &&
+           settings->psi_2b <= l2 && settings->psi_2e <= l2);
+    idx_t ldiff;
+    idx_t dl;
+    // DTWPruned
+    idx_t sc = 0;
+    idx_t ec = 0;
+    bool smaller_found;
+    idx_t ec_next;
+    // signal(SIGINT, dtw_int_handler); // not compatible with OMP
+
+    idx_t window = settings->window;
+    seq32_t max_step = settings->max_step;
+    seq32_t max_dist = settings->max_dist;
+    seq32_t penalty = settings->penalty;
+
+    #ifdef DTWDEBUG
+    printf("r=%zu, c=%zu\n", l1, l2);
+    #endif
+    if (settings->use_pruning || settings->only_ub) {
+        max_dist = ub_euclidean_f32(s1, l1, s2, l2);
+        max_dist = powf(max_dist, 2);
+        if (settings->only_ub) {
+            return max_dist;
+        }
+    } else if (max_dist == 0) {
+        max_dist = INFINITY;
+    } else {
+        max_dist = powf(max_dist, 2);
+    }
+    if (l1 > l2) {
+        ldiff = l1 - l2;
+        dl = ldiff;
+    } else {
+        ldiff  = l2 - l1;
+        dl = 0;
+    }
+    if (settings->max_length_diff != 0 && ldiff > settings->max_length_diff) {
+        return INFINITY;
+    }
+    if (window == 0) {
+        window = MAX(l1, l2);
+    }
+    if (max_step == 0) {
+        max_step = INFINITY;
+    } else {
+        max_step = powf(max_step, 2);
+    }
+    penalty = powf(penalty, 2);
+    // rows is for series 1, columns is for series 2
+    idx_t length = MIN(l2+1, ldiff + 2*window + 1);
+    assert(length > 0);
+    seq32_t * dtw = (seq32_t *)dtw_workspace_reserve(ws, sizeof(seq32_t) * length * 2);
+    if (!dtw) {
+        printf("Error: dtw_distance_f32 - Cannot allocate memory (size=%zu)\n", length*2);
+        return 0;
+    }
+    idx_t i;
+    idx_t j;
+    for (j=0; j<length*2; j++) {
+        dtw[j] = INFINITY;
+    }
+    // Deal with psi-relaxation in first row
+    for (i=0; i<settings->psi_2b + 1; i++) {
+        dtw[i] = 0;
+    }
+    idx_t skip = 0;
+    idx_t skipp = 0;
+    int i0 = 1;
+    int i1 = 0;
+    idx_t minj;
+    idx_t maxj;
+    idx_t curidx = 0;
+    idx_t dl_window = dl + window - 1;
+    idx_t ldiff_window = window;
+    if (l2 > l1) {
+        ldiff_window += ldiff;
+    }
+    seq32_t minv;
+    seq32_t d;
+    seq32_t tempv;
+    seq32_t psi_shortest = INFINITY;
+    // keepRunning = 1;
+    for (i=0; i<l1; i++) {
+        // if (!keepRunning){  // not compatible with OMP
+        //     free(dtw);
+        //     printf("Stop computing DTW...\n");
+        //     return INFINITY;
+        // }
+        // maxj = i;
+        // if (maxj > dl_window) {
+        //     maxj -= dl_window;
+        // } else {
+        //     maxj = 0;
+        // }
+        maxj = (i - dl_window) * (i > dl_window);
+        // No risk for overflow/modulo because we also need to store dtw of size
+        // MIN(l2+1, ldiff + 2*window + 1) ?
+        minj = i + ldiff_window;
+        if (minj > l2) {
+            minj = l2;
+        }
+        skipp = skip;
+        skip = maxj;
+        i0 = 1 - i0;
+        i1 = 1 - i1;
+        // Reset new line i1
+        for (j=0; j<length; j++) {
+            dtw[length * i1 + j] = INFINITY;
+        }
+        // if (length == l2 + 1) {
+        //     skip = 0;
+        // }
+        skip = skip * (length != l2 + 1);
+        // PrunedDTW
+        if (sc > maxj) {
+            #ifdef DTWDEBUG
+            printf("correct maxj to sc: %zu -> %zu (saved %zu computations)\n", maxj, sc, sc-maxj);
+            #endif
+            maxj = sc;
+        }
+        smaller_found = false;
+        ec_next = i;
+        // Deal with psi-relaxation in first column
+        if (settings->psi_1b != 0 && maxj == 0 && i < settings->psi_1b) {
+            dtw[i1*length + 0] = 0;
+        }
+        #ifdef DTWDEBUG
+        printf("i=%zu, maxj=%zu, minj=%zu\n", i, maxj, minj);
+        #endif
+        for (j=maxj; j<minj; j++) {
+            #ifdef DTWDEBUG
+            printf("ri=%zu,ci=%zu, s1[i] = s1[%zu] = %f , s2[j] = s2[%zu] = %f\n", i, j, i, s1[i], j, s2[j]);
+            #endif
+            d = SEDIST(s1[i], s2[j]);
+            if (d > max_step) {
+                // Let the value be INFINITY as initialized
+                continue;
+            }
+            curidx = i0 * length + j - skipp;
+            minv = dtw[curidx];
+            curidx += 1;
+            tempv = dtw[curidx] + penalty;
+            if (tempv < minv) {
+                minv = tempv;
+            }
+            curidx = i1 * length + j - skip;
+            tempv = dtw[curidx] + penalty;
+            if (tempv < minv) {
+                minv = tempv;
+            }
+            #ifdef DTWDEBUG
+            printf("d = %f, minv = %f\n", d, minv);
+            #endif
+            curidx += 1;
+            dtw[curidx] = d + minv;
+            #ifdef DTWDEBUG
+            printf("%zu, %zu, %zu\n",i0*length + j - skipp,i0*length + j + 1 - skipp,i1*length + j - skip);
+            printf("%f, %f, %f\n",dtw[i0*length + j - skipp],dtw[i0*length + j + 1 - skipp],dtw[i1*length + j - skip]);
+            printf("i=%zu, j=%zu, d=%f, skip=%zu, skipp=%zu\n",i,j,d,skip,skipp);
+            #endif
+            // PrunedDTW
+            if (dtw[curidx] > max_dist) {
+                #ifdef DTWDEBUG
+                printf("dtw[%zu] = %f > %f\n", curidx, dtw[curidx], max_dist);
+                #endif
+                if (!smaller_found) {
+                    sc = j + 1;
+                }
+                if (j >= ec) {
+                    #ifdef DTWDEBUG
+                    printf("Break because of pruning with j=%zu, ec=%zu (saved %zu computations)\n", j, ec, minj-j);
+                    #endif
+                    break;
+                }
+            } else {
+                smaller_found = true;
+                ec_next = j + 1;
+            }
+        }
+        ec = ec_next;
+        // Deal with Psi-relaxation in last column
+        if (settings->psi_1e != 0 && minj == l2 && l1 - 1 - i <= settings->psi_1e) {
+            assert(!(settings->window == 0 || settings->window == l2) || (i1 + 1)*length - 1 == curidx);
+            if (dtw[curidx] < psi_shortest) {
+                // curidx is the last value
+                psi_shortest = dtw[curidx];
+            }
+        }
+    }
+    if (window - 1 < 0) {
+        l2 += window - 1;
+    }
+    seq32_t result = sqrtf(dtw[length * i1 + l2 - skip]);
+    // Deal with psi-relaxation in the last row
+    if (settings->psi_1e != 0 || settings->psi_2e != 0) {
+        if (settings->psi_2e != 0) {
+            for (i=l2 - skip - settings->psi_2e; i<l2 - skip + 1; i++) { // iterate over vci
+                if (dtw[i1*length + i] < psi_shortest) {
+                    psi_shortest = dtw[i1*length + i];
+                }
+            }
+        }
+        result = sqrtf(psi_shortest);
+    }
+    // signal(SIGINT, SIG_DFL);  // not compatible with OMP
+    if (settings->max_dist !=0 && result > settings->max_dist) {
+        // DTWPruned keeps the last value larger than max_dist. Correct for this.
+        result = INFINITY;
+    }
+    return result;
+}
+
+/**
+Compute the DTW between two single-precision series, using a temporary workspace.
+
+@see dtw_distance_f32_ws
+*/
+seq32_t dtw_distance_f32(seq32_t *s1, idx_t l1,
+                      seq32_t *s2, idx_t l2, 
+                      DTWSettings *settings) {
+    DTWWorkspace ws = dtw_workspace_empty();
+    seq32_t result = dtw_distance_f32_ws(s1, l1, s2, l2, settings, &ws);
+    dtw_workspace_free(&ws);
+    return result;
+}
+
+
+/**
+Compute the DTW between two single-precision series.
+Use the Euclidean inner distance.
+
+@param s1 First sequence
+@param l1 Length of first sequence. 
+@param s2 Second sequence
+@param l2 Length of second sequence. 
+@param settings A DTWSettings struct with options for the DTW algorithm.
+@param ws Workspace that provides (and keeps) the memory for the cost matrix rows.
+*/
+seq32_t dtw_distance_euclidean_f32_ws(seq32_t *s1, idx_t l1,
+                      seq32_t *s2, idx_t l2, 
+                      DTWSettings *settings, DTWWorkspace *ws) {
+    assert(settings->psi_1b <= l1 && settings->psi_1e <= l1 &&
+           settings->psi_2b <= l2 && settings->psi_2e <= l2);
+    idx_t ldiff;
+    idx_t dl;
+    // DTWPruned
+    idx_t sc = 0;
+    idx_t ec = 0;
+    bool smaller_found;
+    idx_t ec_next;
+    // signal(SIGINT, dtw_int_handler); // not compatible with OMP
+
+    idx_t window = settings->window;
+    seq32_t max_step = settings->max_step;
+    seq32_t max_dist = settings->max_dist;
+    seq32_t penalty = settings->penalty;
+
+    #ifdef DTWDEBUG
+    printf("r=%zu, c=%zu\n", l1, l2);
+    #endif
+    if (settings->use_pruning || settings->only_ub) {
+        max_dist = ub_euclidean_euclidean_f32(s1, l1, s2, l2);
+        if (settings->only_ub) {
+            return max_dist;
+        }
+    } else if (max_dist == 0) {
+        max_dist = INFINITY;
+    } else {
+        max_dist = powf(max_dist, 2);
+    }
+    if (l1 > l2) {
+        ldiff = l1 - l2;
+        dl = ldiff;
+    } else {
+        ldiff  = l2 - l1;
+        dl = 0;
+    }
+    if (settings->max_length_diff != 0 && ldiff > settings->max_length_diff) {
+        return INFINITY;
+    }
+    if (window == 0) {
+        window = MAX(l1, l2);
+    }
+    if (max_step == 0) {
+        max_step = INFINITY;
+    } else {
+        max_step = powf(max_step, 2);
+    }
+    penalty = powf(penalty, 2);
+    // rows is for series 1, columns is for series 2
+    idx_t length = MIN(l2+1, ldiff + 2*window + 1);
+    assert(length > 0);
+    seq32_t * dtw = (seq32_t *)dtw_workspace_reserve(ws, sizeof(seq32_t) * length * 2);
+    if (!dtw) {
+        printf("Error: dtw_distance_f32 - Cannot allocate memory (size=%zu)\n", length*2);
+        return 0;
+    }
+    idx_t i;
+    idx_t j;
+    for (j=0; j<length*2; j++) {
+        dtw[j] = INFINITY;
+    }
+    // Deal with psi-relaxation in first row
+    for (i=0; i<settings->psi_2b + 1; i++) {
+        dtw[i] = 0;
+    }
+    idx_t skip = 0;
+    idx_t skipp = 0;
+    int i0 = 1;
+    int i1 = 0;
+    idx_t minj;
+    idx_t maxj;
+    idx_t curidx = 0;
+    idx_t dl_window = dl + window - 1;
+    idx_t ldiff_window = window;
+    if (l2 > l1) {
+        ldiff_window += ldiff;
+    }
+    seq32_t minv;
+    seq32_t d;
+    seq32_t tempv;
+    seq32_t psi_shortest = INFINITY;
+    // keepRunning = 1;
+    for (i=0; i<l1; i++) {
+        // if (!keepRunning){  // not compatible with OMP
+        //     free(dtw);
+        //     printf("Stop computing DTW...\n");
+        //     return INFINITY;
+        // }
+        // maxj = i;
+        // if (maxj > dl_window) {
+        //     maxj -= dl_window;
+        // } else {
+        //     maxj = 0;
+        // }
+        maxj = (i - dl_window) * (i > dl_window);
+        // No risk for overflow/modulo because we also need to store dtw of size
+        // MIN(l2+1, ldiff + 2*window + 1) ?
+        minj = i + ldiff_window;
+        if (minj > l2) {
+            minj = l2;
+        }
+        skipp = skip;
+        skip = maxj;
+        i0 = 1 - i0;
+        i1 = 1 - i1;
+        // Reset new line i1
+        for (j=0; j<length; j++) {
+            dtw[length * i1 + j] = INFINITY;
+        }
+        // if (length == l2 + 1) {
+        //     skip = 0;
+        // }
+        skip = skip * (length != l2 + 1);
+        // PrunedDTW
+        if (sc > maxj) {
+            #ifdef DTWDEBUG
+            printf("correct maxj to sc: %zu -> %zu (saved %zu computations)\n", maxj, sc, sc-maxj);
+            #endif
+            maxj = sc;
+        }
+        smaller_found = false;
+        ec_next = i;
+        // Deal with psi-relaxation in first column
+        if (settings->psi_1b != 0 && maxj == 0 && i < settings->psi_1b) {
+            dtw[i1*length + 0] = 0;
+        }
+        #ifdef DTWDEBUG
+        printf("i=%zu, maxj=%zu, minj=%zu\n", i, maxj, minj);
+        #endif
+        for (j=maxj; j<minj; j++) {
+            #ifdef DTWDEBUG
+            printf("ri=%zu,ci=%zu, s1[i] = s1[%zu] = %f , s2[j] = s2[%zu] = %f\n", i, j, i, s1[i], j, s2[j]);
+            #endif
+            d = fabsf(s1[i] - s2[j]);
+            if (d > max_step) {
+                // Let the value be INFINITY as initialized
+                continue;
+            }
+            curidx = i0 * length + j - skipp;
+            minv = dtw[curidx];
+            curidx += 1;
+            tempv = dtw[curidx] + penalty;
+            if (tempv < minv) {
+                minv = tempv;
+            }
+            curidx = i1 * length + j - skip;
+            tempv = dtw[curidx] + penalty;
+            if (tempv < minv) {
+                minv = tempv;
+            }
+            #ifdef DTWDEBUG
+            printf("d = %f, minv = %f\n", d, minv);
+            #endif
+            curidx += 1;
+            dtw[curidx] = d + minv;
+            #ifdef DTWDEBUG
+            printf("%zu, %zu, %zu\n",i0*length + j - skipp,i0*length + j + 1 - skipp,i1*length + j - skip);
+            printf("%f, %f, %f\n",dtw[i0*length + j - skipp],dtw[i0*length + j + 1 - skipp],dtw[i1*length + j - skip]);
+            printf("i=%zu, j=%zu, d=%f, skip=%zu, skipp=%zu\n",i,j,d,skip,skipp);
+            #endif
+            // PrunedDTW
+            if (dtw[curidx] > max_dist) {
+                #ifdef DTWDEBUG
+                printf("dtw[%zu] = %f > %f\n", curidx, dtw[curidx], max_dist);
+                #endif
+                if (!smaller_found) {
+                    sc = j + 1;
+                }
+                if (j >= ec) {
+                    #ifdef DTWDEBUG
+                    printf("Break because of pruning with j=%zu, ec=%zu (saved %zu computations)\n", j, ec, minj-j);
+                    #endif
+                    break;
+                }
+            } else {
+                smaller_found = true;
+                ec_next = j + 1;
+            }
+        }
+        ec = ec_next;
+        // Deal with Psi-relaxation in last column
+        if (settings->psi_1e != 0 && minj == l2 && l1 - 1 - i <= settings->psi_1e) {
+            assert(!(settings->window == 0 || settings->window == l2) || (i1 + 1)*length - 1 == curidx);
+            if (dtw[curidx] < psi_shortest) {
+                // curidx is the last value
+                psi_shortest = dtw[curidx];
+            }
+        }
+    }
+    if (window - 1 < 0) {
+        l2 += window - 1;
+    }
+    seq32_t result = dtw[length * i1 + l2 - skip];
+    // Deal with psi-relaxation in the last row
+    if (settings->psi_1e != 0 || settings->psi_2e != 0) {
+        if (settings->psi_2e != 0) {
+            for (i=l2 - skip - settings->psi_2e; i<l2 - skip + 1; i++) { // iterate over vci
+                if (dtw[i1*length + i] < psi_shortest) {
+                    psi_shortest = dtw[i1*length + i];
+                }
+            }
+        }
+        result = psi_shortest;
+    }
+    // signal(SIGINT, SIG_DFL);  // not compatible with OMP
+    if (settings->max_dist !=0 && result > settings->max_dist) {
+        // DTWPruned keeps the last value larger than max_dist. Correct for this.
+        result = INFINITY;
+    }
+    return result;
+}
+
+/**
+Compute the DTW between two single-precision series, using a temporary workspace.
+
+@see dtw_distance_euclidean_f32_ws
+*/
+seq32_t dtw_distance_euclidean_f32(seq32_t *s1, idx_t l1,
+                      seq32_t *s2, idx_t l2, 
+                      DTWSettings *settings) {
+    DTWWorkspace ws = dtw_workspace_empty();
+    seq32_t result = dtw_distance_euclidean_f32_ws(s1, l1, s2, l2, settings, &ws);
+    dtw_workspace_free(&ws);
+    return result;
+}
+
+
+// MARK: Bounds
+
+/*!
+ Euclidean upper bound for DTW.
+
+ @see ub_euclidean
+ */
+seq32_t ub_euclidean_f32(seq32_t *s1, idx_t l1, seq32_t *s2, idx_t l2) {
+    idx_t n = MIN(l1, l2);
+    seq32_t ub = 0;
+    for (idx_t i=0; i<n; i++) {
+        ub += SEDIST(s1[i], s2[i]);
+    }
+    // If the two series differ in length, compare the last element of the shortest series
+    // to the remaining elements in the longer series
+    if (l1 > l2) {
+        for (idx_t i=n; i<l1; i++) {
+            ub += SEDIST(s1[i], s2[n-1]);
+        }
+    } else if (l1 < l2) {
+        for (idx_t i=n; i<l2; i++) {
+            ub += SEDIST(s1[n-1], s2[i]);
+        }
+    }
+    ub = sqrtf(ub);
+    return ub;
+}
+
+
+/*!
+ Euclidean upper bound for DTW.
+
+ @see ub_euclidean_euclidean
+ */
+seq32_t ub_euclidean_euclidean_f32(seq32_t *s1, idx_t l1, seq32_t *s2, idx_t l2) {
+    idx_t n = MIN(l1, l2);
+    seq32_t ub = 0;
+    for (idx_t i=0; i<n; i++) {
+        ub += fabsf(s1[i] - s2[i]);
+    }
+    if (l1 > l2) {
+        for (idx_t i=n; i<l1; i++) {
+            ub += fabsf(s1[i] - s2[n-1]);
+        }
+    } else if (l1 < l2) {
+        for (idx_t i=n; i<l2; i++) {
+            ub += fabsf(s1[n-1] - s2[i]);
+        }
+    }
+    return ub;
+}
+
+
+/*!
+ Keogh lower bound for DTW.
+ */
+seq32_t lb_keogh_f32(seq32_t *s1, idx_t l1, seq32_t *s2, idx_t l2, DTWSettings *settings) {
+    if (settings->inner_dist == 1) {
+        return lb_keogh_euclidean_f32(s1, l1, s2, l2, settings);
+    }
+    idx_t window = settings->window;
+    if (window == 0) {
+        window = MAX(l1, l2);
+    }
+    idx_t imin, imax;
+    seq32_t t = 0;
+    seq32_t ui;
+    seq32_t li;
+    seq32_t ci;
+    idx_t imin_diff = window - 1;
+    if (l1 > l2) {
+        imin_diff += l1 - l2;
+    }
+    idx_t imax_diff = window;
+    if (l2 > l1) {
+        imax_diff += l2 - l1;
+    }
+    for (idx_t i=0; i<l1; i++) {
+        if (i > imin_diff) {
+            imin = i - imin_diff;
+        } else {
+            imin = 0;
+        }
+        imax = i + imax_diff;
+        if (imax > l2) {
+            imax = l2;
+        }
+        ui = 0;
+        for (idx_t j=imin; j<imax; j++) {
+            if (s2[j] > ui) {
+                ui = s2[j];
+            }
+        }
+        li = INFINITY;
+        for (idx_t j=imin; j<imax; j++) {
+            if (s2[j] < li) {
+                li = s2[j];
+            }
+        }
+        ci = s1[i];
+        if (ci > ui) {
+            t += (ci - ui)*(ci - ui);
+        } else if (ci < li) {
+            t += (li - ci)*(li - ci);
+        }
+    }
+    t = sqrtf(t);
+    return t;
+}
+
+
+/*!
+ Keogh lower bound for DTW.
+ */
+seq32_t lb_keogh_euclidean_f32(seq32_t *s1, idx_t l1, seq32_t *s2, idx_t l2, DTWSettings *settings) {
+    idx_t window = settings->window;
+    if (window == 0) {
+        window = MAX(l1, l2);
+    }
+    idx_t imin, imax;
+    seq32_t t = 0;
+    seq32_t ui;
+    seq32_t li;
+    seq32_t ci;
+    idx_t imin_diff = window - 1;
+    if (l1 > l2) {
+        imin_diff += l1 - l2;
+    }
+    idx_t imax_diff = window;
+    if (l2 > l1) {
+        imax_diff += l2 - l1;
+    }
+    for (idx_t i=0; i<l1; i++) {
+        if (i > imin_diff) {
+            imin = i - imin_diff;
+        } else {
+            imin = 0;
+        }
+        imax = i + imax_diff;
+        if (imax > l2) {
+            imax = l2;
+        }
+        ui = 0;
+        for (idx_t j=imin; j<imax; j++) {
+            if (s2[j] > ui) {
+                ui = s2[j];
+            }
+        }
+        li = INFINITY;
+        for (idx_t j=imin; j<imax; j++) {
+            if (s2[j] < li) {
+                li = s2[j];
+            }
+        }
+        ci = s1[i];
+        if (ci > ui) {
+            t += fabsf(ci - ui);
+        } else if (ci < li) {
+            t += li - ci;
+        }
+    }
+    return t;
+}
+
+
+// MARK: Distance Matrix
+
+
+/*!
+Distance matrix for n-dimensional DTW, executed on a list of pointers to arrays.
+
+@param ptrs Pointers to arrays.  The arrays are expected to be 1-dimensional.
+@param nb_ptrs Length of ptrs array
+@param lengths Array of length nb_ptrs with all lengths of the arrays in ptrs.
+@param output Array to store all outputs (should be (nb_ptrs-1)*nb_ptrs/2 if no block is given)
+@param block Restrict to a certain block of combinations of series.
+@param settings DTW settings
+*/
+idx_t dtw_distances_ptrs_f32(seq32_t **ptrs, idx_t nb_ptrs, idx_t* lengths,
+                          seq32_t* output, DTWBlock* block, DTWSettings* settings) {
+    idx_t r, c, cb;
+    idx_t length;
+    idx_t i;
+    seq32_t value;
+
+    length = dtw_distances_length(block, nb_ptrs, nb_ptrs);
+    if (length == 0) {
+        return 0;
+    }
+
+    // Correct block
+    if (block->re == 0) {
+        block->re = nb_ptrs;
+    }
+    if (block->ce == 0) {
+        block->ce = nb_ptrs;
+    }
+
+    i = 0;
+    for (r=block->rb; r<block->re; r++) {
+        if (block->triu && r + 1 > block->cb) {
+            cb = r+1;
+        } else {
+            cb = block->cb;
+        }
+        for (c=cb; c<block->ce; c++) {
+            value = dtw_distance_f32(ptrs[r], lengths[r],
+                                 ptrs[c], lengths[c], settings);
+            // printf("i=%zu - r=%zu - c=%zu - value=%.4f\n", i, r, c, value);
+            output[i] = value;
+            i += 1;
+        }
+    }
+    assert(length == i);
+    return length;
+}
+
+
+/*!
+Distance matrix for n-dimensional DTW, executed on a 2-dimensional array.
+
+ The array is assumed to be C contiguous: C contiguous means that the array data is continuous in memory (see below) and that neighboring elements in the first dimension of the array are furthest apart in memory, whereas neighboring elements in the last dimension are closest together (from https://cython.readthedocs.io/en/latest/src/userguide/memoryviews.html#brief-recap-on-c-fortran-and-strided-memory-layouts).
+
+@param matrix 2-dimensional array. The order is defined by 1st dimension are the series, the 2nd dimension are the sequence entries.
+@param nb_rows Number of series, size of the 1st dimension of matrix
+@param nb_cols Number of elements in each series, size of the 2nd dimension of matrix
+@param output Array to store all outputs (should be (nb_ptrs-1)*nb_ptrs/2 if no block is given)
+@param block Restrict to a certain block of combinations of series.
+@param settings DTW settings
+*/
+idx_t dtw_distances_matrix_f32(seq32_t *matrix, idx_t nb_rows, idx_t nb_cols,
+                          seq32_t* output, DTWBlock* block, DTWSettings* settings) {
+    idx_t r, c, cb;
+    idx_t length;
+    idx_t i;
+    seq32_t value;
+
+    length = dtw_distances_length(block, nb_rows, nb_rows);
+    if (length == 0) {
+        return 0;
+    }
+
+    // Correct block
+    if (block->re == 0) {
+        block->re = nb_rows;
+    }
+    if (block->ce == 0) {
+        block->ce = nb_rows;
+    }
+
+    i = 0;
+    for (r=block->rb; r<block->re; r++) {
+        if (block->triu && r + 1 > block->cb) {
+            cb = r+1;
+        } else {
+            cb = block->cb;
+        }
+        for (c=cb; c<block->ce; c++) {
+            value = dtw_distance_f32(&matrix[r*nb_cols], nb_cols,
+                                 &matrix[c*nb_cols], nb_cols, settings);
+            // printf("i=%zu - r=%zu - c=%zu - value=%.4f\n", i, r, c, value);
+            output[i] = value;
+            i += 1;
+        }
+    }
+    assert(length == i);
+    return length;
+}
@@ -54,45 +54,55 @@ idx_t dtw_distances_{{suffix}}_parallel(
     // the same length, thus a circular assignment works well) but assumes all DTW computations take
     // the same amount of time.
     {%- endif %}
-    #pragma omp parallel for private(r_i, c_i, r, c) schedule(guided)
-    for (r_i=0; r_i < (block->re - block->rb); r_i++) {
-        r = block->rb + r_i;
-        c_i = 0;
-        if (block->triu) {
-            c = cbs[r_i];
-        } else {
-            c = block->cb;
-        }
-        for (; c<block->ce; c++) {
-            {%- if suffix == "ptrs" %}
-            double value = dtw_distance(ptrs[r], lengths[r],
-                                        ptrs[c], lengths[c], settings);
-            {%- elif suffix == "ndim_ptrs" %}
-            double value = dtw_distance_ndim(ptrs[r], lengths[r],
-                          ptrs[c], lengths[c],
-                          ndim, settings);
-            {%- elif suffix == "matrix" %}
-            double value = dtw_distance(&matrix[r*nb_cols], nb_cols,
-                                         &matrix[c*nb_cols], nb_cols, settings);
-            {%- elif suffix == "ndim_matrix" %}
-            double value = dtw_distance_ndim(&matrix[r*nb_cols*ndim], nb_cols,
-                                             &matrix[c*nb_cols*ndim], nb_cols,
-                                             ndim, settings);
-            {%- elif suffix == "matrices" %}
-            double value = dtw_distance(&matrix_r[r*nb_cols_r], nb_cols_r,
-                                        &matrix_c[c*nb_cols_c], nb_cols_c, settings);
-            {%- elif suffix == "ndim_matrices" %}
-            double value = dtw_distance_ndim(&matrix_r[r*nb_cols_r*ndim], nb_cols_r,
-                                             &matrix_c[c*nb_cols_c*ndim], nb_cols_c,
-                                             ndim, settings);
-            {%- endif %}
+    {%- if "ndim" not in suffix %}
+    // The settings are the same for all pairs, select the DTW variant once
+    DTWWsFnPtr dtw_fn = dtw_distance_kernel(settings);
+    {%- endif %}
+    #pragma omp parallel private(r_i, c_i, r, c)
+    {
+        // One workspace per thread, reused for all DTW computations of this thread
+        DTWWorkspace ws = dtw_workspace_empty();
+        #pragma omp for schedule(guided)
+        for (r_i=0; r_i < (block->re - block->rb); r_i++) {
+            r = block->rb + r_i;
+            c_i = 0;
             if (block->triu) {
-                output[rls[r_i] + c_i] = value;
+                c = cbs[r_i];
             } else {
-                output[(block->ce - block->cb) * r_i + c_i] = value;
+                c = block->cb;
+            }
+            for (; c<block->ce; c++) {
+                {%- if suffix == "ptrs" %}
+                double value = dtw_fn(ptrs[r], lengths[r],
+                                      ptrs[c], lengths[c], settings, &ws);
+                {%- elif suffix == "ndim_ptrs" %}
+                double value = dtw_distance_ndim_ws(ptrs[r], lengths[r],
+                                 ptrs[c], lengths[c],
+                                 ndim, settings, &ws);
+                {%- elif suffix == "matrix" %}
+                double value = dtw_fn(&matrix[r*nb_cols], nb_cols,
+                                      &matrix[c*nb_cols], nb_cols, settings, &ws);
+                {%- elif suffix == "ndim_matrix" %}
+                double value = dtw_distance_ndim_ws(&matrix[r*nb_cols*ndim], nb_cols,
+                                                    &matrix[c*nb_cols*ndim], nb_cols,
+                                                    ndim, settings, &ws);
+                {%- elif suffix == "matrices" %}
+                double value = dtw_fn(&matrix_r[r*nb_cols_r], nb_cols_r,
+                                      &matrix_c[c*nb_cols_c], nb_cols_c, settings, &ws);
+                {%- elif suffix == "ndim_matrices" %}
+                double value = dtw_distance_ndim_ws(&matrix_r[r*nb_cols_r*ndim], nb_cols_r,
+                                                    &matrix_c[c*nb_cols_c*ndim], nb_cols_c,
+                                                    ndim, settings, &ws);
+                {%- endif %}
+                if (block->triu) {
+                    output[rls[r_i] + c_i] = value;
+                } else {
+                    output[(block->ce - block->cb) * r_i + c_i] = value;
+                }
+                c_i++;
             }
-            c_i++;
         }
+        dtw_workspace_free(&ws);
     }
     
     if (block->triu) {
@@ -0,0 +1,44 @@
+/*
+ * Variable-length collection of close series: one contiguous values arena with
+ * offsets and lengths, and one buffer with the interned ticker names. The series
+ * are packed next to each other in the order of the file, memory use is thus the
+ * number of values and series are not limited to MAX_TIMEPOINTS.
+ *
+ * A collection loaded from a series store points into the mapping of the store
+ * (map != NULL) for the values and the names.
+ *
+ * This file is part of the DTW aggregation and clustering project.
+ */
+// series_collection.h
+#ifndef SERIES_COLLECTION_H
+#define SERIES_COLLECTION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dd_globals.h"
+#include "types.h"
+
+typedef struct {
+    int num_series;
+    idx_t num_values;
+    double *values;       // series i is values[offsets[i] .. offsets[i] + lengths[i])
+    idx_t *offsets;
+    idx_t *lengths;
+    char *names;          // ticker i is the '\0'-terminated string at names + name_offsets[i]
+    idx_t *name_offsets;
+    void *map;            // mapping of a series store that holds values and names, or NULL
+    size_t map_size;
+} SeriesCollection;
+
+void series_collection_init(SeriesCollection *collection);
+void series_collection_free(SeriesCollection *collection);
+const char *series_collection_ticker(const SeriesCollection *collection, int i);
+double *series_collection_series(const SeriesCollection *collection, int i);
+uint64_t series_hash(const double *values, idx_t length);
+int series_collection_reorder(SeriesCollection *collection, const int *order);
+int series_collection_to_ticker_series(const SeriesCollection *collection, TickerSeries *series_list,
+                                       int *num_series, int max_assets);
+
+#endif // SERIES_COLLECTION_H
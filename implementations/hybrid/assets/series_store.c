@@ -0,0 +1,241 @@
+/*
+ * Binary columnar store for the close series of all tickers.
+ *
+ * This file is part of the DTW aggregation and clustering project.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "series_store.h"
+#include "load_from_csv.h"
+
+
+static uint64_t series_store_align(uint64_t offset) {
+    return (offset + SERIES_STORE_ALIGN - 1) / SERIES_STORE_ALIGN * SERIES_STORE_ALIGN;
+}
+
+bool series_store_is_store(const char *filename) {
+    char magic[8];
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        return false;
+    }
+    bool is_store = (fread(magic, 1, sizeof(magic), fp) == sizeof(magic) &&
+                     memcmp(magic, SERIES_STORE_MAGIC, sizeof(magic)) == 0);
+    fclose(fp);
+    return is_store;
+}
+
+int series_store_write(const char *filename, const char **names, seq_t **ptrs, idx_t *lengths, int num_series) {
+    SeriesStoreHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SERIES_STORE_MAGIC, sizeof(header.magic));
+    header.version = SERIES_STORE_VERSION;
+    header.byte_order = SERIES_STORE_BYTE_ORDER;
+    header.name_size = MAX_TICKER_NAME;
+    header.value_size = sizeof(seq_t);
+    header.num_series = num_series;
+    for (int i = 0; i < num_series; i++) {
+        header.num_values += lengths[i];
+    }
+    header.names_offset = sizeof(SeriesStoreHeader);
+    header.offsets_offset = header.names_offset + (uint64_t)num_series * header.name_size;
+    header.values_offset = series_store_align(header.offsets_offset + sizeof(uint64_t) * ((uint64_t)num_series + 1));
+
+    FILE *fp = fopen(filename, "wb");
+    if (!fp) {
+        perror("fopen");
+        return -1;
+    }
+    bool ok = (fwrite(&header, sizeof(header), 1, fp) == 1);
+
+    // Ticker dictionary
+    char name[MAX_TICKER_NAME];
+    for (int i = 0; ok && i < num_series; i++) {
+        memset(name, 0, sizeof(name));
+        strncpy(name, names[i], MAX_TICKER_NAME - 1);
+        ok = (fwrite(name, sizeof(name), 1, fp) == 1);
+    }
+
+    // Offsets
+    uint64_t offset = 0;
+    for (int i = 0; ok && i <= num_series; i++) {
+        ok = (fwrite(&offset, sizeof(offset), 1, fp) == 1);
+        if (i < num_series) {
+            offset += lengths[i];
+        }
+    }
+
+    // Values
+    static const char padding[SERIES_STORE_ALIGN] = {0};
+    uint64_t pos = header.offsets_offset + sizeof(uint64_t) * ((uint64_t)num_series + 1);
+    if (ok && header.values_offset > pos) {
+        ok = (fwrite(padding, header.values_offset - pos, 1, fp) == 1);
+    }
+    for (int i = 0; ok && i < num_series; i++) {
+        ok = (fwrite(ptrs[i], sizeof(seq_t), lengths[i], fp) == (size_t)lengths[i]);
+    }
+
+    if (fclose(fp) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        fprintf(stderr, "Error writing series store %s\n", filename);
+        return -1;
+    }
+    return 0;
+}
+
+int series_store_write_collection(const char *filename, const SeriesCollection *collection) {
+    int num_series = collection->num_series;
+    const char **names = malloc(sizeof(char *) * (num_series + 1));
+    seq_t **ptrs = malloc(sizeof(seq_t *) * (num_series + 1));
+    if (!names || !ptrs) {
+        fprintf(stderr, "Error: cannot allocate memory for %d series\n", num_series);
+        free(names);
+        free(ptrs);
+        return -1;
+    }
+    for (int i = 0; i < num_series; i++) {
+        names[i] = series_collection_ticker(collection, i);
+        ptrs[i] = series_collection_series(collection, i);
+    }
+    int rvalue = series_store_write(filename, names, ptrs, collection->lengths, num_series);
+    free(names);
+    free(ptrs);
+    return rvalue;
+}
+
+// Map the store read-only and point ptrs/lengths into the mapping (at most max_assets series)
+int series_store_open(const char *filename, SeriesStore *store, int max_assets) {
+    memset(store, 0, sizeof(SeriesStore));
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        perror("open");
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror("fstat");
+        close(fd);
+        return -1;
+    }
+    size_t size = (size_t)st.st_size;
+    if (size < sizeof(SeriesStoreHeader)) {
+        fprintf(stderr, "Error: %s is not a series store\n", filename);
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+
+    const SeriesStoreHeader *header = (const SeriesStoreHeader *)map;
+    uint64_t n = header->num_series;
+    bool ok = (memcmp(header->magic, SERIES_STORE_MAGIC, sizeof(header->magic)) == 0 &&
+               header->version == SERIES_STORE_VERSION &&
+               header->byte_order == SERIES_STORE_BYTE_ORDER &&
+               header->value_size == sizeof(seq_t) &&
+               header->name_size > 0 &&
+               header->values_offset % sizeof(seq_t) == 0 &&
+               header->names_offset + n * header->name_size <= size &&
+               header->offsets_offset + (n + 1) * sizeof(uint64_t) <= size &&
+               header->values_offset + header->num_values * sizeof(seq_t) <= size);
+    const uint64_t *offsets = (const uint64_t *)((const char *)map + header->offsets_offset);
+    for (uint64_t i = 0; ok && i < n; i++) {
+        ok = (offsets[i] <= offsets[i + 1]);
+    }
+    ok = ok && (offsets[0] == 0 && offsets[n] == header->num_values);
+    if (!ok) {
+        fprintf(stderr, "Error: %s is not a valid series store (version %d)\n", filename, SERIES_STORE_VERSION);
+        munmap(map, size);
+        return -1;
+    }
+
+    int num_series = (n < (uint64_t)max_assets) ? (int)n : max_assets;
+    store->ptrs = malloc(sizeof(seq_t *) * (num_series > 0 ? num_series : 1));
+    store->lengths = malloc(sizeof(idx_t) * (num_series > 0 ? num_series : 1));
+    if (!store->ptrs || !store->lengths) {
+        fprintf(stderr, "Error: cannot allocate memory for %d series\n", num_series);
+        free(store->ptrs);
+        free(store->lengths);
+        munmap(map, size);
+        memset(store, 0, sizeof(SeriesStore));
+        return -1;
+    }
+    seq_t *values = (seq_t *)((char *)map + header->values_offset);
+    for (int i = 0; i < num_series; i++) {
+        store->ptrs[i] = values + offsets[i];
+        store->lengths[i] = (idx_t)(offsets[i + 1] - offsets[i]);
+    }
+    store->map = map;
+    store->map_size = size;
+    store->num_series = num_series;
+    store->num_values = (idx_t)offsets[num_series];
+    store->name_size = header->name_size;
+    store->names = (const char *)map + header->names_offset;
+    return 0;
+}
+
+const char *series_store_ticker(SeriesStore *store, int i) {
+    return store->names + (size_t)i * store->name_size;
+}
+
+// Collection of the series in a store, values and names stay in the mapping
+int series_store_load_collection(const char *filename, SeriesCollection *collection, int max_assets) {
+    SeriesStore store;
+    series_collection_init(collection);
+    if (series_store_open(filename, &store, max_assets) != 0) {
+        return -1;
+    }
+    int n = store.num_series;
+    collection->offsets = malloc(sizeof(idx_t) * (n + 1));
+    collection->name_offsets = malloc(sizeof(idx_t) * (n + 1));
+    if (!collection->offsets || !collection->name_offsets) {
+        fprintf(stderr, "Error: cannot allocate memory for %d series\n", n);
+        free(collection->offsets);
+        free(collection->name_offsets);
+        series_collection_init(collection);
+        series_store_close(&store);
+        return -1;
+    }
+    seq_t *values = (n > 0) ? store.ptrs[0] : NULL;
+    for (int i = 0; i < n; i++) {
+        collection->offsets[i] = store.ptrs[i] - values;
+        collection->name_offsets[i] = (idx_t)i * store.name_size;
+    }
+    collection->num_series = n;
+    collection->num_values = store.num_values;
+    collection->values = values;
+    collection->lengths = store.lengths;
+    collection->names = (char *)store.names;
+    collection->map = store.map;
+    collection->map_size = store.map_size;
+    // The collection owns the mapping and the lengths now
+    free(store.ptrs);
+    return 0;
+}
+
+// Load a store written by csv_to_store or, for any other file, the CSV
+int load_series_collection_from_file(const char *filename, SeriesCollection *collection, int max_assets) {
+    if (series_store_is_store(filename)) {
+        return series_store_load_collection(filename, collection, max_assets);
+    }
+    return load_series_collection_from_csv(filename, collection, max_assets);
+}
+
+void series_store_close(SeriesStore *store) {
+    if (store->map != NULL) {
+        munmap(store->map, store->map_size);
+    }
+    free(store->ptrs);
+    free(store->lengths);
+    memset(store, 0, sizeof(SeriesStore));
+}
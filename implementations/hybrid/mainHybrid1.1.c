@@ -6,11 +6,23 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <math.h>
+#include <sched.h>
 #include <mpi.h>
 #include <omp.h>
 
 #include "dd_dtw.h"
+#include "dd_dtw_simd.h"
+#include "dd_dtw_f32.h"
+#include "dd_dtw_prune.h"
 #include "assets/load_from_csv.h"
+#include "assets/series_store.h"
+#include "assets/series_shared.h"
+#include "assets/series_batch.h"
+#include "assets/batch_schedule.h"
+#include "assets/result_sink.h"
+#include "assets/result_cache.h"
+#include "assets/run_checkpoint.h"
 
 #define WORKTAG   1
 #define KILLTAG   2
@@ -19,13 +31,555 @@
 typedef struct {
     int len_r;
     double *r;
+    float *r32;         // --f32 copies, converted once per series (Batch.f32)
 
     int len_c;
     double *c;
+    float *c32;
 } Task;
 
+/* consecutive tasks of a batch that share the same row series */
+typedef struct {
+    int first;
+    int count;
+} RowChunk;
+
+/* batch received by a slave, grouped in row chunks */
+typedef struct {
+    int batch;
+    Task *tasks;
+    char *buf;          // packed series (NULL with --shared)
+    double **cols;
+    idx_t *col_lens;
+    double *dists;
+    RowChunk *chunks;
+    int nb_chunks;
+    float *f32;             // --f32: copies of the distinct series (NULL with --shared)
+    DTWEnvelope *envs;      // --max-dist: envelope of every distinct series (NULL with --shared)
+    int nb_envs;
+    DTWEnvelope *row_envs;  // --max-dist: envelopes of the tasks, copies of envs or of the
+    DTWEnvelope *col_envs;  //   envelopes of the shared series (the arrays are not owned)
+} Batch;
+
+/* series of a slave and what it derives from them before computing: with --shared
+ * the envelopes (--max-dist) and the single-precision copies (--f32) of all series
+ * are made once per rank, otherwise once per distinct series of a batch */
+typedef struct {
+    int use_shared;
+    SharedSeries *shared;
+    int use_envs;              // --max-dist without --f32
+    int use_f32;
+    DTWEnvelope *shared_envs;  // --shared with use_envs
+    float **shared_f32;        // --shared with --f32
+    DTWSettings *settings;
+} SlaveSeries;
+
+/* --hier: two batches per slave, one computed and the next one already received */
+#define HIER_DEPTH     2
+/* --hier: wanted compute time of one batch on one slave (assets/batch_schedule.h) */
+#define HIER_BATCH_SEC 0.2
+
+/* batches of a slave in the order of arrival (the results go back in that order) */
+typedef struct {
+    Batch batch[HIER_DEPTH];
+    int next_chunk[HIER_DEPTH];
+    int done_chunks[HIER_DEPTH];
+    int head;
+    int len;
+    int killed;
+} HierQueue;
+
+/* sum the pruning counters of all slaves on the master */
+static void reduce_prune_stats(DTWPruneStats *stats, int rank) {
+    unsigned long long local[5] = {stats->pairs, stats->pruned_kim, stats->pruned_keogh,
+                                   stats->abandoned, stats->kept};
+    unsigned long long total[5];
+    MPI_Reduce(local, total, 5, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (rank == 0) {
+        stats->pairs = total[0];
+        stats->pruned_kim = total[1];
+        stats->pruned_keogh = total[2];
+        stats->abandoned = total[3];
+        stats->kept = total[4];
+    }
+}
+
+/* print the idle thread time of every slave on the master: the wall time from the
+ * first batch to the end times the number of threads, minus the compute time */
+static void report_idle(int rank, int nprocs, int nb_threads, double wall, const double *busy) {
+    double local[3] = {nb_threads, wall, 0};
+    for (int t = 0; t < nb_threads; t++)
+        local[2] += busy[t];
+    char name[MPI_MAX_PROCESSOR_NAME] = {0};
+    int len;
+    MPI_Get_processor_name(name, &len);
+
+    double *all = NULL;
+    char *names = NULL;
+    if (rank == 0) {
+        all = malloc(sizeof(double) * 3 * nprocs);
+        names = malloc(MPI_MAX_PROCESSOR_NAME * nprocs);
+    }
+    MPI_Gather(local, 3, MPI_DOUBLE, all, 3, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    MPI_Gather(name, MPI_MAX_PROCESSOR_NAME, MPI_CHAR, names, MPI_MAX_PROCESSOR_NAME, MPI_CHAR, 0, MPI_COMM_WORLD);
+    if (rank == 0) {
+        for (int p = 1; p < nprocs; p++) {
+            double threads = all[3*p], thread_time = all[3*p] * all[3*p+1], busy_time = all[3*p+2];
+            double idle = (thread_time > busy_time) ? thread_time - busy_time : 0;
+            printf("Rank %d (%s): %d threads, busy %.3f s, idle %.3f s (%.1f%%)\n",
+                   p, names + (size_t)p * MPI_MAX_PROCESSOR_NAME, (int)threads, busy_time, idle,
+                   (thread_time > 0) ? 100.0 * idle / thread_time : 0.0);
+        }
+        free(all);
+        free(names);
+    }
+}
+
+/* send the pairs first, ..., first+batch-1 to dest: with --shared only the first
+ * pair and the number of pairs, otherwise every distinct series once and the
+ * indices of the pairs (assets/series_batch.h). Returns the size of the message. */
+static size_t send_batch(SeriesBatchBuilder *builder, int dest, int (*tasks)[2], int first, int batch,
+                         double **s, int *lengths, int use_shared) {
+    if (use_shared) {
+        int range[3] = {tasks[first][0], tasks[first][1], batch};
+        MPI_Send(range, 3, MPI_INT, dest, WORKTAG, MPI_COMM_WORLD);
+        return sizeof(range);
+    }
+
+    size_t bytes = series_batch_packed_size(builder, tasks, first, batch, lengths);
+    char *buf = malloc(bytes);
+    size_t pos = series_batch_pack(builder, buf, tasks, first, batch, s, lengths);
+
+    MPI_Send(buf, pos, MPI_BYTE, dest, WORKTAG, MPI_COMM_WORLD);
+    free(buf);
+    return pos;
+}
+
+/* put the results of the pairs first, ..., first+count-1 of tasks in the sink, one
+ * run of consecutive pairs of the upper triangle at a time, and in the checkpoint
+ * if not NULL */
+static void sink_batch(ResultSink *sink, RunCheckpoint *checkpoint, int (*tasks)[2], int first,
+                       const float *values, int count, int num_series) {
+    int i = 0;
+    while (i < count) {
+        int run = 1;
+        while (i + run < count && tasks[first + i + run][0] == tasks[first + i][0] &&
+               tasks[first + i + run][1] == tasks[first + i][1] + run) {
+            run++;
+        }
+        idx_t index = result_matrix_pair_index(tasks[first + i][0], tasks[first + i][1], num_series);
+        if (result_sink_put(sink, index, values + i, run) != 0 ||
+            (checkpoint && run_checkpoint_put(checkpoint, index, values + i, run) != 0)) {
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        i += run;
+    }
+}
+
+/* --cache: put the cached pairs of tasks in the sink and keep the other tasks, in
+ * their order; returns the number of tasks left */
+static int take_cached_pairs(ResultCache *cache, const uint64_t *keys, uint64_t cache_settings, ResultSink *sink,
+                             int (*tasks)[2], int total_tasks, int num_series) {
+    int (*hits)[2] = malloc(sizeof(int[2]) * (total_tasks + 1));
+    float *values = malloc(sizeof(float) * (total_tasks + 1));
+    if (!hits || !values) {
+        fprintf(stderr, "MASTER: cannot alloc cached pairs\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    int nb_hits = 0, kept = 0;
+    for (int t = 0; t < total_tasks; t++) {
+        double value;
+        if (result_cache_get(cache, keys[tasks[t][0]], keys[tasks[t][1]], cache_settings, &value)) {
+            hits[nb_hits][0] = tasks[t][0];
+            hits[nb_hits][1] = tasks[t][1];
+            values[nb_hits++] = (float)value;
+        } else {
+            tasks[kept][0] = tasks[t][0];
+            tasks[kept][1] = tasks[t][1];
+            kept++;
+        }
+    }
+    sink_batch(sink, NULL, hits, 0, values, nb_hits, num_series);
+    free(hits);
+    free(values);
+    return kept;
+}
+
+/* --checkpoint: keep the tasks of the pairs that are not done, in their order;
+ * returns the number of tasks left */
+static int take_restored_pairs(const bool *done, int (*tasks)[2], int total_tasks, int num_series) {
+    int kept = 0;
+    for (int t = 0; t < total_tasks; t++) {
+        if (!done[result_matrix_pair_index(tasks[t][0], tasks[t][1], num_series)]) {
+            tasks[kept][0] = tasks[t][0];
+            tasks[kept][1] = tasks[t][1];
+            kept++;
+        }
+    }
+    return kept;
+}
+
+/* --shared: a batch is only its first pair, it ends where --cache left a gap in
+ * the upper triangle */
+static int shared_batch(int (*tasks)[2], int first, int batch, int num_series, int use_shared) {
+    int run = 1;
+    if (!use_shared) return batch;
+    while (run < batch) {
+        int r = tasks[first + run - 1][0], c = tasks[first + run - 1][1] + 1;
+        if (c == num_series) {
+            r++;
+            c = r + 1;
+        }
+        if (tasks[first + run][0] != r || tasks[first + run][1] != c) break;
+        run++;
+    }
+    return run;
+}
+
+/* --max-dist: envelope of one series, with a radius for all pairs of the slave or of the batch */
+static void envelope_build(DTWEnvelope *env, double *series, idx_t length, idx_t radius) {
+    if (!dtw_envelope_init(env, series, length, radius)) {
+        fprintf(stderr, "SLAVE: envelopes OOM\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+}
+
+static SlaveSeries slave_series_init(int use_shared, SharedSeries *shared, int use_f32, double max_dist,
+                                     DTWSettings *settings) {
+    SlaveSeries src = {use_shared, shared, max_dist > 0 && !use_f32, use_f32, NULL, NULL, settings};
+    if (!use_shared) {
+        return src;
+    }
+    if (src.use_envs) {
+        /* one envelope per shared series, the radius is the one of the shortest and the
+         * longest series, as in dtw_distances_ptrs_parallel_pruned */
+        idx_t lmin = 0, lmax = 0;
+        for (int k = 0; k < shared->num_series; k++) {
+            lmin = k == 0 ? shared->lengths[k] : MIN(lmin, shared->lengths[k]);
+            lmax = MAX(lmax, shared->lengths[k]);
+        }
+        idx_t radius = dtw_envelope_radius(lmin, lmax, settings);
+        src.shared_envs = malloc(sizeof(DTWEnvelope) * (shared->num_series + 1));
+        if (!src.shared_envs) { fprintf(stderr, "SLAVE: envelopes OOM\n"); MPI_Abort(MPI_COMM_WORLD, 1); }
+        for (int k = 0; k < shared->num_series; k++) {
+            envelope_build(&src.shared_envs[k], shared->ptrs[k], shared->lengths[k], radius);
+        }
+    }
+    if (use_f32) {
+        src.shared_f32 = malloc(sizeof(float *) * (shared->num_series + 1));
+        if (!src.shared_f32) { fprintf(stderr, "SLAVE: f32 OOM\n"); MPI_Abort(MPI_COMM_WORLD, 1); }
+        for (int k = 0; k < shared->num_series; k++) {
+            src.shared_f32[k] = malloc(sizeof(float) * (shared->lengths[k] + 1));
+            if (!src.shared_f32[k]) { fprintf(stderr, "SLAVE: f32 OOM\n"); MPI_Abort(MPI_COMM_WORLD, 1); }
+            dtw_seq_to_f32(shared->ptrs[k], shared->lengths[k], src.shared_f32[k]);
+        }
+    }
+    return src;
+}
+
+static void slave_series_free(SlaveSeries *src) {
+    if (src->shared_envs) {
+        for (int k = 0; k < src->shared->num_series; k++)
+            dtw_envelope_free(&src->shared_envs[k]);
+        free(src->shared_envs);
+    }
+    if (src->shared_f32) {
+        for (int k = 0; k < src->shared->num_series; k++)
+            free(src->shared_f32[k]);
+        free(src->shared_f32);
+    }
+}
+
+/* receive the batch announced by status and group its tasks per row series. With
+ * --max-dist the tasks get the envelopes of their series and with --f32 their
+ * single-precision copies: the ones of the rank with --shared, otherwise the ones of
+ * the distinct series of the batch, made here. */
+static void recv_batch(Batch *b, MPI_Status *status, SlaveSeries *src) {
+    SharedSeries *shared = src->shared;
+    int use_envs = src->use_envs;
+    b->buf = NULL;
+    b->f32 = NULL;
+    b->envs = NULL;
+    b->nb_envs = 0;
+    b->row_envs = NULL;
+    b->col_envs = NULL;
+    if (src->use_shared) {
+        /* pairs (r, c), (r, c+1), ... of the upper triangle, pointers into
+         * the shared series of the node */
+        int range[3];
+        MPI_Recv(range, 3, MPI_INT, 0, WORKTAG, MPI_COMM_WORLD, status);
+        int r = range[0], c = range[1];
+        b->batch = range[2];
+        b->tasks = malloc(sizeof(Task) * b->batch);
+        if (use_envs) {
+            b->row_envs = malloc(sizeof(DTWEnvelope) * b->batch);
+            b->col_envs = malloc(sizeof(DTWEnvelope) * b->batch);
+        }
+        for (int k = 0; k < b->batch; k++) {
+            if (use_envs) {
+                b->row_envs[k] = src->shared_envs[r];
+                b->col_envs[k] = src->shared_envs[c];
+            }
+            b->tasks[k].r32 = src->use_f32 ? src->shared_f32[r] : NULL;
+            b->tasks[k].c32 = src->use_f32 ? src->shared_f32[c] : NULL;
+            b->tasks[k].len_r = shared->lengths[r];
+            b->tasks[k].r = shared->ptrs[r];
+            b->tasks[k].len_c = shared->lengths[c];
+            b->tasks[k].c = shared->ptrs[c];
+            if (++c == shared->num_series) {
+                r++;
+                c = r + 1;
+            }
+        }
+    } else {
+        int count;
+        MPI_Get_count(status, MPI_BYTE, &count);
+
+        /* aligned, the series are used in place */
+        void *buf = NULL;
+        if (posix_memalign(&buf, SERIES_BATCH_ALIGN, count > 0 ? count : 1) != 0) {
+            fprintf(stderr, "SLAVE: batch buffer OOM\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        b->buf = buf;
+        MPI_Recv(b->buf, count, MPI_BYTE, 0, WORKTAG, MPI_COMM_WORLD, status);
+
+        SeriesBatchView view;
+        if (series_batch_view(b->buf, count, &view) != 0) {
+            fprintf(stderr, "SLAVE: malformed batch\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        b->batch = view.nb_pairs;
+        b->tasks = malloc(sizeof(Task) * b->batch);
+
+        for (int k = 0; k < b->batch; k++) {
+            b->tasks[k].r = series_batch_series(&view, k, 0, &b->tasks[k].len_r);
+            b->tasks[k].c = series_batch_series(&view, k, 1, &b->tasks[k].len_c);
+            b->tasks[k].r32 = NULL;
+            b->tasks[k].c32 = NULL;
+        }
+
+        if (src->use_f32) {
+            /* one single-precision copy per distinct series, next to each other */
+            size_t total = 0;
+            for (int i = 0; i < view.nb_series; i++)
+                total += view.lengths[i];
+            b->f32 = malloc(sizeof(float) * (total + 1));
+            size_t *first32 = malloc(sizeof(size_t) * (view.nb_series + 1));
+            if (!b->f32 || !first32) { fprintf(stderr, "SLAVE: f32 OOM\n"); MPI_Abort(MPI_COMM_WORLD, 1); }
+            total = 0;
+            for (int i = 0; i < view.nb_series; i++) {
+                int length;
+                double *series = series_batch_distinct(&view, i, &length);
+                dtw_seq_to_f32(series, (idx_t)length, b->f32 + total);
+                first32[i] = total;
+                total += length;
+            }
+            for (int k = 0; k < b->batch; k++) {
+                b->tasks[k].r32 = b->f32 + first32[view.pairs[2 * k]];
+                b->tasks[k].c32 = b->f32 + first32[view.pairs[2 * k + 1]];
+            }
+            free(first32);
+        }
+
+        if (use_envs) {
+            /* one envelope per distinct series, for all the pairs of the batch */
+            int lmin = 0, lmax = 0;
+            for (int i = 0; i < view.nb_series; i++) {
+                lmin = i == 0 ? view.lengths[i] : MIN(lmin, view.lengths[i]);
+                lmax = MAX(lmax, view.lengths[i]);
+            }
+            idx_t radius = dtw_envelope_radius((idx_t)lmin, (idx_t)lmax, src->settings);
+            b->envs = malloc(sizeof(DTWEnvelope) * (view.nb_series + 1));
+            b->row_envs = malloc(sizeof(DTWEnvelope) * b->batch);
+            b->col_envs = malloc(sizeof(DTWEnvelope) * b->batch);
+            for (int i = 0; i < view.nb_series; i++) {
+                int length;
+                double *series = series_batch_distinct(&view, i, &length);
+                envelope_build(&b->envs[i], series, (idx_t)length, radius);
+                b->nb_envs++;
+            }
+            for (int k = 0; k < b->batch; k++) {
+                b->row_envs[k] = b->envs[view.pairs[2 * k]];
+                b->col_envs[k] = b->envs[view.pairs[2 * k + 1]];
+            }
+        }
+    }
+
+    /* Tasks are consecutive upper-triangle pairs (in tiles without --shared), so
+     * most neighbours share their row series. Such runs are split in chunks of SIMD width and
+     * computed with dtw_distance_batch_ws (one lane per pair). */
+    Task *tasks = b->tasks;
+    int lanes = dtw_simd_lanes();
+    b->cols = malloc(sizeof(double *) * b->batch);
+    b->col_lens = malloc(sizeof(idx_t) * b->batch);
+    b->dists = malloc(sizeof(double) * b->batch);
+    b->chunks = malloc(sizeof(RowChunk) * b->batch);
+    b->nb_chunks = 0;
+
+    for (int k = 0; k < b->batch; k++) {
+        b->cols[k] = tasks[k].c;
+        b->col_lens[k] = tasks[k].len_c;
+
+        int same_row = b->nb_chunks > 0
+            && b->chunks[b->nb_chunks-1].count < lanes
+            && tasks[k].len_r == tasks[k-1].len_r
+            && (tasks[k].r == tasks[k-1].r
+                || memcmp(tasks[k].r, tasks[k-1].r, sizeof(double) * tasks[k].len_r) == 0);
+        if (same_row) {
+            b->chunks[b->nb_chunks-1].count++;
+        } else {
+            b->chunks[b->nb_chunks].first = k;
+            b->chunks[b->nb_chunks].count = 1;
+            b->nb_chunks++;
+        }
+    }
+}
+
+/* compute the distances of row chunk k of the batch */
+static void compute_chunk(Batch *b, int k, int use_f32, double max_dist, DTWSettings *settings,
+                          DTWWorkspace *ws, DTWPruneStats *stats) {
+    Task *tasks = b->tasks;
+    RowChunk *chunk = &b->chunks[k];
+    int f = chunk->first;
+    if (use_f32) {
+        /* single precision: one dtw_distance_f32 per pair of the chunk, on the copies made in recv_batch */
+        for (int i = f; i < f + chunk->count; i++) {
+            b->dists[i] = dtw_distance_f32_ws(tasks[f].r32, tasks[f].len_r, tasks[i].c32, tasks[i].len_c, settings, ws);
+        }
+    } else if (max_dist > 0) {
+        /* LB_Kim -> LB_Keogh -> early-abandoning DTW, with the envelopes built in recv_batch */
+        dtw_distance_cascade_batch_ws(tasks[f].r, tasks[f].len_r, &b->row_envs[f],
+                                      &b->cols[f], &b->col_lens[f], &b->col_envs[f], chunk->count,
+                                      &b->dists[f], settings, ws, stats);
+    } else {
+        dtw_distance_batch_ws(tasks[f].r, tasks[f].len_r,
+                              &b->cols[f], &b->col_lens[f], chunk->count,
+                              &b->dists[f], settings, ws);
+    }
+}
+
+static void send_results(Batch *b) {
+    float *results = malloc(sizeof(float) * b->batch);
+    for (int k = 0; k < b->batch; k++)
+        results[k] = (float) b->dists[k];
+    MPI_Send(results, b->batch, MPI_FLOAT, 0, RESULTTAG, MPI_COMM_WORLD);
+    free(results);
+}
+
+static void batch_free(Batch *b) {
+    for (int i = 0; i < b->nb_envs; i++)
+        dtw_envelope_free(&b->envs[i]);
+    free(b->envs);
+    free(b->f32);
+    free(b->row_envs);
+    free(b->col_envs);
+    free(b->chunks);
+    free(b->dists);
+    free(b->col_lens);
+    free(b->cols);
+    free(b->tasks);
+    free(b->buf);
+    memset(b, 0, sizeof(Batch));
+}
+
+/* --hier, OpenMP thread 0 only: send the results of the finished batches (in the
+ * order of arrival) and receive the next batches without waiting for them */
+static void hier_poll(HierQueue *q, SlaveSeries *src, double *wall_start) {
+    while (1) {
+        /* the finished batch leaves the queue under the lock, it is sent and freed
+         * from a copy while the other threads read the queue */
+        int done;
+        Batch finished;
+        #pragma omp critical(hier_queue)
+        {
+            done = q->len > 0 && q->done_chunks[q->head] == q->batch[q->head].nb_chunks;
+            if (done) {
+                finished = q->batch[q->head];
+                memset(&q->batch[q->head], 0, sizeof(Batch));
+                q->head = (q->head + 1) % HIER_DEPTH;
+                q->len--;
+            }
+        }
+        if (!done) break;
+
+        send_results(&finished);
+        batch_free(&finished);
+    }
+
+    while (!q->killed && q->len < HIER_DEPTH) {
+        int flag;
+        MPI_Status status;
+        MPI_Iprobe(0, MPI_ANY_TAG, MPI_COMM_WORLD, &flag, &status);
+        if (!flag) break;
+
+        if (status.MPI_TAG == KILLTAG) {
+            MPI_Recv(NULL, 0, MPI_INT, 0, KILLTAG, MPI_COMM_WORLD, &status);
+            #pragma omp critical(hier_queue)
+            q->killed = 1;
+            break;
+        }
+        if (*wall_start < 0) *wall_start = MPI_Wtime();
+
+        /* the slot is only visible to the other threads after len++ */
+        int slot = (q->head + q->len) % HIER_DEPTH;
+        recv_batch(&q->batch[slot], &status, src);
+        #pragma omp critical(hier_queue)
+        {
+            q->next_chunk[slot] = 0;
+            q->done_chunks[slot] = 0;
+            q->len++;
+        }
+    }
+}
+
+/* --hier slave: the threads take row chunks from the local queue of batches, the
+ * next batch is already there when the current one runs out of chunks */
+static void hier_slave(SlaveSeries *src, int use_f32, double max_dist,
+                       DTWSettings *settings, DTWWorkspace *wss, DTWPruneStats *thread_stats,
+                       double *busy, double *wall_start) {
+    HierQueue q;
+    memset(&q, 0, sizeof(HierQueue));
+
+    #pragma omp parallel
+    {
+        int tid = omp_get_thread_num();
+        while (1) {
+            if (tid == 0)
+                hier_poll(&q, src, wall_start);
+
+            int slot = -1, k = -1, finished;
+            #pragma omp critical(hier_queue)
+            {
+                for (int i = 0; i < q.len && slot < 0; i++) {
+                    int j = (q.head + i) % HIER_DEPTH;
+                    if (q.next_chunk[j] < q.batch[j].nb_chunks) {
+                        slot = j;
+                        k = q.next_chunk[j]++;
+                    }
+                }
+                finished = (slot < 0 && q.killed && q.len == 0);
+            }
+
+            if (slot >= 0) {
+                double t0 = omp_get_wtime();
+                compute_chunk(&q.batch[slot], k, use_f32, max_dist, settings, &wss[tid], &thread_stats[tid]);
+                busy[tid] += omp_get_wtime() - t0;
+                #pragma omp critical(hier_queue)
+                q.done_chunks[slot]++;
+            } else if (finished) {
+                break;
+            } else {
+                sched_yield();
+            }
+        }
+    }
+}
+
 int main(int argc, char *argv[]) {
-    MPI_Init(&argc, &argv);
+    /* --hier: OpenMP thread 0 of the slaves calls MPI inside the parallel region */
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
 
     int rank, nprocs;
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
@@ -33,7 +587,7 @@ int main(int argc, char *argv[]) {
 
     if (argc < 5) {
         if (rank == 0)
-            printf("Usage: %s <csv> <max_assets> <batch_size> <output>\n", argv[0]);
+            printf("Usage: %s <csv> <max_assets> <batch_size> <output> [--f32] [--max-dist <value>] [--shared] [--hier] [--cache <cache_file>] [--checkpoint <file>] [--checkpoint-interval <seconds>]\n", argv[0]);
         MPI_Finalize();
         return 1;
     }
@@ -42,83 +596,164 @@ int main(int argc, char *argv[]) {
     int max_assets = atoi(argv[2]);
     int BATCH_SIZE = atoi(argv[3]);
     const char *result_file = argv[4];
+    int use_f32 = 0;
+    int use_shared = 0;
+    int use_hier = 0;
+    double max_dist = 0;
+    const char *cache_file = NULL;
+    const char *checkpoint_file = NULL;
+    double checkpoint_interval = RUN_CHECKPOINT_INTERVAL;
+    for (int a = 5; a < argc; a++) {
+        if (strcmp(argv[a], "--f32") == 0) use_f32 = 1;
+        else if (strcmp(argv[a], "--max-dist") == 0 && a + 1 < argc) max_dist = atof(argv[++a]);
+        else if (strcmp(argv[a], "--shared") == 0) use_shared = 1;
+        else if (strcmp(argv[a], "--hier") == 0) use_hier = 1;
+        else if (strcmp(argv[a], "--cache") == 0 && a + 1 < argc) cache_file = argv[++a];
+        else if (strcmp(argv[a], "--checkpoint") == 0 && a + 1 < argc) checkpoint_file = argv[++a];
+        else if (strcmp(argv[a], "--checkpoint-interval") == 0 && a + 1 < argc) checkpoint_interval = atof(argv[++a]);
+    }
+    if (use_hier && provided < MPI_THREAD_FUNNELED) {
+        if (rank == 0) fprintf(stderr, "--hier needs MPI_THREAD_FUNNELED\n");
+        MPI_Finalize();
+        return 1;
+    }
 
     DTWSettings settings = dtw_settings_default();
+    settings.max_dist = max_dist;
+    DTWPruneStats stats = dtw_prune_stats_empty();
 
     double start = MPI_Wtime();
 
-    /**************** MASTER ****************/
+    SeriesCollection collection;
+    series_collection_init(&collection);
     if (rank == 0) {
         printf("Max OpenMP threads = %d\n", omp_get_max_threads());
 
         printf("MASTER: loading CSV...\n");
-        TickerSeries *series = malloc(sizeof(TickerSeries) * max_assets);
-        int num_series = 0;
+        if (load_series_collection_from_file(csv_path, &collection, max_assets) != 0) {
+            fprintf(stderr, "MASTER: error loading CSV\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
 
-        load_series_from_csv(csv_path, series, &num_series, max_assets);
+    /* --shared: one copy of the series per node, the OpenMP threads and the
+     * ranks of a node read the same segment */
+    SharedSeries shared;
+    if (use_shared && series_shared_bcast(&collection, 0, MPI_COMM_WORLD, &shared) != 0) {
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    /**************** MASTER ****************/
+    if (rank == 0) {
+        int num_series = collection.num_series;
         
         double *s[num_series];
         int lengths[num_series];
 
         for (int i = 0; i < num_series; i++) {
-            s[i] = series[i].close;
-            lengths[i] = series[i].count;
+            s[i] = series_collection_series(&collection, i);
+            lengths[i] = collection.lengths[i];
         }
 
         int total_tasks = num_series * (num_series - 1) / 2;
 
-        int (*tasks)[2] = malloc(sizeof(int[2]) * total_tasks);
-        int t = 0;
-        for (int r = 0; r < num_series; r++)
-            for (int c = r + 1; c < num_series; c++)
-                tasks[t][0] = r, tasks[t][1] = c, t++;
+        int (*tasks)[2] = malloc(sizeof(int[2]) * (total_tasks + 1));
+        SeriesBatchBuilder builder;
+        if (!tasks || series_batch_builder_init(&builder, num_series) != 0) {
+            fprintf(stderr, "MASTER: cannot alloc tasks\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        if (use_shared) {
+            int t = 0;
+            for (int r = 0; r < num_series; r++)
+                for (int c = r + 1; c < num_series; c++)
+                    tasks[t][0] = r, tasks[t][1] = c, t++;
+        } else {
+            /* tiles of about BATCH_SIZE pairs, the pairs of a batch share their series */
+            series_batch_tile_order(num_series, (int)ceil(sqrt((double)BATCH_SIZE)), tasks);
+        }
+        /* bytes of the work messages, and of the same pairs with both series per pair */
+        double wire_bytes = 0, pairwise_bytes = 0;
+
+        /* results are written while they arrive (text, or a binary condensed matrix
+         * for a .dtwm output), out of order batches wait in the sink */
+        ResultSink sink;
+        if (result_sink_open(&sink, result_file, result_sink_format_of(result_file), &collection,
+                             num_series, max_dist) != 0) {
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        double sink_time = 0;
+        uint64_t cache_settings = result_cache_settings_key(&settings, use_f32 ? RESULT_CACHE_F32 : RESULT_CACHE_F64_AS_F32);
+
+        /* --checkpoint: the pairs of an earlier run go to the sink, only the others are sent */
+        RunCheckpoint checkpoint;
+        if (checkpoint_file) {
+            bool *done = calloc(sink.num_pairs + 1, sizeof(bool));
+            uint64_t key = run_checkpoint_key(&collection, num_series, cache_settings);
+            if (!done || run_checkpoint_open(&checkpoint, checkpoint_file, num_series, key, checkpoint_interval,
+                                             &sink, done) != 0) {
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            total_tasks = take_restored_pairs(done, tasks, total_tasks, num_series);
+            free(done);
+        }
 
-        float *result = calloc(total_tasks, sizeof(float));
+        /* --cache: the cached pairs go to the sink, only the others are sent */
+        ResultCache cache;
+        uint64_t keys[num_series + 1];
+        if (cache_file) {
+            if (result_cache_open(&cache, cache_file) != 0) MPI_Abort(MPI_COMM_WORLD, 1);
+            for (int i = 0; i < num_series; i++) keys[i] = series_hash(s[i], lengths[i]);
+            total_tasks = take_cached_pairs(&cache, keys, cache_settings, &sink, tasks, total_tasks, num_series);
+        }
 
-        int *last_send = malloc(sizeof(int) * nprocs);
-        for (int i = 0; i < nprocs; i++) last_send[i] = -1;
+        /* batches sent to every slave and not answered yet (first task and number
+         * of tasks), in the order they were sent. Without --hier at most one. */
+        int depth = use_hier ? HIER_DEPTH : 1;
+        int (*pending)[HIER_DEPTH][2] = malloc(sizeof(int[HIER_DEPTH][2]) * nprocs);
+        int *pending_head = calloc(nprocs, sizeof(int));
+        int *pending_len = calloc(nprocs, sizeof(int));
+
+        /* --hier: batches of about HIER_BATCH_SEC at the measured DTW cells per
+         * second of every slave, shrinking near the end. At least one SIMD
+         * width of pairs. */
+        BatchSchedule schedule;
+        if (batch_schedule_init(&schedule, nprocs, HIER_BATCH_SEC, BATCH_SIZE, dtw_simd_lanes(),
+                                total_tasks, tasks, total_tasks, lengths) != 0) {
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
 
         int next_task = 0;
+        int alive = nprocs - 1;
 
         // initial distribution
-        for (int p = 1; p < nprocs && next_task < total_tasks; p++) {
-            int batch = (total_tasks - next_task < BATCH_SIZE)
-                        ? (total_tasks - next_task) : BATCH_SIZE;
+        for (int d = 0; d < depth; d++) {
+            for (int p = 1; p < nprocs && next_task < total_tasks; p++) {
+                int batch = (total_tasks - next_task < BATCH_SIZE)
+                            ? (total_tasks - next_task) : BATCH_SIZE;
+                batch = shared_batch(tasks, next_task, batch, num_series, use_shared);
 
-            size_t bytes = sizeof(int); // batch header
+                wire_bytes += send_batch(&builder, p, tasks, next_task, batch, s, lengths, use_shared);
+                pairwise_bytes += series_batch_pairwise_size(tasks, next_task, batch, lengths);
 
-            for (int b = 0; b < batch; b++) {
-                int r = tasks[next_task + b][0];
-                int c = tasks[next_task + b][1];
-                bytes += sizeof(int) + lengths[r]*sizeof(double);
-                bytes += sizeof(int) + lengths[c]*sizeof(double);
+                int slot = (pending_head[p] + pending_len[p]++) % HIER_DEPTH;
+                pending[p][slot][0] = next_task;
+                pending[p][slot][1] = batch;
+                batch_schedule_sent(&schedule, p, batch,
+                                    batch_schedule_cells(tasks, next_task, batch, lengths), MPI_Wtime());
+                next_task += batch;
             }
+        }
 
-            char *buf = malloc(bytes);
-            size_t pos = 0;
-
-            memcpy(buf + pos, &batch, sizeof(int)); pos += sizeof(int);
-
-            for (int b = 0; b < batch; b++) {
-                int r = tasks[next_task + b][0];
-                int c = tasks[next_task + b][1];
-
-                memcpy(buf+pos, &lengths[r], sizeof(int)); pos += sizeof(int);
-                memcpy(buf+pos, s[r], lengths[r]*sizeof(double)); pos += lengths[r]*sizeof(double);
-
-                memcpy(buf+pos, &lengths[c], sizeof(int)); pos += sizeof(int);
-                memcpy(buf+pos, s[c], lengths[c]*sizeof(double)); pos += lengths[c]*sizeof(double);
+        // slaves without work
+        for (int p = 1; p < nprocs; p++) {
+            if (pending_len[p] == 0) {
+                MPI_Send(NULL, 0, MPI_INT, p, KILLTAG, MPI_COMM_WORLD);
+                alive--;
             }
-
-            MPI_Send(buf, pos, MPI_BYTE, p, WORKTAG, MPI_COMM_WORLD);
-
-            last_send[p] = next_task;
-            next_task += batch;
-            free(buf);
         }
 
         MPI_Status status;
-        int alive = nprocs - 1;
 
         while (alive > 0) {
             MPI_Probe(MPI_ANY_SOURCE, RESULTTAG, MPI_COMM_WORLD, &status);
@@ -130,142 +765,169 @@ int main(int argc, char *argv[]) {
             float *res = malloc(sizeof(float)*count);
             MPI_Recv(res, count, MPI_FLOAT, src, RESULTTAG, MPI_COMM_WORLD, &status);
 
-            int start_idx = last_send[src];
-            for (int i = 0; i < count; i++)
-                result[start_idx + i] = res[i];
+            int start_idx = pending[src][pending_head[src]][0];
+            int expected = pending[src][pending_head[src]][1];
+            pending_head[src] = (pending_head[src] + 1) % HIER_DEPTH;
+            pending_len[src]--;
+            if (count != expected) {
+                fprintf(stderr, "MASTER: %d results from %d for a batch of %d pairs\n", count, src, expected);
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            double sink_start = MPI_Wtime();
+            sink_batch(&sink, checkpoint_file ? &checkpoint : NULL, tasks, start_idx, res, count, num_series);
+            sink_time += MPI_Wtime() - sink_start;
+            for (int i = 0; cache_file && i < count; i++) {
+                result_cache_put(&cache, keys[tasks[start_idx + i][0]], keys[tasks[start_idx + i][1]],
+                                 cache_settings, res[i]);
+            }
 
             free(res);
 
+            batch_schedule_done(&schedule, src, batch_schedule_cells(tasks, start_idx, count, lengths), MPI_Wtime());
+
             if (next_task < total_tasks) {
-                int batch = (total_tasks - next_task < BATCH_SIZE)
+                int batch;
+                if (use_hier) {
+                    batch = batch_schedule_next(&schedule, src, tasks, next_task, total_tasks, lengths);
+                } else {
+                    batch = (total_tasks - next_task < BATCH_SIZE)
                             ? (total_tasks - next_task) : BATCH_SIZE;
-
-                size_t bytes = sizeof(int);
-                for (int b = 0; b < batch; b++) {
-                    int r = tasks[next_task + b][0];
-                    int c = tasks[next_task + b][1];
-                    bytes += sizeof(int) + lengths[r]*sizeof(double);
-                    bytes += sizeof(int) + lengths[c]*sizeof(double);
-                }
-
-                char *buf = malloc(bytes);
-                size_t pos = 0;
-
-                memcpy(buf+pos, &batch, sizeof(int)); pos += sizeof(int);
-
-                for (int b = 0; b < batch; b++) {
-                    int r = tasks[next_task + b][0];
-                    int c = tasks[next_task + b][1];
-
-                    memcpy(buf+pos, &lengths[r], sizeof(int)); pos += sizeof(int);
-                    memcpy(buf+pos, s[r], lengths[r]*sizeof(double)); pos += lengths[r]*sizeof(double);
-
-                    memcpy(buf+pos, &lengths[c], sizeof(int)); pos += sizeof(int);
-                    memcpy(buf+pos, s[c], lengths[c]*sizeof(double)); pos += lengths[c]*sizeof(double);
                 }
+                batch = shared_batch(tasks, next_task, batch, num_series, use_shared);
 
-                MPI_Send(buf, pos, MPI_BYTE, src, WORKTAG, MPI_COMM_WORLD);
+                wire_bytes += send_batch(&builder, src, tasks, next_task, batch, s, lengths, use_shared);
+                pairwise_bytes += series_batch_pairwise_size(tasks, next_task, batch, lengths);
 
-                last_send[src] = next_task;
+                int slot = (pending_head[src] + pending_len[src]++) % HIER_DEPTH;
+                pending[src][slot][0] = next_task;
+                pending[src][slot][1] = batch;
+                batch_schedule_sent(&schedule, src, batch,
+                                    batch_schedule_cells(tasks, next_task, batch, lengths), MPI_Wtime());
                 next_task += batch;
-
-                free(buf);
-            } else {
+            } else if (pending_len[src] == 0) {
                 MPI_Send(NULL, 0, MPI_INT, src, KILLTAG, MPI_COMM_WORLD);
                 alive--;
             }
         }
 
-        printf("Time: %f sec\n", MPI_Wtime() - start);
+        double run_time = MPI_Wtime() - start;
+        printf("Time: %f sec\n", run_time);
+        printf("Batches: %d, %d to %d pairs per batch\n", schedule.nb_batches, schedule.smallest, schedule.largest);
+        printf("Wire: %.3f MB for %d pairs (%.2f pairs/KB), with both series per pair %.3f MB (%.2f pairs/KB)\n",
+               wire_bytes / 1e6, total_tasks, (wire_bytes > 0) ? total_tasks / (wire_bytes / 1e3) : 0.0,
+               pairwise_bytes / 1e6, (pairwise_bytes > 0) ? total_tasks / (pairwise_bytes / 1e3) : 0.0);
 
-        /* Save results to file (ticker names) */
-        FILE *fp = fopen(result_file, "w");
-        if (!fp) { fprintf(stderr, "MASTER: cannot open output file\n"); }
-        int idx = 0;
-        for (int r = 0; r < num_series; r++) {
-            for (int c = r + 1; c < num_series; c++) {
-                fprintf(fp, "%s;%s;%.6f\n", series[r].ticker, series[c].ticker, result[idx++]);
-            }
+        report_idle(rank, nprocs, 0, 0, NULL);
+
+        if (max_dist > 0) {
+            reduce_prune_stats(&stats, rank);
+            if (stats.pairs > 0) dtw_print_prune_stats(&stats);
+        }
+
+        /* the results are already written, only the buffered tail is left */
+        double close_start = MPI_Wtime();
+        result_sink_print_stats(&sink);
+        if (result_sink_close(&sink) != 0) {
+            fprintf(stderr, "MASTER: cannot write %s\n", result_file);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        printf("Result write: %f s during the run, %f s after it\n", sink_time, MPI_Wtime() - close_start);
+        if (checkpoint_file) {
+            /* the result is complete, a restart is no longer needed */
+            run_checkpoint_print_stats(&checkpoint, run_time);
+            run_checkpoint_close(&checkpoint, checkpoint_file, true);
+        }
+        if (cache_file) {
+            result_cache_print_stats(&cache, sink.num_pairs);
+            if (result_cache_close(&cache) != 0) fprintf(stderr, "MASTER: cannot write cache %s\n", cache_file);
         }
-        if (fp) fclose(fp);
 
         printf("MASTER: Done. Results saved to %s\n", result_file);
 
-        free(result);
-        free(last_send);
+        batch_schedule_free(&schedule);
+        free(pending_len);
+        free(pending_head);
+        free(pending);
+        series_batch_builder_free(&builder);
         free(tasks);
-        free(series);
     }
 
     /**************** SLAVE ****************/
     else {
         MPI_Status status;
 
-        while (1) {
-            MPI_Probe(0, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
-
-            if (status.MPI_TAG == KILLTAG) {
-                MPI_Recv(NULL, 0, MPI_INT, 0, KILLTAG, MPI_COMM_WORLD, &status);
-                break;
-            }
-
-            int count;
-            MPI_Get_count(&status, MPI_BYTE, &count);
-
-            char *buf = malloc(count);
-            MPI_Recv(buf, count, MPI_BYTE, 0, WORKTAG, MPI_COMM_WORLD, &status);
-
-            size_t pos = 0;
-            int batch;
-            memcpy(&batch, buf+pos, sizeof(int)); pos += sizeof(int);
-            Task *tasks = malloc(sizeof(Task) * batch);
-
-            for (int b = 0; b < batch; b++) {
-                int len_r;
-                memcpy(&len_r, buf + pos, sizeof(int));
-                pos += sizeof(int);
-
-                double *r = (double *)(buf + pos);  // 👈 pointer INTO buffer
-                pos += sizeof(double) * len_r;
+        /* one DTW workspace per OpenMP thread, reused over all batches */
+        int nb_threads = omp_get_max_threads();
+        DTWWorkspace *wss = malloc(sizeof(DTWWorkspace) * nb_threads);
+        DTWPruneStats *thread_stats = malloc(sizeof(DTWPruneStats) * nb_threads);
+        double *busy = calloc(nb_threads, sizeof(double));
+        for (int t = 0; t < nb_threads; t++) {
+            wss[t] = dtw_workspace_empty();
+            thread_stats[t] = dtw_prune_stats_empty();
+        }
+        double wall_start = -1;
 
-                int len_c;
-                memcpy(&len_c, buf + pos, sizeof(int));
-                pos += sizeof(int);
+        /* --shared: the envelopes and the single-precision copies of all series are made once per rank */
+        SlaveSeries src = slave_series_init(use_shared, &shared, use_f32, max_dist, &settings);
 
-                double *c = (double *)(buf + pos);  // 👈 pointer INTO buffer
-                pos += sizeof(double) * len_c;
+        if (use_hier) {
+            hier_slave(&src, use_f32, max_dist, &settings,
+                       wss, thread_stats, busy, &wall_start);
+        } else {
+            while (1) {
+                MPI_Probe(0, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
 
-                tasks[b].len_r = len_r;
-                tasks[b].r = r;
-                tasks[b].len_c = len_c;
-                tasks[b].c = c;
-            }
+                if (status.MPI_TAG == KILLTAG) {
+                    MPI_Recv(NULL, 0, MPI_INT, 0, KILLTAG, MPI_COMM_WORLD, &status);
+                    break;
+                }
+                if (wall_start < 0) wall_start = MPI_Wtime();
+
+                /* -------------------------------
+                * STEP 1-2: receive, group tasks per row series
+                * ------------------------------- */
+                Batch b;
+                recv_batch(&b, &status, &src);
+
+                /* -------------------------------
+                * STEP 3: parallel compute
+                * ------------------------------- */
+                #pragma omp parallel for schedule(dynamic)
+                for (int k = 0; k < b.nb_chunks; k++) {
+                    int tid = omp_get_thread_num();
+                    double t0 = omp_get_wtime();
+                    compute_chunk(&b, k, use_f32, max_dist, &settings, &wss[tid], &thread_stats[tid]);
+                    busy[tid] += omp_get_wtime() - t0;
+                }
 
-            /* -------------------------------
-            * STEP 2: parallel compute
-            * ------------------------------- */
-            float *results = malloc(sizeof(float) * batch);
-
-            #pragma omp parallel for schedule(dynamic)
-            for (int b = 0; b < batch; b++) {
-                results[b] = (float) dtw_distance(
-                    tasks[b].r, tasks[b].len_r,
-                    tasks[b].c, tasks[b].len_c,
-                    &settings
-                );
+                /* -------------------------------
+                * SEND BACK
+                * ------------------------------- */
+                send_results(&b);
+                batch_free(&b);
             }
+        }
 
-            /* -------------------------------
-            * SEND BACK
-            * ------------------------------- */
-            MPI_Send(results, batch, MPI_FLOAT, 0, RESULTTAG, MPI_COMM_WORLD);
+        report_idle(rank, nprocs, nb_threads, (wall_start < 0) ? 0 : MPI_Wtime() - wall_start, busy);
+        slave_series_free(&src);
 
-            free(results);
-            free(tasks);
-            free(buf);
+        for (int t = 0; t < nb_threads; t++) {
+            dtw_workspace_free(&wss[t]);
+            dtw_prune_stats_add(&stats, &thread_stats[t]);
+        }
+        free(busy);
+        free(thread_stats);
+        free(wss);
+        if (max_dist > 0) {
+            reduce_prune_stats(&stats, rank);
         }
     }
 
+    if (use_shared) {
+        series_shared_free(&shared);
+    }
+    series_collection_free(&collection);
+
     MPI_Finalize();
     return 0;
-}
\ No newline at end of file
+}
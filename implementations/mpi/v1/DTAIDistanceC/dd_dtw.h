@@ -120,6 +120,20 @@ struct DTWWps_s {
 };
 typedef struct DTWWps_s DTWWps;
 
+/**
+ Reusable memory for the functions with a _ws suffix. Create one workspace per
+ thread and pass it to every call, the buffer only grows when a call needs more
+ memory than any call before (e.g. a longer series).
+
+ @field buffer Memory shared by the calls, content is not preserved between calls
+ @field size Size of buffer in bytes
+ */
+struct DTWWorkspace_s {
+    void *buffer;
+    size_t size;
+};
+typedef struct DTWWorkspace_s DTWWorkspace;
+
 
 // Settings
 DTWSettings dtw_settings_default(void);
@@ -128,6 +142,11 @@ idx_t       dtw_settings_wps_width(idx_t l1, idx_t l2, DTWSettings *settings);
 void        dtw_settings_set_psi(idx_t psi, DTWSettings *settings);
 void        dtw_settings_print(DTWSettings *settings);
 
+// Workspace
+DTWWorkspace dtw_workspace_empty(void);
+void *       dtw_workspace_reserve(DTWWorkspace *ws, size_t size);
+void         dtw_workspace_free(DTWWorkspace *ws);
+
 // DTW
 typedef seq_t (*DTWFnPtr)(seq_t *s1, idx_t l1, seq_t *s2, idx_t l2, DTWSettings *settings);
 
@@ -135,9 +154,22 @@ seq_t dtw_distance(seq_t *s1, idx_t l1, seq_t *s2, idx_t l2, DTWSettings *settin
 seq_t dtw_distance_ndim(seq_t *s1, idx_t l1, seq_t *s2, idx_t l2, int ndim, DTWSettings *settings);
 seq_t dtw_distance_euclidean(seq_t *s1, idx_t l1, seq_t *s2, idx_t l2, DTWSettings *settings);
 seq_t dtw_distance_ndim_euclidean(seq_t *s1, idx_t l1, seq_t *s2, idx_t l2, int ndim, DTWSettings *settings);
+seq_t dtw_distance_ws(seq_t *s1, idx_t l1, seq_t *s2, idx_t l2, DTWSettings *settings, DTWWorkspace *ws);
+seq_t dtw_distance_ndim_ws(seq_t *s1, idx_t l1, seq_t *s2, idx_t l2, int ndim, DTWSettings *settings, DTWWorkspace *ws);
+seq_t dtw_distance_euclidean_ws(seq_t *s1, idx_t l1, seq_t *s2, idx_t l2, DTWSettings *settings, DTWWorkspace *ws);
+seq_t dtw_distance_ndim_euclidean_ws(seq_t *s1, idx_t l1, seq_t *s2, idx_t l2, int ndim, DTWSettings *settings, DTWWorkspace *ws);
+
+typedef seq_t (*DTWWsFnPtr)(seq_t *s1, idx_t l1, seq_t *s2, idx_t l2, DTWSettings *settings, DTWWorkspace *ws);
+
+seq_t dtw_distance_full_ws(seq_t *s1, idx_t l1, seq_t *s2, idx_t l2, DTWSettings *settings, DTWWorkspace *ws);
+seq_t dtw_distance_banded_ws(seq_t *s1, idx_t l1, seq_t *s2, idx_t l2, DTWSettings *settings, DTWWorkspace *ws);
+seq_t dtw_distance_euclidean_full_ws(seq_t *s1, idx_t l1, seq_t *s2, idx_t l2, DTWSettings *settings, DTWWorkspace *ws);
+seq_t dtw_distance_euclidean_banded_ws(seq_t *s1, idx_t l1, seq_t *s2, idx_t l2, DTWSettings *settings, DTWWorkspace *ws);
+DTWWsFnPtr dtw_distance_kernel(DTWSettings *settings);
 
 // WPS
 seq_t dtw_warping_paths(seq_t *wps, seq_t *s1, idx_t l1, seq_t *s2, idx_t l2, bool return_dtw, bool keep_int_repr, bool psi_neg, DTWSettings *settings);
+seq_t dtw_warping_paths_ws(seq_t **wps, seq_t *s1, idx_t l1, seq_t *s2, idx_t l2, bool return_dtw, bool keep_int_repr, bool psi_neg, DTWSettings *settings, DTWWorkspace *ws);
 seq_t dtw_warping_paths_ndim(seq_t *wps, seq_t *s1, idx_t l1, seq_t *s2, idx_t l2, bool return_dtw, bool keep_int_repr, bool psi_neg, int ndim, DTWSettings *settings);
 seq_t dtw_warping_paths_euclidean(seq_t *wps, seq_t *s1, idx_t l1, seq_t *s2, idx_t l2, bool return_dtw, bool keep_int_repr, bool psi_neg, DTWSettings *settings);
 seq_t dtw_warping_paths_ndim_euclidean(seq_t *wps, seq_t *s1, idx_t l1, seq_t *s2, idx_t l2, bool return_dtw, bool keep_int_repr, bool psi_neg, int ndim, DTWSettings *settings);
@@ -197,6 +229,7 @@ idx_t dtw_distances_ndim_matrices(seq_t *matrix_r, idx_t nb_rows_r, idx_t nb_col
                                   seq_t *matrix_c, idx_t nb_rows_c, idx_t nb_cols_c, int ndim,
                                   seq_t* output, DTWBlock* block, DTWSettings* settings);
 idx_t dtw_distances_length(DTWBlock *block, idx_t nb_series_r, idx_t nb_series_c);
+idx_t dtw_distances_partition(idx_t *lengths, idx_t nb_series, idx_t nb_parts, idx_t *bounds);
 
 // DBA
 void dtw_dba_ptrs(seq_t **ptrs, idx_t nb_ptrs, idx_t* lengths,
@@ -0,0 +1,81 @@
+/*!
+@header dtw_knn.h
+@brief DTAIDistance.dtw : k nearest and k farthest neighbours with DTW
+
+For every series, the k series with the smallest and the k series with the largest
+DTW distance are returned, the output is O(N * k) instead of the full distance matrix.
+
+Nearest neighbours: the other series are visited in increasing order of their lower
+bound (see dtw_lower_bound). Each query keeps a bounded max-heap of the k best
+distances. Once the heap is full, its top (the k-th best distance) is used as
+max_dist, such that DTW computations that cannot enter the heap are abandoned, and
+the search stops when the next lower bound exceeds the k-th best distance. The
+candidates are computed in groups of dtw_simd_lanes() pairs with dtw_distance_batch.
+
+Farthest neighbours: the same with a bounded min-heap, the Euclidean upper bound
+(see dtw_upper_bound) in decreasing order and the distances that were already
+computed for the nearest neighbours.
+
+DTW is symmetric, so the searches of all queries share a condensed cache of the
+N * (N - 1) / 2 pairs (8 bytes per pair). It holds the exact distances, which are
+used instead of computing d(j, q) again, and the thresholds at which a computation
+was abandoned, which are lower bounds of the pair for the nearest search of j.
+
+@copyright Apache License, Version 2.0, see LICENSE for details.
+*/
+
+#ifndef dtw_knn_h
+#define dtw_knn_h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <stdbool.h>
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+#include "dd_globals.h"
+#include "dd_dtw.h"
+#include "dd_dtw_prune.h"
+
+
+/**
+ A neighbour of a query series.
+
+ @field idx Index of the neighbour, nb_ptrs if there is no neighbour in this slot.
+ @field dist DTW distance to the neighbour.
+ */
+struct DTWNeighbour_s {
+    idx_t idx;
+    seq_t dist;
+};
+typedef struct DTWNeighbour_s DTWNeighbour;
+
+/**
+ Work done by the neighbour search.
+
+ @field pairs Number of (query, other series) pairs, for every search.
+ @field pruned_lb Nearest: pairs skipped because the lower bound exceeds the k-th best distance.
+ @field abandoned Nearest: DTW computations abandoned above the k-th best distance.
+ @field pruned_ub Farthest: pairs skipped because the upper bound is below the k-th largest distance.
+ @field reused Pairs for which the distance was in the cache (from the other query or the nearest search).
+ @field computed Number of DTW computations (including abandoned ones).
+ */
+struct DTWKnnStats_s {
+    idx_t pairs;
+    idx_t pruned_lb;
+    idx_t abandoned;
+    idx_t pruned_ub;
+    idx_t reused;
+    idx_t computed;
+};
+typedef struct DTWKnnStats_s DTWKnnStats;
+
+DTWKnnStats dtw_knn_stats_empty(void);
+void  dtw_print_knn_stats(DTWKnnStats *stats);
+idx_t dtw_knn_ptrs_parallel(seq_t **ptrs, idx_t nb_ptrs, idx_t *lengths, idx_t k,
+                            DTWNeighbour *nearest, DTWNeighbour *farthest,
+                            DTWSettings *settings, DTWKnnStats *stats);
+
+#endif /* dtw_knn_h */
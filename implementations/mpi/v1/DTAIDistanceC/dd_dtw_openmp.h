@@ -16,12 +16,48 @@
 #endif
 
 #include "dd_dtw.h"
+#include "dd_dtw_prune.h"
+
+/**
+ Work done by dtw_distances_ptrs_parallel_steal.
+
+ @field tasks Number of executed tasks.
+ @field splits Number of times a task was split in two.
+ @field steals Number of tasks taken from the deque of another thread.
+ @field total_time Wall time in seconds.
+ @field tail_time Time in seconds from the moment the first thread ran out of work
+    until all work was done.
+ */
+struct DTWStealStats_s {
+    idx_t tasks;
+    idx_t splits;
+    idx_t steals;
+    double total_time;
+    double tail_time;
+};
+typedef struct DTWStealStats_s DTWStealStats;
 
 bool is_openmp_supported(void);
 int    dtw_distances_prepare(DTWBlock *block, idx_t nb_series_r, idx_t nb_series_c, 
                              idx_t **cbs, idx_t **rls, idx_t *length, DTWSettings *settings);
 idx_t dtw_distances_ptrs_parallel(seq_t **ptrs, idx_t nb_ptrs, idx_t* lengths,
                                    seq_t* output, DTWBlock* block, DTWSettings* settings);
+idx_t dtw_distances_ptrs_parallel_d(seq_t **ptrs, idx_t nb_ptrs, idx_t* lengths,
+                                     seq_t* output, DTWBlock* block, DTWSettings* settings);
+idx_t dtw_distances_tile_size(idx_t nb_ptrs, idx_t *lengths, idx_t cache_size);
+idx_t dtw_distances_ptrs_parallel_tiled(seq_t **ptrs, idx_t nb_ptrs, idx_t* lengths,
+                                         seq_t* output, DTWBlock* block, DTWSettings* settings,
+                                         idx_t tile);
+DTWStealStats dtw_steal_stats_empty(void);
+void  dtw_print_steal_stats(DTWStealStats *stats);
+idx_t dtw_distances_ptrs_parallel_steal(seq_t **ptrs, idx_t nb_ptrs, idx_t* lengths,
+                                         seq_t* output, DTWBlock* block, DTWSettings* settings,
+                                         DTWStealStats* stats);
+idx_t dtw_distances_ptrs_parallel_pruned(seq_t **ptrs, idx_t nb_ptrs, idx_t* lengths,
+                                          seq_t* output, DTWBlock* block, DTWSettings* settings,
+                                          DTWPruneStats* stats);
+idx_t dtw_distances_ptrs_parallel_f32(seq32_t **ptrs, idx_t nb_ptrs, idx_t* lengths,
+                                       seq32_t* output, DTWBlock* block, DTWSettings* settings);
 idx_t dtw_distances_ndim_ptrs_parallel(seq_t **ptrs, idx_t nb_ptrs, idx_t* lengths, int ndim, seq_t* output,
                                         DTWBlock* block, DTWSettings* settings);
 idx_t dtw_distances_matrix_parallel(seq_t *matrix, idx_t nb_rows, idx_t nb_cols,
@@ -10,6 +10,13 @@ Use the Euclidean inner distance.
 {%- else %}{# inner_dist == "squaredeuclidean"  #}
 Use the Squared Euclidean inner distance.
 {%- endif %}
+{%- if window_kind %}
+
+Specialised for the settings without psi-relaxation, max_step, penalty and
+upper bound pruning{% if window_kind == "full" %}, and without a window (settings->window is ignored){% else %}, with a window{% endif %}.
+The branches for these options are removed from the inner loop. Use
+dtw_distance_kernel to select the variant for a DTWSettings struct.
+{%- endif %}
 
 @param s1 First sequence
 @param l1 Length of first sequence. {% if "ndim" in suffix %}In tuples, real length should be length*ndim.{% endif %}
@@ -19,6 +26,7 @@ Use the Squared Euclidean inner distance.
 @param ndim Number of dimensions
 {%- endif %}
 @param settings A DTWSettings struct with options for the DTW algorithm.
+@param ws Workspace that provides (and keeps) the memory for the cost matrix rows.
 */
 {%- if "ptrs" in suffix %}
 {%- set i="i" %}
@@ -32,18 +40,30 @@ Use the Squared Euclidean inner distance.
 {%- else %}
 {%- set suffix2="" %}
 {%- endif %}
-seq_t dtw_distance{{ suffix }}{{ suffix2 }}(seq_t *s1, idx_t l1,
+{%- if window_kind %}
+{%- set suffix2 = suffix2 ~ "_" ~ window_kind %}
+{%- endif %}
+seq_t dtw_distance{{ suffix }}{{ suffix2 }}_ws(seq_t *s1, idx_t l1,
                       seq_t *s2, idx_t l2, {% if "ndim" in suffix %}int ndim,{% endif %}
-                      DTWSettings *settings) {
-    {%- if inner_dist != "euclidean" %}
+                      DTWSettings *settings, DTWWorkspace *ws) {
+    {%- if inner_dist != "euclidean" and not window_kind %}
     if (settings->inner_dist == 1) {
-        return dtw_distance{{ suffix }}_euclidean(s1, l1, s2, l2, {% if "ndim" in suffix %}ndim, {% endif %} settings);
+        return dtw_distance{{ suffix }}_euclidean_ws(s1, l1, s2, l2, {% if "ndim" in suffix %}ndim, {% endif %} settings, ws);
+    }
+    {%- if "ndim" not in suffix %}
+    if (dtw_simd_level() != DTW_SIMD_NONE && dtw_simd_settings_supported(l1, l2, settings)) {
+        return dtw_distance_wavefront_ws(s1, l1, s2, l2, settings, ws);
     }
     {%- endif %}
+    {%- endif %}
+    {%- if not window_kind %}
     assert(settings->psi_1b <= l1 && settings->psi_1e <= l1 &&
            settings->psi_2b <= l2 && settings->psi_2e <= l2);
+    {%- endif %}
     idx_t ldiff;
+    {%- if window_kind != "full" %}
     idx_t dl;
+    {%- endif %}
     // DTWPruned
     idx_t sc = 0;
     idx_t ec = 0;
@@ -51,14 +71,21 @@ seq_t dtw_distance{{ suffix }}{{ suffix2 }}(seq_t *s1, idx_t l1,
     idx_t ec_next;
     // signal(SIGINT, dtw_int_handler); // not compatible with OMP
 
-    idx_t window = settings->window;
+{% if window_kind != "full" %}    idx_t window = settings->window;
+{% endif %}    {%- if not window_kind %}
     seq_t max_step = settings->max_step;
+    {%- endif %}
     seq_t max_dist = settings->max_dist;
+    {%- if not window_kind %}
     seq_t penalty = settings->penalty;
+    {%- endif %}
 
     #ifdef DTWDEBUG
     printf("r=%zu, c=%zu\n", l1, l2);
     #endif
+    {%- if window_kind %}
+    if (max_dist == 0) {
+    {%- else %}
     if (settings->use_pruning || settings->only_ub) {
         {%- if "ndim" in suffix %}
         max_dist = ub_euclidean_ndim{{ suffix2 }}(s1, l1, s2, l2, ndim);
@@ -73,10 +100,14 @@ seq_t dtw_distance{{ suffix }}{{ suffix2 }}(seq_t *s1, idx_t l1,
             return max_dist;
         }
     } else if (max_dist == 0) {
+    {%- endif %}
         max_dist = INFINITY;
     } else {
         max_dist = pow(max_dist, 2);
     }
+    {%- if window_kind == "full" %}
+    ldiff = (l1 > l2) ? (l1 - l2) : (l2 - l1);
+    {%- else %}
     if (l1 > l2) {
         ldiff = l1 - l2;
         dl = ldiff;
@@ -84,24 +115,33 @@ seq_t dtw_distance{{ suffix }}{{ suffix2 }}(seq_t *s1, idx_t l1,
         ldiff  = l2 - l1;
         dl = 0;
     }
+    {%- endif %}
     if (settings->max_length_diff != 0 && ldiff > settings->max_length_diff) {
         return INFINITY;
     }
+    {%- if window_kind != "full" %}
     if (window == 0) {
         window = MAX(l1, l2);
     }
+    {%- endif %}
+    {%- if not window_kind %}
     if (max_step == 0) {
         max_step = INFINITY;
     } else {
         max_step = pow(max_step, 2);
     }
     penalty = pow(penalty, 2);
+    {%- endif %}
     // rows is for series 1, columns is for series 2
+    {%- if window_kind == "full" %}
+    idx_t length = l2 + 1;
+    {%- else %}
     idx_t length = MIN(l2+1, ldiff + 2*window + 1);
+    {%- endif %}
     assert(length > 0);
-    seq_t * dtw = (seq_t *)malloc(sizeof(seq_t) * length * 2);
+    seq_t * dtw = (seq_t *)dtw_workspace_reserve(ws, sizeof(seq_t) * length * 2);
     if (!dtw) {
-        printf("Error: dtw_distance{{ suffix }} - Cannot allocate memory (size=%zu)\n", length*2);
+        printf("Error: dtw_distance{{ suffix }}{% if window_kind %}{{ suffix2 }}{% endif %} - Cannot allocate memory (size=%zu)\n", length*2);
         return 0;
     }
     idx_t i;
@@ -113,26 +153,36 @@ seq_t dtw_distance{{ suffix }}{{ suffix2 }}(seq_t *s1, idx_t l1,
     for (j=0; j<length*2; j++) {
         dtw[j] = INFINITY;
     }
+    {%- if window_kind %}
+    dtw[0] = 0;
+    {%- else %}
     // Deal with psi-relaxation in first row
     for (i=0; i<settings->psi_2b + 1; i++) {
         dtw[i] = 0;
     }
+    {%- endif %}
+    {%- if window_kind != "full" %}
     idx_t skip = 0;
     idx_t skipp = 0;
+    {%- endif %}
     int i0 = 1;
     int i1 = 0;
     idx_t minj;
     idx_t maxj;
     idx_t curidx = 0;
+    {%- if window_kind != "full" %}
     idx_t dl_window = dl + window - 1;
     idx_t ldiff_window = window;
     if (l2 > l1) {
         ldiff_window += ldiff;
     }
+    {%- endif %}
     seq_t minv;
     seq_t d;
     seq_t tempv;
+    {%- if not window_kind %}
     seq_t psi_shortest = INFINITY;
+    {%- endif %}
     // keepRunning = 1;
     for (i=0; i<l1; i++) {
         // if (!keepRunning){  // not compatible with OMP
@@ -143,6 +193,11 @@ seq_t dtw_distance{{ suffix }}{{ suffix2 }}(seq_t *s1, idx_t l1,
         {%- if "ndim" in suffix %}
         i_idx = i * ndim;
         {%- endif %}
+        {%- if window_kind == "full" %}
+        // Without a window the rows span all columns: skip = skipp = 0
+        maxj = 0;
+        minj = l2;
+        {%- else %}
         // maxj = i;
         // if (maxj > dl_window) {
         //     maxj -= dl_window;
@@ -158,16 +213,19 @@ seq_t dtw_distance{{ suffix }}{{ suffix2 }}(seq_t *s1, idx_t l1,
         }
         skipp = skip;
         skip = maxj;
+        {%- endif %}
         i0 = 1 - i0;
         i1 = 1 - i1;
         // Reset new line i1
         for (j=0; j<length; j++) {
             dtw[length * i1 + j] = INFINITY;
         }
+        {%- if window_kind != "full" %}
         // if (length == l2 + 1) {
         //     skip = 0;
         // }
         skip = skip * (length != l2 + 1);
+        {%- endif %}
         // PrunedDTW
         if (sc > maxj) {
             #ifdef DTWDEBUG
@@ -177,10 +235,12 @@ seq_t dtw_distance{{ suffix }}{{ suffix2 }}(seq_t *s1, idx_t l1,
         }
         smaller_found = false;
         ec_next = i;
+        {%- if not window_kind %}
         // Deal with psi-relaxation in first column
         if (settings->psi_1b != 0 && maxj == 0 && i < settings->psi_1b) {
             dtw[i1*length + 0] = 0;
         }
+        {%- endif %}
         #ifdef DTWDEBUG
         printf("i=%zu, maxj=%zu, minj=%zu\n", i, maxj, minj);
         #endif
@@ -206,19 +266,21 @@ seq_t dtw_distance{{ suffix }}{{ suffix2 }}(seq_t *s1, idx_t l1,
             d = SEDIST(s1[i], s2[j]);
             {%- endif %}
             {%- endif %}
+            {%- if not window_kind %}
             if (d > max_step) {
                 // Let the value be INFINITY as initialized
                 continue;
             }
-            curidx = i0 * length + j - skipp;
+            {%- endif %}
+            curidx = i0 * length + j{% if window_kind != "full" %} - skipp{% endif %};
             minv = dtw[curidx];
             curidx += 1;
-            tempv = dtw[curidx] + penalty;
+            tempv = dtw[curidx]{% if not window_kind %} + penalty{% endif %};
             if (tempv < minv) {
                 minv = tempv;
             }
-            curidx = i1 * length + j - skip;
-            tempv = dtw[curidx] + penalty;
+            curidx = i1 * length + j{% if window_kind != "full" %} - skip{% endif %};
+            tempv = dtw[curidx]{% if not window_kind %} + penalty{% endif %};
             if (tempv < minv) {
                 minv = tempv;
             }
@@ -227,11 +289,13 @@ seq_t dtw_distance{{ suffix }}{{ suffix2 }}(seq_t *s1, idx_t l1,
             #endif
             curidx += 1;
             dtw[curidx] = d + minv;
+            {%- if window_kind != "full" %}
             #ifdef DTWDEBUG
             printf("%zu, %zu, %zu\n",i0*length + j - skipp,i0*length + j + 1 - skipp,i1*length + j - skip);
             printf("%f, %f, %f\n",dtw[i0*length + j - skipp],dtw[i0*length + j + 1 - skipp],dtw[i1*length + j - skip]);
             printf("i=%zu, j=%zu, d=%f, skip=%zu, skipp=%zu\n",i,j,d,skip,skipp);
             #endif
+            {%- endif %}
             // PrunedDTW
             if (dtw[curidx] > max_dist) {
                 #ifdef DTWDEBUG
@@ -252,6 +316,7 @@ seq_t dtw_distance{{ suffix }}{{ suffix2 }}(seq_t *s1, idx_t l1,
             }
         }
         ec = ec_next;
+        {%- if not window_kind %}
         // Deal with Psi-relaxation in last column
         if (settings->psi_1e != 0 && minj == l2 && l1 - 1 - i <= settings->psi_1e) {
             assert(!(settings->window == 0 || settings->window == l2) || (i1 + 1)*length - 1 == curidx);
@@ -260,18 +325,24 @@ seq_t dtw_distance{{ suffix }}{{ suffix2 }}(seq_t *s1, idx_t l1,
                 psi_shortest = dtw[curidx];
             }
         }
+        {%- endif %}
+        {%- if window_kind != "full" %}
         #ifdef DTWDEBUG
         dtw_print_twoline(dtw, l1, l2, length, i0, i1, skip, skipp, maxj, minj);
         #endif
+        {%- endif %}
     }
+    {%- if window_kind != "full" %}
     if (window - 1 < 0) {
         l2 += window - 1;
     }
+    {%- endif %}
     {%- if "euclidean" == inner_dist %}
-    seq_t result = dtw[length * i1 + l2 - skip];
+    seq_t result = dtw[length * i1 + l2{% if window_kind != "full" %} - skip{% endif %}];
     {%- else %}
-    seq_t result = sqrt(dtw[length * i1 + l2 - skip]);
+    seq_t result = sqrt(dtw[length * i1 + l2{% if window_kind != "full" %} - skip{% endif %}]);
     {%- endif %}
+    {%- if not window_kind %}
     // Deal with psi-relaxation in the last row
     if (settings->psi_1e != 0 || settings->psi_2e != 0) {
         if (settings->psi_2e != 0) {
@@ -287,7 +358,7 @@ seq_t dtw_distance{{ suffix }}{{ suffix2 }}(seq_t *s1, idx_t l1,
         result = sqrt(psi_shortest);
         {%- endif %}
     }
-    free(dtw);
+    {%- endif %}
     // signal(SIGINT, SIG_DFL);  // not compatible with OMP
     if (settings->max_dist !=0 && result > settings->max_dist) {
         // DTWPruned keeps the last value larger than max_dist. Correct for this.
@@ -295,4 +366,24 @@ seq_t dtw_distance{{ suffix }}{{ suffix2 }}(seq_t *s1, idx_t l1,
     }
     return result;
 }
+{%- if not window_kind %}
+
+/**
+{%- if "ndim" in suffix %}
+Compute the DTW between two n-dimensional series.
+{%- else %}
+Compute the DTW between two series.
+{%- endif %}
+Allocates a temporary workspace, use dtw_distance{{ suffix }}{{ suffix2 }}_ws to reuse memory over calls.
 
+@see dtw_distance{{ suffix }}{{ suffix2 }}_ws
+*/
+seq_t dtw_distance{{ suffix }}{{ suffix2 }}(seq_t *s1, idx_t l1,
+                      seq_t *s2, idx_t l2, {% if "ndim" in suffix %}int ndim,{% endif %}
+                      DTWSettings *settings) {
+    DTWWorkspace ws = dtw_workspace_empty();
+    seq_t result = dtw_distance{{ suffix }}{{ suffix2 }}_ws(s1, l1, s2, l2, {% if "ndim" in suffix %}ndim, {% endif %}settings, &ws);
+    dtw_workspace_free(&ws);
+    return result;
+}
+{%- endif %}
@@ -70,6 +70,11 @@ idx_t dtw_distances_{{ suffix }}(
     idx_t length;
     idx_t i;
     seq_t value;
+    {%- if "ndim" not in suffix %}
+    // The settings are the same for all pairs, select the DTW variant once
+    DTWWsFnPtr dtw_fn = dtw_distance_kernel(settings);
+    DTWWorkspace ws = dtw_workspace_empty();
+    {%- endif %}
 
     length = dtw_distances_length(block, {{nb_size_r}}, {{nb_size_c}});
     if (length == 0) {
@@ -93,22 +98,22 @@ idx_t dtw_distances_{{ suffix }}(
         }
         for (c=cb; c<block->ce; c++) {
             {%- if suffix == "ptrs" %}
-            value = dtw_distance(ptrs[r], lengths[r],
-                                 ptrs[c], lengths[c], settings);
+            value = dtw_fn(ptrs[r], lengths[r],
+                           ptrs[c], lengths[c], settings, &ws);
             {%- elif suffix == "ndim_ptrs" %}
             value = dtw_distance_ndim(ptrs[r], lengths[r],
                                       ptrs[c], lengths[c],
                                       ndim, settings);
             {%- elif suffix == "matrix" %}
-            value = dtw_distance(&matrix[r*nb_cols], nb_cols,
-                                 &matrix[c*nb_cols], nb_cols, settings);
+            value = dtw_fn(&matrix[r*nb_cols], nb_cols,
+                           &matrix[c*nb_cols], nb_cols, settings, &ws);
             {%- elif suffix == "ndim_matrix" %}
             value = dtw_distance_ndim(&matrix[r*nb_cols*ndim], nb_cols,
                                       &matrix[c*nb_cols*ndim], nb_cols,
                                       ndim, settings);
             {%- elif suffix == "matrices" %}
-            value = dtw_distance(&matrix_r[r*nb_cols_r], nb_cols_r,
-                                 &matrix_c[c*nb_cols_c], nb_cols_c, settings);
+            value = dtw_fn(&matrix_r[r*nb_cols_r], nb_cols_r,
+                           &matrix_c[c*nb_cols_c], nb_cols_c, settings, &ws);
             {%- elif suffix == "ndim_matrices" %}
             value = dtw_distance_ndim(&matrix_r[r*nb_cols_r*ndim], nb_cols_r,
                                       &matrix_c[c*nb_cols_c*ndim], nb_cols_c,
@@ -119,6 +124,9 @@ idx_t dtw_distances_{{ suffix }}(
             i += 1;
         }
     }
+    {%- if "ndim" not in suffix %}
+    dtw_workspace_free(&ws);
+    {%- endif %}
     assert(length == i);
     return length;
 }
@@ -0,0 +1,41 @@
+/*
+ * Cost-aware batch sizing for the master of the MPI implementations.
+ *
+ * The cost of a pair (r, c) is lengths[r] * lengths[c] DTW cells. The master
+ * measures the cells per second of every worker from the time between two of its
+ * results (the next batch is queued on the worker, so that time is about the
+ * compute time of the batch) and sizes the next batch of the worker to about
+ * quantum seconds. A batch never has more than a fraction 1 / (2 * workers) of the
+ * remaining cells (guided self-scheduling): the batches shrink geometrically near
+ * the end and the workers finish at about the same time.
+ *
+ * This file is part of the DTW aggregation and clustering project.
+ */
+// batch_schedule.h
+#ifndef BATCH_SCHEDULE_H
+#define BATCH_SCHEDULE_H
+
+typedef struct {
+    int nb_workers;
+    double quantum;       // wanted compute time of a batch (seconds)
+    int first_batch;      // number of pairs of the batches sent before any measurement
+    int min_batch;
+    int max_batch;
+    double remaining;     // cells of the pairs not sent yet
+    double *rate;         // cells per second of every rank, 0 if not measured yet
+    double *last_time;    // time of the last send or result of every rank
+    int nb_batches;
+    int smallest;
+    int largest;
+} BatchSchedule;
+
+int    batch_schedule_init(BatchSchedule *schedule, int nprocs, double quantum, int first_batch,
+                           int min_batch, int max_batch, int (*tasks)[2], int total_tasks, const int *lengths);
+void   batch_schedule_free(BatchSchedule *schedule);
+double batch_schedule_cells(int (*tasks)[2], int first, int count, const int *lengths);
+int    batch_schedule_next(BatchSchedule *schedule, int rank, int (*tasks)[2], int next_task,
+                           int total_tasks, const int *lengths);
+void   batch_schedule_sent(BatchSchedule *schedule, int rank, int count, double cells, double now);
+void   batch_schedule_done(BatchSchedule *schedule, int rank, double cells, double now);
+
+#endif // BATCH_SCHEDULE_H
@@ -0,0 +1,100 @@
+/*
+ * Checkpoint of an all-pairs DTW run for an incremental refresh: for every pair
+ * the last row and the last column of its cumulative cost matrix
+ * (DTAIDistanceC/dd_dtw_incremental.h), and for every series its ticker, length
+ * and a hash of its values. When the series of a later run start with the values
+ * of the checkpoint (new bars appended), the distance of a pair is extended from
+ * its boundary in O((l1 + l2) * new points) instead of recomputed in O(l1 * l2).
+ *
+ * This file is part of the DTW aggregation and clustering project.
+ */
+// dtw_checkpoint.h
+#ifndef DTW_CHECKPOINT_H
+#define DTW_CHECKPOINT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "dd_globals.h"
+#include "dd_dtw.h"
+#include "types.h"
+#include "series_collection.h"
+
+/*
+ * Layout of a checkpoint file (native byte order, checked with byte_order):
+ *
+ *   DTWCheckpointHeader                    128 bytes
+ *   ticker table        num_series * name_size bytes, '\0'-terminated names
+ *   series table        num_series DTWCheckpointSeries
+ *   pair offsets        num_pairs + 1 uint64_t, in values from values_offset
+ *   values              64-byte aligned seq_t; pair k = (r, c), r < c, in the
+ *                       order of the upper triangle, holds its last row
+ *                       (lengths[c] values) followed by its last column
+ *                       (lengths[r] values)
+ *
+ * The boundaries are the cumulative cost before the square root, for the
+ * inner_dist, penalty and max_step of the header.
+ */
+#define DTW_CHECKPOINT_MAGIC "DTWCKPT1"
+#define DTW_CHECKPOINT_VERSION 1
+#define DTW_CHECKPOINT_BYTE_ORDER 0x01020304u
+#define DTW_CHECKPOINT_ALIGN 64
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t name_size;
+    uint32_t value_size;
+    uint64_t num_series;
+    uint64_t num_pairs;
+    uint64_t num_values;
+    uint64_t names_offset;
+    uint64_t series_offset;
+    uint64_t pairs_offset;
+    uint64_t values_offset;
+    int32_t inner_dist;
+    int32_t reserved;
+    double penalty;
+    double max_step;
+    uint64_t padding[3];
+} DTWCheckpointHeader;
+
+typedef struct {
+    uint64_t length;
+    uint64_t hash;        // series_hash of the values
+} DTWCheckpointSeries;
+
+// A checkpoint file mapped read-only
+typedef struct {
+    const DTWCheckpointHeader *header;
+    int num_series;
+    const char *names;
+    const DTWCheckpointSeries *series;
+    const uint64_t *offsets;
+    const seq_t *values;
+    int *sorted;          // series indices sorted by ticker, for dtw_checkpoint_find
+    void *map;
+    size_t map_size;
+} DTWCheckpoint;
+
+typedef struct {
+    int fd;
+    DTWCheckpointHeader header;
+    uint64_t *offsets;
+} DTWCheckpointWriter;
+
+int  dtw_checkpoint_open(const char *filename, DTWCheckpoint *checkpoint);
+bool dtw_checkpoint_compatible(const DTWCheckpoint *checkpoint, DTWSettings *settings);
+int  dtw_checkpoint_find(const DTWCheckpoint *checkpoint, const char *ticker, const seq_t *s, idx_t length);
+void dtw_checkpoint_boundary(const DTWCheckpoint *checkpoint, int r, int c, const seq_t **row, const seq_t **col);
+void dtw_checkpoint_close(DTWCheckpoint *checkpoint);
+
+int  dtw_checkpoint_writer_create(DTWCheckpointWriter *writer, const char *filename,
+                                  const SeriesCollection *collection, int num_series, DTWSettings *settings);
+int  dtw_checkpoint_writer_put(DTWCheckpointWriter *writer, idx_t pair, const seq_t *row, idx_t row_len,
+                               const seq_t *col, idx_t col_len);
+int  dtw_checkpoint_writer_close(DTWCheckpointWriter *writer);
+
+#endif // DTW_CHECKPOINT_H
@@ -8,77 +8,459 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
 #include "load_from_csv.h"
 #include "types.h"
 
 
-int load_series_from_csv(const char *filename, TickerSeries *series_list, int *num_series, int max_assets) {
-    FILE *fp = fopen(filename, "r");
-    if (!fp) {
-        perror("fopen");
-        return -1;
+/*
+ * The file is mapped and split in one chunk of lines per thread. Every chunk is parsed
+ * in parallel into (ticker, close) rows with a hash table of its own tickers. The
+ * chunk tables are then merged in file order, such that the tickers keep the order of
+ * their first appearance, and the values are copied in parallel to their position in
+ * the values arena of the collection.
+ *
+ * Lines are split exactly as the original strtok-based loader did (empty fields are
+ * skipped, the ticker ends at ',' or '\n') and the close price is converted with the
+ * same result as atof, such that the output is the same.
+ */
+
+struct csv_table_s {
+    idx_t *slots;         // index + 1 of the ticker, 0 if empty
+    idx_t size;           // number of slots, a power of two
+    const char **names;   // ticker names, not '\0'-terminated (they point into the file)
+    size_t *lens;
+    idx_t *counts;        // number of rows per ticker
+    idx_t nb;
+    idx_t capacity;
+};
+
+struct csv_chunk_s {
+    const char *begin;
+    const char *end;
+    struct csv_table_s tickers;
+    idx_t *row_tickers;
+    double *row_values;
+    idx_t nb_rows;
+    idx_t capacity;
+    idx_t *global;        // index in the collection per ticker of this chunk, -1 if dropped
+    idx_t *pos;           // next position in the values arena per ticker of this chunk
+    bool ok;
+};
+
+static uint64_t csv_hash(const char *s, size_t len) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
     }
+    return h;
+}
 
-    char line[1024];
-    fgets(line, sizeof(line), fp); // skip header
+static bool csv_table_init(struct csv_table_s *table) {
+    memset(table, 0, sizeof(struct csv_table_s));
+    table->size = 64;
+    table->capacity = 32;
+    table->slots = calloc(table->size, sizeof(idx_t));
+    table->names = malloc(sizeof(char *) * table->capacity);
+    table->lens = malloc(sizeof(size_t) * table->capacity);
+    table->counts = malloc(sizeof(idx_t) * table->capacity);
+    return (table->slots && table->names && table->lens && table->counts);
+}
+
+static void csv_table_free(struct csv_table_s *table) {
+    free(table->slots);
+    free(table->names);
+    free(table->lens);
+    free(table->counts);
+    memset(table, 0, sizeof(struct csv_table_s));
+}
 
-    while (fgets(line, sizeof(line), fp)) {
-        // Make a copy of the line to safely tokenize
-        char *line_ptr = strdup(line);
-        if (!line_ptr) {
-            perror("strdup");
-            fclose(fp);
+static idx_t csv_table_find(struct csv_table_s *table, const char *name, size_t len) {
+    idx_t mask = table->size - 1;
+    for (idx_t i = (idx_t)(csv_hash(name, len) & (uint64_t)mask); table->slots[i] != 0; i = (i + 1) & mask) {
+        idx_t t = table->slots[i] - 1;
+        if (table->lens[t] == len && memcmp(table->names[t], name, len) == 0) {
+            return t;
+        }
+    }
+    return -1;
+}
+
+// Add a ticker that is not in the table, returns its index or -1 if out of memory
+static idx_t csv_table_add(struct csv_table_s *table, const char *name, size_t len) {
+    if (table->nb == table->capacity) {
+        idx_t capacity = 2 * table->capacity;
+        const char **names = realloc(table->names, sizeof(char *) * capacity);
+        if (names) table->names = names;
+        size_t *lens = realloc(table->lens, sizeof(size_t) * capacity);
+        if (lens) table->lens = lens;
+        idx_t *counts = realloc(table->counts, sizeof(idx_t) * capacity);
+        if (counts) table->counts = counts;
+        if (!names || !lens || !counts) {
+            return -1;
+        }
+        table->capacity = capacity;
+    }
+    if (2 * (table->nb + 1) > table->size) {
+        // Keep the load factor below one half
+        idx_t size = 2 * table->size;
+        idx_t *slots = calloc(size, sizeof(idx_t));
+        if (!slots) {
             return -1;
         }
+        for (idx_t t = 0; t < table->nb; t++) {
+            idx_t i = (idx_t)(csv_hash(table->names[t], table->lens[t]) & (uint64_t)(size - 1));
+            while (slots[i] != 0) {
+                i = (i + 1) & (size - 1);
+            }
+            slots[i] = t + 1;
+        }
+        free(table->slots);
+        table->slots = slots;
+        table->size = size;
+    }
+    idx_t t = table->nb++;
+    table->names[t] = name;
+    table->lens[t] = len;
+    table->counts[t] = 0;
+    idx_t i = (idx_t)(csv_hash(name, len) & (uint64_t)(table->size - 1));
+    while (table->slots[i] != 0) {
+        i = (i + 1) & (table->size - 1);
+    }
+    table->slots[i] = t + 1;
+    return t;
+}
 
-        // Tokenize line
-        char *token = strtok(line_ptr, ","); // Date
-        if (!token) { free(line_ptr); continue; }
+static inline bool csv_is_delim(char c, bool newline) {
+    return c == ',' || (newline && c == '\n');
+}
 
-        strtok(NULL, ","); // Open
-        strtok(NULL, ","); // High
-        strtok(NULL, ","); // Low
+// Next token of a line as strtok returns it: leading delimiters are skipped
+static bool csv_token(const char **p, const char *end, bool newline, const char **token, size_t *len) {
+    const char *s = *p;
+    while (s < end && csv_is_delim(*s, newline)) {
+        s++;
+    }
+    if (s == end) {
+        *p = end;
+        return false;
+    }
+    const char *e = s;
+    while (e < end && !csv_is_delim(*e, newline)) {
+        e++;
+    }
+    *token = s;
+    *len = e - s;
+    *p = (e < end) ? e + 1 : end;
+    return true;
+}
 
-        char *close_str = strtok(NULL, ","); // Close
-        if (!close_str) { free(line_ptr); continue; }
+// Same result as atof on the token
+static double csv_parse_double(const char *s, size_t len) {
+    static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    // Fast path for [-+]digits[.digits]: the mantissa and the power of ten are exact
+    // doubles, thus their quotient is correctly rounded like strtod
+    size_t i = 0;
+    bool negative = false;
+    if (i < len && (s[i] == '-' || s[i] == '+')) {
+        negative = (s[i] == '-');
+        i++;
+    }
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int decimals = 0;
+    bool point = false;
+    bool fast = (i < len && s[i] >= '0' && s[i] <= '9');
+    for (; fast && i < len; i++) {
+        if (s[i] >= '0' && s[i] <= '9') {
+            mantissa = 10 * mantissa + (uint64_t)(s[i] - '0');
+            if (mantissa != 0) {
+                digits++;
+            }
+            if (point) {
+                decimals++;
+            }
+        } else if (s[i] == '.' && !point) {
+            point = true;
+        } else {
+            fast = false;
+        }
+    }
+    if (fast && digits <= 15 && decimals <= 22) {
+        double value = (double)mantissa / powers[decimals];
+        return negative ? -value : value;
+    }
+    char buffer[64];
+    char *copy = (len < sizeof(buffer)) ? buffer : malloc(len + 1);
+    if (!copy) {
+        return 0;
+    }
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    double value = atof(copy);
+    if (copy != buffer) {
+        free(copy);
+    }
+    return value;
+}
 
-        strtok(NULL, ","); // Adj Close
-        strtok(NULL, ","); // Volume
+static void csv_parse_chunk(struct csv_chunk_s *chunk) {
+    const char *p = chunk->begin;
+    const char *token, *close_str, *ticker;
+    size_t len, close_len, ticker_len;
+    chunk->ok = csv_table_init(&chunk->tickers);
+    chunk->capacity = 1024;
+    chunk->row_tickers = malloc(sizeof(idx_t) * chunk->capacity);
+    chunk->row_values = malloc(sizeof(double) * chunk->capacity);
+    if (!chunk->row_tickers || !chunk->row_values) {
+        chunk->ok = false;
+    }
+    while (chunk->ok && p < chunk->end) {
+        const char *line_end = memchr(p, '\n', chunk->end - p);
+        line_end = (line_end == NULL) ? chunk->end : line_end + 1;
+        const char *q = p;
+        p = line_end;
 
-        char *ticker = strtok(NULL, ",\n");
-        if (!ticker) { free(line_ptr); continue; }
+        if (!csv_token(&q, line_end, false, &token, &len)) continue; // Date
+        csv_token(&q, line_end, false, &token, &len); // Open
+        csv_token(&q, line_end, false, &token, &len); // High
+        csv_token(&q, line_end, false, &token, &len); // Low
+        if (!csv_token(&q, line_end, false, &close_str, &close_len)) continue; // Close
+        csv_token(&q, line_end, false, &token, &len); // Adj Close
+        csv_token(&q, line_end, false, &token, &len); // Volume
+        if (!csv_token(&q, line_end, true, &ticker, &ticker_len)) continue; // Ticker
+        if (ticker_len > MAX_TICKER_NAME - 1) {
+            ticker_len = MAX_TICKER_NAME - 1;
+        }
 
-        if (!close_str || strlen(close_str) == 0) {
-            free(line_ptr);
-            continue;
+        idx_t t = csv_table_find(&chunk->tickers, ticker, ticker_len);
+        if (t < 0) {
+            t = csv_table_add(&chunk->tickers, ticker, ticker_len);
+            if (t < 0) {
+                chunk->ok = false;
+                break;
+            }
+        }
+        if (chunk->nb_rows == chunk->capacity) {
+            idx_t capacity = 2 * chunk->capacity;
+            idx_t *row_tickers = realloc(chunk->row_tickers, sizeof(idx_t) * capacity);
+            if (row_tickers) chunk->row_tickers = row_tickers;
+            double *row_values = realloc(chunk->row_values, sizeof(double) * capacity);
+            if (row_values) chunk->row_values = row_values;
+            if (!row_tickers || !row_values) {
+                chunk->ok = false;
+                break;
+            }
+            chunk->capacity = capacity;
         }
-        double close_val = atof(close_str);
+        chunk->tickers.counts[t]++;
+        chunk->row_tickers[chunk->nb_rows] = t;
+        chunk->row_values[chunk->nb_rows] = csv_parse_double(close_str, close_len);
+        chunk->nb_rows++;
+    }
+}
+
+/*
+ * Load the close series of at most max_assets tickers, in the order of their first
+ * appearance in the file. Series are not truncated.
+ *
+ * Returns 0 if ok, -1 otherwise.
+ */
+int load_series_collection_from_csv(const char *filename, SeriesCollection *collection, int max_assets) {
+    series_collection_init(collection);
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        perror("open");
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror("fstat");
+        close(fd);
+        return -1;
+    }
+    size_t size = (size_t)st.st_size;
+    const char *data = NULL;
+    if (size > 0) {
+        data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            perror("mmap");
+            close(fd);
+            return -1;
+        }
+    }
+    close(fd);
 
-        // Check if ticker already exists
-        int i, found = 0;
-        for (i = 0; i < *num_series; i++) {
-            if (strcmp(series_list[i].ticker, ticker) == 0) {
-                if (series_list[i].count < MAX_TIMEPOINTS) {
-                    series_list[i].close[series_list[i].count++] = close_val;
+    // Skip header
+    const char *begin = (size > 0) ? memchr(data, '\n', size) : NULL;
+    begin = (begin == NULL) ? data + size : begin + 1;
+    const char *end = data + size;
+
+    // One chunk of whole lines per thread
+    int nb_chunks = 1;
+#if defined(_OPENMP)
+    nb_chunks = omp_get_max_threads();
+#endif
+    if ((size_t)(end - begin) < (size_t)nb_chunks * 65536) {
+        nb_chunks = 1 + (int)((end - begin) / 65536);
+    }
+    struct csv_chunk_s *chunks = calloc(nb_chunks, sizeof(struct csv_chunk_s));
+    if (!chunks) {
+        fprintf(stderr, "Error: cannot allocate memory for %d chunks\n", nb_chunks);
+        if (size > 0) munmap((void *)data, size);
+        return -1;
+    }
+    const char *p = begin;
+    for (int c = 0; c < nb_chunks; c++) {
+        chunks[c].begin = p;
+        const char *e = begin + (end - begin) * (c + 1) / nb_chunks;
+        if (e < p) {
+            e = p;
+        }
+        if (c < nb_chunks - 1 && e < end) {
+            const char *nl = memchr(e, '\n', end - e);
+            e = (nl == NULL) ? end : nl + 1;
+        } else {
+            e = end;
+        }
+        chunks[c].end = e;
+        p = e;
+    }
+
+    int c;
+#if defined(_OPENMP)
+    #pragma omp parallel for schedule(static, 1)
+#endif
+    for (c = 0; c < nb_chunks; c++) {
+        csv_parse_chunk(&chunks[c]);
+    }
+
+    // Merge the tickers in file order, drop tickers after the first max_assets
+    bool ok = true;
+    struct csv_table_s global;
+    ok = csv_table_init(&global);
+    for (c = 0; ok && c < nb_chunks; c++) {
+        ok = chunks[c].ok;
+        chunks[c].global = malloc(sizeof(idx_t) * (chunks[c].tickers.nb + 1));
+        chunks[c].pos = malloc(sizeof(idx_t) * (chunks[c].tickers.nb + 1));
+        if (!chunks[c].global || !chunks[c].pos) {
+            ok = false;
+        }
+        for (idx_t t = 0; ok && t < chunks[c].tickers.nb; t++) {
+            const char *name = chunks[c].tickers.names[t];
+            size_t len = chunks[c].tickers.lens[t];
+            idx_t g = csv_table_find(&global, name, len);
+            if (g < 0 && global.nb < max_assets) {
+                g = csv_table_add(&global, name, len);
+                if (g < 0) {
+                    ok = false;
+                    break;
                 }
-                found = 1;
-                break;
+            }
+            chunks[c].global[t] = g;
+            if (g >= 0) {
+                global.counts[g] += chunks[c].tickers.counts[t];
             }
         }
+    }
 
-        // New ticker
-        if (!found && *num_series < max_assets) {
-            strncpy(series_list[*num_series].ticker, ticker, MAX_TICKER_NAME - 1);
-            series_list[*num_series].ticker[MAX_TICKER_NAME - 1] = '\0'; // Ensure null-terminated
-            series_list[*num_series].close[0] = close_val;
-            series_list[*num_series].count = 1;
-            (*num_series)++;
+    // Values arena, offsets and interned names
+    int n = (int)global.nb;
+    idx_t names_size = 0;
+    for (idx_t g = 0; ok && g < n; g++) {
+        names_size += global.lens[g] + 1;
+    }
+    if (ok) {
+        collection->offsets = malloc(sizeof(idx_t) * (n + 1));
+        collection->lengths = malloc(sizeof(idx_t) * (n + 1));
+        collection->name_offsets = malloc(sizeof(idx_t) * (n + 1));
+        collection->names = malloc(names_size + 1);
+        ok = (collection->offsets && collection->lengths && collection->name_offsets && collection->names);
+    }
+    if (ok) {
+        idx_t offset = 0, name_offset = 0;
+        for (idx_t g = 0; g < n; g++) {
+            collection->offsets[g] = offset;
+            collection->lengths[g] = global.counts[g];
+            offset += global.counts[g];
+            collection->name_offsets[g] = name_offset;
+            memcpy(collection->names + name_offset, global.names[g], global.lens[g]);
+            collection->names[name_offset + global.lens[g]] = '\0';
+            name_offset += global.lens[g] + 1;
+        }
+        collection->num_series = n;
+        collection->num_values = offset;
+        collection->values = malloc(sizeof(double) * (offset + 1));
+        ok = (collection->values != NULL);
+    }
+    if (ok) {
+        // Every chunk continues where the previous chunk stopped for the same ticker
+        idx_t *fill = calloc(n + 1, sizeof(idx_t));
+        ok = (fill != NULL);
+        for (c = 0; ok && c < nb_chunks; c++) {
+            for (idx_t t = 0; t < chunks[c].tickers.nb; t++) {
+                idx_t g = chunks[c].global[t];
+                if (g >= 0) {
+                    chunks[c].pos[t] = collection->offsets[g] + fill[g];
+                    fill[g] += chunks[c].tickers.counts[t];
+                }
+            }
+        }
+        free(fill);
+    }
+    if (ok) {
+#if defined(_OPENMP)
+        #pragma omp parallel for schedule(static, 1)
+#endif
+        for (c = 0; c < nb_chunks; c++) {
+            for (idx_t r = 0; r < chunks[c].nb_rows; r++) {
+                idx_t t = chunks[c].row_tickers[r];
+                if (chunks[c].global[t] >= 0) {
+                    collection->values[chunks[c].pos[t]++] = chunks[c].row_values[r];
+                }
+            }
         }
+    }
 
-        free(line_ptr);
+    for (c = 0; c < nb_chunks; c++) {
+        csv_table_free(&chunks[c].tickers);
+        free(chunks[c].row_tickers);
+        free(chunks[c].row_values);
+        free(chunks[c].global);
+        free(chunks[c].pos);
+    }
+    free(chunks);
+    csv_table_free(&global);
+    if (size > 0) {
+        munmap((void *)data, size);
+    }
+    if (!ok) {
+        fprintf(stderr, "Error: cannot allocate memory to load %s\n", filename);
+        series_collection_free(collection);
+        return -1;
     }
+    return 0;
+}
 
-    fclose(fp);
+/*
+ * Load into fixed TickerSeries structs, series are truncated to MAX_TIMEPOINTS values.
+ */
+int load_series_from_csv(const char *filename, TickerSeries *series_list, int *num_series, int max_assets) {
+    SeriesCollection collection;
+    if (load_series_collection_from_csv(filename, &collection, max_assets) != 0) {
+        return -1;
+    }
+    series_collection_to_ticker_series(&collection, series_list, num_series, max_assets);
+    series_collection_free(&collection);
     return 0;
 }
 
@@ -111,4 +493,4 @@ bool load_result_from_csv(const char *filename, double *result, int num_series)
     }
 
     return true;
-}
\ No newline at end of file
+}
@@ -0,0 +1,82 @@
+/*
+ * Persistent cache of pair distances, keyed by the content of the two series and
+ * the DTW settings instead of the ticker names or positions: a rerun with added or
+ * changed tickers only computes the pairs of these tickers.
+ *
+ * The cache is one append-only file of records. It is loaded in a hash table when
+ * opened, new distances are buffered and appended under an exclusive flock, such
+ * that several processes (MPI ranks, concurrent runs) can add to the same file.
+ * Records of pairs that are computed twice are identical, the last one wins.
+ *
+ * This file is part of the DTW aggregation and clustering project.
+ */
+// result_cache.h
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "dd_globals.h"
+#include "dd_dtw.h"
+#include "types.h"
+#include "series_collection.h"
+
+/*
+ * Layout of a cache file (native byte order, checked with byte_order):
+ *
+ *   ResultCacheHeader   32 bytes
+ *   records             ResultCacheRecord, in the order they were appended; an
+ *                       incomplete record at the end (a writer that died) is
+ *                       ignored and overwritten by the next append
+ */
+#define RESULT_CACHE_MAGIC "DTWCACHE"
+#define RESULT_CACHE_VERSION 1
+#define RESULT_CACHE_BYTE_ORDER 0x01020304u
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t record_size;
+    uint32_t reserved[3];
+} ResultCacheHeader;
+
+// Distance of the pair (series_r, series_c) in this order, series_hash of both series
+typedef struct {
+    uint64_t series_r;
+    uint64_t series_c;
+    uint64_t settings;    // result_cache_settings_key
+    double value;
+} ResultCacheRecord;
+
+// How the distances were computed and kept, drivers only share the distances of the same kind
+typedef enum {
+    RESULT_CACHE_F64 = 0,           // double precision DTW, kept as double
+    RESULT_CACHE_F64_AS_F32 = 1,    // double precision DTW, rounded to float
+    RESULT_CACHE_F32 = 2            // single precision DTW (dd_dtw_f32.h)
+} ResultCacheKind;
+
+typedef struct {
+    int fd;
+    ResultCacheRecord *table;     // open addressing, power-of-two size
+    bool *used;
+    idx_t table_size;
+    idx_t count;
+    ResultCacheRecord *pending;   // records not appended yet
+    idx_t num_pending;
+    idx_t hits;
+    idx_t added;
+} ResultCache;
+
+uint64_t result_cache_settings_key(const DTWSettings *settings, ResultCacheKind kind);
+
+int  result_cache_open(ResultCache *cache, const char *filename);
+bool result_cache_get(ResultCache *cache, uint64_t series_r, uint64_t series_c, uint64_t settings, double *value);
+int  result_cache_put(ResultCache *cache, uint64_t series_r, uint64_t series_c, uint64_t settings, double value);
+int  result_cache_flush(ResultCache *cache);
+int  result_cache_close(ResultCache *cache);
+void result_cache_print_stats(const ResultCache *cache, idx_t num_pairs);
+
+#endif // RESULT_CACHE_H
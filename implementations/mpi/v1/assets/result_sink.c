@@ -0,0 +1,205 @@
+/*
+ * Streaming result sink of the MPI masters.
+ *
+ * This file is part of the DTW aggregation and clustering project.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "result_sink.h"
+
+
+#define RESULT_SINK_WINDOW    4096
+#define RESULT_SINK_FP_BUFFER (1 << 20)
+
+// Binary for the names that end in RESULT_MATRIX_SUFFIX, text otherwise
+ResultSinkFormat result_sink_format_of(const char *filename) {
+    return result_matrix_is_matrix_name(filename) ? RESULT_SINK_BINARY : RESULT_SINK_TEXT;
+}
+
+int result_sink_open(ResultSink *sink, const char *filename, ResultSinkFormat format,
+                     const SeriesCollection *collection, int num_series, double max_dist) {
+    memset(sink, 0, sizeof(ResultSink));
+    sink->format = format;
+    sink->collection = collection;
+    sink->num_series = num_series;
+    sink->num_pairs = (idx_t)num_series * (num_series - 1) / 2;
+    sink->max_dist = max_dist;
+    sink->next_c = 1;
+    sink->matrix.fd = -1;
+    if (format == RESULT_SINK_BINARY) {
+        sink->written = calloc(sink->num_pairs / 8 + 1, 1);
+        if (!sink->written) {
+            fprintf(stderr, "Error: cannot allocate memory for the written pairs\n");
+            return -1;
+        }
+        if (result_matrix_writer_create(&sink->matrix, filename, collection, num_series, sizeof(float), max_dist) != 0) {
+            result_sink_close(sink);
+            return -1;
+        }
+        return 0;
+    }
+
+    sink->fp = fopen(filename, "w");
+    if (!sink->fp) {
+        fprintf(stderr, "Error: cannot open output file %s\n", filename);
+        return -1;
+    }
+    sink->fp_buffer = malloc(RESULT_SINK_FP_BUFFER);
+    if (sink->fp_buffer) {
+        setvbuf(sink->fp, sink->fp_buffer, _IOFBF, RESULT_SINK_FP_BUFFER);
+    }
+    sink->window_size = 1;
+    while (sink->window_size < MIN(sink->num_pairs, RESULT_SINK_WINDOW)) {
+        sink->window_size *= 2;
+    }
+    sink->window = malloc(sizeof(float) * sink->window_size);
+    sink->ready = calloc(sink->window_size, sizeof(bool));
+    if (!sink->window || !sink->ready) {
+        fprintf(stderr, "Error: cannot allocate memory for the result window\n");
+        result_sink_close(sink);
+        return -1;
+    }
+    return 0;
+}
+
+// Grow the window until the pair last fits in it
+static int result_sink_grow(ResultSink *sink, idx_t last) {
+    idx_t size = sink->window_size;
+    while (last - sink->next >= size) {
+        size *= 2;
+    }
+    float *window = malloc(sizeof(float) * size);
+    bool *ready = calloc(size, sizeof(bool));
+    if (!window || !ready) {
+        fprintf(stderr, "Error: cannot allocate memory for a result window of %zd pairs\n", size);
+        free(window);
+        free(ready);
+        return -1;
+    }
+    for (idx_t i = sink->next; i < sink->next + sink->window_size; i++) {
+        idx_t from = i & (sink->window_size - 1);
+        if (sink->ready[from]) {
+            window[i & (size - 1)] = sink->window[from];
+            ready[i & (size - 1)] = true;
+        }
+    }
+    free(sink->window);
+    free(sink->ready);
+    sink->window = window;
+    sink->ready = ready;
+    sink->window_size = size;
+    return 0;
+}
+
+// Write the pairs of the window from next on, up to the first missing one
+static void result_sink_flush(ResultSink *sink) {
+    idx_t mask = sink->window_size - 1;
+    while (sink->next < sink->num_pairs && sink->ready[sink->next & mask]) {
+        float value = sink->window[sink->next & mask];
+        sink->ready[sink->next & mask] = false;
+        if (!(sink->max_dist > 0 && isinf(value))) {
+            fprintf(sink->fp, "%s;%s;%.6f\n", series_collection_ticker(sink->collection, sink->next_r),
+                    series_collection_ticker(sink->collection, sink->next_c), value);
+        }
+        sink->waiting--;
+        sink->next++;
+        if (++sink->next_c == sink->num_series) {
+            sink->next_r++;
+            sink->next_c = sink->next_r + 1;
+        }
+    }
+}
+
+/*
+ * The distances of the pairs first, ..., first+count-1 (result_matrix_pair_index),
+ * every pair is put once.
+ */
+int result_sink_put(ResultSink *sink, idx_t first, const float *values, idx_t count) {
+    if (count <= 0) {
+        return 0;
+    }
+    if (first < 0 || first + count > sink->num_pairs) {
+        fprintf(stderr, "Error: pairs %zd..%zd out of the result\n", first, first + count);
+        return -1;
+    }
+    if (sink->format == RESULT_SINK_BINARY) {
+        if (result_matrix_writer_write(&sink->matrix, first, values, count) != 0) {
+            return -1;
+        }
+        for (idx_t i = first; i < first + count; i++) {
+            if (!(sink->written[i >> 3] & (1u << (i & 7)))) {
+                sink->written[i >> 3] |= (unsigned char)(1u << (i & 7));
+                sink->num_written++;
+            }
+        }
+        return 0;
+    }
+    if (first < sink->next) {
+        fprintf(stderr, "Error: pair %zd was already written\n", first);
+        return -1;
+    }
+    if (first + count - 1 - sink->next >= sink->window_size && result_sink_grow(sink, first + count - 1) != 0) {
+        return -1;
+    }
+    idx_t mask = sink->window_size - 1;
+    for (idx_t i = 0; i < count; i++) {
+        sink->window[(first + i) & mask] = values[i];
+        sink->ready[(first + i) & mask] = true;
+    }
+    sink->waiting += count;
+    sink->peak_waiting = MAX(sink->peak_waiting, sink->waiting);
+    result_sink_flush(sink);
+    return 0;
+}
+
+// Close the file, returns -1 if pairs are missing or the file cannot be written
+int result_sink_close(ResultSink *sink) {
+    int rvalue = 0;
+    if (sink->format == RESULT_SINK_BINARY) {
+        if (sink->written && sink->num_written < sink->num_pairs) {
+            idx_t first = 0;
+            while (sink->written[first >> 3] & (1u << (first & 7))) {
+                first++;
+            }
+            fprintf(stderr, "Error: %zd pairs missing in the result (first: pair %zd)\n",
+                    sink->num_pairs - sink->num_written, first);
+            rvalue = -1;
+        }
+        if (result_matrix_writer_close(&sink->matrix) != 0) {
+            rvalue = -1;
+        }
+    } else if (sink->fp) {
+        if (sink->next < sink->num_pairs) {
+            fprintf(stderr, "Error: %zd pairs missing in the result\n", sink->num_pairs - sink->next);
+            rvalue = -1;
+        }
+        if (fclose(sink->fp) != 0) {
+            perror("fclose");
+            rvalue = -1;
+        }
+        sink->fp = NULL;
+    }
+    free(sink->fp_buffer);
+    free(sink->window);
+    free(sink->ready);
+    free(sink->written);
+    sink->fp_buffer = NULL;
+    sink->window = NULL;
+    sink->ready = NULL;
+    sink->written = NULL;
+    return rvalue;
+}
+
+// Peak memory of the sink, compared to an array of all pairs
+void result_sink_print_stats(const ResultSink *sink) {
+    if (sink->format == RESULT_SINK_BINARY) {
+        printf("Result sink: binary matrix, %.3f MB of written pair bits (all pairs: %.3f MB)\n",
+               (double)(sink->num_pairs / 8 + 1) / 1e6, sizeof(float) * (double)sink->num_pairs / 1e6);
+    } else {
+        printf("Result sink: at most %zd pairs waiting, window of %.3f MB (all pairs: %.3f MB)\n",
+               sink->peak_waiting, (sizeof(float) + sizeof(bool)) * (double)sink->window_size / 1e6,
+               sizeof(float) * (double)sink->num_pairs / 1e6);
+    }
+}
@@ -0,0 +1,196 @@
+/*
+ * Wire format of a batch of pairs with every series packed once.
+ *
+ * This file is part of the DTW aggregation and clustering project.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "series_batch.h"
+
+
+#define SERIES_BATCH_HEADER_INTS 4
+
+static size_t series_batch_align(size_t bytes) {
+    return (bytes + SERIES_BATCH_ALIGN - 1) / SERIES_BATCH_ALIGN * SERIES_BATCH_ALIGN;
+}
+
+// Size of the header and the tables, the first series starts there
+static size_t series_batch_tables_size(int nb_pairs, int nb_series) {
+    return series_batch_align(sizeof(int32_t) * SERIES_BATCH_HEADER_INTS +
+                              (sizeof(int64_t) + sizeof(int32_t)) * (size_t)nb_series +
+                              sizeof(int32_t) * 2 * (size_t)nb_pairs);
+}
+
+/*
+ * Fill tasks with all pairs (r, c), r < c, in tiles of tile rows and tile columns.
+ * The tiles follow each other row by row, within a tile the pairs are ordered row
+ * by row. A run of tile * tile consecutive pairs thus needs about 2 * tile series.
+ *
+ * Returns the number of pairs.
+ */
+int series_batch_tile_order(int num_series, int tile, int (*tasks)[2]) {
+    if (tile < 1) {
+        tile = 1;
+    }
+    int t = 0;
+    for (int rb = 0; rb < num_series; rb += tile) {
+        int re = MIN(rb + tile, num_series);
+        for (int cb = rb; cb < num_series; cb += tile) {
+            int ce = MIN(cb + tile, num_series);
+            for (int r = rb; r < re; r++) {
+                for (int c = MAX(cb, r + 1); c < ce; c++) {
+                    tasks[t][0] = r;
+                    tasks[t][1] = c;
+                    t++;
+                }
+            }
+        }
+    }
+    return t;
+}
+
+int series_batch_builder_init(SeriesBatchBuilder *builder, int num_series) {
+    builder->num_series = num_series;
+    builder->slot = malloc(sizeof(int) * (num_series + 1));
+    builder->ids = malloc(sizeof(int) * (num_series + 1));
+    if (!builder->slot || !builder->ids) {
+        fprintf(stderr, "Error: cannot allocate memory for %d series\n", num_series);
+        series_batch_builder_free(builder);
+        return -1;
+    }
+    for (int i = 0; i < num_series; i++) {
+        builder->slot[i] = -1;
+    }
+    return 0;
+}
+
+void series_batch_builder_free(SeriesBatchBuilder *builder) {
+    free(builder->slot);
+    free(builder->ids);
+    memset(builder, 0, sizeof(SeriesBatchBuilder));
+}
+
+// Distinct series of the pairs first, ..., first+count-1 (builder->ids), returns their number
+static int series_batch_collect(SeriesBatchBuilder *builder, int (*tasks)[2], int first, int count) {
+    int nb_series = 0;
+    for (int b = first; b < first + count; b++) {
+        for (int side = 0; side < 2; side++) {
+            int id = tasks[b][side];
+            if (builder->slot[id] < 0) {
+                builder->slot[id] = nb_series;
+                builder->ids[nb_series++] = id;
+            }
+        }
+    }
+    return nb_series;
+}
+
+static void series_batch_reset(SeriesBatchBuilder *builder, int nb_series) {
+    for (int i = 0; i < nb_series; i++) {
+        builder->slot[builder->ids[i]] = -1;
+    }
+}
+
+// Largest batch of nb_pairs pairs with series of at most max_length values
+size_t series_batch_max_size(int nb_pairs, idx_t max_length) {
+    return series_batch_tables_size(nb_pairs, 2 * nb_pairs) +
+           2 * (size_t)nb_pairs * series_batch_align(sizeof(double) * (size_t)max_length);
+}
+
+// Size of the same pairs with both series of every pair (header, lengths and values)
+size_t series_batch_pairwise_size(int (*tasks)[2], int first, int count, const int *lengths) {
+    size_t bytes = sizeof(int);
+    for (int b = first; b < first + count; b++) {
+        bytes += 2 * sizeof(int) + sizeof(double) * ((size_t)lengths[tasks[b][0]] + lengths[tasks[b][1]]);
+    }
+    return bytes;
+}
+
+size_t series_batch_packed_size(SeriesBatchBuilder *builder, int (*tasks)[2], int first, int count,
+                                const int *lengths) {
+    int nb_series = series_batch_collect(builder, tasks, first, count);
+    size_t bytes = series_batch_tables_size(count, nb_series);
+    for (int i = 0; i < nb_series; i++) {
+        bytes += series_batch_align(sizeof(double) * (size_t)lengths[builder->ids[i]]);
+    }
+    series_batch_reset(builder, nb_series);
+    return bytes;
+}
+
+/*
+ * Pack the pairs first, ..., first+count-1 in buf (at least series_batch_packed_size
+ * bytes, 64-byte aligned for aligned series). Returns the size of the batch.
+ */
+size_t series_batch_pack(SeriesBatchBuilder *builder, char *buf, int (*tasks)[2], int first, int count,
+                         double **s, const int *lengths) {
+    int nb_series = series_batch_collect(builder, tasks, first, count);
+    int32_t header[SERIES_BATCH_HEADER_INTS] = {count, nb_series, 0, 0};
+    memcpy(buf, header, sizeof(header));
+    int64_t *offsets = (int64_t *)(buf + sizeof(header));
+    int32_t *lens = (int32_t *)(offsets + nb_series);
+    int32_t *pairs = lens + nb_series;
+
+    size_t tables = sizeof(header) + (sizeof(int64_t) + sizeof(int32_t)) * (size_t)nb_series +
+                    sizeof(int32_t) * 2 * (size_t)count;
+    size_t pos = series_batch_tables_size(count, nb_series);
+    memset(buf + tables, 0, pos - tables);
+    for (int i = 0; i < nb_series; i++) {
+        int id = builder->ids[i];
+        size_t bytes = sizeof(double) * (size_t)lengths[id];
+        offsets[i] = (int64_t)pos;
+        lens[i] = lengths[id];
+        memcpy(buf + pos, s[id], bytes);
+        memset(buf + pos + bytes, 0, series_batch_align(bytes) - bytes);
+        pos += series_batch_align(bytes);
+    }
+    for (int b = 0; b < count; b++) {
+        pairs[2 * b] = builder->slot[tasks[first + b][0]];
+        pairs[2 * b + 1] = builder->slot[tasks[first + b][1]];
+    }
+    series_batch_reset(builder, nb_series);
+    return pos;
+}
+
+// Point view into a received batch of size bytes, returns 0 if ok, -1 if malformed
+int series_batch_view(char *buf, size_t size, SeriesBatchView *view) {
+    int32_t header[SERIES_BATCH_HEADER_INTS];
+    memset(view, 0, sizeof(SeriesBatchView));
+    if (size < sizeof(header)) {
+        return -1;
+    }
+    memcpy(header, buf, sizeof(header));
+    int nb_pairs = header[0], nb_series = header[1];
+    if (nb_pairs < 0 || nb_series < 0 || series_batch_tables_size(nb_pairs, nb_series) > size) {
+        return -1;
+    }
+    view->nb_pairs = nb_pairs;
+    view->nb_series = nb_series;
+    view->offsets = (const int64_t *)(buf + sizeof(header));
+    view->lengths = (const int32_t *)(view->offsets + nb_series);
+    view->pairs = view->lengths + nb_series;
+    view->base = buf;
+    for (int i = 0; i < nb_series; i++) {
+        if (view->lengths[i] < 0 || view->offsets[i] < 0 ||
+            (size_t)view->offsets[i] + sizeof(double) * (size_t)view->lengths[i] > size) {
+            return -1;
+        }
+    }
+    for (int k = 0; k < 2 * nb_pairs; k++) {
+        if (view->pairs[k] < 0 || view->pairs[k] >= nb_series) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Distinct series i of a view, i < nb_series
+double *series_batch_distinct(const SeriesBatchView *view, int i, int *length) {
+    *length = view->lengths[i];
+    return (double *)(view->base + view->offsets[i]);
+}
+
+// Series of pair k of a view (row: side 0, column: side 1)
+double *series_batch_series(const SeriesBatchView *view, int k, int side, int *length) {
+    return series_batch_distinct(view, view->pairs[2 * k + side], length);
+}
@@ -9,6 +9,10 @@
 #include "dd_dtw.h"
 #include <mpi.h>
 #include "assets/load_from_csv.h"
+#include "assets/series_store.h"
+#include "assets/series_shared.h"
+#include "assets/result_matrix.h"
+#include "assets/result_cache.h"
 
 /* tags */
 #define WORKTAG 1
@@ -72,8 +76,11 @@ int dtw_distances_prepare(DTWBlock *block, idx_t nb_series_r, idx_t nb_series_c,
     return 0;
 }
 
-// n is the number of time series
-bool save_result(int n, double *result, TickerSeries *series_list, const char *filename) {
+// n is the number of time series, a filename ending in .dtwm gets a binary condensed matrix
+bool save_result(int n, double *result, const SeriesCollection *collection, const char *filename) {
+    if (result_matrix_is_matrix_name(filename)) {
+        return result_matrix_save(filename, collection, n, result, sizeof(double), 0) != 0;
+    }
     FILE *fptr;
     fptr = fopen(filename, "w");
     if (fptr == NULL) {
@@ -83,7 +90,7 @@ bool save_result(int n, double *result, TickerSeries *series_list, const char *f
     int idx = 0;
     for (int r = 0; r < n; r++) {
         for (int c = r + 1; c < n; c++) {
-            fprintf(fptr, "%s; %s; %f;\n", series_list[r].ticker, series_list[c].ticker, result[idx++]);
+            fprintf(fptr, "%s; %s; %f;\n", series_collection_ticker(collection, r), series_collection_ticker(collection, c), result[idx++]);
         }
     }
     fclose(fptr);
@@ -93,8 +100,10 @@ bool save_result(int n, double *result, TickerSeries *series_list, const char *f
 int main(int argc, char *argv[]) {
     if (argc < 4) {
         // expecting 4 or 5 arguments
-        fprintf(stderr, "Uso: %s <caminho_csv> <max_assets> <file_result_destination> [--reuse]\n", argv[0]);
+        fprintf(stderr, "Uso: %s <caminho_csv> <max_assets> <file_result_destination> [--reuse] [--shared] [--cache <cache_file>]\n", argv[0]);
         fprintf(stderr, "[--reuse] optional flag to reuse existing DTW result for aggregation\n");
+        fprintf(stderr, "[--shared] optional flag to send the series once per node (shared memory) instead of with every task\n");
+        fprintf(stderr, "[--cache <cache_file>] optional flag to skip the pairs computed by an earlier run (assets/result_cache.h)\n");
         fprintf(stderr, "Example: %s data/prices.csv 100 results/dtw_result.csv --reuse\n", argv[0]);
         return 1;
     }
@@ -106,6 +115,12 @@ int main(int argc, char *argv[]) {
     const char *file_path = argv[1];
     int max_assets = atoi(argv[2]);
     const char *result_file = argv[3];
+    bool use_shared = false;
+    const char *cache_file = NULL;
+    for (int a = 4; a < argc; a++) {
+        if (strcmp(argv[a], "--shared") == 0) use_shared = true;
+        else if (strcmp(argv[a], "--cache") == 0 && a + 1 < argc) cache_file = argv[++a];
+    }
 
     #if VERBOSE
       printf("Max OpenMP threads = %d\n", omp_get_max_threads());
@@ -138,22 +153,26 @@ int main(int argc, char *argv[]) {
     DTWSettings settings = dtw_settings_default();
     MPI_Barrier(MPI_COMM_WORLD); // Espera todos chegarem aqui
 
+    SeriesCollection collection;
+    series_collection_init(&collection);
     if (my_rank == 0) {
         #if VERBOSE
           printf("Master[%d]: loading time series...\n", my_rank);
         #endif
-        TickerSeries *series = malloc(sizeof(TickerSeries) * max_assets);
-        if (!series) {
-            fprintf(stderr, "Erro: não foi possível alocar memória para séries\n");
-            return 1;
-        }
-
-        int num_series = 0;
-        if (load_series_from_csv(file_path, series, &num_series, max_assets) != 0) {
+        if (load_series_collection_from_file(file_path, &collection, max_assets) != 0) {
             fprintf(stderr, "Erro ao carregar CSV\n");
-            free(series);
-            return 1;
+            MPI_Abort(MPI_COMM_WORLD, 1);
         }
+    }
+
+    // --shared: every node gets the series once, tasks only carry (r, c)
+    SharedSeries shared;
+    if (use_shared && series_shared_bcast(&collection, 0, MPI_COMM_WORLD, &shared) != 0) {
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    if (my_rank == 0) {
+        int num_series = collection.num_series;
         #if VERBOSE
           printf("Loaded %d time series\n", num_series);
         #endif  
@@ -163,8 +182,8 @@ int main(int argc, char *argv[]) {
         idx_t lengths[num_series];
 
         for (int i = 0; i < num_series; i++) {
-            s[i] = series[i].close;
-            lengths[i] = series[i].count;
+            s[i] = series_collection_series(&collection, i);
+            lengths[i] = collection.lengths[i];
         }
 
         idx_t result_length = num_series * (num_series - 1) / 2;
@@ -206,22 +225,55 @@ int main(int argc, char *argv[]) {
                 t++;
             }
         }
+
+        // --cache: the pairs computed by an earlier run are not sent
+        ResultCache cache;
+        uint64_t cache_settings = result_cache_settings_key(&settings, RESULT_CACHE_F64);
+        uint64_t keys[num_series];
+        if (cache_file) {
+            if (result_cache_open(&cache, cache_file) != 0) {
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            for (int i = 0; i < num_series; i++) {
+                keys[i] = series_hash(s[i], lengths[i]);
+            }
+            int kept = 0;
+            for (t = 0; t < num_tasks; t++) {
+                idx_t idx = result_matrix_pair_index(tasks[t][0], tasks[t][1], num_series);
+                if (!result_cache_get(&cache, keys[tasks[t][0]], keys[tasks[t][1]], cache_settings, &result[idx])) {
+                    tasks[kept][0] = tasks[t][0];
+                    tasks[kept][1] = tasks[t][1];
+                    kept++;
+                }
+            }
+            num_tasks = kept;
+        }
+
         // send first round of work to the slaves
         next_task = 0;
+        int idle = 0;
         // adicionar verificaçao se o numero de processos é maior que o numero de tasks
         for (i = 1; i < proc_n; i++) {  // begin with first slave (process 1, since master is 0)
+            if (next_task >= num_tasks) {
+                // fewer tasks than slaves
+                MPI_Send(NULL, 0, MPI_INT, i, KILLTAG, MPI_COMM_WORLD);
+                idle++;
+                continue;
+            }
             // Enviar par de índices
             MPI_Send(tasks[next_task], 2, MPI_INT, i, WORKTAG, MPI_COMM_WORLD);
 
-            // Enviar tamanhos das séries
-            int len_r = lengths[tasks[next_task][0]];
-            int len_c = lengths[tasks[next_task][1]];
-            MPI_Send(&len_r, 1, MPI_INT, i, WORKTAG, MPI_COMM_WORLD);
-            MPI_Send(&len_c, 1, MPI_INT, i, WORKTAG, MPI_COMM_WORLD);
+            if (!use_shared) {
+                // Enviar tamanhos das séries
+                int len_r = lengths[tasks[next_task][0]];
+                int len_c = lengths[tasks[next_task][1]];
+                MPI_Send(&len_r, 1, MPI_INT, i, WORKTAG, MPI_COMM_WORLD);
+                MPI_Send(&len_c, 1, MPI_INT, i, WORKTAG, MPI_COMM_WORLD);
 
-            // Enviar os vetores de preços
-            MPI_Send(s[tasks[next_task][0]], len_r, MPI_DOUBLE, i, WORKTAG, MPI_COMM_WORLD);
-            MPI_Send(s[tasks[next_task][1]], len_c, MPI_DOUBLE, i, WORKTAG, MPI_COMM_WORLD);
+                // Enviar os vetores de preços
+                MPI_Send(s[tasks[next_task][0]], len_r, MPI_DOUBLE, i, WORKTAG, MPI_COMM_WORLD);
+                MPI_Send(s[tasks[next_task][1]], len_c, MPI_DOUBLE, i, WORKTAG, MPI_COMM_WORLD);
+            }
             next_task++;
             #if VERBOSE
                 printf("\nMaster[%d]: sending new work (task %d) to slave %d with positions [%d,%d].", my_rank, next_task-1, i, tasks[next_task-1][0], tasks[next_task-1][1]);
@@ -230,7 +282,7 @@ int main(int argc, char *argv[]) {
         }
 
         // wait for results from slaves
-        kill_msg = proc_n - 1; // will send np-1 kill messages before job is done
+        kill_msg = proc_n - 1 - idle; // will send np-1 kill messages before job is done
 
         while (kill_msg > 0) { // continue while kill_msg kill messages are not send
             // receive dtw result independently from source and tag
@@ -260,21 +312,26 @@ int main(int argc, char *argv[]) {
                 c_i = c - block.cb;
                 result[(block.ce - block.cb) * r_i + c_i] = result_recv[2];
             }
+            if (cache_file) {
+                result_cache_put(&cache, keys[r], keys[c], cache_settings, result_recv[2]);
+            }
 
             if (next_task < num_tasks) {
                 // still some work to do, send it to the free slave
                 // enviar par de índices
                 MPI_Send(tasks[next_task], 2, MPI_INT, status.MPI_SOURCE, WORKTAG, MPI_COMM_WORLD);
 
-                // Enviar tamanhos das séries
-                int len_r = lengths[tasks[next_task][0]];
-                int len_c = lengths[tasks[next_task][1]];
-                MPI_Send(&len_r, 1, MPI_INT, status.MPI_SOURCE, WORKTAG, MPI_COMM_WORLD);
-                MPI_Send(&len_c, 1, MPI_INT, status.MPI_SOURCE, WORKTAG, MPI_COMM_WORLD);
-
-                // Enviar os vetores de preços
-                MPI_Send(s[tasks[next_task][0]], len_r, MPI_DOUBLE, status.MPI_SOURCE, WORKTAG, MPI_COMM_WORLD);
-                MPI_Send(s[tasks[next_task][1]], len_c, MPI_DOUBLE, status.MPI_SOURCE, WORKTAG, MPI_COMM_WORLD);
+                if (!use_shared) {
+                    // Enviar tamanhos das séries
+                    int len_r = lengths[tasks[next_task][0]];
+                    int len_c = lengths[tasks[next_task][1]];
+                    MPI_Send(&len_r, 1, MPI_INT, status.MPI_SOURCE, WORKTAG, MPI_COMM_WORLD);
+                    MPI_Send(&len_c, 1, MPI_INT, status.MPI_SOURCE, WORKTAG, MPI_COMM_WORLD);
+
+                    // Enviar os vetores de preços
+                    MPI_Send(s[tasks[next_task][0]], len_r, MPI_DOUBLE, status.MPI_SOURCE, WORKTAG, MPI_COMM_WORLD);
+                    MPI_Send(s[tasks[next_task][1]], len_c, MPI_DOUBLE, status.MPI_SOURCE, WORKTAG, MPI_COMM_WORLD);
+                }
                 #if VERBOSE
                     printf("\nMaster[%d]: sending new work (task %d) to slave %d with positions [%d,%d].", my_rank, next_task, status.MPI_SOURCE, tasks[next_task][0], tasks[next_task][1]);
                     fflush(stdout);
@@ -297,19 +354,25 @@ int main(int argc, char *argv[]) {
         diff_t = difftime(end_t, start_t);
         diff_t2 = ((double)end.tv_sec * 1e9 + end.tv_nsec) - ((double)start.tv_sec * 1e9 + start.tv_nsec);
         printf("Execution time = %f sec = %f ms\n", diff_t, diff_t2 / 1000000);
+        if (cache_file) {
+            result_cache_print_stats(&cache, result_length);
+            if (result_cache_close(&cache) != 0) {
+                fprintf(stderr, "Error writing cache %s\n", cache_file);
+            }
+        }
 
-        save_result(num_series, result, series, result_file);
+        save_result(num_series, result, &collection, result_file);
 
         #if VERBOSE
           printf("Result saved\n");
         #endif
         free(result);
-        free(series);
 
     } else {
         // I am the slave!
         int task_counter = 0;
         int (*message) = malloc(2 * sizeof(int)); // slave message buffer
+        DTWWorkspace ws = dtw_workspace_empty(); // DTW memory reused over all tasks
 
         while (1) {
             MPI_Recv(message, 2, MPI_INT, 0, MPI_ANY_TAG, MPI_COMM_WORLD, &status); // receive task
@@ -320,6 +383,13 @@ int main(int argc, char *argv[]) {
                     fflush(stdout);
                 #endif
                 break;
+            } else if (status.MPI_TAG == WORKTAG && use_shared) {
+                // Séries lidas da memória compartilhada do nó
+                double value = dtw_distance_ws(shared.ptrs[message[0]], shared.lengths[message[0]],
+                                               shared.ptrs[message[1]], shared.lengths[message[1]], &settings, &ws);
+                double result_send[3] = { (double) message[0], (double) message[1], value };
+                MPI_Send(result_send, 3, MPI_DOUBLE, 0, RESULTTAG, MPI_COMM_WORLD);
+                task_counter++;
             } else if (status.MPI_TAG == WORKTAG) {
                 // Receber tamanhos
                 int len_r, len_c;
@@ -334,7 +404,7 @@ int main(int argc, char *argv[]) {
                 MPI_Recv(series_r, len_r, MPI_DOUBLE, 0, WORKTAG, MPI_COMM_WORLD, &status);
                 MPI_Recv(series_c, len_c, MPI_DOUBLE, 0, WORKTAG, MPI_COMM_WORLD, &status);
 
-                double value = dtw_distance(series_r, len_r, series_c, len_c, &settings);
+                double value = dtw_distance_ws(series_r, len_r, series_c, len_c, &settings, &ws);
 
                 // Liberar buffers
                 free(series_r);
@@ -355,6 +425,7 @@ int main(int argc, char *argv[]) {
                 fflush(stdout);
             }
         }
+        dtw_workspace_free(&ws);
         printf("\n\n");
     }
 
@@ -363,6 +434,11 @@ int main(int argc, char *argv[]) {
 
 
 
+    if (use_shared) {
+        series_shared_free(&shared);
+    }
+    series_collection_free(&collection);
+
     MPI_Finalize();
     return 0;
 }
\ No newline at end of file
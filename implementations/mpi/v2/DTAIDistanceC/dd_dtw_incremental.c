@@ -0,0 +1,167 @@
+/*!
+@file dtw_incremental.c
+@brief DTAIDistance.dtw : Extend a DTW distance when points are appended
+
+@copyright Apache License, Version 2.0, see LICENSE for details.
+*/
+
+#include "dd_dtw_incremental.h"
+
+
+/*!
+ Check if the cumulative cost matrix with these settings only depends on the
+ values of the series, such that it can be extended.
+
+ @param settings A DTWSettings struct with options for the DTW algorithm.
+ @return false for a window, psi-relaxation or pruning.
+ */
+bool dtw_incremental_supported(DTWSettings *settings) {
+    return settings->window == 0 &&
+           settings->psi_1b == 0 && settings->psi_1e == 0 &&
+           settings->psi_2b == 0 && settings->psi_2e == 0 &&
+           !settings->use_pruning && !settings->only_ub &&
+           (settings->inner_dist == 0 || settings->inner_dist == 1);
+}
+
+static inline seq_t dtw_incremental_cost(seq_t a, seq_t b, int inner_dist) {
+    return (inner_dist == 1) ? fabs(a - b) : (a - b) * (a - b);
+}
+
+/*
+ Cell (i, j) from its three predecessors, in the order of dtw_distance such that
+ the result is the same value.
+ */
+static inline seq_t dtw_incremental_cell(seq_t d, seq_t diag, seq_t up, seq_t left,
+                                         seq_t penalty, seq_t max_step) {
+    if (d > max_step) {
+        return INFINITY;
+    }
+    seq_t minv = diag;
+    seq_t tempv = up + penalty;
+    if (tempv < minv) {
+        minv = tempv;
+    }
+    tempv = left + penalty;
+    if (tempv < minv) {
+        minv = tempv;
+    }
+    return d + minv;
+}
+
+static seq_t dtw_incremental_result(seq_t cost, idx_t l1, idx_t l2, DTWSettings *settings) {
+    seq_t result = (settings->inner_dist == 1) ? cost : sqrt(cost);
+    idx_t ldiff = (l1 > l2) ? l1 - l2 : l2 - l1;
+    if (settings->max_length_diff != 0 && ldiff > settings->max_length_diff) {
+        return INFINITY;
+    }
+    if (settings->max_dist != 0 && result > settings->max_dist) {
+        return INFINITY;
+    }
+    return result;
+}
+
+/*!
+ Compute the DTW between two series and keep the boundary of the cumulative cost
+ matrix to extend it later with dtw_distance_extend_ws.
+
+ @param s1 First sequence
+ @param l1 Length of first sequence, at least 1.
+ @param s2 Second sequence
+ @param l2 Length of second sequence, at least 1.
+ @param settings A DTWSettings struct, see dtw_incremental_supported.
+ @param row Receives the last row of the matrix (l2 values).
+ @param col Receives the last column of the matrix (l1 values).
+ @param ws Workspace that provides (and keeps) the memory for the cost matrix rows.
+ @return The same distance as dtw_distance.
+ */
+seq_t dtw_distance_boundary_ws(seq_t *s1, idx_t l1, seq_t *s2, idx_t l2, DTWSettings *settings,
+                               seq_t *row, seq_t *col, DTWWorkspace *ws) {
+    return dtw_distance_extend_ws(s1, l1, s2, l2, settings, 0, 0, NULL, NULL, row, col, ws);
+}
+
+/*!
+ Extend the DTW between the first old_l1 values of s1 and the first old_l2 values
+ of s2 to the full series.
+
+ @param s1 First sequence, starts with the values the boundary was computed for.
+ @param l1 Length of first sequence, at least old_l1.
+ @param s2 Second sequence, starts with the values the boundary was computed for.
+ @param l2 Length of second sequence, at least old_l2.
+ @param settings The same settings as for the boundary, see dtw_incremental_supported.
+ @param old_l1 Length of series 1 for the boundary, 0 to compute the matrix from scratch.
+ @param old_l2 Length of series 2 for the boundary, 0 to compute the matrix from scratch.
+ @param old_row Last row of the old matrix (old_l2 values).
+ @param old_col Last column of the old matrix (old_l1 values).
+ @param row Receives the last row of the new matrix (l2 values), not old_row.
+ @param col Receives the last column of the new matrix (l1 values), not old_col.
+ @param ws Workspace that provides (and keeps) the memory for the cost matrix rows.
+ @return The same distance as dtw_distance on the full series, INFINITY for
+         unsupported settings or lengths.
+ */
+seq_t dtw_distance_extend_ws(seq_t *s1, idx_t l1, seq_t *s2, idx_t l2, DTWSettings *settings,
+                             idx_t old_l1, idx_t old_l2, const seq_t *old_row, const seq_t *old_col,
+                             seq_t *row, seq_t *col, DTWWorkspace *ws) {
+    if (!dtw_incremental_supported(settings) || l1 < 1 || l2 < 1 || old_l1 > l1 || old_l2 > l2) {
+        return INFINITY;
+    }
+    if (old_l1 == 0 || old_l2 == 0) {
+        old_l1 = 0;
+        old_l2 = 0;
+    }
+    int inner_dist = settings->inner_dist;
+    seq_t max_step = (settings->max_step == 0) ? INFINITY : pow(settings->max_step, 2);
+    seq_t penalty = pow(settings->penalty, 2);
+    idx_t width = l2 - old_l2;
+    seq_t *line = (seq_t *)dtw_workspace_reserve(ws, sizeof(seq_t) * (l2 + width));
+    if (!line) {
+        printf("Error: dtw_distance_extend - Cannot allocate memory (size=%zu)\n", l2 + width);
+        return INFINITY;
+    }
+    // line[0..l2) is the previous row of the matrix, prev/cur the new columns of the old rows
+    seq_t *prev = line + old_l2;
+    seq_t *cur = line + l2;
+    idx_t i, j;
+
+    // Old rows, new columns l2_old..l2-1, from the old last column
+    for (i=0; i<old_l1; i++) {
+        seq_t left = old_col[i];
+        seq_t diag = (i == 0) ? INFINITY : old_col[i - 1];
+        for (j=0; j<width; j++) {
+            seq_t up = (i == 0) ? INFINITY : prev[j];
+            cur[j] = dtw_incremental_cell(dtw_incremental_cost(s1[i], s2[old_l2 + j], inner_dist),
+                                          diag, up, left, penalty, max_step);
+            diag = up;
+            left = cur[j];
+        }
+        col[i] = (width > 0) ? cur[width - 1] : old_col[i];
+        for (j=0; j<width; j++) {
+            prev[j] = cur[j];
+        }
+    }
+
+    // New rows, all columns, from the old last row followed by the new columns of row old_l1-1
+    for (j=0; j<old_l2; j++) {
+        line[j] = old_row[j];
+    }
+    if (old_l1 == 0) {
+        for (j=0; j<l2; j++) {
+            line[j] = INFINITY;
+        }
+    }
+    for (i=old_l1; i<l1; i++) {
+        seq_t left = INFINITY;
+        seq_t diag = (i == 0) ? 0 : INFINITY;
+        for (j=0; j<l2; j++) {
+            seq_t up = line[j];
+            line[j] = dtw_incremental_cell(dtw_incremental_cost(s1[i], s2[j], inner_dist),
+                                           diag, up, left, penalty, max_step);
+            diag = up;
+            left = line[j];
+        }
+        col[i] = line[l2 - 1];
+    }
+    for (j=0; j<l2; j++) {
+        row[j] = line[j];
+    }
+    return dtw_incremental_result(row[l2 - 1], l1, l2, settings);
+}
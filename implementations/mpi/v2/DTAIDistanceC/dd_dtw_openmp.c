@@ -8,6 +8,13 @@
 
 #include "dd_dtw_openmp.h"
 #include "dd_dtw.h" 
+#include "dd_dtw_simd.h"
+#include "dd_dtw_f32.h"
+#include "dd_dtw_prune.h"
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#include <sched.h>
+#endif
 
 bool is_openmp_supported() {
 #if defined(_OPENMP)
@@ -114,25 +121,33 @@ idx_t dtw_distances_ptrs_parallel(seq_t **ptrs, idx_t nb_ptrs, idx_t* lengths,
     // Using schedule("static, 1") is also fast for the same reason (neighbor rows are almost
     // the same length, thus a circular assignment works well) but assumes all DTW computations take
     // the same amount of time.
-    #pragma omp parallel for private(r_i, c_i, r, c) schedule(guided)
-    for (r_i=0; r_i < (block->re - block->rb); r_i++) {
-        r = block->rb + r_i;
-        c_i = 0;
-        if (block->triu) {
-            c = cbs[r_i];
-        } else {
-            c = block->cb;
-        }
-        for (; c<block->ce; c++) {
-            double value = dtw_distance(ptrs[r], lengths[r],
-                                        ptrs[c], lengths[c], settings);
+    // The settings are the same for all pairs, select the DTW variant once
+    DTWWsFnPtr dtw_fn = dtw_distance_kernel(settings);
+    #pragma omp parallel private(r_i, c_i, r, c)
+    {
+        // One workspace per thread, reused for all DTW computations of this thread
+        DTWWorkspace ws = dtw_workspace_empty();
+        #pragma omp for schedule(guided)
+        for (r_i=0; r_i < (block->re - block->rb); r_i++) {
+            r = block->rb + r_i;
+            c_i = 0;
             if (block->triu) {
-                output[rls[r_i] + c_i] = value;
+                c = cbs[r_i];
             } else {
-                output[(block->ce - block->cb) * r_i + c_i] = value;
+                c = block->cb;
+            }
+            for (; c<block->ce; c++) {
+                double value = dtw_fn(ptrs[r], lengths[r],
+                                      ptrs[c], lengths[c], settings, &ws);
+                if (block->triu) {
+                    output[rls[r_i] + c_i] = value;
+                } else {
+                    output[(block->ce - block->cb) * r_i + c_i] = value;
+                }
+                c_i++;
             }
-            c_i++;
         }
+        dtw_workspace_free(&ws);
     }
     
     if (block->triu) {
@@ -157,43 +172,672 @@ Distance matrix for n-dimensional DTW, executed on a list of pointers to arrays
 */
 idx_t dtw_distances_ptrs_parallel_d(seq_t **ptrs, idx_t nb_ptrs, idx_t* lengths,
                           seq_t* output, DTWBlock* block, DTWSettings* settings) {
-    idx_t r, c, r_i, c_i;
+    idx_t r, c, r_i;
     idx_t length;
     idx_t *cbs, *rls;
 
+    if (settings->max_dist != 0) {
+        // Thresholded: most pairs are discarded by the lower bounds
+        return dtw_distances_ptrs_parallel_pruned(ptrs, nb_ptrs, lengths, output, block, settings, NULL);
+    }
     if (dtw_distances_prepare(block, nb_ptrs, nb_ptrs, &cbs, &rls, &length, settings) != 0) {
         return 0;
     }
     
 #if defined(_OPENMP)
     r_i=0;
-    // Rows have different lengths, thus use guided scheduling to make threads with shorter rows
-    // not wait for threads with longer rows. Also the first rows are always longer than the last
-    // ones (upper triangular matrix), so this nicely aligns with the guided strategy.
-    // Using schedule("static, 1") is also fast for the same reason (neighbor rows are almost
-    // the same length, thus a circular assignment works well) but assumes all DTW computations take
-    // the same amount of time.
-    #pragma omp parallel for private(r_i, c_i, r, c) schedule(dynamic)
-    for (r_i=0; r_i < (block->re - block->rb); r_i++) {
-        r = block->rb + r_i;
-        c_i = 0;
+    // Use dynamic scheduling over rows. The columns of one row are consecutive in the
+    // output and are computed with one call to dtw_distance_batch, such that columns
+    // with the same length share the SIMD lanes.
+    #pragma omp parallel private(r_i, r, c)
+    {
+        // One workspace per thread, reused for all DTW computations of this thread
+        DTWWorkspace ws = dtw_workspace_empty();
+        #pragma omp for schedule(dynamic)
+        for (r_i=0; r_i < (block->re - block->rb); r_i++) {
+            r = block->rb + r_i;
+            if (block->triu) {
+                c = cbs[r_i];
+                dtw_distance_batch_ws(ptrs[r], lengths[r], &ptrs[c], &lengths[c], block->ce - c,
+                                      &output[rls[r_i]], settings, &ws);
+            } else {
+                c = block->cb;
+                dtw_distance_batch_ws(ptrs[r], lengths[r], &ptrs[c], &lengths[c], block->ce - c,
+                                      &output[(block->ce - block->cb) * r_i], settings, &ws);
+            }
+        }
+        dtw_workspace_free(&ws);
+    }
+    
+    if (block->triu) {
+        free(cbs);
+        free(rls);
+    }
+    return length;
+#else
+    printf("ERROR: DTAIDistanceC is compiled without OpenMP support.\n");
+    for  (r_i=0; r_i<length; r_i++) {
+        output[r_i] = 0;
+    }
+    return 0;
+#endif
+}
+
+
+/*!
+Number of series per tile such that a row block and a column block fit together in
+a cache of the given size.
+
+@param nb_ptrs Number of series
+@param lengths Lengths of the series
+@param cache_size Cache size in bytes, 0 to use the size of the L2 cache (or 1 MB if
+    it cannot be determined).
+@return Tile size, at least the number of SIMD lanes and at most nb_ptrs.
+*/
+idx_t dtw_distances_tile_size(idx_t nb_ptrs, idx_t *lengths, idx_t cache_size) {
+    if (nb_ptrs == 0) {
+        return 1;
+    }
+    if (cache_size == 0) {
+        cache_size = 1024 * 1024;
+#if defined(_SC_LEVEL2_CACHE_SIZE)
+        long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+        if (l2 > 0) {
+            cache_size = (idx_t)l2;
+        }
+#endif
+    }
+    idx_t total = 0;
+    for (idx_t i=0; i<nb_ptrs; i++) {
+        total += lengths[i];
+    }
+    idx_t series_size = MAX(1, total / nb_ptrs) * sizeof(seq_t);
+    // Half of the cache for the two blocks, the rest for the cost matrix rows and output
+    idx_t tile = cache_size / (4 * series_size);
+    // A multiple of the SIMD lanes, such that the rows of a tile fill all lanes
+    idx_t lanes = (idx_t)dtw_simd_lanes();
+    tile = MAX(lanes, tile - tile % lanes);
+    return MIN(tile, nb_ptrs);
+}
+
+
+/*!
+Distance matrix for DTW, executed on a list of pointers to arrays and in parallel over
+tiles of the matrix.
+
+dtw_distances_ptrs_parallel_d hands out rows, every thread thus streams through all
+column series. Here the (upper triangular) block is split in tiles of tile x tile
+series, such that the rows and columns of one tile stay in cache while all their pairs
+are computed. The tiles that contain pairs form a work queue that is consumed with
+dynamic scheduling. The output layout is the same as for dtw_distances_ptrs_parallel_d.
+
+@param tile Number of series per tile, 0 to use dtw_distances_tile_size for the L2 cache.
+@see dtw_distances_ptrs
+*/
+idx_t dtw_distances_ptrs_parallel_tiled(seq_t **ptrs, idx_t nb_ptrs, idx_t* lengths,
+                          seq_t* output, DTWBlock* block, DTWSettings* settings, idx_t tile) {
+    idx_t r, c, r_i, t;
+    idx_t length;
+    idx_t *cbs, *rls;
+
+    if (dtw_distances_prepare(block, nb_ptrs, nb_ptrs, &cbs, &rls, &length, settings) != 0) {
+        return 0;
+    }
+    
+#if defined(_OPENMP)
+    if (tile == 0) {
+        tile = dtw_distances_tile_size(nb_ptrs, lengths, 0);
+    }
+    // Work queue with the first row and first column of the tiles that contain pairs
+    idx_t nb_tr = (block->re - block->rb + tile - 1) / tile;
+    idx_t nb_tc = (block->ce - block->cb + tile - 1) / tile;
+    idx_t *tiles = (idx_t *)malloc(sizeof(idx_t) * 2 * nb_tr * nb_tc);
+    if (!tiles) {
+        printf("Error: dtw_distances_ptrs_parallel_tiled - cannot allocate memory (tiles = %zu)", nb_tr * nb_tc);
         if (block->triu) {
-            c = cbs[r_i];
+            free(cbs);
+            free(rls);
+        }
+        return 0;
+    }
+    idx_t nb_tiles = 0;
+    for (idx_t tr=block->rb; tr<block->re; tr+=tile) {
+        for (idx_t tc=block->cb; tc<block->ce; tc+=tile) {
+            if (block->triu && MAX(tr + 1, block->cb) >= MIN(tc + tile, block->ce)) {
+                continue;
+            }
+            tiles[2 * nb_tiles] = tr;
+            tiles[2 * nb_tiles + 1] = tc;
+            nb_tiles++;
+        }
+    }
+    t=0;
+    #pragma omp parallel private(t, r_i, r, c)
+    {
+        // One workspace per thread, reused for all DTW computations of this thread
+        DTWWorkspace ws = dtw_workspace_empty();
+        #pragma omp for schedule(dynamic)
+        for (t=0; t<nb_tiles; t++) {
+            idx_t tr = tiles[2 * t];
+            idx_t tc = tiles[2 * t + 1];
+            idx_t tr_e = MIN(tr + tile, block->re);
+            idx_t tc_e = MIN(tc + tile, block->ce);
+            for (r=tr; r<tr_e; r++) {
+                r_i = r - block->rb;
+                if (block->triu) {
+                    c = MAX(cbs[r_i], tc);
+                    if (c >= tc_e) {
+                        continue;
+                    }
+                    dtw_distance_batch_ws(ptrs[r], lengths[r], &ptrs[c], &lengths[c], tc_e - c,
+                                          &output[rls[r_i] + c - cbs[r_i]], settings, &ws);
+                } else {
+                    c = tc;
+                    dtw_distance_batch_ws(ptrs[r], lengths[r], &ptrs[c], &lengths[c], tc_e - c,
+                                          &output[(block->ce - block->cb) * r_i + c - block->cb],
+                                          settings, &ws);
+                }
+            }
+        }
+        dtw_workspace_free(&ws);
+    }
+    
+    free(tiles);
+    if (block->triu) {
+        free(cbs);
+        free(rls);
+    }
+    return length;
+#else
+    printf("ERROR: DTAIDistanceC is compiled without OpenMP support.\n");
+    for  (r_i=0; r_i<length; r_i++) {
+        output[r_i] = 0;
+    }
+    return 0;
+#endif
+}
+
+
+// MARK: Work stealing
+
+DTWStealStats dtw_steal_stats_empty(void) {
+    DTWStealStats stats = {
+        .tasks = 0,
+        .splits = 0,
+        .steals = 0,
+        .total_time = 0,
+        .tail_time = 0
+    };
+    return stats;
+}
+
+void dtw_print_steal_stats(DTWStealStats *stats) {
+    printf("Work stealing: %zu tasks, %zu splits, %zu steals, total %.3f ms, tail %.3f ms\n",
+           stats->tasks, stats->splits, stats->steals, stats->total_time * 1000, stats->tail_time * 1000);
+}
+
+#if defined(_OPENMP)
+/* Rows [rb, re) and columns [cb, ce) of the block, the columns of a row are further
+   restricted to the upper triangle if the block is triu. */
+struct dtw_steal_task_s {
+    idx_t rb;
+    idx_t re;
+    idx_t cb;
+    idx_t ce;
+};
+
+/* Owner pushes and pops at the tail, thieves take from the head (the oldest and
+   thus largest tasks). */
+struct dtw_steal_deque_s {
+    struct dtw_steal_task_s *tasks;
+    idx_t head;
+    idx_t tail;
+    idx_t capacity;
+    omp_lock_t lock;
+};
+
+struct dtw_steal_ctx_s {
+    DTWBlock *block;
+    idx_t *cbs;
+    idx_t *lengths;
+    idx_t *prefix;  // prefix[c] is the sum of lengths[0..c-1]
+};
+
+static inline idx_t dtw_steal_row_begin(struct dtw_steal_ctx_s *ctx, struct dtw_steal_task_s *task, idx_t r) {
+    idx_t c = ctx->block->triu ? ctx->cbs[r - ctx->block->rb] : ctx->block->cb;
+    return MAX(c, task->cb);
+}
+
+/* Cost model: the number of cells of the cost matrices, lengths[r] * lengths[c]. */
+static inline idx_t dtw_steal_row_cost(struct dtw_steal_ctx_s *ctx, struct dtw_steal_task_s *task, idx_t r) {
+    idx_t c = dtw_steal_row_begin(ctx, task, r);
+    if (c >= task->ce) {
+        return 0;
+    }
+    return ctx->lengths[r] * (ctx->prefix[task->ce] - ctx->prefix[c]);
+}
+
+static idx_t dtw_steal_task_cost(struct dtw_steal_ctx_s *ctx, struct dtw_steal_task_s *task) {
+    idx_t cost = 0;
+    for (idx_t r=task->rb; r<task->re; r++) {
+        cost += dtw_steal_row_cost(ctx, task, r);
+    }
+    return cost;
+}
+
+/* Split task in two halves of about the same cost: task keeps the first half and
+   other gets the second. Rows are split first, a single row is split on a multiple of
+   the SIMD lanes. Returns false if the task cannot be split. */
+static bool dtw_steal_task_split(struct dtw_steal_ctx_s *ctx, struct dtw_steal_task_s *task,
+                                 idx_t cost, struct dtw_steal_task_s *other) {
+    idx_t r, c;
+    *other = *task;
+    if (task->re - task->rb > 1) {
+        idx_t acc = 0;
+        for (r=task->rb; r<task->re - 1; r++) {
+            acc += dtw_steal_row_cost(ctx, task, r);
+            if (2 * acc >= cost) {
+                break;
+            }
+        }
+        // Both halves have at least one row, also if the last row has most of the cost
+        r = MIN(r + 1, task->re - 1);
+        task->re = r;
+        other->rb = r;
+        return true;
+    }
+    idx_t lanes = (idx_t)dtw_simd_lanes();
+    idx_t cb = dtw_steal_row_begin(ctx, task, task->rb);
+    if (task->ce <= cb + 2 * lanes) {
+        return false;
+    }
+    idx_t half = (ctx->prefix[cb] + ctx->prefix[task->ce]) / 2;
+    for (c=cb + lanes; c<task->ce - lanes; c+=lanes) {
+        if (ctx->prefix[c] >= half) {
+            break;
+        }
+    }
+    task->ce = c;
+    other->cb = c;
+    return true;
+}
+
+static bool dtw_steal_deque_push(struct dtw_steal_deque_s *deque, struct dtw_steal_task_s *task) {
+    bool ok = true;
+    omp_set_lock(&deque->lock);
+    if (deque->head == deque->tail) {
+        deque->head = 0;
+        deque->tail = 0;
+    }
+    if (deque->tail == deque->capacity) {
+        idx_t capacity = 2 * deque->capacity;
+        struct dtw_steal_task_s *tasks = (struct dtw_steal_task_s *)realloc(deque->tasks, sizeof(struct dtw_steal_task_s) * capacity);
+        if (!tasks) {
+            ok = false;
         } else {
-            c = block->cb;
+            deque->tasks = tasks;
+            deque->capacity = capacity;
+        }
+    }
+    if (ok) {
+        deque->tasks[deque->tail++] = *task;
+    }
+    omp_unset_lock(&deque->lock);
+    return ok;
+}
+
+static bool dtw_steal_deque_pop(struct dtw_steal_deque_s *deque, struct dtw_steal_task_s *task, bool steal) {
+    bool found = false;
+    omp_set_lock(&deque->lock);
+    if (deque->head < deque->tail) {
+        *task = steal ? deque->tasks[deque->head++] : deque->tasks[--deque->tail];
+        found = true;
+    }
+    omp_unset_lock(&deque->lock);
+    return found;
+}
+#endif
+
+
+/*!
+Distance matrix for DTW, executed on a list of pointers to arrays and in parallel with
+work stealing.
+
+Every thread has a deque of (row range, column range) tasks and starts with a range of
+rows of the same cost, using lengths[r] * lengths[c] as the cost of a pair. Before
+executing a task, a thread splits it in halves until its cost is below a grain size and
+pushes the other halves on its deque. Idle threads steal the oldest, and thus largest,
+task of another thread and split it in turn. This avoids the tail of
+schedule(dynamic) over rows when rows and series have very different lengths.
+The output layout is the same as for dtw_distances_ptrs_parallel_d.
+
+@param stats Number of tasks, splits and steals, the total time and the tail latency
+    (time from the first idle thread to completion), or NULL.
+@see dtw_distances_ptrs
+*/
+idx_t dtw_distances_ptrs_parallel_steal(seq_t **ptrs, idx_t nb_ptrs, idx_t* lengths,
+                          seq_t* output, DTWBlock* block, DTWSettings* settings,
+                          DTWStealStats* stats) {
+    idx_t i;
+    idx_t length;
+    idx_t *cbs, *rls;
+
+    if (stats != NULL) {
+        *stats = dtw_steal_stats_empty();
+    }
+    if (dtw_distances_prepare(block, nb_ptrs, nb_ptrs, &cbs, &rls, &length, settings) != 0) {
+        return 0;
+    }
+    
+#if defined(_OPENMP)
+    int nb_threads = omp_get_max_threads();
+    int t;
+    idx_t *prefix = (idx_t *)malloc(sizeof(idx_t) * (nb_ptrs + 1));
+    struct dtw_steal_deque_s *deques = (struct dtw_steal_deque_s *)calloc(nb_threads, sizeof(struct dtw_steal_deque_s));
+    bool ok = (prefix && deques);
+    for (t=0; ok && t<nb_threads; t++) {
+        deques[t].capacity = 64;
+        deques[t].tasks = (struct dtw_steal_task_s *)malloc(sizeof(struct dtw_steal_task_s) * deques[t].capacity);
+        ok = (deques[t].tasks != NULL);
+    }
+    if (!ok) {
+        printf("Error: dtw_distances_ptrs_parallel_steal - cannot allocate memory (threads = %d)", nb_threads);
+        for (t=0; deques && t<nb_threads; t++) {
+            free(deques[t].tasks);
+        }
+        free(prefix);
+        free(deques);
+        if (block->triu) {
+            free(cbs);
+            free(rls);
+        }
+        return 0;
+    }
+    prefix[0] = 0;
+    for (i=0; i<nb_ptrs; i++) {
+        prefix[i + 1] = prefix[i] + lengths[i];
+    }
+    struct dtw_steal_ctx_s ctx = {.block=block, .cbs=cbs, .lengths=lengths, .prefix=prefix};
+    struct dtw_steal_task_s root = {.rb=block->rb, .re=block->re, .cb=block->cb, .ce=block->ce};
+    idx_t total_cost = dtw_steal_task_cost(&ctx, &root);
+    // Small enough to balance the last tasks, large enough to fill the SIMD lanes
+    idx_t grain = MAX(1, total_cost / (64 * (idx_t)nb_threads));
+
+    // Initial deques: consecutive row ranges of about the same cost
+    idx_t r = block->rb;
+    idx_t acc = 0;
+    for (t=0; t<nb_threads; t++) {
+        omp_init_lock(&deques[t].lock);
+        struct dtw_steal_task_s task = root;
+        task.rb = r;
+        while (r < block->re && (t == nb_threads - 1 || acc * nb_threads < total_cost * (t + 1))) {
+            acc += dtw_steal_row_cost(&ctx, &root, r);
+            r++;
+        }
+        task.re = r;
+        if (task.rb < task.re) {
+            deques[t].tasks[deques[t].tail++] = task;
+        }
+    }
+    idx_t remaining = length;
+    double first_idle = INFINITY;
+    double start = omp_get_wtime();
+
+    #pragma omp parallel num_threads(nb_threads)
+    {
+        // One workspace and one set of counters per thread
+        DTWWorkspace ws = dtw_workspace_empty();
+        DTWStealStats thread_stats = dtw_steal_stats_empty();
+        int me = omp_get_thread_num();
+        unsigned int seed = 2654435761u * (unsigned int)(me + 1);
+        double idle = INFINITY;
+        idx_t todo, cost, pairs, rt, c;
+        struct dtw_steal_task_s task, other;
+        bool failed = false;
+        while (true) {
+            if (!dtw_steal_deque_pop(&deques[me], &task, false)) {
+                // Steal from the other threads, starting at a random one
+                bool found = false;
+                seed = seed * 1103515245u + 12345u;
+                int first = (int)((seed >> 16) % (unsigned int)nb_threads);
+                for (int v=0; v<nb_threads && !found; v++) {
+                    int victim = (first + v) % nb_threads;
+                    if (victim != me && dtw_steal_deque_pop(&deques[victim], &task, true)) {
+                        found = true;
+                        thread_stats.steals++;
+                    }
+                }
+                if (!found) {
+                    if (idle == INFINITY) {
+                        idle = omp_get_wtime();
+                    }
+                    #pragma omp atomic read
+                    todo = remaining;
+                    if (todo == 0) {
+                        break;
+                    }
+#if defined(__unix__) || defined(__APPLE__)
+                    // Give the core to a thread with work if there are more threads than cores
+                    sched_yield();
+#endif
+                    continue;
+                }
+            }
+            // Keep the first half, the second half can be stolen
+            cost = dtw_steal_task_cost(&ctx, &task);
+            while (!failed && cost > grain && dtw_steal_task_split(&ctx, &task, cost, &other)) {
+                if (!dtw_steal_deque_push(&deques[me], &other)) {
+                    // Out of memory, execute both halves here
+                    printf("Error: dtw_distances_ptrs_parallel_steal - cannot grow task queue\n");
+                    failed = true;
+                    task.re = MAX(task.re, other.re);
+                    task.ce = MAX(task.ce, other.ce);
+                    break;
+                }
+                thread_stats.splits++;
+                cost = dtw_steal_task_cost(&ctx, &task);
+            }
+            pairs = 0;
+            for (rt=task.rb; rt<task.re; rt++) {
+                c = dtw_steal_row_begin(&ctx, &task, rt);
+                if (c >= task.ce) {
+                    continue;
+                }
+                idx_t rt_i = rt - block->rb;
+                if (block->triu) {
+                    dtw_distance_batch_ws(ptrs[rt], lengths[rt], &ptrs[c], &lengths[c], task.ce - c,
+                                          &output[rls[rt_i] + c - cbs[rt_i]], settings, &ws);
+                } else {
+                    dtw_distance_batch_ws(ptrs[rt], lengths[rt], &ptrs[c], &lengths[c], task.ce - c,
+                                          &output[(block->ce - block->cb) * rt_i + c - block->cb],
+                                          settings, &ws);
+                }
+                pairs += task.ce - c;
+            }
+            thread_stats.tasks++;
+            #pragma omp atomic
+            remaining -= pairs;
+        }
+        dtw_workspace_free(&ws);
+        #pragma omp critical
+        {
+            first_idle = MIN(first_idle, idle);
+            if (stats != NULL) {
+                stats->tasks += thread_stats.tasks;
+                stats->splits += thread_stats.splits;
+                stats->steals += thread_stats.steals;
+            }
+        }
+    }
+    double end = omp_get_wtime();
+    if (stats != NULL) {
+        stats->total_time = end - start;
+        stats->tail_time = (first_idle < end) ? (end - first_idle) : 0;
+    }
+
+    for (t=0; t<nb_threads; t++) {
+        omp_destroy_lock(&deques[t].lock);
+        free(deques[t].tasks);
+    }
+    free(deques);
+    free(prefix);
+    if (block->triu) {
+        free(cbs);
+        free(rls);
+    }
+    return length;
+#else
+    printf("ERROR: DTAIDistanceC is compiled without OpenMP support.\n");
+    for  (i=0; i<length; i++) {
+        output[i] = 0;
+    }
+    return 0;
+#endif
+}
+
+
+/*!
+Distance matrix for DTW with a threshold (settings->max_dist), executed on a list of
+pointers to arrays and in parallel.
+
+The envelopes of all series are computed once, after which every pair goes through
+the LB_Kim, LB_Keogh, early-abandoning DTW cascade (see dd_dtw_prune.h). Pairs with a
+distance larger than max_dist get INFINITY, as with dtw_distances_ptrs_parallel_d.
+
+@param stats Number of pairs discarded by every stage, or NULL.
+@see dtw_distances_ptrs
+*/
+idx_t dtw_distances_ptrs_parallel_pruned(seq_t **ptrs, idx_t nb_ptrs, idx_t* lengths,
+                          seq_t* output, DTWBlock* block, DTWSettings* settings,
+                          DTWPruneStats* stats) {
+    idx_t r, c, r_i, c_i;
+    idx_t length;
+    idx_t *cbs, *rls;
+
+    if (dtw_distances_prepare(block, nb_ptrs, nb_ptrs, &cbs, &rls, &length, settings) != 0) {
+        return 0;
+    }
+    
+#if defined(_OPENMP)
+    // One envelope per series, with a radius that is valid for all pairs
+    idx_t i;
+    idx_t lmin = lengths[0];
+    idx_t lmax = lengths[0];
+    for (i=1; i<nb_ptrs; i++) {
+        lmin = MIN(lmin, lengths[i]);
+        lmax = MAX(lmax, lengths[i]);
+    }
+    idx_t radius = dtw_envelope_radius(lmin, lmax, settings);
+    DTWEnvelope *envs = (DTWEnvelope *)malloc(sizeof(DTWEnvelope) * nb_ptrs);
+    if (!envs) {
+        printf("Error: dtw_distances_ptrs_parallel_pruned - cannot allocate memory (envelopes = %zu)", nb_ptrs);
+        if (block->triu) {
+            free(cbs);
+            free(rls);
         }
-        for (; c<block->ce; c++) {
-            double value = dtw_distance(ptrs[r], lengths[r],
-                                        ptrs[c], lengths[c], settings);
+        return 0;
+    }
+    #pragma omp parallel for schedule(static)
+    for (i=0; i<nb_ptrs; i++) {
+        if (!dtw_envelope_init(&envs[i], ptrs[i], lengths[i], radius)) {
+            envs[i].radius = 0;
+        }
+    }
+    if (stats != NULL) {
+        *stats = dtw_prune_stats_empty();
+    }
+    r_i=0;
+    // As in dtw_distances_ptrs_parallel_d, the columns of a row are one call such that
+    // the pairs left after the lower bounds share the SIMD lanes.
+    #pragma omp parallel private(r_i, c_i, r, c)
+    {
+        // One workspace and one set of counters per thread
+        DTWWorkspace ws = dtw_workspace_empty();
+        DTWPruneStats thread_stats = dtw_prune_stats_empty();
+        #pragma omp for schedule(dynamic)
+        for (r_i=0; r_i < (block->re - block->rb); r_i++) {
+            r = block->rb + r_i;
             if (block->triu) {
-                output[rls[r_i] + c_i] = value;
+                c_i = rls[r_i];
+                c = cbs[r_i];
             } else {
-                output[(block->ce - block->cb) * r_i + c_i] = value;
+                c_i = (block->ce - block->cb) * r_i;
+                c = block->cb;
             }
-            c_i++;
+            dtw_distance_cascade_batch_ws(ptrs[r], lengths[r], &envs[r],
+                                          &ptrs[c], &lengths[c], &envs[c], block->ce - c,
+                                          &output[c_i], settings, &ws, &thread_stats);
+        }
+        dtw_workspace_free(&ws);
+        if (stats != NULL) {
+            #pragma omp critical
+            dtw_prune_stats_add(stats, &thread_stats);
         }
     }
     
+    for (i=0; i<nb_ptrs; i++) {
+        dtw_envelope_free(&envs[i]);
+    }
+    free(envs);
+    if (block->triu) {
+        free(cbs);
+        free(rls);
+    }
+    return length;
+#else
+    printf("ERROR: DTAIDistanceC is compiled without OpenMP support.\n");
+    for  (r_i=0; r_i<length; r_i++) {
+        output[r_i] = 0;
+    }
+    return 0;
+#endif
+}
+
+
+/*!
+Distance matrix for single-precision DTW, executed on a list of pointers to arrays and in parallel.
+
+@see dtw_distances_ptrs_f32
+*/
+idx_t dtw_distances_ptrs_parallel_f32(seq32_t **ptrs, idx_t nb_ptrs, idx_t* lengths,
+                          seq32_t* output, DTWBlock* block, DTWSettings* settings) {
+    idx_t r, c, r_i, c_i;
+    idx_t length;
+    idx_t *cbs, *rls;
+
+    if (dtw_distances_prepare(block, nb_ptrs, nb_ptrs, &cbs, &rls, &length, settings) != 0) {
+        return 0;
+    }
+    
+#if defined(_OPENMP)
+    r_i=0;
+    #pragma omp parallel private(r_i, c_i, r, c)
+    {
+        // One workspace per thread, reused for all DTW computations of this thread
+        DTWWorkspace ws = dtw_workspace_empty();
+        #pragma omp for schedule(dynamic)
+        for (r_i=0; r_i < (block->re - block->rb); r_i++) {
+            r = block->rb + r_i;
+            c_i = 0;
+            if (block->triu) {
+                c = cbs[r_i];
+            } else {
+                c = block->cb;
+            }
+            for (; c<block->ce; c++) {
+                seq32_t value = dtw_distance_f32_ws(ptrs[r], lengths[r],
+                                                    ptrs[c], lengths[c], settings, &ws);
+                if (block->triu) {
+                    output[rls[r_i] + c_i] = value;
+                } else {
+                    output[(block->ce - block->cb) * r_i + c_i] = value;
+                }
+                c_i++;
+            }
+        }
+        dtw_workspace_free(&ws);
+    }
+    
     if (block->triu) {
         free(cbs);
         free(rls);
@@ -226,26 +870,32 @@ idx_t dtw_distances_ndim_ptrs_parallel(seq_t **ptrs, idx_t nb_ptrs, idx_t* lengt
     
 #if defined(_OPENMP)
     r_i=0;
-    #pragma omp parallel for private(r_i, c_i, r, c) schedule(guided)
-    for (r_i=0; r_i < (block->re - block->rb); r_i++) {
-        r = block->rb + r_i;
-        c_i = 0;
-        if (block->triu) {
-            c = cbs[r_i];
-        } else {
-            c = block->cb;
-        }
-        for (; c<block->ce; c++) {
-            double value = dtw_distance_ndim(ptrs[r], lengths[r],
-                          ptrs[c], lengths[c],
-                          ndim, settings);
+    #pragma omp parallel private(r_i, c_i, r, c)
+    {
+        // One workspace per thread, reused for all DTW computations of this thread
+        DTWWorkspace ws = dtw_workspace_empty();
+        #pragma omp for schedule(guided)
+        for (r_i=0; r_i < (block->re - block->rb); r_i++) {
+            r = block->rb + r_i;
+            c_i = 0;
             if (block->triu) {
-                output[rls[r_i] + c_i] = value;
+                c = cbs[r_i];
             } else {
-                output[(block->ce - block->cb) * r_i + c_i] = value;
+                c = block->cb;
+            }
+            for (; c<block->ce; c++) {
+                double value = dtw_distance_ndim_ws(ptrs[r], lengths[r],
+                                 ptrs[c], lengths[c],
+                                 ndim, settings, &ws);
+                if (block->triu) {
+                    output[rls[r_i] + c_i] = value;
+                } else {
+                    output[(block->ce - block->cb) * r_i + c_i] = value;
+                }
+                c_i++;
             }
-            c_i++;
         }
+        dtw_workspace_free(&ws);
     }
     
     if (block->triu) {
@@ -280,25 +930,33 @@ idx_t dtw_distances_matrix_parallel(seq_t *matrix, idx_t nb_rows, idx_t nb_cols,
     
 #if defined(_OPENMP)
     r_i=0;
-    #pragma omp parallel for private(r_i, c_i, r, c) schedule(guided)
-    for (r_i=0; r_i < (block->re - block->rb); r_i++) {
-        r = block->rb + r_i;
-        c_i = 0;
-        if (block->triu) {
-            c = cbs[r_i];
-        } else {
-            c = block->cb;
-        }
-        for (; c<block->ce; c++) {
-            double value = dtw_distance(&matrix[r*nb_cols], nb_cols,
-                                         &matrix[c*nb_cols], nb_cols, settings);
+    // The settings are the same for all pairs, select the DTW variant once
+    DTWWsFnPtr dtw_fn = dtw_distance_kernel(settings);
+    #pragma omp parallel private(r_i, c_i, r, c)
+    {
+        // One workspace per thread, reused for all DTW computations of this thread
+        DTWWorkspace ws = dtw_workspace_empty();
+        #pragma omp for schedule(guided)
+        for (r_i=0; r_i < (block->re - block->rb); r_i++) {
+            r = block->rb + r_i;
+            c_i = 0;
             if (block->triu) {
-                output[rls[r_i] + c_i] = value;
+                c = cbs[r_i];
             } else {
-                output[(block->ce - block->cb) * r_i + c_i] = value;
+                c = block->cb;
+            }
+            for (; c<block->ce; c++) {
+                double value = dtw_fn(&matrix[r*nb_cols], nb_cols,
+                                      &matrix[c*nb_cols], nb_cols, settings, &ws);
+                if (block->triu) {
+                    output[rls[r_i] + c_i] = value;
+                } else {
+                    output[(block->ce - block->cb) * r_i + c_i] = value;
+                }
+                c_i++;
             }
-            c_i++;
         }
+        dtw_workspace_free(&ws);
     }
     
     if (block->triu) {
@@ -333,26 +991,32 @@ idx_t dtw_distances_ndim_matrix_parallel(seq_t *matrix, idx_t nb_rows, idx_t nb_
     
 #if defined(_OPENMP)
     r_i=0;
-    #pragma omp parallel for private(r_i, c_i, r, c) schedule(guided)
-    for (r_i=0; r_i < (block->re - block->rb); r_i++) {
-        r = block->rb + r_i;
-        c_i = 0;
-        if (block->triu) {
-            c = cbs[r_i];
-        } else {
-            c = block->cb;
-        }
-        for (; c<block->ce; c++) {
-            double value = dtw_distance_ndim(&matrix[r*nb_cols*ndim], nb_cols,
-                                             &matrix[c*nb_cols*ndim], nb_cols,
-                                             ndim, settings);
+    #pragma omp parallel private(r_i, c_i, r, c)
+    {
+        // One workspace per thread, reused for all DTW computations of this thread
+        DTWWorkspace ws = dtw_workspace_empty();
+        #pragma omp for schedule(guided)
+        for (r_i=0; r_i < (block->re - block->rb); r_i++) {
+            r = block->rb + r_i;
+            c_i = 0;
             if (block->triu) {
-                output[rls[r_i] + c_i] = value;
+                c = cbs[r_i];
             } else {
-                output[(block->ce - block->cb) * r_i + c_i] = value;
+                c = block->cb;
+            }
+            for (; c<block->ce; c++) {
+                double value = dtw_distance_ndim_ws(&matrix[r*nb_cols*ndim], nb_cols,
+                                                    &matrix[c*nb_cols*ndim], nb_cols,
+                                                    ndim, settings, &ws);
+                if (block->triu) {
+                    output[rls[r_i] + c_i] = value;
+                } else {
+                    output[(block->ce - block->cb) * r_i + c_i] = value;
+                }
+                c_i++;
             }
-            c_i++;
         }
+        dtw_workspace_free(&ws);
     }
     
     if (block->triu) {
@@ -387,25 +1051,33 @@ idx_t dtw_distances_matrices_parallel(seq_t *matrix_r, idx_t nb_rows_r, idx_t nb
     
 #if defined(_OPENMP)
     r_i=0;
-    #pragma omp parallel for private(r_i, c_i, r, c) schedule(guided)
-    for (r_i=0; r_i < (block->re - block->rb); r_i++) {
-        r = block->rb + r_i;
-        c_i = 0;
-        if (block->triu) {
-            c = cbs[r_i];
-        } else {
-            c = block->cb;
-        }
-        for (; c<block->ce; c++) {
-            double value = dtw_distance(&matrix_r[r*nb_cols_r], nb_cols_r,
-                                        &matrix_c[c*nb_cols_c], nb_cols_c, settings);
+    // The settings are the same for all pairs, select the DTW variant once
+    DTWWsFnPtr dtw_fn = dtw_distance_kernel(settings);
+    #pragma omp parallel private(r_i, c_i, r, c)
+    {
+        // One workspace per thread, reused for all DTW computations of this thread
+        DTWWorkspace ws = dtw_workspace_empty();
+        #pragma omp for schedule(guided)
+        for (r_i=0; r_i < (block->re - block->rb); r_i++) {
+            r = block->rb + r_i;
+            c_i = 0;
             if (block->triu) {
-                output[rls[r_i] + c_i] = value;
+                c = cbs[r_i];
             } else {
-                output[(block->ce - block->cb) * r_i + c_i] = value;
+                c = block->cb;
+            }
+            for (; c<block->ce; c++) {
+                double value = dtw_fn(&matrix_r[r*nb_cols_r], nb_cols_r,
+                                      &matrix_c[c*nb_cols_c], nb_cols_c, settings, &ws);
+                if (block->triu) {
+                    output[rls[r_i] + c_i] = value;
+                } else {
+                    output[(block->ce - block->cb) * r_i + c_i] = value;
+                }
+                c_i++;
             }
-            c_i++;
         }
+        dtw_workspace_free(&ws);
     }
     
     if (block->triu) {
@@ -440,26 +1112,32 @@ idx_t dtw_distances_ndim_matrices_parallel(seq_t *matrix_r, idx_t nb_rows_r, idx
     
 #if defined(_OPENMP)
     r_i=0;
-    #pragma omp parallel for private(r_i, c_i, r, c) schedule(guided)
-    for (r_i=0; r_i < (block->re - block->rb); r_i++) {
-        r = block->rb + r_i;
-        c_i = 0;
-        if (block->triu) {
-            c = cbs[r_i];
-        } else {
-            c = block->cb;
-        }
-        for (; c<block->ce; c++) {
-            double value = dtw_distance_ndim(&matrix_r[r*nb_cols_r*ndim], nb_cols_r,
-                                             &matrix_c[c*nb_cols_c*ndim], nb_cols_c,
-                                             ndim, settings);
+    #pragma omp parallel private(r_i, c_i, r, c)
+    {
+        // One workspace per thread, reused for all DTW computations of this thread
+        DTWWorkspace ws = dtw_workspace_empty();
+        #pragma omp for schedule(guided)
+        for (r_i=0; r_i < (block->re - block->rb); r_i++) {
+            r = block->rb + r_i;
+            c_i = 0;
             if (block->triu) {
-                output[rls[r_i] + c_i] = value;
+                c = cbs[r_i];
             } else {
-                output[(block->ce - block->cb) * r_i + c_i] = value;
+                c = block->cb;
+            }
+            for (; c<block->ce; c++) {
+                double value = dtw_distance_ndim_ws(&matrix_r[r*nb_cols_r*ndim], nb_cols_r,
+                                                    &matrix_c[c*nb_cols_c*ndim], nb_cols_c,
+                                                    ndim, settings, &ws);
+                if (block->triu) {
+                    output[rls[r_i] + c_i] = value;
+                } else {
+                    output[(block->ce - block->cb) * r_i + c_i] = value;
+                }
+                c_i++;
             }
-            c_i++;
         }
+        dtw_workspace_free(&ws);
     }
     
     if (block->triu) {
@@ -0,0 +1,97 @@
+/*!
+@header dtw_prune.h
+@brief DTAIDistance.dtw : Lower-bound cascade for thresholded DTW
+
+When only the pairs with a distance up to a threshold (settings->max_dist) are
+needed, most pairs can be discarded without computing the full cost matrix. Every
+pair goes through three stages, from cheap to expensive:
+
+  1. LB_Kim: the first and last points are on every warping path, O(1).
+  2. LB_Keogh: distance of one series to the envelope of the other, O(l). The
+     envelopes are computed once per series (see dtw_envelope_init) and the bound
+     is evaluated in both directions.
+  3. Early-abandoning DTW: dtw_distance with max_dist, the wavefront kernel stops
+     as soon as all cells of the current anti-diagonals exceed the threshold. In
+     dtw_distance_cascade_batch_ws the pairs that are left share the SIMD lanes of
+     dtw_distance_batch and a group stops when all its lanes exceed the threshold.
+
+A pair that is pruned by any stage gets distance INFINITY, the result is thus the
+same as calling dtw_distance with max_dist for every pair. The number of pairs
+discarded by every stage is collected in a DTWPruneStats struct.
+
+The lower bounds are only valid without psi-relaxation; with psi-relaxation only
+the last stage is used.
+
+@copyright Apache License, Version 2.0, see LICENSE for details.
+*/
+
+#ifndef dtw_prune_h
+#define dtw_prune_h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <stdbool.h>
+
+#include "dd_globals.h"
+#include "dd_dtw.h"
+
+
+/**
+ Upper and lower envelope of a series: upper[i] and lower[i] are the largest and
+ smallest value of the series within distance radius of position i.
+ */
+struct DTWEnvelope_s {
+    seq_t *lower;
+    seq_t *upper;
+    idx_t length;
+    idx_t radius;
+};
+typedef struct DTWEnvelope_s DTWEnvelope;
+
+/**
+ Number of pairs that are discarded by every stage of the cascade.
+
+ @field pairs Number of pairs that went through the cascade.
+ @field pruned_kim Pairs discarded by LB_Kim.
+ @field pruned_keogh Pairs discarded by LB_Keogh.
+ @field abandoned Pairs for which the DTW computation exceeded the threshold.
+ @field kept Pairs with a distance up to the threshold.
+ */
+struct DTWPruneStats_s {
+    idx_t pairs;
+    idx_t pruned_kim;
+    idx_t pruned_keogh;
+    idx_t abandoned;
+    idx_t kept;
+};
+typedef struct DTWPruneStats_s DTWPruneStats;
+
+// Envelopes
+bool  dtw_envelope_init(DTWEnvelope *env, seq_t *s, idx_t l, idx_t radius);
+void  dtw_envelope_free(DTWEnvelope *env);
+idx_t dtw_envelope_radius(idx_t l1, idx_t l2, DTWSettings *settings);
+
+// Bounds
+seq_t lb_kim(seq_t *s1, idx_t l1, seq_t *s2, idx_t l2, DTWSettings *settings);
+seq_t lb_keogh_envelope(seq_t *s1, idx_t l1, DTWEnvelope *env2, DTWSettings *settings);
+seq_t dtw_lower_bound(seq_t *s1, idx_t l1, DTWEnvelope *env1,
+                      seq_t *s2, idx_t l2, DTWEnvelope *env2, DTWSettings *settings);
+seq_t dtw_upper_bound(seq_t *s1, idx_t l1, seq_t *s2, idx_t l2, DTWSettings *settings);
+
+// Cascade
+DTWPruneStats dtw_prune_stats_empty(void);
+void  dtw_prune_stats_add(DTWPruneStats *stats, DTWPruneStats *other);
+void  dtw_print_prune_stats(DTWPruneStats *stats);
+bool  dtw_cascade_bounds_supported(DTWSettings *settings);
+seq_t dtw_distance_cascade_ws(seq_t *s1, idx_t l1, DTWEnvelope *env1,
+                              seq_t *s2, idx_t l2, DTWEnvelope *env2,
+                              DTWSettings *settings, DTWWorkspace *ws, DTWPruneStats *stats);
+idx_t dtw_distance_cascade_batch_ws(seq_t *s1, idx_t l1, DTWEnvelope *env1,
+                                    seq_t **s2s, idx_t *l2s, DTWEnvelope *env2s, idx_t n,
+                                    seq_t *output, DTWSettings *settings, DTWWorkspace *ws,
+                                    DTWPruneStats *stats);
+seq_t dtw_distance_cascade(seq_t *s1, idx_t l1, seq_t *s2, idx_t l2,
+                           DTWSettings *settings, DTWPruneStats *stats);
+
+#endif /* dtw_prune_h */
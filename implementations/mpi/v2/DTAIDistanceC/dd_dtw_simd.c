@@ -0,0 +1,823 @@
+/*!
+@file dtw_simd.c
+@brief DTAIDistance.dtw : SIMD kernels for Dynamic Time Warping
+
+The DTW recurrence D[i][j] = d(i,j) + min(D[i-1][j-1], D[i-1][j], D[i][j-1]) has
+a dependency on the left neighbour, so a row cannot be vectorized. All cells on
+one anti-diagonal (i+j = k) only depend on the two previous anti-diagonals and
+can be computed in parallel. The wavefront kernel stores three anti-diagonals,
+indexed by the row i, and fills each one with AVX2 (4 lanes) or AVX-512
+(8 lanes).
+
+The additions, multiplications and minimums are the same operations as in the
+scalar dtw_distance, only executed in a different order of cells. The result is
+thus bit-identical to the scalar version for the settings accepted by
+dtw_simd_settings_supported.
+
+With max_dist set, the wavefront stops as soon as two consecutive anti-diagonals
+only hold values larger than max_dist. Every warping path crosses one of them and
+the cumulative cost never decreases along a path, so the result would be larger
+than max_dist and INFINITY is returned, as dtw_distance does.
+
+The single-precision wavefront kernel is the same algorithm with 8 (AVX2) or 16
+(AVX-512) float lanes and is bit-identical to dtw_distance_f32.
+
+The batch kernel takes the other route: one series is compared against 4 or 8
+series of equal length at the same time, each SIMD lane holding a different
+pair. The cells are computed row by row exactly as in the scalar code.
+
+@copyright Apache License, Version 2.0, see LICENSE for details.
+*/
+
+#include "dd_dtw_simd.h"
+#include "dd_dtw_f32.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DTW_SIMD_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__) && !defined(__clang__)
+// Fusing the square and the addition into an FMA would round differently than
+// the scalar code and break bit-identical results.
+#pragma GCC optimize ("fp-contract=off")
+#endif
+
+
+// MARK: Runtime selection
+
+static int dtw_simd_level_cur = -1;
+
+/*!
+ Detect the best instruction set supported by the CPU that runs the code.
+ */
+int dtw_simd_detect(void) {
+#if defined(DTW_SIMD_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return DTW_SIMD_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return DTW_SIMD_AVX2;
+    }
+#endif
+    return DTW_SIMD_NONE;
+}
+
+/*!
+ Instruction set that is used by the SIMD kernels.
+ */
+int dtw_simd_level(void) {
+    if (dtw_simd_level_cur < 0) {
+        dtw_simd_level_cur = dtw_simd_detect();
+    }
+    return dtw_simd_level_cur;
+}
+
+/*!
+ Restrict the instruction set used by the SIMD kernels. A level higher than what
+ the CPU supports is lowered to the supported level.
+ */
+void dtw_simd_set_level(int level) {
+    int detected = dtw_simd_detect();
+    if (level < DTW_SIMD_NONE) {
+        level = DTW_SIMD_NONE;
+    }
+    dtw_simd_level_cur = MIN(level, detected);
+}
+
+/*!
+ Number of series pairs that dtw_distance_batch computes in lockstep.
+ */
+int dtw_simd_lanes(void) {
+    switch (dtw_simd_level()) {
+        case DTW_SIMD_AVX2:
+            return 4;
+        case DTW_SIMD_AVX512:
+            return 8;
+        default:
+            return 1;
+    }
+}
+
+const char * dtw_simd_level_name(int level) {
+    switch (level) {
+        case DTW_SIMD_AVX2:
+            return "avx2";
+        case DTW_SIMD_AVX512:
+            return "avx512";
+        default:
+            return "scalar";
+    }
+}
+
+/*!
+ Check if the SIMD kernels compute the same result as dtw_distance for these settings.
+ The kernels compute the full cost matrix with squared Euclidean inner distance and
+ do not support pruning, psi-relaxation, penalties, maximal steps or a band smaller
+ than the longest series. A maximal distance (max_dist) is supported.
+ */
+bool dtw_simd_settings_supported(idx_t l1, idx_t l2, DTWSettings *settings) {
+    if (l1 == 0 || l2 == 0) {
+        return false;
+    }
+    if (settings->window != 0 && settings->window < MAX(l1, l2)) {
+        return false;
+    }
+    if (settings->max_step != 0 || settings->penalty != 0) {
+        return false;
+    }
+    if (settings->psi_1b != 0 || settings->psi_1e != 0 ||
+        settings->psi_2b != 0 || settings->psi_2e != 0) {
+        return false;
+    }
+    if (settings->use_pruning || settings->only_ub || settings->inner_dist != 0) {
+        return false;
+    }
+    return true;
+}
+
+
+// MARK: Wavefront
+
+/* Smallest value of cells lo..hi (inclusive) of an anti-diagonal. */
+static inline seq_t dtw_wavefront_diag_min(seq_t *diag, idx_t lo, idx_t hi) {
+    seq_t minv = INFINITY;
+    for (idx_t i=lo; i<=hi; i++) {
+        if (diag[i] < minv) {
+            minv = diag[i];
+        }
+    }
+    return minv;
+}
+
+/* Compute cells lo..hi (inclusive) of anti-diagonal k without SIMD. */
+static inline void dtw_wavefront_diag_scalar(seq_t *cur, seq_t *p, seq_t *pp,
+                                             seq_t *s1, seq_t *s2r, idx_t l2, idx_t k,
+                                             idx_t lo, idx_t hi) {
+    seq_t minv;
+    seq_t d;
+    for (idx_t i=lo; i<=hi; i++) {
+        d = SEDIST(s1[i - 1], s2r[l2 - k + i]);
+        minv = pp[i - 1];
+        if (p[i - 1] < minv) {
+            minv = p[i - 1];
+        }
+        if (p[i] < minv) {
+            minv = p[i];
+        }
+        cur[i] = d + minv;
+    }
+}
+
+#if defined(DTW_SIMD_X86)
+__attribute__((target("avx2")))
+static idx_t dtw_wavefront_diag_avx2(seq_t *cur, seq_t *p, seq_t *pp,
+                                     seq_t *s1, seq_t *s2r, idx_t l2, idx_t k,
+                                     idx_t lo, idx_t hi) {
+    idx_t i = lo;
+    for (; i + 3 <= hi; i += 4) {
+        __m256d a = _mm256_loadu_pd(&s1[i - 1]);
+        __m256d b = _mm256_loadu_pd(&s2r[l2 - k + i]);
+        __m256d diff = _mm256_sub_pd(a, b);
+        __m256d d = _mm256_mul_pd(diff, diff);
+        // min returns its second operand if one is NaN: same order as the scalar loop
+        __m256d minv = _mm256_min_pd(_mm256_loadu_pd(&p[i]),
+                                     _mm256_min_pd(_mm256_loadu_pd(&p[i - 1]),
+                                                   _mm256_loadu_pd(&pp[i - 1])));
+        _mm256_storeu_pd(&cur[i], _mm256_add_pd(d, minv));
+    }
+    return i;
+}
+
+__attribute__((target("avx512f")))
+static idx_t dtw_wavefront_diag_avx512(seq_t *cur, seq_t *p, seq_t *pp,
+                                       seq_t *s1, seq_t *s2r, idx_t l2, idx_t k,
+                                       idx_t lo, idx_t hi) {
+    idx_t i = lo;
+    for (; i + 7 <= hi; i += 8) {
+        __m512d a = _mm512_loadu_pd(&s1[i - 1]);
+        __m512d b = _mm512_loadu_pd(&s2r[l2 - k + i]);
+        __m512d diff = _mm512_sub_pd(a, b);
+        __m512d d = _mm512_mul_pd(diff, diff);
+        __m512d minv = _mm512_min_pd(_mm512_loadu_pd(&p[i]),
+                                     _mm512_min_pd(_mm512_loadu_pd(&p[i - 1]),
+                                                   _mm512_loadu_pd(&pp[i - 1])));
+        _mm512_storeu_pd(&cur[i], _mm512_add_pd(d, minv));
+    }
+    return i;
+}
+#endif
+
+/*!
+ Compute the DTW between two series by iterating over the anti-diagonals of the
+ cost matrix. Uses the SIMD level returned by dtw_simd_level.
+
+ Only valid for settings accepted by dtw_simd_settings_supported, otherwise
+ dtw_distance is called.
+
+ @param s1 First sequence
+ @param l1 Length of first sequence.
+ @param s2 Second sequence
+ @param l2 Length of second sequence.
+ @param settings A DTWSettings struct with options for the DTW algorithm.
+ @param ws Workspace that provides (and keeps) the memory for the anti-diagonals.
+ */
+seq_t dtw_distance_wavefront_ws(seq_t *s1, idx_t l1, seq_t *s2, idx_t l2, DTWSettings *settings, DTWWorkspace *ws) {
+    if (!dtw_simd_settings_supported(l1, l2, settings)) {
+        return dtw_distance_ws(s1, l1, s2, l2, settings, ws);
+    }
+    idx_t ldiff = (l1 > l2) ? (l1 - l2) : (l2 - l1);
+    if (settings->max_length_diff != 0 && ldiff > settings->max_length_diff) {
+        return INFINITY;
+    }
+#if defined(DTW_SIMD_X86)
+    int level = dtw_simd_level();
+#endif
+    // Three anti-diagonals of length l1+1 (indexed by row) and series 2 reversed such that
+    // the cells on an anti-diagonal read both series in increasing memory order.
+    seq_t *buffer = (seq_t *)dtw_workspace_reserve(ws, sizeof(seq_t) * (3 * (l1 + 1) + l2));
+    if (!buffer) {
+        printf("Error: dtw_distance_wavefront - Cannot allocate memory (size=%zu)\n", 3*(l1+1) + l2);
+        return 0;
+    }
+    seq_t *pp = buffer;                // anti-diagonal k-2
+    seq_t *p = buffer + (l1 + 1);      // anti-diagonal k-1
+    seq_t *cur = buffer + 2 * (l1 + 1); // anti-diagonal k
+    seq_t *s2r = buffer + 3 * (l1 + 1);
+    seq_t *tmp;
+    idx_t i, lo, hi;
+    seq_t max_dist = INFINITY;
+    if (settings->max_dist != 0) {
+        max_dist = pow(settings->max_dist, 2);
+    }
+    for (i=0; i<3*(l1+1); i++) {
+        buffer[i] = INFINITY;
+    }
+    for (i=0; i<l2; i++) {
+        s2r[i] = s2[l2 - 1 - i];
+    }
+    p[0] = 0;  // D[0][0]
+    for (idx_t k=1; k<=l1+l2; k++) {
+        // First row and first column are INFINITY, except D[0][0]
+        cur[0] = INFINITY;
+        if (k <= l1) {
+            cur[k] = INFINITY;
+        }
+        lo = (k > l2) ? (k - l2) : 1;
+        hi = (k - 1 < l1) ? (k - 1) : l1;
+        if (lo <= hi) {
+            i = lo;
+#if defined(DTW_SIMD_X86)
+            if (level == DTW_SIMD_AVX512) {
+                i = dtw_wavefront_diag_avx512(cur, p, pp, s1, s2r, l2, k, lo, hi);
+            } else if (level == DTW_SIMD_AVX2) {
+                i = dtw_wavefront_diag_avx2(cur, p, pp, s1, s2r, l2, k, lo, hi);
+            }
+#endif
+            dtw_wavefront_diag_scalar(cur, p, pp, s1, s2r, l2, k, i, hi);
+        }
+        // Early abandoning, every warping path crosses anti-diagonal k-1 or k
+        if (max_dist != INFINITY && (k & 15) == 0 && k < l1 + l2 &&
+            dtw_wavefront_diag_min(cur, lo, hi) > max_dist &&
+            dtw_wavefront_diag_min(p, (k - 1 > l2) ? (k - 1 - l2) : 1, (k - 2 < l1) ? (k - 2) : l1) > max_dist) {
+            return INFINITY;
+        }
+        tmp = pp;
+        pp = p;
+        p = cur;
+        cur = tmp;
+    }
+    // After the last rotation, p holds anti-diagonal l1+l2
+    seq_t result = sqrt(p[l1]);
+    if (settings->max_dist != 0 && result > settings->max_dist) {
+        result = INFINITY;
+    }
+    return result;
+}
+
+/*!
+ Compute the DTW between two series by iterating over the anti-diagonals of the
+ cost matrix, using a temporary workspace.
+
+ @see dtw_distance_wavefront_ws
+ */
+seq_t dtw_distance_wavefront(seq_t *s1, idx_t l1, seq_t *s2, idx_t l2, DTWSettings *settings) {
+    DTWWorkspace ws = dtw_workspace_empty();
+    seq_t result = dtw_distance_wavefront_ws(s1, l1, s2, l2, settings, &ws);
+    dtw_workspace_free(&ws);
+    return result;
+}
+
+
+
+/* Smallest value of cells lo..hi (inclusive) of an anti-diagonal. */
+static inline seq32_t dtw_wavefront_diag_min_f32(seq32_t *diag, idx_t lo, idx_t hi) {
+    seq32_t minv = INFINITY;
+    for (idx_t i=lo; i<=hi; i++) {
+        if (diag[i] < minv) {
+            minv = diag[i];
+        }
+    }
+    return minv;
+}
+
+/* Single-precision version of dtw_wavefront_diag_scalar. */
+static inline void dtw_wavefront_diag_scalar_f32(seq32_t *cur, seq32_t *p, seq32_t *pp,
+                                                 seq32_t *s1, seq32_t *s2r, idx_t l2, idx_t k,
+                                                 idx_t lo, idx_t hi) {
+    seq32_t minv;
+    seq32_t d;
+    for (idx_t i=lo; i<=hi; i++) {
+        d = SEDIST(s1[i - 1], s2r[l2 - k + i]);
+        minv = pp[i - 1];
+        if (p[i - 1] < minv) {
+            minv = p[i - 1];
+        }
+        if (p[i] < minv) {
+            minv = p[i];
+        }
+        cur[i] = d + minv;
+    }
+}
+
+#if defined(DTW_SIMD_X86)
+__attribute__((target("avx2")))
+static idx_t dtw_wavefront_diag_avx2_f32(seq32_t *cur, seq32_t *p, seq32_t *pp,
+                                         seq32_t *s1, seq32_t *s2r, idx_t l2, idx_t k,
+                                         idx_t lo, idx_t hi) {
+    idx_t i = lo;
+    for (; i + 7 <= hi; i += 8) {
+        __m256 a = _mm256_loadu_ps(&s1[i - 1]);
+        __m256 b = _mm256_loadu_ps(&s2r[l2 - k + i]);
+        __m256 diff = _mm256_sub_ps(a, b);
+        __m256 d = _mm256_mul_ps(diff, diff);
+        __m256 minv = _mm256_min_ps(_mm256_loadu_ps(&p[i]),
+                                    _mm256_min_ps(_mm256_loadu_ps(&p[i - 1]),
+                                                  _mm256_loadu_ps(&pp[i - 1])));
+        _mm256_storeu_ps(&cur[i], _mm256_add_ps(d, minv));
+    }
+    return i;
+}
+
+__attribute__((target("avx512f")))
+static idx_t dtw_wavefront_diag_avx512_f32(seq32_t *cur, seq32_t *p, seq32_t *pp,
+                                           seq32_t *s1, seq32_t *s2r, idx_t l2, idx_t k,
+                                           idx_t lo, idx_t hi) {
+    idx_t i = lo;
+    for (; i + 15 <= hi; i += 16) {
+        __m512 a = _mm512_loadu_ps(&s1[i - 1]);
+        __m512 b = _mm512_loadu_ps(&s2r[l2 - k + i]);
+        __m512 diff = _mm512_sub_ps(a, b);
+        __m512 d = _mm512_mul_ps(diff, diff);
+        __m512 minv = _mm512_min_ps(_mm512_loadu_ps(&p[i]),
+                                    _mm512_min_ps(_mm512_loadu_ps(&p[i - 1]),
+                                                  _mm512_loadu_ps(&pp[i - 1])));
+        _mm512_storeu_ps(&cur[i], _mm512_add_ps(d, minv));
+    }
+    return i;
+}
+#endif
+
+/*!
+ Single-precision version of dtw_distance_wavefront, with 8 (AVX2) or 16 (AVX-512)
+ cells per instruction.
+
+ Only valid for settings accepted by dtw_simd_settings_supported, otherwise
+ dtw_distance_f32 is called.
+
+ @param s1 First sequence
+ @param l1 Length of first sequence.
+ @param s2 Second sequence
+ @param l2 Length of second sequence.
+ @param settings A DTWSettings struct with options for the DTW algorithm.
+ @param ws Workspace that provides (and keeps) the memory for the anti-diagonals.
+ */
+seq32_t dtw_distance_wavefront_f32_ws(seq32_t *s1, idx_t l1, seq32_t *s2, idx_t l2, DTWSettings *settings, DTWWorkspace *ws) {
+    if (!dtw_simd_settings_supported(l1, l2, settings)) {
+        return dtw_distance_f32_ws(s1, l1, s2, l2, settings, ws);
+    }
+    idx_t ldiff = (l1 > l2) ? (l1 - l2) : (l2 - l1);
+    if (settings->max_length_diff != 0 && ldiff > settings->max_length_diff) {
+        return INFINITY;
+    }
+#if defined(DTW_SIMD_X86)
+    int level = dtw_simd_level();
+#endif
+    // Three anti-diagonals of length l1+1 (indexed by row) and series 2 reversed such that
+    // the cells on an anti-diagonal read both series in increasing memory order.
+    seq32_t *buffer = (seq32_t *)dtw_workspace_reserve(ws, sizeof(seq32_t) * (3 * (l1 + 1) + l2));
+    if (!buffer) {
+        printf("Error: dtw_distance_wavefront_f32 - Cannot allocate memory (size=%zu)\n", 3*(l1+1) + l2);
+        return 0;
+    }
+    seq32_t *pp = buffer;                // anti-diagonal k-2
+    seq32_t *p = buffer + (l1 + 1);      // anti-diagonal k-1
+    seq32_t *cur = buffer + 2 * (l1 + 1); // anti-diagonal k
+    seq32_t *s2r = buffer + 3 * (l1 + 1);
+    seq32_t *tmp;
+    idx_t i, lo, hi;
+    seq32_t max_dist = INFINITY;
+    if (settings->max_dist != 0) {
+        max_dist = powf(settings->max_dist, 2);
+    }
+    for (i=0; i<3*(l1+1); i++) {
+        buffer[i] = INFINITY;
+    }
+    for (i=0; i<l2; i++) {
+        s2r[i] = s2[l2 - 1 - i];
+    }
+    p[0] = 0;  // D[0][0]
+    for (idx_t k=1; k<=l1+l2; k++) {
+        // First row and first column are INFINITY, except D[0][0]
+        cur[0] = INFINITY;
+        if (k <= l1) {
+            cur[k] = INFINITY;
+        }
+        lo = (k > l2) ? (k - l2) : 1;
+        hi = (k - 1 < l1) ? (k - 1) : l1;
+        if (lo <= hi) {
+            i = lo;
+#if defined(DTW_SIMD_X86)
+            if (level == DTW_SIMD_AVX512) {
+                i = dtw_wavefront_diag_avx512_f32(cur, p, pp, s1, s2r, l2, k, lo, hi);
+            } else if (level == DTW_SIMD_AVX2) {
+                i = dtw_wavefront_diag_avx2_f32(cur, p, pp, s1, s2r, l2, k, lo, hi);
+            }
+#endif
+            dtw_wavefront_diag_scalar_f32(cur, p, pp, s1, s2r, l2, k, i, hi);
+        }
+        // Early abandoning, every warping path crosses anti-diagonal k-1 or k
+        if (max_dist != INFINITY && (k & 15) == 0 && k < l1 + l2 &&
+            dtw_wavefront_diag_min_f32(cur, lo, hi) > max_dist &&
+            dtw_wavefront_diag_min_f32(p, (k - 1 > l2) ? (k - 1 - l2) : 1, (k - 2 < l1) ? (k - 2) : l1) > max_dist) {
+            return INFINITY;
+        }
+        tmp = pp;
+        pp = p;
+        p = cur;
+        cur = tmp;
+    }
+    // After the last rotation, p holds anti-diagonal l1+l2
+    seq32_t result = sqrtf(p[l1]);
+    if (settings->max_dist != 0 && result > settings->max_dist) {
+        result = INFINITY;
+    }
+    return result;
+}
+
+/*!
+ Compute the DTW between two series by iterating over the anti-diagonals of the
+ cost matrix, using a temporary workspace.
+
+ @see dtw_distance_wavefront_f32_ws
+ */
+seq32_t dtw_distance_wavefront_f32(seq32_t *s1, idx_t l1, seq32_t *s2, idx_t l2, DTWSettings *settings) {
+    DTWWorkspace ws = dtw_workspace_empty();
+    seq32_t result = dtw_distance_wavefront_f32_ws(s1, l1, s2, l2, settings, &ws);
+    dtw_workspace_free(&ws);
+    return result;
+}
+
+
+// MARK: Batch
+
+struct dtw_batch_item_s {
+    idx_t length;
+    idx_t idx;
+};
+
+static int dtw_batch_item_cmp(const void *a, const void *b) {
+    const struct dtw_batch_item_s *ia = (const struct dtw_batch_item_s *)a;
+    const struct dtw_batch_item_s *ib = (const struct dtw_batch_item_s *)b;
+    if (ia->length != ib->length) {
+        return (ia->length < ib->length) ? -1 : 1;
+    }
+    return (ia->idx < ib->idx) ? -1 : (ia->idx > ib->idx);
+}
+
+#if defined(DTW_SIMD_X86)
+/*
+ Lockstep DTW between s1 and the 4 series in s2s that all have length l2.
+ Buffer should have room for 4 * (3*l2 + 2) values. The computation stops when
+ all lanes exceed max_dist (squared, INFINITY to disable).
+
+ Rows are computed two at a time: cell j of row i and cell j-1 of row i+1 are
+ independent, which hides the latency of the dependency on the left neighbour.
+ Row i itself is only kept in registers. A cell is min(left, min(up, diag)): min
+ returns its second operand if one is NaN, as the comparisons of dtw_distance.
+ */
+__attribute__((target("avx2")))
+static void dtw_batch_lockstep_avx2(seq_t *s1, idx_t l1, seq_t **s2s, idx_t l2,
+                                    seq_t max_dist, seq_t *buffer, seq_t *output) {
+    const int w = 4;
+    seq_t *cols = buffer;                   // series 2 interleaved, cols[j*w + lane]
+    seq_t *prev = cols + l2 * w;            // previous row of the cost matrix
+    seq_t *cur = prev + (l2 + 1) * w;       // current row of the cost matrix
+    seq_t *tmp;
+    idx_t i, j;
+    for (j=0; j<l2; j++) {
+        for (int lane=0; lane<w; lane++) {
+            cols[j * w + lane] = s2s[lane][j];
+        }
+    }
+    __m256d inf = _mm256_set1_pd(INFINITY);
+    __m256d thr = _mm256_set1_pd(max_dist);
+    __m256d a, a2, d, diff, up, diag, left, left2, left_prev, next, rowmin;
+    _mm256_storeu_pd(&prev[0], _mm256_setzero_pd());
+    for (j=1; j<=l2; j++) {
+        _mm256_storeu_pd(&prev[j * w], inf);
+    }
+    for (i=0; i+1<l1; i+=2) {
+        a = _mm256_set1_pd(s1[i]);
+        a2 = _mm256_set1_pd(s1[i + 1]);
+        diag = _mm256_loadu_pd(&prev[0]);
+        left_prev = inf;  // row i, cell j-2
+        left = inf;       // row i, cell j-1
+        left2 = inf;      // row i+1, cell j-2
+        _mm256_storeu_pd(&cur[0], inf);
+        // Row i, cell 1
+        up = _mm256_loadu_pd(&prev[w]);
+        diff = _mm256_sub_pd(a, _mm256_loadu_pd(&cols[0]));
+        d = _mm256_mul_pd(diff, diff);
+        next = _mm256_add_pd(d, _mm256_min_pd(left, _mm256_min_pd(up, diag)));
+        diag = up;
+        left_prev = left;
+        left = next;
+        for (j=2; j<=l2; j++) {
+            // Row i, cell j
+            up = _mm256_loadu_pd(&prev[j * w]);
+            diff = _mm256_sub_pd(a, _mm256_loadu_pd(&cols[(j - 1) * w]));
+            d = _mm256_mul_pd(diff, diff);
+            next = _mm256_add_pd(d, _mm256_min_pd(left, _mm256_min_pd(up, diag)));
+            diag = up;
+            // Row i+1, cell j-1
+            diff = _mm256_sub_pd(a2, _mm256_loadu_pd(&cols[(j - 2) * w]));
+            d = _mm256_mul_pd(diff, diff);
+            left2 = _mm256_add_pd(d, _mm256_min_pd(left2, _mm256_min_pd(left, left_prev)));
+            _mm256_storeu_pd(&cur[(j - 1) * w], left2);
+            left_prev = left;
+            left = next;
+        }
+        // Row i+1, cell l2
+        diff = _mm256_sub_pd(a2, _mm256_loadu_pd(&cols[(l2 - 1) * w]));
+        d = _mm256_mul_pd(diff, diff);
+        left2 = _mm256_add_pd(d, _mm256_min_pd(left2, _mm256_min_pd(left, left_prev)));
+        _mm256_storeu_pd(&cur[l2 * w], left2);
+        if (max_dist != INFINITY) {
+            // Early abandoning, every warping path crosses row i+1
+            rowmin = inf;
+            for (j=1; j<=l2; j++) {
+                rowmin = _mm256_min_pd(rowmin, _mm256_loadu_pd(&cur[j * w]));
+            }
+            if (_mm256_movemask_pd(_mm256_cmp_pd(rowmin, thr, _CMP_GT_OQ)) == 0xF) {
+                for (int lane=0; lane<w; lane++) {
+                    output[lane] = INFINITY;
+                }
+                return;
+            }
+        }
+        tmp = prev;
+        prev = cur;
+        cur = tmp;
+    }
+    if (i < l1) {
+        // Last row if l1 is odd
+        a = _mm256_set1_pd(s1[i]);
+        left = inf;
+        diag = _mm256_loadu_pd(&prev[0]);
+        _mm256_storeu_pd(&cur[0], inf);
+        for (j=1; j<=l2; j++) {
+            up = _mm256_loadu_pd(&prev[j * w]);
+            diff = _mm256_sub_pd(a, _mm256_loadu_pd(&cols[(j - 1) * w]));
+            d = _mm256_mul_pd(diff, diff);
+            left = _mm256_add_pd(d, _mm256_min_pd(left, _mm256_min_pd(up, diag)));
+            _mm256_storeu_pd(&cur[j * w], left);
+            diag = up;
+        }
+        tmp = prev;
+        prev = cur;
+        cur = tmp;
+    }
+    for (int lane=0; lane<w; lane++) {
+        output[lane] = sqrt(prev[l2 * w + lane]);
+    }
+}
+
+/*
+ Lockstep DTW between s1 and the 8 series in s2s that all have length l2.
+ Buffer should have room for 8 * (3*l2 + 2) values. The computation stops when
+ all lanes exceed max_dist (squared, INFINITY to disable).
+
+ Rows are computed two at a time: cell j of row i and cell j-1 of row i+1 are
+ independent, which hides the latency of the dependency on the left neighbour.
+ Row i itself is only kept in registers.
+ */
+__attribute__((target("avx512f")))
+static void dtw_batch_lockstep_avx512(seq_t *s1, idx_t l1, seq_t **s2s, idx_t l2,
+                                      seq_t max_dist, seq_t *buffer, seq_t *output) {
+    const int w = 8;
+    seq_t *cols = buffer;                   // series 2 interleaved, cols[j*w + lane]
+    seq_t *prev = cols + l2 * w;            // previous row of the cost matrix
+    seq_t *cur = prev + (l2 + 1) * w;       // current row of the cost matrix
+    seq_t *tmp;
+    idx_t i, j;
+    for (j=0; j<l2; j++) {
+        for (int lane=0; lane<w; lane++) {
+            cols[j * w + lane] = s2s[lane][j];
+        }
+    }
+    __m512d inf = _mm512_set1_pd(INFINITY);
+    __m512d thr = _mm512_set1_pd(max_dist);
+    __m512d a, a2, d, diff, up, diag, left, left2, left_prev, next, rowmin;
+    _mm512_storeu_pd(&prev[0], _mm512_setzero_pd());
+    for (j=1; j<=l2; j++) {
+        _mm512_storeu_pd(&prev[j * w], inf);
+    }
+    for (i=0; i+1<l1; i+=2) {
+        a = _mm512_set1_pd(s1[i]);
+        a2 = _mm512_set1_pd(s1[i + 1]);
+        diag = _mm512_loadu_pd(&prev[0]);
+        left_prev = inf;  // row i, cell j-2
+        left = inf;       // row i, cell j-1
+        left2 = inf;      // row i+1, cell j-2
+        _mm512_storeu_pd(&cur[0], inf);
+        // Row i, cell 1
+        up = _mm512_loadu_pd(&prev[w]);
+        diff = _mm512_sub_pd(a, _mm512_loadu_pd(&cols[0]));
+        d = _mm512_mul_pd(diff, diff);
+        next = _mm512_add_pd(d, _mm512_min_pd(left, _mm512_min_pd(up, diag)));
+        diag = up;
+        left_prev = left;
+        left = next;
+        for (j=2; j<=l2; j++) {
+            // Row i, cell j
+            up = _mm512_loadu_pd(&prev[j * w]);
+            diff = _mm512_sub_pd(a, _mm512_loadu_pd(&cols[(j - 1) * w]));
+            d = _mm512_mul_pd(diff, diff);
+            next = _mm512_add_pd(d, _mm512_min_pd(left, _mm512_min_pd(up, diag)));
+            diag = up;
+            // Row i+1, cell j-1
+            diff = _mm512_sub_pd(a2, _mm512_loadu_pd(&cols[(j - 2) * w]));
+            d = _mm512_mul_pd(diff, diff);
+            left2 = _mm512_add_pd(d, _mm512_min_pd(left2, _mm512_min_pd(left, left_prev)));
+            _mm512_storeu_pd(&cur[(j - 1) * w], left2);
+            left_prev = left;
+            left = next;
+        }
+        // Row i+1, cell l2
+        diff = _mm512_sub_pd(a2, _mm512_loadu_pd(&cols[(l2 - 1) * w]));
+        d = _mm512_mul_pd(diff, diff);
+        left2 = _mm512_add_pd(d, _mm512_min_pd(left2, _mm512_min_pd(left, left_prev)));
+        _mm512_storeu_pd(&cur[l2 * w], left2);
+        if (max_dist != INFINITY) {
+            // Early abandoning, every warping path crosses row i+1
+            rowmin = inf;
+            for (j=1; j<=l2; j++) {
+                rowmin = _mm512_min_pd(rowmin, _mm512_loadu_pd(&cur[j * w]));
+            }
+            if (_mm512_cmp_pd_mask(rowmin, thr, _CMP_GT_OQ) == 0xFF) {
+                for (int lane=0; lane<w; lane++) {
+                    output[lane] = INFINITY;
+                }
+                return;
+            }
+        }
+        tmp = prev;
+        prev = cur;
+        cur = tmp;
+    }
+    if (i < l1) {
+        // Last row if l1 is odd
+        a = _mm512_set1_pd(s1[i]);
+        left = inf;
+        diag = _mm512_loadu_pd(&prev[0]);
+        _mm512_storeu_pd(&cur[0], inf);
+        for (j=1; j<=l2; j++) {
+            up = _mm512_loadu_pd(&prev[j * w]);
+            diff = _mm512_sub_pd(a, _mm512_loadu_pd(&cols[(j - 1) * w]));
+            d = _mm512_mul_pd(diff, diff);
+            left = _mm512_add_pd(d, _mm512_min_pd(left, _mm512_min_pd(up, diag)));
+            _mm512_storeu_pd(&cur[j * w], left);
+            diag = up;
+        }
+        tmp = prev;
+        prev = cur;
+        cur = tmp;
+    }
+    for (int lane=0; lane<w; lane++) {
+        output[lane] = sqrt(prev[l2 * w + lane]);
+    }
+}
+#endif
+
+/*!
+ Compute the DTW between one series and a list of other series.
+
+ Series in s2s with the same length are compared to s1 in groups of
+ dtw_simd_lanes() pairs, each SIMD lane computing a different pair. The
+ remaining pairs, and all pairs if the settings are not supported by the SIMD
+ kernels (see dtw_simd_settings_supported), are computed with the DTW
+ variant that dtw_distance_kernel selects once for the settings. The results are identical to calling dtw_distance for every pair.
+
+ @param s1 First sequence
+ @param l1 Length of first sequence
+ @param s2s Array of n pointers to the other sequences
+ @param l2s Array of n lengths of the other sequences
+ @param n Number of other sequences
+ @param output Array of length n to store the distances
+ @param settings A DTWSettings struct with options for the DTW algorithm.
+ @param ws Workspace that provides (and keeps) the memory for the cost matrices.
+ @return Number of pairs that were computed in lockstep.
+ */
+idx_t dtw_distance_batch_ws(seq_t *s1, idx_t l1, seq_t **s2s, idx_t *l2s, idx_t n,
+                            seq_t *output, DTWSettings *settings, DTWWorkspace *ws) {
+    idx_t nb_lockstep = 0;
+    int lanes = dtw_simd_lanes();
+    DTWWsFnPtr dtw_fn = dtw_distance_kernel(settings);
+    idx_t i;
+    if (lanes == 1 || n < lanes) {
+        for (i=0; i<n; i++) {
+            output[i] = dtw_fn(s1, l1, s2s[i], l2s[i], settings, ws);
+        }
+        return 0;
+    }
+    struct dtw_batch_item_s *items = (struct dtw_batch_item_s *)malloc(sizeof(struct dtw_batch_item_s) * n);
+    if (!items) {
+        printf("Error: dtw_distance_batch - Cannot allocate memory (size=%zu)\n", n);
+        return 0;
+    }
+    for (i=0; i<n; i++) {
+        items[i].length = l2s[i];
+        items[i].idx = i;
+    }
+    qsort(items, n, sizeof(struct dtw_batch_item_s), dtw_batch_item_cmp);
+    seq_t *buffer;
+    seq_t max_dist = INFINITY;
+    if (settings->max_dist != 0) {
+        max_dist = pow(settings->max_dist, 2);
+    }
+    seq_t *group[8];
+    seq_t group_output[8];
+    idx_t run_start = 0;
+    idx_t run_end;
+    while (run_start < n) {
+        // Series with equal length are adjacent after sorting
+        run_end = run_start + 1;
+        while (run_end < n && items[run_end].length == items[run_start].length) {
+            run_end++;
+        }
+        idx_t l2 = items[run_start].length;
+        i = run_start;
+        if (dtw_simd_settings_supported(l1, l2, settings) &&
+            !(settings->max_length_diff != 0 && MAX(l1, l2) - MIN(l1, l2) > settings->max_length_diff) &&
+            i + lanes <= run_end) {
+            // Reserve per run, the fallback calls below can move the workspace buffer
+            buffer = (seq_t *)dtw_workspace_reserve(ws, sizeof(seq_t) * lanes * (3 * l2 + 2));
+            if (!buffer) {
+                printf("Error: dtw_distance_batch - Cannot allocate memory (size=%zu)\n", lanes * (3 * l2 + 2));
+                free(items);
+                return 0;
+            }
+            for (; i + lanes <= run_end; i += lanes) {
+                for (int lane=0; lane<lanes; lane++) {
+                    group[lane] = s2s[items[i + lane].idx];
+                }
+#if defined(DTW_SIMD_X86)
+                if (lanes == 8) {
+                    dtw_batch_lockstep_avx512(s1, l1, group, l2, max_dist, buffer, group_output);
+                } else {
+                    dtw_batch_lockstep_avx2(s1, l1, group, l2, max_dist, buffer, group_output);
+                }
+#endif
+                for (int lane=0; lane<lanes; lane++) {
+                    if (settings->max_dist != 0 && group_output[lane] > settings->max_dist) {
+                        group_output[lane] = INFINITY;
+                    }
+                    output[items[i + lane].idx] = group_output[lane];
+                }
+                nb_lockstep += lanes;
+            }
+        }
+        for (; i<run_end; i++) {
+            output[items[i].idx] = dtw_fn(s1, l1, s2s[items[i].idx], l2, settings, ws);
+        }
+        run_start = run_end;
+    }
+    free(items);
+    return nb_lockstep;
+}
+
+
+/*!
+ Compute the DTW between one series and a list of other series, using a temporary workspace.
+
+ @see dtw_distance_batch_ws
+ */
+idx_t dtw_distance_batch(seq_t *s1, idx_t l1, seq_t **s2s, idx_t *l2s, idx_t n,
+                         seq_t *output, DTWSettings *settings) {
+    DTWWorkspace ws = dtw_workspace_empty();
+    idx_t nb_lockstep = dtw_distance_batch_ws(s1, l1, s2s, l2s, n, output, settings, &ws);
+    dtw_workspace_free(&ws);
+    return nb_lockstep;
+}
@@ -0,0 +1,45 @@
+/*!
+@header dtw_simd.h
+@brief DTAIDistance.dtw : SIMD kernels for Dynamic Time Warping
+
+@copyright Apache License, Version 2.0, see LICENSE for details.
+*/
+
+#ifndef dtw_simd_h
+#define dtw_simd_h
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "dd_globals.h"
+#include "dd_dtw.h"
+
+
+/**
+ SIMD instruction set used by the kernels in this file. The level is detected
+ at runtime the first time it is requested and can be lowered with
+ dtw_simd_set_level (e.g. to compare against the scalar code).
+ */
+#define DTW_SIMD_NONE   0
+#define DTW_SIMD_AVX2   1
+#define DTW_SIMD_AVX512 2
+
+int   dtw_simd_level(void);
+int   dtw_simd_lanes(void);
+int   dtw_simd_detect(void);
+void  dtw_simd_set_level(int level);
+const char * dtw_simd_level_name(int level);
+
+bool  dtw_simd_settings_supported(idx_t l1, idx_t l2, DTWSettings *settings);
+seq_t dtw_distance_wavefront(seq_t *s1, idx_t l1, seq_t *s2, idx_t l2, DTWSettings *settings);
+seq_t dtw_distance_wavefront_ws(seq_t *s1, idx_t l1, seq_t *s2, idx_t l2, DTWSettings *settings,
+                                DTWWorkspace *ws);
+seq32_t dtw_distance_wavefront_f32(seq32_t *s1, idx_t l1, seq32_t *s2, idx_t l2, DTWSettings *settings);
+seq32_t dtw_distance_wavefront_f32_ws(seq32_t *s1, idx_t l1, seq32_t *s2, idx_t l2, DTWSettings *settings,
+                                      DTWWorkspace *ws);
+idx_t dtw_distance_batch(seq_t *s1, idx_t l1, seq_t **s2s, idx_t *l2s, idx_t n,
+                         seq_t *output, DTWSettings *settings);
+idx_t dtw_distance_batch_ws(seq_t *s1, idx_t l1, seq_t **s2s, idx_t *l2s, idx_t n,
+                            seq_t *output, DTWSettings *settings, DTWWorkspace *ws);
+
+#endif /* dtw_simd_h */
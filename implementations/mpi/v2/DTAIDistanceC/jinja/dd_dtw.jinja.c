@@ -6,6 +6,7 @@
 @copyright Copyright © 2020 Wannes Meert. Apache License, Version 2.0, see LICENSE for details.
 */
 #include "dd_dtw.h"
+#include "dd_dtw_simd.h"
 
 
 //#define DTWDEBUG
@@ -66,6 +67,42 @@ void dtw_settings_print(DTWSettings *settings) {
     printf("}\n");
 }
 
+// MARK: Workspace
+
+/* Create an empty workspace, memory is allocated by the first call that uses it. */
+DTWWorkspace dtw_workspace_empty(void) {
+    DTWWorkspace ws = {
+        .buffer = NULL,
+        .size = 0
+    };
+    return ws;
+}
+
+/*!
+ Make sure the workspace has room for size bytes and return the buffer.
+ The buffer only grows, its content is not preserved when it grows.
+
+ @return Pointer to the buffer, NULL if memory cannot be allocated.
+ */
+void * dtw_workspace_reserve(DTWWorkspace *ws, size_t size) {
+    if (size > ws->size) {
+        free(ws->buffer);
+        ws->buffer = malloc(size);
+        if (!ws->buffer) {
+            ws->size = 0;
+            return NULL;
+        }
+        ws->size = size;
+    }
+    return ws->buffer;
+}
+
+void dtw_workspace_free(DTWWorkspace *ws) {
+    free(ws->buffer);
+    ws->buffer = NULL;
+    ws->size = 0;
+}
+
 // MARK: DTW
 
 {% set suffix = '' %}
@@ -84,6 +121,54 @@ void dtw_settings_print(DTWSettings *settings) {
 {% set inner_dist = 'euclidean' %}
 {%- include 'dtw_distance.jinja.c' %}
 
+{% set suffix = '' %}
+{% set inner_dist = 'squaredeuclidean' %}
+{% set window_kind = 'full' %}
+{%- include 'dtw_distance.jinja.c' %}
+
+{% set window_kind = 'banded' %}
+{%- include 'dtw_distance.jinja.c' %}
+
+{% set inner_dist = 'euclidean' %}
+{% set window_kind = 'full' %}
+{%- include 'dtw_distance.jinja.c' %}
+
+{% set window_kind = 'banded' %}
+{%- include 'dtw_distance.jinja.c' %}
+{% set window_kind = '' %}
+
+/*!
+Select the DTW function for the given settings.
+
+The options of DTWSettings are checked once, e.g. for a distance matrix, instead
+of for every pair. Settings that use psi-relaxation, max_step, penalty or upper
+bound pruning get the generic dtw_distance_ws, the others a variant where the
+branches for these options are removed. Without a window and with the squared
+Euclidean inner distance the wavefront (SIMD) version is used when available.
+
+@param settings A DTWSettings struct with options for the DTW algorithm.
+@return Function with the same result as dtw_distance_ws for these settings.
+*/
+DTWWsFnPtr dtw_distance_kernel(DTWSettings *settings) {
+    if (settings->psi_1b != 0 || settings->psi_1e != 0 || settings->psi_2b != 0 || settings->psi_2e != 0 ||
+        settings->max_step != 0 || settings->penalty != 0 || settings->use_pruning || settings->only_ub) {
+        return dtw_distance_ws;
+    }
+    if (settings->inner_dist == 1) {
+        if (settings->window == 0) {
+            return dtw_distance_euclidean_full_ws;
+        }
+        return dtw_distance_euclidean_banded_ws;
+    }
+    if (settings->window == 0) {
+        if (dtw_simd_level() != DTW_SIMD_NONE) {
+            return dtw_distance_wavefront_ws;
+        }
+        return dtw_distance_full_ws;
+    }
+    return dtw_distance_banded_ws;
+}
+
 // MARK: WPS
 
 /*!
@@ -115,6 +200,31 @@ seq_t dtw_warping_paths(seq_t *wps,
                              settings);
 }
 
+/*!
+Compute all warping paths between two series in the memory of a workspace.
+
+@param wps Is set to the warping paths matrix, which is stored in ws and valid until
+    the next call that uses ws.
+@param ws Workspace that provides (and keeps) the memory for the warping paths.
+
+@see dtw_warping_paths
+*/
+seq_t dtw_warping_paths_ws(seq_t **wps,
+                           seq_t *s1, idx_t l1,
+                           seq_t *s2, idx_t l2,
+                           bool return_dtw, bool keep_int_repr, bool psi_neg,
+                           DTWSettings *settings, DTWWorkspace *ws) {
+    idx_t wps_length = dtw_settings_wps_length(l1, l2, settings);
+    *wps = (seq_t *)dtw_workspace_reserve(ws, sizeof(seq_t) * wps_length);
+    if (!*wps) {
+        printf("Error: dtw_warping_paths_ws - Cannot allocate memory (size=%zu)\n", wps_length);
+        return 0;
+    }
+    return dtw_warping_paths(*wps, s1, l1, s2, l2,
+                             return_dtw, keep_int_repr, psi_neg,
+                             settings);
+}
+
 {% set suffix = '_ndim' %}
 {% set inner_dist = 'squaredeuclidean' %}
 {%- include 'dtw_warpingpaths.jinja.c' %}
@@ -1212,6 +1322,75 @@ idx_t dtw_distances_length(DTWBlock *block, idx_t nb_series_r, idx_t nb_series_c
     return length;
 }
 
+
+/*!
+Split the upper triangle of the distance matrix of nb_series series in nb_parts
+contiguous ranges of pairs with about the same cost.
+
+The pairs are in the order of the output of dtw_distances_ptrs with a triu block,
+(0,1), (0,2), ..., (1,2), ... and the cost of pair (r, c) is lengths[r] * lengths[c],
+the number of cells of its cost matrix. The split only depends on lengths, every
+process thus computes the same ranges without communication.
+
+@param lengths Array of length nb_series with the lengths of the series.
+@param nb_series Number of series
+@param nb_parts Number of ranges
+@param bounds Array of length nb_parts + 1, range p is pairs [bounds[p], bounds[p+1])
+@return Number of pairs, 0 if there are no pairs
+*/
+idx_t dtw_distances_partition(idx_t *lengths, idx_t nb_series, idx_t nb_parts, idx_t *bounds) {
+    DTWBlock block = {.rb=0, .re=0, .cb=0, .ce=0, .triu=true};
+    idx_t nb_pairs = (nb_series > 1) ? dtw_distances_length(&block, nb_series, nb_series) : 0;
+    for (idx_t p=0; p<=nb_parts; p++) {
+        bounds[p] = nb_pairs;
+    }
+    bounds[0] = 0;
+    if (nb_pairs == 0 || nb_parts < 1) {
+        return nb_pairs;
+    }
+    idx_t *prefix = (idx_t *)malloc(sizeof(idx_t) * (nb_series + 1));
+    if (!prefix) {
+        printf("Error: dtw_distances_partition - cannot allocate memory (prefix length = %zu)\n", nb_series + 1);
+        return 0;
+    }
+    prefix[0] = 0;
+    for (idx_t i=0; i<nb_series; i++) {
+        prefix[i + 1] = prefix[i] + lengths[i];
+    }
+    idx_t total = 0;
+    for (idx_t r=0; r<nb_series; r++) {
+        total += lengths[r] * (prefix[nb_series] - prefix[r + 1]);
+    }
+
+    // Target of range p is p * total / nb_parts, written to avoid overflow
+    idx_t p = 1;
+    idx_t acc = 0;
+    idx_t base = 0;  // index of pair (r, r+1)
+    for (idx_t r=0; r<nb_series && p<nb_parts; r++) {
+        idx_t row_cost = lengths[r] * (prefix[nb_series] - prefix[r + 1]);
+        idx_t target = (total / nb_parts) * p + ((total % nb_parts) * p) / nb_parts;
+        while (p < nb_parts && acc + row_cost >= target) {
+            // Smallest c such that the pairs (r, r+1) .. (r, c-1) reach the target
+            idx_t lo = r + 1, hi = nb_series;
+            while (lo < hi) {
+                idx_t mid = lo + (hi - lo) / 2;
+                if (acc + lengths[r] * (prefix[mid] - prefix[r + 1]) >= target) {
+                    hi = mid;
+                } else {
+                    lo = mid + 1;
+                }
+            }
+            bounds[p] = base + (lo - r - 1);
+            p++;
+            target = (total / nb_parts) * p + ((total % nb_parts) * p) / nb_parts;
+        }
+        acc += row_cost;
+        base += nb_series - r - 1;
+    }
+    free(prefix);
+    return nb_pairs;
+}
+
 // MARK: DBA
 
 {% set suffix = 'ptrs' %}
@@ -1464,7 +1643,7 @@ void dtw_print_wps(seq_t * wps, idx_t l1, idx_t l2, DTWSettings* settings) {
 /* Helper function for debugging. */
 void dtw_print_twoline(seq_t * dtw, idx_t r, idx_t c, idx_t length, int i0, int i1, idx_t skip, idx_t skipp, idx_t maxj, idx_t minj) {
     char buffer[20];
-    char format[5];
+    char format[16];
     snprintf(format, sizeof(format), "%%.%df ", printPrecision);
     idx_t ci_cor; // corrected column index
     // Row 1
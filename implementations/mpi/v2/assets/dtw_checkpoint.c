@@ -0,0 +1,290 @@
+/*
+ * Checkpoint of the DTW cost matrix boundaries for an incremental refresh.
+ *
+ * This file is part of the DTW aggregation and clustering project.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include "dtw_checkpoint.h"
+#include "result_matrix.h"
+
+
+static uint64_t dtw_checkpoint_align(uint64_t offset) {
+    return (offset + DTW_CHECKPOINT_ALIGN - 1) / DTW_CHECKPOINT_ALIGN * DTW_CHECKPOINT_ALIGN;
+}
+
+static const char *dtw_checkpoint_ticker(const DTWCheckpoint *checkpoint, int i) {
+    return checkpoint->names + (size_t)i * checkpoint->header->name_size;
+}
+
+static const DTWCheckpoint *dtw_checkpoint_sorting;
+
+static int dtw_checkpoint_compare(const void *a, const void *b) {
+    return strcmp(dtw_checkpoint_ticker(dtw_checkpoint_sorting, *(const int *)a),
+                  dtw_checkpoint_ticker(dtw_checkpoint_sorting, *(const int *)b));
+}
+
+int dtw_checkpoint_open(const char *filename, DTWCheckpoint *checkpoint) {
+    memset(checkpoint, 0, sizeof(DTWCheckpoint));
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        perror("open");
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror("fstat");
+        close(fd);
+        return -1;
+    }
+    size_t size = (size_t)st.st_size;
+    if (size < sizeof(DTWCheckpointHeader)) {
+        fprintf(stderr, "Error: %s is not a DTW checkpoint\n", filename);
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+
+    const DTWCheckpointHeader *header = (const DTWCheckpointHeader *)map;
+    uint64_t n = header->num_series;
+    bool ok = (memcmp(header->magic, DTW_CHECKPOINT_MAGIC, sizeof(header->magic)) == 0 &&
+               header->version == DTW_CHECKPOINT_VERSION &&
+               header->byte_order == DTW_CHECKPOINT_BYTE_ORDER &&
+               header->value_size == sizeof(seq_t) &&
+               header->name_size > 0 && n <= INT32_MAX &&
+               header->num_pairs == n * (n > 0 ? n - 1 : 0) / 2 &&
+               header->names_offset + n * header->name_size <= header->series_offset &&
+               header->series_offset + n * sizeof(DTWCheckpointSeries) <= header->pairs_offset &&
+               header->pairs_offset + (header->num_pairs + 1) * sizeof(uint64_t) <= header->values_offset &&
+               header->values_offset % DTW_CHECKPOINT_ALIGN == 0 &&
+               header->values_offset + header->num_values * sizeof(seq_t) <= size);
+    if (ok) {
+        const uint64_t *offsets = (const uint64_t *)((const char *)map + header->pairs_offset);
+        ok = (offsets[header->num_pairs] == header->num_values);
+    }
+    if (!ok) {
+        fprintf(stderr, "Error: %s is not a valid DTW checkpoint\n", filename);
+        munmap(map, size);
+        return -1;
+    }
+    checkpoint->header = header;
+    checkpoint->num_series = (int)n;
+    checkpoint->names = (const char *)map + header->names_offset;
+    checkpoint->series = (const DTWCheckpointSeries *)((const char *)map + header->series_offset);
+    checkpoint->offsets = (const uint64_t *)((const char *)map + header->pairs_offset);
+    checkpoint->values = (const seq_t *)((const char *)map + header->values_offset);
+    checkpoint->map = map;
+    checkpoint->map_size = size;
+
+    checkpoint->sorted = malloc(sizeof(int) * (n > 0 ? n : 1));
+    if (!checkpoint->sorted) {
+        fprintf(stderr, "Error: cannot allocate memory for the checkpoint index\n");
+        dtw_checkpoint_close(checkpoint);
+        return -1;
+    }
+    for (int i = 0; i < (int)n; i++) {
+        checkpoint->sorted[i] = i;
+    }
+    dtw_checkpoint_sorting = checkpoint;
+    qsort(checkpoint->sorted, n, sizeof(int), dtw_checkpoint_compare);
+    dtw_checkpoint_sorting = NULL;
+    return 0;
+}
+
+// The boundaries can only be extended with the same cost function
+bool dtw_checkpoint_compatible(const DTWCheckpoint *checkpoint, DTWSettings *settings) {
+    return checkpoint->header->inner_dist == settings->inner_dist &&
+           checkpoint->header->penalty == settings->penalty &&
+           checkpoint->header->max_step == settings->max_step;
+}
+
+/*
+ * Index of ticker in the checkpoint if its values there are a prefix of s, -1 if
+ * the ticker is new or its values changed.
+ */
+int dtw_checkpoint_find(const DTWCheckpoint *checkpoint, const char *ticker, const seq_t *s, idx_t length) {
+    int low = 0, high = checkpoint->num_series - 1;
+    while (low <= high) {
+        int mid = low + (high - low) / 2;
+        int i = checkpoint->sorted[mid];
+        int cmp = strcmp(ticker, dtw_checkpoint_ticker(checkpoint, i));
+        if (cmp == 0) {
+            const DTWCheckpointSeries *series = &checkpoint->series[i];
+            if (series->length == 0 || series->length > (uint64_t)length ||
+                series->hash != series_hash(s, (idx_t)series->length)) {
+                return -1;
+            }
+            return i;
+        }
+        if (cmp < 0) {
+            high = mid - 1;
+        } else {
+            low = mid + 1;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Boundary of the pair of the old series r and c with r as the first series: row
+ * has lengths[c] values, col has lengths[r] values.
+ */
+void dtw_checkpoint_boundary(const DTWCheckpoint *checkpoint, int r, int c, const seq_t **row, const seq_t **col) {
+    idx_t pair = result_matrix_pair_index(MIN(r, c), MAX(r, c), checkpoint->num_series);
+    const seq_t *values = checkpoint->values + checkpoint->offsets[pair];
+    idx_t second_len = (idx_t)checkpoint->series[MAX(r, c)].length;
+    if (r < c) {
+        *row = values;
+        *col = values + second_len;
+    } else {
+        // Stored for (c, r): its last column is the last row of the transposed matrix
+        *row = values + second_len;
+        *col = values;
+    }
+}
+
+void dtw_checkpoint_close(DTWCheckpoint *checkpoint) {
+    if (checkpoint->map != NULL) {
+        munmap(checkpoint->map, checkpoint->map_size);
+    }
+    free(checkpoint->sorted);
+    memset(checkpoint, 0, sizeof(DTWCheckpoint));
+}
+
+static bool dtw_checkpoint_pwrite(int fd, const void *buf, size_t size, uint64_t offset) {
+    const char *pos = buf;
+    while (size > 0) {
+        ssize_t written = pwrite(fd, pos, size, (off_t)offset);
+        if (written <= 0) {
+            return false;
+        }
+        pos += written;
+        size -= (size_t)written;
+        offset += (uint64_t)written;
+    }
+    return true;
+}
+
+/*
+ * Create the file for the first num_series series of collection with everything
+ * but the boundaries, which are written with dtw_checkpoint_writer_put.
+ */
+int dtw_checkpoint_writer_create(DTWCheckpointWriter *writer, const char *filename,
+                                 const SeriesCollection *collection, int num_series, DTWSettings *settings) {
+    DTWCheckpointHeader *header = &writer->header;
+    memset(writer, 0, sizeof(DTWCheckpointWriter));
+    writer->fd = -1;
+    memcpy(header->magic, DTW_CHECKPOINT_MAGIC, sizeof(header->magic));
+    header->version = DTW_CHECKPOINT_VERSION;
+    header->byte_order = DTW_CHECKPOINT_BYTE_ORDER;
+    header->name_size = MAX_TICKER_NAME;
+    header->value_size = sizeof(seq_t);
+    header->num_series = num_series;
+    header->num_pairs = (uint64_t)num_series * (num_series > 0 ? num_series - 1 : 0) / 2;
+    header->inner_dist = settings->inner_dist;
+    header->penalty = settings->penalty;
+    header->max_step = settings->max_step;
+    header->names_offset = sizeof(DTWCheckpointHeader);
+    header->series_offset = header->names_offset + (uint64_t)num_series * header->name_size;
+    header->pairs_offset = header->series_offset + (uint64_t)num_series * sizeof(DTWCheckpointSeries);
+    header->values_offset = dtw_checkpoint_align(header->pairs_offset + (header->num_pairs + 1) * sizeof(uint64_t));
+
+    writer->offsets = malloc(sizeof(uint64_t) * (header->num_pairs + 1));
+    if (!writer->offsets) {
+        fprintf(stderr, "Error: cannot allocate memory for the checkpoint offsets\n");
+        return -1;
+    }
+    // Pair (r, c) holds lengths[c] + lengths[r] values, in the order of result_matrix_pair_index
+    uint64_t pair = 0, total = 0;
+    for (int r = 0; r < num_series; r++) {
+        for (int c = r + 1; c < num_series; c++) {
+            writer->offsets[pair++] = total;
+            total += (uint64_t)(collection->lengths[r] + collection->lengths[c]);
+        }
+    }
+    writer->offsets[pair] = total;
+    header->num_values = total;
+    // l1 + l2 values per pair, O(N^2 * L): the size is reported and, since ftruncate
+    // makes a sparse file, checked against the free space before computing
+    uint64_t size = header->values_offset + total * sizeof(seq_t);
+    printf("Checkpoint: %.1f MB for %lu pairs\n", (double)size / 1e6, (unsigned long)header->num_pairs);
+
+    writer->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (writer->fd < 0) {
+        perror("open");
+        free(writer->offsets);
+        writer->offsets = NULL;
+        return -1;
+    }
+    struct statvfs fs;
+    if (fstatvfs(writer->fd, &fs) == 0 && (uint64_t)fs.f_bavail * fs.f_frsize < size) {
+        fprintf(stderr, "Error: the DTW checkpoint %s needs %.1f MB, %.1f MB are free\n",
+                filename, (double)size / 1e6, (double)fs.f_bavail * fs.f_frsize / 1e6);
+        dtw_checkpoint_writer_close(writer);
+        return -1;
+    }
+    char *table = calloc(header->pairs_offset, 1);
+    bool ok = (table != NULL);
+    if (ok) {
+        memcpy(table, header, sizeof(DTWCheckpointHeader));
+        DTWCheckpointSeries *series = (DTWCheckpointSeries *)(table + header->series_offset);
+        for (int i = 0; i < num_series; i++) {
+            strncpy(table + header->names_offset + (size_t)i * header->name_size,
+                    series_collection_ticker(collection, i), header->name_size - 1);
+            series[i].length = (uint64_t)collection->lengths[i];
+            series[i].hash = series_hash(series_collection_series(collection, i), collection->lengths[i]);
+        }
+        ok = dtw_checkpoint_pwrite(writer->fd, table, header->pairs_offset, 0) &&
+             dtw_checkpoint_pwrite(writer->fd, writer->offsets, sizeof(uint64_t) * (header->num_pairs + 1),
+                                   header->pairs_offset);
+    }
+    free(table);
+    ok = ok && ftruncate(writer->fd, (off_t)size) == 0;
+    if (!ok) {
+        fprintf(stderr, "Error writing DTW checkpoint %s\n", filename);
+        dtw_checkpoint_writer_close(writer);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Write the boundary of pair (r, c), r < c, at index pair (result_matrix_pair_index):
+ * the last row (row_len = lengths[c] values) and the last column (col_len =
+ * lengths[r] values). Safe to call from several threads for different pairs.
+ */
+int dtw_checkpoint_writer_put(DTWCheckpointWriter *writer, idx_t pair, const seq_t *row, idx_t row_len,
+                              const seq_t *col, idx_t col_len) {
+    if (pair < 0 || (uint64_t)pair >= writer->header.num_pairs ||
+        writer->offsets[pair + 1] - writer->offsets[pair] != (uint64_t)(row_len + col_len)) {
+        fprintf(stderr, "Error: boundary of pair %zd does not fit the checkpoint\n", pair);
+        return -1;
+    }
+    uint64_t offset = writer->header.values_offset + writer->offsets[pair] * sizeof(seq_t);
+    bool ok = dtw_checkpoint_pwrite(writer->fd, row, sizeof(seq_t) * row_len, offset) &&
+              dtw_checkpoint_pwrite(writer->fd, col, sizeof(seq_t) * col_len, offset + sizeof(seq_t) * row_len);
+    return ok ? 0 : -1;
+}
+
+int dtw_checkpoint_writer_close(DTWCheckpointWriter *writer) {
+    int rvalue = 0;
+    if (writer->fd >= 0 && close(writer->fd) != 0) {
+        perror("close");
+        rvalue = -1;
+    }
+    free(writer->offsets);
+    writer->offsets = NULL;
+    writer->fd = -1;
+    return rvalue;
+}
@@ -0,0 +1,411 @@
+/*
+ * Binary condensed distance matrix.
+ *
+ * This file is part of the DTW aggregation and clustering project.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "result_matrix.h"
+#include "load_from_csv.h"
+
+
+// Values converted per pwrite when the file holds doubles
+#define RESULT_MATRIX_CHUNK 4096
+
+static uint64_t result_matrix_align(uint64_t offset) {
+    return (offset + RESULT_MATRIX_ALIGN - 1) / RESULT_MATRIX_ALIGN * RESULT_MATRIX_ALIGN;
+}
+
+// Index of the pair (r, c), r < c, in the upper triangle of num_series series, row by row
+idx_t result_matrix_pair_index(idx_t r, idx_t c, idx_t num_series) {
+    return r * num_series - r * (r + 1) / 2 + (c - r - 1);
+}
+
+// Output files ending in RESULT_MATRIX_SUFFIX are written in the binary format
+bool result_matrix_is_matrix_name(const char *filename) {
+    size_t len = strlen(filename), suffix = strlen(RESULT_MATRIX_SUFFIX);
+    return len >= suffix && strcmp(filename + len - suffix, RESULT_MATRIX_SUFFIX) == 0;
+}
+
+bool result_matrix_is_matrix(const char *filename) {
+    char magic[8];
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        return false;
+    }
+    bool is_matrix = (fread(magic, 1, sizeof(magic), fp) == sizeof(magic) &&
+                      memcmp(magic, RESULT_MATRIX_MAGIC, sizeof(magic)) == 0);
+    fclose(fp);
+    return is_matrix;
+}
+
+static bool result_matrix_pwrite(int fd, const void *buf, size_t size, uint64_t offset) {
+    const char *pos = buf;
+    while (size > 0) {
+        ssize_t written = pwrite(fd, pos, size, (off_t)offset);
+        if (written <= 0) {
+            return false;
+        }
+        pos += written;
+        size -= (size_t)written;
+        offset += (uint64_t)written;
+    }
+    return true;
+}
+
+/*
+ * Create the file with the header and the ticker table of the first num_series
+ * series of collection. The values are written with result_matrix_writer_write, in
+ * any order; pairs that are never written read as 0.
+ */
+int result_matrix_writer_create(ResultMatrixWriter *writer, const char *filename, const SeriesCollection *collection,
+                         int num_series, int value_size, double max_dist) {
+    ResultMatrixHeader *header = &writer->header;
+    memset(writer, 0, sizeof(ResultMatrixWriter));
+    if (value_size != sizeof(float) && value_size != sizeof(double)) {
+        fprintf(stderr, "Error: unsupported value size %d\n", value_size);
+        writer->fd = -1;
+        return -1;
+    }
+    memcpy(header->magic, RESULT_MATRIX_MAGIC, sizeof(header->magic));
+    header->version = RESULT_MATRIX_VERSION;
+    header->byte_order = RESULT_MATRIX_BYTE_ORDER;
+    header->name_size = MAX_TICKER_NAME;
+    header->value_size = value_size;
+    header->num_series = num_series;
+    header->num_pairs = (uint64_t)num_series * (num_series > 0 ? num_series - 1 : 0) / 2;
+    header->names_offset = sizeof(ResultMatrixHeader);
+    header->values_offset = result_matrix_align(header->names_offset + (uint64_t)num_series * header->name_size);
+    header->max_dist = max_dist;
+
+    writer->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (writer->fd < 0) {
+        perror("open");
+        return -1;
+    }
+    char *table = calloc(header->values_offset, 1);
+    bool ok = (table != NULL);
+    if (ok) {
+        memcpy(table, header, sizeof(ResultMatrixHeader));
+        for (int i = 0; i < num_series; i++) {
+            strncpy(table + header->names_offset + (size_t)i * header->name_size,
+                    series_collection_ticker(collection, i), header->name_size - 1);
+        }
+        ok = result_matrix_pwrite(writer->fd, table, header->values_offset, 0);
+    }
+    free(table);
+    ok = ok && ftruncate(writer->fd, (off_t)(header->values_offset + header->num_pairs * value_size)) == 0;
+    if (!ok) {
+        fprintf(stderr, "Error writing result matrix %s\n", filename);
+        close(writer->fd);
+        writer->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+static bool result_matrix_in_range(const ResultMatrixWriter *writer, idx_t first, idx_t count) {
+    if (first < 0 || count < 0 || (uint64_t)(first + count) > writer->header.num_pairs) {
+        fprintf(stderr, "Error: pairs %zd..%zd out of the result matrix\n", first, first + count);
+        return false;
+    }
+    return true;
+}
+
+// Write the distances of the pairs first, ..., first+count-1
+int result_matrix_writer_write(ResultMatrixWriter *writer, idx_t first, const float *values, idx_t count) {
+    uint64_t offset = writer->header.values_offset + (uint64_t)first * writer->header.value_size;
+    if (!result_matrix_in_range(writer, first, count)) {
+        return -1;
+    }
+    if (writer->header.value_size == sizeof(float)) {
+        return result_matrix_pwrite(writer->fd, values, sizeof(float) * count, offset) ? 0 : -1;
+    }
+    double chunk[RESULT_MATRIX_CHUNK];
+    for (idx_t i = 0; i < count; i += RESULT_MATRIX_CHUNK) {
+        idx_t n = MIN(count - i, RESULT_MATRIX_CHUNK);
+        for (idx_t k = 0; k < n; k++) {
+            chunk[k] = values[i + k];
+        }
+        if (!result_matrix_pwrite(writer->fd, chunk, sizeof(double) * n, offset + sizeof(double) * i)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Same as result_matrix_writer_write for distances computed in double precision
+int result_matrix_writer_write_f64(ResultMatrixWriter *writer, idx_t first, const double *values, idx_t count) {
+    uint64_t offset = writer->header.values_offset + (uint64_t)first * writer->header.value_size;
+    if (!result_matrix_in_range(writer, first, count)) {
+        return -1;
+    }
+    if (writer->header.value_size == sizeof(double)) {
+        return result_matrix_pwrite(writer->fd, values, sizeof(double) * count, offset) ? 0 : -1;
+    }
+    float chunk[RESULT_MATRIX_CHUNK];
+    for (idx_t i = 0; i < count; i += RESULT_MATRIX_CHUNK) {
+        idx_t n = MIN(count - i, RESULT_MATRIX_CHUNK);
+        for (idx_t k = 0; k < n; k++) {
+            chunk[k] = (float)values[i + k];
+        }
+        if (!result_matrix_pwrite(writer->fd, chunk, sizeof(float) * n, offset + sizeof(float) * i)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int result_matrix_writer_close(ResultMatrixWriter *writer) {
+    int rvalue = 0;
+    if (writer->fd >= 0 && close(writer->fd) != 0) {
+        perror("close");
+        rvalue = -1;
+    }
+    writer->fd = -1;
+    return rvalue;
+}
+
+/*
+ * Write the condensed result of num_series series (result[result_matrix_pair_index(r, c)])
+ * to filename, with one write of the values if value_size is sizeof(double).
+ */
+int result_matrix_save(const char *filename, const SeriesCollection *collection, int num_series,
+                       const double *result, int value_size, double max_dist) {
+    ResultMatrixWriter writer;
+    if (result_matrix_writer_create(&writer, filename, collection, num_series, value_size, max_dist) != 0) {
+        return -1;
+    }
+    int rvalue = result_matrix_writer_write_f64(&writer, 0, result, (idx_t)writer.header.num_pairs);
+    if (result_matrix_writer_close(&writer) != 0) {
+        rvalue = -1;
+    }
+    return rvalue;
+}
+
+int result_matrix_open(const char *filename, ResultMatrix *matrix) {
+    memset(matrix, 0, sizeof(ResultMatrix));
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        perror("open");
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror("fstat");
+        close(fd);
+        return -1;
+    }
+    size_t size = (size_t)st.st_size;
+    if (size < sizeof(ResultMatrixHeader)) {
+        fprintf(stderr, "Error: %s is not a result matrix\n", filename);
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+
+    const ResultMatrixHeader *header = (const ResultMatrixHeader *)map;
+    uint64_t n = header->num_series;
+    bool ok = (memcmp(header->magic, RESULT_MATRIX_MAGIC, sizeof(header->magic)) == 0 &&
+               header->version == RESULT_MATRIX_VERSION &&
+               header->byte_order == RESULT_MATRIX_BYTE_ORDER &&
+               (header->value_size == sizeof(float) || header->value_size == sizeof(double)) &&
+               header->name_size > 0 && n <= INT32_MAX &&
+               header->num_pairs == n * (n > 0 ? n - 1 : 0) / 2 &&
+               header->names_offset + n * header->name_size <= header->values_offset &&
+               header->values_offset % RESULT_MATRIX_ALIGN == 0 &&
+               header->values_offset + header->num_pairs * header->value_size <= size);
+    if (!ok) {
+        fprintf(stderr, "Error: %s is not a valid result matrix\n", filename);
+        munmap(map, size);
+        return -1;
+    }
+    matrix->num_series = (int)n;
+    matrix->num_pairs = (idx_t)header->num_pairs;
+    matrix->value_size = (int)header->value_size;
+    matrix->max_dist = header->max_dist;
+    matrix->names = (const char *)map + header->names_offset;
+    matrix->name_size = (int)header->name_size;
+    matrix->values = (const char *)map + header->values_offset;
+    matrix->map = map;
+    matrix->map_size = size;
+    return 0;
+}
+
+const char *result_matrix_ticker(const ResultMatrix *matrix, int i) {
+    return matrix->names + (size_t)i * matrix->name_size;
+}
+
+double result_matrix_value(const ResultMatrix *matrix, idx_t index) {
+    if (matrix->value_size == sizeof(float)) {
+        return ((const float *)matrix->values)[index];
+    }
+    return ((const double *)matrix->values)[index];
+}
+
+// Copy the num_pairs values of the matrix to result, returns -1 if it holds another number of pairs
+int result_matrix_read(const ResultMatrix *matrix, double *result, idx_t num_pairs) {
+    if (num_pairs != matrix->num_pairs) {
+        fprintf(stderr, "Error: expected %zd distances, but the matrix has %zd\n", num_pairs, matrix->num_pairs);
+        return -1;
+    }
+    if (matrix->value_size == sizeof(double)) {
+        memcpy(result, matrix->values, sizeof(double) * num_pairs);
+    } else {
+        const float *values = matrix->values;
+        for (idx_t i = 0; i < num_pairs; i++) {
+            result[i] = values[i];
+        }
+    }
+    return 0;
+}
+
+static const SeriesCollection *result_matrix_sorting;
+
+static int result_matrix_compare(const void *a, const void *b) {
+    return strcmp(series_collection_ticker(result_matrix_sorting, *(const int *)a),
+                  series_collection_ticker(result_matrix_sorting, *(const int *)b));
+}
+
+/*
+ * Order of the series of collection for result_matrix_append: order[i] is the index
+ * in collection of the i-th ticker of the matrix, followed by the tickers that are not
+ * in the matrix in the order of collection. Returns the number of tickers of the
+ * matrix, -1 if one of them is not in collection.
+ */
+int result_matrix_append_order(const ResultMatrix *matrix, const SeriesCollection *collection, int *order) {
+    int n = collection->num_series;
+    int *sorted = malloc(sizeof(int) * (n > 0 ? n : 1));
+    bool *taken = calloc(n > 0 ? n : 1, sizeof(bool));
+    if (!sorted || !taken) {
+        fprintf(stderr, "Error: cannot allocate memory for the ticker index\n");
+        free(sorted);
+        free(taken);
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        sorted[i] = i;
+    }
+    result_matrix_sorting = collection;
+    qsort(sorted, n, sizeof(int), result_matrix_compare);
+    result_matrix_sorting = NULL;
+
+    int rvalue = matrix->num_series;
+    for (int i = 0; i < matrix->num_series && rvalue >= 0; i++) {
+        const char *ticker = result_matrix_ticker(matrix, i);
+        int low = 0, high = n - 1, found = -1;
+        while (low <= high) {
+            int mid = low + (high - low) / 2;
+            int cmp = strcmp(ticker, series_collection_ticker(collection, sorted[mid]));
+            if (cmp == 0) {
+                found = sorted[mid];
+                break;
+            }
+            if (cmp < 0) {
+                high = mid - 1;
+            } else {
+                low = mid + 1;
+            }
+        }
+        if (found < 0 || taken[found]) {
+            fprintf(stderr, "Error: ticker %s of the result matrix is not in the input\n", ticker);
+            rvalue = -1;
+        } else {
+            order[i] = found;
+            taken[found] = true;
+        }
+    }
+    for (int i = 0, k = matrix->num_series; i < n && rvalue >= 0; i++) {
+        if (!taken[i]) {
+            order[k++] = i;
+        }
+    }
+    free(sorted);
+    free(taken);
+    return rvalue;
+}
+
+/*
+ * Write the matrix of all series of collection to filename: the distances of the
+ * matrix for the pairs of its tickers, which are the first series of collection (see
+ * result_matrix_append_order), and block for the pairs with a new series. block holds
+ * the upper triangle of the rows 0..n-1 and the columns num_old..n-1, i.e. for every
+ * row r the columns max(r + 1, num_old)..n-1 (DTWBlock with cb = num_old, triu).
+ * The values keep the value size and the max_dist of the matrix.
+ */
+int result_matrix_append(const ResultMatrix *matrix, const char *filename, const SeriesCollection *collection,
+                         const double *block) {
+    idx_t num_old = matrix->num_series;
+    idx_t n = collection->num_series;
+    if (n < num_old) {
+        fprintf(stderr, "Error: the input has fewer series than the result matrix\n");
+        return -1;
+    }
+    for (idx_t i = 0; i < num_old; i++) {
+        if (strcmp(result_matrix_ticker(matrix, (int)i), series_collection_ticker(collection, (int)i)) != 0) {
+            fprintf(stderr, "Error: series %zd of the input is not ticker %s of the result matrix\n",
+                    i, result_matrix_ticker(matrix, (int)i));
+            return -1;
+        }
+    }
+    ResultMatrixWriter writer;
+    if (result_matrix_writer_create(&writer, filename, collection, (int)n, matrix->value_size, matrix->max_dist) != 0) {
+        return -1;
+    }
+    int rvalue = 0;
+    idx_t first = 0, old_first = 0, block_first = 0;
+    for (idx_t r = 0; r < n && rvalue == 0; r++) {
+        // Row r: the old columns r+1..num_old-1, then the new columns
+        idx_t num_kept = (r < num_old) ? num_old - r - 1 : 0;
+        idx_t num_new = n - MAX(r + 1, num_old);
+        if (num_kept > 0 && matrix->value_size == sizeof(float)) {
+            rvalue = result_matrix_writer_write(&writer, first, (const float *)matrix->values + old_first, num_kept);
+        } else if (num_kept > 0) {
+            rvalue = result_matrix_writer_write_f64(&writer, first, (const double *)matrix->values + old_first, num_kept);
+        }
+        if (rvalue == 0 && num_new > 0) {
+            rvalue = result_matrix_writer_write_f64(&writer, first + num_kept, block + block_first, num_new);
+        }
+        first += num_kept + num_new;
+        old_first += num_kept;
+        block_first += num_new;
+    }
+    if (result_matrix_writer_close(&writer) != 0) {
+        rvalue = -1;
+    }
+    if (rvalue != 0) {
+        fprintf(stderr, "Error writing result matrix %s\n", filename);
+    }
+    return rvalue;
+}
+
+void result_matrix_close(ResultMatrix *matrix) {
+    if (matrix->map != NULL) {
+        munmap(matrix->map, matrix->map_size);
+    }
+    memset(matrix, 0, sizeof(ResultMatrix));
+}
+
+// Load the distances of a result matrix or, for any other file, of a CSV result
+bool load_result_from_file(const char *filename, double *result, int num_series) {
+    if (!result_matrix_is_matrix(filename)) {
+        return load_result_from_csv(filename, result, num_series);
+    }
+    ResultMatrix matrix;
+    if (result_matrix_open(filename, &matrix) != 0) {
+        return false;
+    }
+    int rvalue = result_matrix_read(&matrix, result, (idx_t)num_series * (num_series - 1) / 2);
+    result_matrix_close(&matrix);
+    return rvalue == 0;
+}
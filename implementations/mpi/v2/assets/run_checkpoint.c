@@ -0,0 +1,233 @@
+/*
+ * Restart checkpoint of the MPI masters.
+ *
+ * This file is part of the DTW aggregation and clustering project.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "run_checkpoint.h"
+
+
+// Pending bytes after which the records are appended before the interval is over
+#define RUN_CHECKPOINT_BUFFER (4 << 20)
+
+static double run_checkpoint_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t run_checkpoint_check(uint64_t first, uint32_t count, const float *values) {
+    uint64_t hash = 14695981039346656037ULL;
+    const unsigned char *parts[3] = {(const unsigned char *)&first, (const unsigned char *)&count,
+                                     (const unsigned char *)values};
+    size_t sizes[3] = {sizeof(first), sizeof(count), sizeof(float) * count};
+    for (int p = 0; p < 3; p++) {
+        for (size_t i = 0; i < sizes[p]; i++) {
+            hash ^= parts[p][i];
+            hash *= 1099511628211ULL;
+        }
+    }
+    return (uint32_t)(hash ^ (hash >> 32));
+}
+
+// Identifies the input of a run: the values of the series, in their order, and the settings
+uint64_t run_checkpoint_key(const SeriesCollection *collection, int num_series, uint64_t settings) {
+    uint64_t key = settings;
+    for (int i = 0; i < num_series; i++) {
+        uint64_t hash = series_hash(series_collection_series(collection, i), collection->lengths[i]);
+        key = (key ^ hash) * 1099511628211ULL;
+    }
+    return key;
+}
+
+static bool run_checkpoint_write(int fd, const void *buf, size_t size) {
+    const char *pos = buf;
+    while (size > 0) {
+        ssize_t written = write(fd, pos, size);
+        if (written <= 0) {
+            return false;
+        }
+        pos += written;
+        size -= (size_t)written;
+    }
+    return true;
+}
+
+// Put the valid records of the file in sink and done, and cut the file after the last one
+static int run_checkpoint_restore(RunCheckpoint *checkpoint, const char *filename, ResultSink *sink, bool *done) {
+    FILE *fp = fdopen(dup(checkpoint->fd), "rb");
+    if (!fp) {
+        perror("fdopen");
+        return -1;
+    }
+    off_t end = sizeof(RunCheckpointHeader);
+    fseeko(fp, end, SEEK_SET);
+    float *values = NULL;
+    uint32_t capacity = 0;
+    RunCheckpointRecord record;
+    int rvalue = 0;
+    while (fread(&record, sizeof(record), 1, fp) == 1) {
+        if (record.count == 0 || record.first + record.count > (uint64_t)checkpoint->num_pairs) {
+            break;
+        }
+        if (record.count > capacity) {
+            free(values);
+            capacity = record.count;
+            values = malloc(sizeof(float) * capacity);
+            if (!values) {
+                fprintf(stderr, "Error: cannot allocate memory to restore %u pairs\n", capacity);
+                rvalue = -1;
+                break;
+            }
+        }
+        if (fread(values, sizeof(float), record.count, fp) != record.count ||
+            run_checkpoint_check(record.first, record.count, values) != record.check) {
+            break;
+        }
+        if (result_sink_put(sink, (idx_t)record.first, values, record.count) != 0) {
+            rvalue = -1;
+            break;
+        }
+        for (uint32_t i = 0; i < record.count; i++) {
+            checkpoint->restored += !done[record.first + i];
+            done[record.first + i] = true;
+        }
+        end += sizeof(record) + sizeof(float) * record.count;
+    }
+    free(values);
+    fclose(fp);
+    if (rvalue == 0 && ftruncate(checkpoint->fd, end) != 0) {
+        fprintf(stderr, "Error: cannot truncate checkpoint %s\n", filename);
+        rvalue = -1;
+    }
+    return rvalue;
+}
+
+/*
+ * Open the checkpoint of a run of num_series series, or create it. The pairs of an
+ * earlier run with the same key are put in sink and set in done (num_pairs bools,
+ * false); a checkpoint of another input is an error.
+ */
+int run_checkpoint_open(RunCheckpoint *checkpoint, const char *filename, int num_series, uint64_t key,
+                        double interval, ResultSink *sink, bool *done) {
+    memset(checkpoint, 0, sizeof(RunCheckpoint));
+    checkpoint->num_pairs = (idx_t)num_series * (num_series - 1) / 2;
+    checkpoint->interval = (interval > 0) ? interval : RUN_CHECKPOINT_INTERVAL;
+    checkpoint->last_sync = run_checkpoint_now();
+    checkpoint->fd = open(filename, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (checkpoint->fd < 0) {
+        perror("open");
+        return -1;
+    }
+    RunCheckpointHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RUN_CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = RUN_CHECKPOINT_VERSION;
+    header.byte_order = RUN_CHECKPOINT_BYTE_ORDER;
+    header.value_size = sizeof(float);
+    header.num_series = (uint64_t)num_series;
+    header.num_pairs = (uint64_t)checkpoint->num_pairs;
+    header.key = key;
+
+    RunCheckpointHeader found;
+    struct stat st;
+    int rvalue = 0;
+    if (fstat(checkpoint->fd, &st) != 0) {
+        perror("fstat");
+        rvalue = -1;
+    } else if (st.st_size < (off_t)sizeof(header)) {
+        // New, or a header that was never completely written
+        if (ftruncate(checkpoint->fd, 0) != 0 || !run_checkpoint_write(checkpoint->fd, &header, sizeof(header)) ||
+            fdatasync(checkpoint->fd) != 0) {
+            fprintf(stderr, "Error writing checkpoint %s\n", filename);
+            rvalue = -1;
+        }
+    } else if (pread(checkpoint->fd, &found, sizeof(found), 0) != sizeof(found) ||
+               memcmp(&found, &header, sizeof(header)) != 0) {
+        fprintf(stderr, "Error: checkpoint %s is not a checkpoint of this input and these settings\n", filename);
+        rvalue = -1;
+    } else {
+        rvalue = run_checkpoint_restore(checkpoint, filename, sink, done);
+    }
+    if (rvalue != 0) {
+        close(checkpoint->fd);
+        checkpoint->fd = -1;
+    }
+    return rvalue;
+}
+
+// Add the distances of the pairs first, ..., first+count-1, synced with the next interval
+int run_checkpoint_put(RunCheckpoint *checkpoint, idx_t first, const float *values, idx_t count) {
+    size_t bytes = sizeof(RunCheckpointRecord) + sizeof(float) * count;
+    if (checkpoint->num_pending + bytes > checkpoint->pending_size) {
+        size_t size = MAX(checkpoint->pending_size * 2, checkpoint->num_pending + bytes);
+        char *pending = realloc(checkpoint->pending, size);
+        if (!pending) {
+            fprintf(stderr, "Error: cannot allocate memory for the checkpoint buffer\n");
+            return -1;
+        }
+        checkpoint->pending = pending;
+        checkpoint->pending_size = size;
+    }
+    RunCheckpointRecord record = {(uint64_t)first, (uint32_t)count, run_checkpoint_check(first, count, values)};
+    memcpy(checkpoint->pending + checkpoint->num_pending, &record, sizeof(record));
+    memcpy(checkpoint->pending + checkpoint->num_pending + sizeof(record), values, sizeof(float) * count);
+    checkpoint->num_pending += bytes;
+    checkpoint->saved += count;
+    if (checkpoint->num_pending >= RUN_CHECKPOINT_BUFFER ||
+        run_checkpoint_now() - checkpoint->last_sync >= checkpoint->interval) {
+        return run_checkpoint_sync(checkpoint);
+    }
+    return 0;
+}
+
+// Append the buffered records and wait until they are on disk
+int run_checkpoint_sync(RunCheckpoint *checkpoint) {
+    double start = run_checkpoint_now();
+    if (checkpoint->num_pending > 0) {
+        if (!run_checkpoint_write(checkpoint->fd, checkpoint->pending, checkpoint->num_pending) ||
+            fdatasync(checkpoint->fd) != 0) {
+            fprintf(stderr, "Error appending %zu bytes to the checkpoint\n", checkpoint->num_pending);
+            return -1;
+        }
+        checkpoint->num_pending = 0;
+        checkpoint->syncs++;
+    }
+    checkpoint->last_sync = run_checkpoint_now();
+    checkpoint->sync_time += checkpoint->last_sync - start;
+    return 0;
+}
+
+// completed: the result is written and the checkpoint file is removed
+int run_checkpoint_close(RunCheckpoint *checkpoint, const char *filename, bool completed) {
+    int rvalue = 0;
+    if (checkpoint->fd >= 0) {
+        if (!completed) {
+            rvalue = run_checkpoint_sync(checkpoint);
+        }
+        if (close(checkpoint->fd) != 0) {
+            perror("close");
+            rvalue = -1;
+        }
+        if (completed && unlink(filename) != 0) {
+            perror("unlink");
+            rvalue = -1;
+        }
+    }
+    free(checkpoint->pending);
+    memset(checkpoint, 0, sizeof(RunCheckpoint));
+    checkpoint->fd = -1;
+    return rvalue;
+}
+
+void run_checkpoint_print_stats(const RunCheckpoint *checkpoint, double run_time) {
+    printf("Checkpoint: %zd pairs restored, %zd pairs saved in %d syncs, %f s (%.3f%% of the run)\n",
+           checkpoint->restored, checkpoint->saved, checkpoint->syncs, checkpoint->sync_time,
+           (run_time > 0) ? 100.0 * checkpoint->sync_time / run_time : 0.0);
+}
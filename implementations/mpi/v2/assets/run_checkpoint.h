@@ -0,0 +1,80 @@
+/*
+ * Restart checkpoint of the MPI masters: the distances of the pairs that came
+ * back from the slaves are appended to a journal file and synced to disk every
+ * RUN_CHECKPOINT_INTERVAL seconds. A run that is stopped (node failure, wall-time
+ * limit) is restarted with the same checkpoint file: the journal is replayed into
+ * the result sink and only the missing pairs are dispatched. Once the result is
+ * written the checkpoint is removed.
+ *
+ * This file is part of the DTW aggregation and clustering project.
+ */
+// run_checkpoint.h
+#ifndef RUN_CHECKPOINT_H
+#define RUN_CHECKPOINT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "dd_globals.h"
+#include "types.h"
+#include "series_collection.h"
+#include "result_sink.h"
+
+/*
+ * Layout of a checkpoint file (native byte order, checked with byte_order):
+ *
+ *   RunCheckpointHeader    64 bytes
+ *   records                RunCheckpointRecord followed by count floats, in the
+ *                          order they were appended; the records after the first
+ *                          incomplete or corrupt one (a master that died during an
+ *                          append) are dropped when the checkpoint is opened
+ */
+#define RUN_CHECKPOINT_MAGIC "DTWRUNCK"
+#define RUN_CHECKPOINT_VERSION 1
+#define RUN_CHECKPOINT_BYTE_ORDER 0x01020304u
+#define RUN_CHECKPOINT_INTERVAL 60.0
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t value_size;
+    uint32_t reserved;
+    uint64_t num_series;
+    uint64_t num_pairs;
+    uint64_t key;           // run_checkpoint_key of the series and settings
+    uint64_t padding[2];
+} RunCheckpointHeader;
+
+// Distances of the pairs first, ..., first+count-1 (result_matrix_pair_index)
+typedef struct {
+    uint64_t first;
+    uint32_t count;
+    uint32_t check;         // of first, count and the values
+} RunCheckpointRecord;
+
+typedef struct {
+    int fd;
+    idx_t num_pairs;
+    double interval;        // seconds between two syncs
+    double last_sync;
+    char *pending;          // records not appended yet
+    size_t num_pending;
+    size_t pending_size;
+    idx_t restored;
+    idx_t saved;
+    int syncs;
+    double sync_time;
+} RunCheckpoint;
+
+uint64_t run_checkpoint_key(const SeriesCollection *collection, int num_series, uint64_t settings);
+
+int  run_checkpoint_open(RunCheckpoint *checkpoint, const char *filename, int num_series, uint64_t key,
+                         double interval, ResultSink *sink, bool *done);
+int  run_checkpoint_put(RunCheckpoint *checkpoint, idx_t first, const float *values, idx_t count);
+int  run_checkpoint_sync(RunCheckpoint *checkpoint);
+int  run_checkpoint_close(RunCheckpoint *checkpoint, const char *filename, bool completed);
+void run_checkpoint_print_stats(const RunCheckpoint *checkpoint, double run_time);
+
+#endif // RUN_CHECKPOINT_H
@@ -13,6 +13,7 @@
 
 #include "dd_dtw.h"
 #include "dd_dtw_openmp.h"
+#include "dd_dtw_simd.h"
 //#include "dd_loco.h"
 
 
@@ -29,6 +30,10 @@ void benchmark10(void);
 void benchmark11(void);
 void benchmark12_subsequence(void);
 void benchmark13(void);
+void benchmark_simd(void);
+void benchmark_workspace(void);
+void benchmark_tiled(void);
+void benchmark_kernel(void);
 
 
 void benchmark1() {
@@ -425,6 +430,200 @@ void benchmark14() {
     printf("d = %f\n", d);
 }
 
+void benchmark_simd() {
+    // Two series with the typical length of a NASDAQ ticker (MAX_TIMEPOINTS)
+    idx_t l = 2000;
+    int repeat = 20;
+    seq_t *s1 = (seq_t *)malloc(sizeof(seq_t) * l);
+    seq_t *s2 = (seq_t *)malloc(sizeof(seq_t) * l);
+    for (idx_t i=0; i<l; i++) {
+        s1[i] = sin(i * 0.01);
+        s2[i] = cos(i * 0.013);
+    }
+    DTWSettings settings = dtw_settings_default();
+    int detected = dtw_simd_detect();
+    struct timespec start, end;
+    for (int level=DTW_SIMD_NONE; level<=detected; level++) {
+        dtw_simd_set_level(level);
+        seq_t d = 0;
+        clock_gettime(CLOCK_REALTIME, &start);
+        for (int r=0; r<repeat; r++) {
+            d = dtw_distance(s1, l, s2, l, &settings);
+        }
+        clock_gettime(CLOCK_REALTIME, &end);
+        double ms = (((double)end.tv_sec*1e9 + end.tv_nsec) - ((double)start.tv_sec*1e9 + start.tv_nsec)) / 1e6;
+        printf("%-7s d=%.17g  %8.3f ms/pair\n", dtw_simd_level_name(level), d, ms / repeat);
+    }
+    dtw_simd_set_level(detected);
+    free(s1);
+    free(s2);
+}
+
+void benchmark_workspace() {
+    // Many short series (one year of daily bars) such that the allocator is visible
+    idx_t n = 100;
+    idx_t l = 250;
+    seq_t **s = (seq_t **)malloc(sizeof(seq_t *) * n);
+    for (idx_t r=0; r<n; r++) {
+        s[r] = (seq_t *)malloc(sizeof(seq_t) * l);
+        for (idx_t i=0; i<l; i++) {
+            s[r][i] = sin(i * 0.01 * (r + 1));
+        }
+    }
+    DTWSettings settings = dtw_settings_default();
+    // Use the row-by-row kernel, the one that allocates the two cost matrix rows
+    settings.window = l - 1;
+    struct timespec start, end;
+    double ms_alloc, ms_malloc, ms_ws;
+    seq_t sum_malloc = 0, sum_ws = 0;
+
+    // Allocator only: one malloc/free pair of the size used by dtw_distance per pair
+    clock_gettime(CLOCK_REALTIME, &start);
+    #pragma omp parallel for schedule(dynamic)
+    for (idx_t r=0; r<n; r++) {
+        for (idx_t c=r+1; c<n; c++) {
+            seq_t * volatile buffer = (seq_t *)malloc(sizeof(seq_t) * (l + 1) * 2);
+            free(buffer);
+        }
+    }
+    clock_gettime(CLOCK_REALTIME, &end);
+    ms_alloc = (((double)end.tv_sec*1e9 + end.tv_nsec) - ((double)start.tv_sec*1e9 + start.tv_nsec)) / 1e6;
+
+    // Before: malloc and free in every dtw_distance call
+    clock_gettime(CLOCK_REALTIME, &start);
+    #pragma omp parallel for schedule(dynamic) reduction(+:sum_malloc)
+    for (idx_t r=0; r<n; r++) {
+        for (idx_t c=r+1; c<n; c++) {
+            sum_malloc += dtw_distance(s[r], l, s[c], l, &settings);
+        }
+    }
+    clock_gettime(CLOCK_REALTIME, &end);
+    ms_malloc = (((double)end.tv_sec*1e9 + end.tv_nsec) - ((double)start.tv_sec*1e9 + start.tv_nsec)) / 1e6;
+
+    // After: one workspace per thread
+    clock_gettime(CLOCK_REALTIME, &start);
+    #pragma omp parallel reduction(+:sum_ws)
+    {
+        DTWWorkspace ws = dtw_workspace_empty();
+        #pragma omp for schedule(dynamic)
+        for (idx_t r=0; r<n; r++) {
+            for (idx_t c=r+1; c<n; c++) {
+                sum_ws += dtw_distance_ws(s[r], l, s[c], l, &settings, &ws);
+            }
+        }
+        dtw_workspace_free(&ws);
+    }
+    clock_gettime(CLOCK_REALTIME, &end);
+    ms_ws = (((double)end.tv_sec*1e9 + end.tv_nsec) - ((double)start.tv_sec*1e9 + start.tv_nsec)) / 1e6;
+
+    idx_t pairs = n * (n - 1) / 2;
+    printf("pairs=%zu, length=%zu\n", pairs, l);
+    printf("malloc/free only    %8.3f ms\n", ms_alloc);
+    printf("dtw_distance        %8.3f ms  (sum=%.6f)\n", ms_malloc, sum_malloc);
+    printf("dtw_distance_ws     %8.3f ms  (sum=%.6f)\n", ms_ws, sum_ws);
+    for (idx_t r=0; r<n; r++) {
+        free(s[r]);
+    }
+    free(s);
+}
+
+void benchmark_tiled() {
+    // Row scheduler against tiles for the whole triangle. The cache misses can be
+    // compared with: perf stat -e L2_RQSTS.MISS,LLC-load-misses ./benchmark
+    idx_t sizes[] = {1000, 5000};
+    idx_t l = 250;
+    DTWSettings settings = dtw_settings_default();
+    struct timespec start, end;
+    for (int si=0; si<2; si++) {
+        idx_t n = sizes[si];
+        seq_t **s = (seq_t **)malloc(sizeof(seq_t *) * n);
+        idx_t *lengths = (idx_t *)malloc(sizeof(idx_t) * n);
+        for (idx_t r=0; r<n; r++) {
+            s[r] = (seq_t *)malloc(sizeof(seq_t) * l);
+            lengths[r] = l;
+            for (idx_t i=0; i<l; i++) {
+                s[r][i] = sin(i * 0.01 * (r % 97 + 1)) + 0.001 * r;
+            }
+        }
+        idx_t pairs = n * (n - 1) / 2;
+        seq_t *result = (seq_t *)malloc(sizeof(seq_t) * pairs);
+        idx_t tile = dtw_distances_tile_size(n, lengths, 0);
+        for (int tiled=0; tiled<=1; tiled++) {
+            DTWBlock block = dtw_block_empty();
+            clock_gettime(CLOCK_REALTIME, &start);
+            if (tiled) {
+                dtw_distances_ptrs_parallel_tiled(s, n, lengths, result, &block, &settings, tile);
+            } else {
+                dtw_distances_ptrs_parallel_d(s, n, lengths, result, &block, &settings);
+            }
+            clock_gettime(CLOCK_REALTIME, &end);
+            double ms = (((double)end.tv_sec*1e9 + end.tv_nsec) - ((double)start.tv_sec*1e9 + start.tv_nsec)) / 1e6;
+            printf("n=%zu l=%zu %-5s tile=%4zu %10.3f ms %10.0f pairs/s\n", n, l, tiled ? "tiled" : "rows",
+                   tiled ? tile : 0, ms, pairs / (ms / 1000));
+        }
+        free(result);
+        for (idx_t r=0; r<n; r++) {
+            free(s[r]);
+        }
+        free(s);
+        free(lengths);
+    }
+}
+
+void benchmark_kernel() {
+    // Generic dtw_distance_ws against the variant selected by dtw_distance_kernel. SIMD is
+    // disabled such that both are the scalar row-by-row code and only the removed branches differ.
+    idx_t n = 100;
+    idx_t l = 250;
+    int repeat = 3;
+    seq_t **s = (seq_t **)malloc(sizeof(seq_t *) * n);
+    for (idx_t r=0; r<n; r++) {
+        s[r] = (seq_t *)malloc(sizeof(seq_t) * l);
+        for (idx_t i=0; i<l; i++) {
+            s[r][i] = sin(i * 0.01 * (r % 97 + 1)) + 0.001 * r;
+        }
+    }
+    idx_t windows[] = {0, 25};
+    const char *names[] = {"generic", "specialised"};
+    int level = dtw_simd_level();
+    dtw_simd_set_level(DTW_SIMD_NONE);
+    DTWWorkspace ws = dtw_workspace_empty();
+    struct timespec start, end;
+    for (int inner_dist=0; inner_dist<=1; inner_dist++) {
+        for (int wi=0; wi<2; wi++) {
+            DTWSettings settings = dtw_settings_default();
+            settings.inner_dist = inner_dist;
+            settings.window = windows[wi];
+            DTWWsFnPtr fns[2] = {dtw_distance_ws, dtw_distance_kernel(&settings)};
+            double ms[2];
+            seq_t sum[2];
+            for (int f=0; f<2; f++) {
+                ms[f] = INFINITY;
+                for (int rep=0; rep<repeat; rep++) {
+                    sum[f] = 0;
+                    clock_gettime(CLOCK_REALTIME, &start);
+                    for (idx_t r=0; r<n; r++) {
+                        for (idx_t c=r+1; c<n; c++) {
+                            sum[f] += fns[f](s[r], l, s[c], l, &settings, &ws);
+                        }
+                    }
+                    clock_gettime(CLOCK_REALTIME, &end);
+                    ms[f] = MIN(ms[f], (((double)end.tv_sec*1e9 + end.tv_nsec) - ((double)start.tv_sec*1e9 + start.tv_nsec)) / 1e6);
+                }
+            }
+            printf("%-9s window=%3zu  %s %8.3f ms  %s %8.3f ms  speedup %.2fx  (sum=%.6f%s)\n",
+                   inner_dist ? "euclidean" : "squared", windows[wi], names[0], ms[0], names[1], ms[1],
+                   ms[0] / ms[1], sum[1], (sum[0] == sum[1]) ? "" : " DIFFERS");
+        }
+    }
+    dtw_workspace_free(&ws);
+    dtw_simd_set_level(level);
+    for (idx_t r=0; r<n; r++) {
+        free(s[r]);
+    }
+    free(s);
+}
+
 void benchmark_loco() {
     dtw_printprecision_set(3);
     double series1[] = {0., -1, -1, 0, 1, 2, 1, 0, 0, 0, 1, 3, 2, 1, 0, 0, 0, -1, 0};
@@ -659,6 +858,10 @@ int main(int argc, const char * argv[]) {
 //    benchmark12_subsequence();
 //    benchmark13();
 //    benchmark14();
+//    benchmark_simd();
+//    benchmark_workspace();
+//    benchmark_tiled();
+//    benchmark_kernel();
     benchmark_loco();
 //    benchmark_affinity();
 //    wps_test();
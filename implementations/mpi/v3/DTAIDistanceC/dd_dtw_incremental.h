@@ -0,0 +1,46 @@
+/*!
+@header dtw_incremental.h
+@brief DTAIDistance.dtw : Extend a DTW distance when points are appended
+
+The distance of two series only needs the last row D[l1-1][0..l2-1] and the last
+column D[0..l1-1][l2-1] of the cumulative cost matrix to be extended to longer
+series that start with the same values. Appending d1 points to series 1 and d2
+points to series 2 adds the rows l1..l1+d1-1 and, for the old rows, the columns
+l2..l2+d2-1 of the matrix:
+
+  - old rows, new columns: l1 * d2 cells, from the old last column
+  - new rows, all columns: d1 * (l2 + d2) cells, from the old last row
+
+The cost is thus O((l1 + l2) * d) instead of O(l1 * l2) for a full computation, and
+the result is the same value as dtw_distance (the same recurrence on the same
+values). The boundary of the extended matrix is written for the next extension.
+
+The boundaries hold the cumulative cost before the square root (inner_dist 0).
+
+Only settings for which the matrix does not depend on the length of the series
+are supported (see dtw_incremental_supported): no window, no psi-relaxation and no
+pruning of the cost matrix. max_dist and max_length_diff are applied to the result.
+
+@copyright Apache License, Version 2.0, see LICENSE for details.
+*/
+
+#ifndef dtw_incremental_h
+#define dtw_incremental_h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <stdbool.h>
+
+#include "dd_globals.h"
+#include "dd_dtw.h"
+
+
+bool  dtw_incremental_supported(DTWSettings *settings);
+seq_t dtw_distance_boundary_ws(seq_t *s1, idx_t l1, seq_t *s2, idx_t l2, DTWSettings *settings,
+                               seq_t *row, seq_t *col, DTWWorkspace *ws);
+seq_t dtw_distance_extend_ws(seq_t *s1, idx_t l1, seq_t *s2, idx_t l2, DTWSettings *settings,
+                             idx_t old_l1, idx_t old_l2, const seq_t *old_row, const seq_t *old_col,
+                             seq_t *row, seq_t *col, DTWWorkspace *ws);
+
+#endif /* dtw_incremental_h */
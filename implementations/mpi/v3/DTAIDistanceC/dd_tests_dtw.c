@@ -14,6 +14,10 @@
 #include <criterion/parameterized.h>
 
 #include "dd_dtw.h"
+#include "dd_dtw_simd.h"
+#include "dd_dtw_f32.h"
+#include "dd_dtw_prune.h"
+#include "dd_dtw_incremental.h"
 
 
 //#define SKIPALL
@@ -832,3 +836,484 @@ Test(bounds, test_keogh_lb_1) {
     double d = lb_keogh(ra1, size, ra2, size, &settings);
     cr_assert_float_eq(d, 2.23606797749979, 0.001);
 }
+
+
+//----------------------------------------------------
+// MARK: SIMD
+
+Test(simd, test_wavefront_identical) {
+#ifdef SKIPALL
+    cr_skip_test();
+#endif
+    idx_t l1 = 37;
+    idx_t l2 = 29;
+    double s1[37];
+    double s2[29];
+    for (idx_t i=0; i<l1; i++) {
+        s1[i] = sin(i * 0.3) + 0.01 * i;
+    }
+    for (idx_t i=0; i<l2; i++) {
+        s2[i] = cos(i * 0.2);
+    }
+    DTWSettings settings = dtw_settings_default();
+    int level = dtw_simd_level();
+    dtw_simd_set_level(DTW_SIMD_NONE);
+    double d12 = dtw_distance(s1, l1, s2, l2, &settings);
+    double d21 = dtw_distance(s2, l2, s1, l1, &settings);
+    for (int l=DTW_SIMD_NONE; l<=DTW_SIMD_AVX512; l++) {
+        dtw_simd_set_level(l);
+        cr_assert_eq(dtw_distance_wavefront(s1, l1, s2, l2, &settings), d12);
+        cr_assert_eq(dtw_distance_wavefront(s2, l2, s1, l1, &settings), d21);
+        cr_assert_eq(dtw_distance(s1, l1, s2, l2, &settings), d12);
+    }
+    // A NaN in a series reaches the result through the diagonal, as in dtw_distance
+    s1[11] = NAN;
+    dtw_simd_set_level(DTW_SIMD_NONE);
+    cr_assert(isnan(dtw_distance(s1, l1, s2, l2, &settings)));
+    for (int l=DTW_SIMD_NONE; l<=DTW_SIMD_AVX512; l++) {
+        dtw_simd_set_level(l);
+        cr_assert(isnan(dtw_distance_wavefront(s1, l1, s2, l2, &settings)));
+        cr_assert(isnan(dtw_distance_wavefront(s2, l2, s1, l1, &settings)));
+    }
+    dtw_simd_set_level(level);
+}
+
+Test(simd, test_wavefront_fallback) {
+#ifdef SKIPALL
+    cr_skip_test();
+#endif
+    double s1[] = {0, 0, 1, 2, 1, 0, 1, 0, 0};
+    double s2[] = {0, 1, 2, 0, 0, 0, 0, 0, 0};
+    DTWSettings settings = dtw_settings_default();
+    settings.window = 2;
+    cr_assert(!dtw_simd_settings_supported(9, 9, &settings));
+    double d = dtw_distance_wavefront(s1, 9, s2, 9, &settings);
+    cr_assert_float_eq(d, sqrt(2), 0.001);
+}
+
+Test(simd, test_batch_identical) {
+#ifdef SKIPALL
+    cr_skip_test();
+#endif
+    idx_t l1 = 23;
+    double s1[23];
+    for (idx_t i=0; i<l1; i++) {
+        s1[i] = sin(i * 0.4);
+    }
+    // 11 columns: two length groups that fill the lanes and a few leftovers
+    idx_t n = 11;
+    double data[11][20];
+    seq_t *s2s[11];
+    idx_t l2s[11];
+    for (idx_t k=0; k<n; k++) {
+        l2s[k] = (k % 3 == 0) ? 17 : 20;
+        for (idx_t i=0; i<l2s[k]; i++) {
+            data[k][i] = cos(i * 0.1 * (k + 1));
+        }
+        s2s[k] = data[k];
+    }
+    DTWSettings settings = dtw_settings_default();
+    int level = dtw_simd_level();
+    dtw_simd_set_level(DTW_SIMD_NONE);
+    double expected[11];
+    for (idx_t k=0; k<n; k++) {
+        expected[k] = dtw_distance(s1, l1, s2s[k], l2s[k], &settings);
+    }
+    double output[11];
+    for (int l=DTW_SIMD_NONE; l<=DTW_SIMD_AVX512; l++) {
+        dtw_simd_set_level(l);
+        dtw_distance_batch(s1, l1, s2s, l2s, n, output, &settings);
+        for (idx_t k=0; k<n; k++) {
+            cr_assert_eq(output[k], expected[k]);
+        }
+    }
+    // NaN in a column and then in s1: the same NaN or infinity as dtw_distance
+    for (int t=0; t<2; t++) {
+        if (t == 0) {
+            data[4][9] = NAN;
+        } else {
+            s1[13] = NAN;
+        }
+        dtw_simd_set_level(DTW_SIMD_NONE);
+        for (idx_t k=0; k<n; k++) {
+            expected[k] = dtw_distance(s1, l1, s2s[k], l2s[k], &settings);
+        }
+        cr_assert(isnan(expected[4]));
+        for (int l=DTW_SIMD_NONE; l<=DTW_SIMD_AVX512; l++) {
+            dtw_simd_set_level(l);
+            dtw_distance_batch(s1, l1, s2s, l2s, n, output, &settings);
+            for (idx_t k=0; k<n; k++) {
+                cr_assert(isnan(expected[k]) ? isnan(output[k]) : output[k] == expected[k]);
+            }
+        }
+    }
+    dtw_simd_set_level(level);
+}
+
+
+// MARK: Float32
+
+Test(f32, test_f32_identical_simd) {
+#ifdef SKIPALL
+    cr_skip_test();
+#endif
+    idx_t l1 = 41;
+    idx_t l2 = 33;
+    float s1[41];
+    float s2[33];
+    for (idx_t i=0; i<l1; i++) {
+        s1[i] = sinf(i * 0.3f) + 0.01f * i;
+    }
+    for (idx_t i=0; i<l2; i++) {
+        s2[i] = cosf(i * 0.2f);
+    }
+    DTWSettings settings = dtw_settings_default();
+    int level = dtw_simd_level();
+    dtw_simd_set_level(DTW_SIMD_NONE);
+    float d = dtw_distance_f32(s1, l1, s2, l2, &settings);
+    for (int l=DTW_SIMD_NONE; l<=DTW_SIMD_AVX512; l++) {
+        dtw_simd_set_level(l);
+        cr_assert_eq(dtw_distance_wavefront_f32(s1, l1, s2, l2, &settings), d);
+        cr_assert_eq(dtw_distance_f32(s1, l1, s2, l2, &settings), d);
+    }
+    s1[13] = NAN;
+    dtw_simd_set_level(DTW_SIMD_NONE);
+    cr_assert(isnan(dtw_distance_f32(s1, l1, s2, l2, &settings)));
+    for (int l=DTW_SIMD_NONE; l<=DTW_SIMD_AVX512; l++) {
+        dtw_simd_set_level(l);
+        cr_assert(isnan(dtw_distance_wavefront_f32(s1, l1, s2, l2, &settings)));
+        cr_assert(isnan(dtw_distance_wavefront_f32(s2, l2, s1, l1, &settings)));
+    }
+    dtw_simd_set_level(level);
+}
+
+Test(f32, test_f32_error_bound) {
+#ifdef SKIPALL
+    cr_skip_test();
+#endif
+    idx_t l1 = 200;
+    idx_t l2 = 170;
+    double s1[200];
+    double s2[170];
+    float s1f[200];
+    float s2f[170];
+    double max_abs = 0;
+    for (idx_t i=0; i<l1; i++) {
+        s1[i] = 100 + 10 * sin(i * 0.05) + 0.001 * i;
+        max_abs = MAX(max_abs, fabs(s1[i]));
+    }
+    for (idx_t i=0; i<l2; i++) {
+        s2[i] = 100 + 10 * cos(i * 0.07);
+        max_abs = MAX(max_abs, fabs(s2[i]));
+    }
+    dtw_seq_to_f32(s1, l1, s1f);
+    dtw_seq_to_f32(s2, l2, s2f);
+    DTWSettings settings = dtw_settings_default();
+    double d64 = dtw_distance(s1, l1, s2, l2, &settings);
+    double d32 = dtw_distance_f32(s1f, l1, s2f, l2, &settings);
+    double bound = dtw_distance_f32_error_bound(l1, l2, max_abs, d64);
+    cr_assert_leq(fabs(d32 - d64), bound);
+}
+
+Test(f32, test_f32_bounds) {
+#ifdef SKIPALL
+    cr_skip_test();
+#endif
+    float s1[] = {0, 0, 1, 2, 1, 0, 1, 0, 0};
+    float s2[] = {0, 1, 2, 0, 0, 0, 0, 0, 0};
+    DTWSettings settings = dtw_settings_default();
+    settings.window = 2;
+    float d = dtw_distance_f32(s1, 9, s2, 9, &settings);
+    cr_assert_float_eq(d, sqrt(2), 0.001);
+    cr_assert_leq(lb_keogh_f32(s1, 9, s2, 9, &settings), d);
+    cr_assert_geq(ub_euclidean_f32(s1, 9, s2, 9), d);
+}
+
+
+// MARK: Workspace
+
+Test(workspace, test_ws_identical) {
+#ifdef SKIPALL
+    cr_skip_test();
+#endif
+    double s[3][40];
+    idx_t l[3] = {40, 12, 25};
+    for (idx_t k=0; k<3; k++) {
+        for (idx_t i=0; i<l[k]; i++) {
+            s[k][i] = sin(i * 0.2 * (k + 1));
+        }
+    }
+    DTWSettings settings = dtw_settings_default();
+    settings.window = 5;
+    DTWWorkspace ws = dtw_workspace_empty();
+    for (idx_t a=0; a<3; a++) {
+        for (idx_t b=0; b<3; b++) {
+            double d = dtw_distance(s[a], l[a], s[b], l[b], &settings);
+            double d_ws = dtw_distance_ws(s[a], l[a], s[b], l[b], &settings, &ws);
+            cr_assert_eq(d, d_ws);
+            d = dtw_distance_ndim(s[a], l[a] / 2, s[b], l[b] / 2, 2, &settings);
+            d_ws = dtw_distance_ndim_ws(s[a], l[a] / 2, s[b], l[b] / 2, 2, &settings, &ws);
+            cr_assert_eq(d, d_ws);
+        }
+    }
+    // The workspace only grows
+    size_t size = ws.size;
+    dtw_distance_ws(s[1], l[1], s[1], l[1], &settings, &ws);
+    cr_assert_eq(ws.size, size);
+    dtw_workspace_free(&ws);
+    cr_assert_eq(ws.size, 0);
+}
+
+Test(workspace, test_warping_paths_ws) {
+#ifdef SKIPALL
+    cr_skip_test();
+#endif
+    double s1[] = {0, 0, 1, 2, 1, 0, 1, 0, 0};
+    double s2[] = {0, 1, 2, 0, 0, 0, 0, 0, 0};
+    DTWSettings settings = dtw_settings_default();
+    DTWWorkspace ws = dtw_workspace_empty();
+    seq_t *wps;
+    double d = dtw_warping_paths_ws(&wps, s1, 9, s2, 9, true, false, true, &settings, &ws);
+    cr_assert_float_eq(d, sqrt(2), 0.001);
+    cr_assert(wps == ws.buffer);
+    dtw_workspace_free(&ws);
+}
+
+
+// MARK: Kernels
+
+Test(kernel, test_kernel_selection) {
+#ifdef SKIPALL
+    cr_skip_test();
+#endif
+    int level = dtw_simd_level();
+    dtw_simd_set_level(DTW_SIMD_NONE);
+    DTWSettings settings = dtw_settings_default();
+    cr_assert(dtw_distance_kernel(&settings) == dtw_distance_full_ws);
+    settings.max_dist = 2;
+    settings.max_length_diff = 3;
+    cr_assert(dtw_distance_kernel(&settings) == dtw_distance_full_ws);
+    settings.window = 4;
+    cr_assert(dtw_distance_kernel(&settings) == dtw_distance_banded_ws);
+    settings.inner_dist = 1;
+    cr_assert(dtw_distance_kernel(&settings) == dtw_distance_euclidean_banded_ws);
+    settings.window = 0;
+    cr_assert(dtw_distance_kernel(&settings) == dtw_distance_euclidean_full_ws);
+    // Options without a specialised variant
+    settings = dtw_settings_default();
+    dtw_settings_set_psi(2, &settings);
+    cr_assert(dtw_distance_kernel(&settings) == dtw_distance_ws);
+    settings = dtw_settings_default();
+    settings.penalty = 0.1;
+    cr_assert(dtw_distance_kernel(&settings) == dtw_distance_ws);
+    settings = dtw_settings_default();
+    settings.max_step = 1;
+    cr_assert(dtw_distance_kernel(&settings) == dtw_distance_ws);
+    settings = dtw_settings_default();
+    settings.use_pruning = true;
+    cr_assert(dtw_distance_kernel(&settings) == dtw_distance_ws);
+    for (int l=DTW_SIMD_NONE+1; l<=dtw_simd_detect(); l++) {
+        dtw_simd_set_level(l);
+        settings = dtw_settings_default();
+        cr_assert(dtw_distance_kernel(&settings) == dtw_distance_wavefront_ws);
+    }
+    dtw_simd_set_level(level);
+}
+
+Test(kernel, test_specialised_identical) {
+#ifdef SKIPALL
+    cr_skip_test();
+#endif
+    double s[3][40];
+    idx_t l[3] = {40, 12, 25};
+    for (idx_t k=0; k<3; k++) {
+        for (idx_t i=0; i<l[k]; i++) {
+            s[k][i] = sin(i * 0.2 * (k + 1)) + 0.1 * k;
+        }
+    }
+    idx_t windows[] = {0, 1, 3, 5, 60};
+    double max_dists[] = {0, 1.5};
+    idx_t max_length_diffs[] = {0, 14};
+    int level = dtw_simd_level();
+    dtw_simd_set_level(DTW_SIMD_NONE);
+    DTWWorkspace ws = dtw_workspace_empty();
+    for (int inner_dist=0; inner_dist<=1; inner_dist++) {
+        for (int w=0; w<5; w++) {
+            for (int m=0; m<2; m++) {
+                for (int ld=0; ld<2; ld++) {
+                    DTWSettings settings = dtw_settings_default();
+                    settings.inner_dist = inner_dist;
+                    settings.window = windows[w];
+                    settings.max_dist = max_dists[m];
+                    settings.max_length_diff = max_length_diffs[ld];
+                    DTWWsFnPtr dtw_fn = dtw_distance_kernel(&settings);
+                    cr_assert(dtw_fn != dtw_distance_ws);
+                    for (idx_t a=0; a<3; a++) {
+                        for (idx_t b=0; b<3; b++) {
+                            double d = dtw_distance(s[a], l[a], s[b], l[b], &settings);
+                            cr_assert_eq(dtw_fn(s[a], l[a], s[b], l[b], &settings, &ws), d);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    // Matrix functions select the variant once
+    DTWSettings settings = dtw_settings_default();
+    settings.window = 3;
+    double *ptrs[3] = {s[0], s[1], s[2]};
+    double result[3];
+    DTWBlock block = dtw_block_empty();
+    dtw_distances_ptrs(ptrs, 3, l, result, &block, &settings);
+    cr_assert_eq(result[0], dtw_distance(s[0], l[0], s[1], l[1], &settings));
+    cr_assert_eq(result[2], dtw_distance(s[1], l[1], s[2], l[2], &settings));
+    dtw_workspace_free(&ws);
+    dtw_simd_set_level(level);
+}
+
+
+// MARK: Pruning
+
+Test(prune, test_envelope) {
+#ifdef SKIPALL
+    cr_skip_test();
+#endif
+    double s[] = {0, 3, 1, 2, 5, 0, 1, -2, 0, 4};
+    idx_t l = 10;
+    DTWEnvelope env;
+    for (idx_t radius=0; radius<=l; radius++) {
+        cr_assert(dtw_envelope_init(&env, s, l, radius));
+        for (idx_t i=0; i<l; i++) {
+            double lower = INFINITY;
+            double upper = -INFINITY;
+            for (idx_t j=(i > radius ? i - radius : 0); j<l && j<=i+radius; j++) {
+                lower = fmin(lower, s[j]);
+                upper = fmax(upper, s[j]);
+            }
+            cr_assert_eq(env.lower[i], lower);
+            cr_assert_eq(env.upper[i], upper);
+        }
+        dtw_envelope_free(&env);
+    }
+}
+
+Test(prune, test_lower_bounds) {
+#ifdef SKIPALL
+    cr_skip_test();
+#endif
+    double s1[] = {0, 0, 1, 2, 1, 0, 1, 0, 0, 3, 1};
+    double s2[] = {1, 1, 2, 0, 0, 0, 0, 0, 2};
+    idx_t l1 = 11;
+    idx_t l2 = 9;
+    DTWSettings settings = dtw_settings_default();
+    DTWEnvelope env2;
+    for (idx_t window=0; window<4; window++) {
+        for (int inner_dist=0; inner_dist<2; inner_dist++) {
+            settings.window = window;
+            settings.inner_dist = inner_dist;
+            double d = dtw_distance(s1, l1, s2, l2, &settings);
+            cr_assert_leq(lb_kim(s1, l1, s2, l2, &settings), d);
+            dtw_envelope_init(&env2, s2, l2, dtw_envelope_radius(l1, l2, &settings));
+            cr_assert_leq(lb_keogh_envelope(s1, l1, &env2, &settings), d);
+            dtw_envelope_free(&env2);
+            if (inner_dist == 0) {
+                // Same band as lb_keogh for series of equal length
+                dtw_envelope_init(&env2, s2, l2, dtw_envelope_radius(l2, l2, &settings));
+                cr_assert_geq(lb_keogh_envelope(s1, l2, &env2, &settings),
+                              lb_keogh(s1, l2, s2, l2, &settings));
+                dtw_envelope_free(&env2);
+            }
+        }
+    }
+}
+
+Test(prune, test_cascade_identical) {
+#ifdef SKIPALL
+    cr_skip_test();
+#endif
+    // Random walks of different lengths, compared with thresholds around their distance
+    double data[6][60];
+    idx_t l[6] = {60, 60, 45, 52, 60, 30};
+    for (idx_t k=0; k<6; k++) {
+        double v = 0;
+        for (idx_t i=0; i<l[k]; i++) {
+            v += sin(i * 0.37 * (k + 1)) + 0.1 * k;
+            data[k][i] = v;
+        }
+    }
+    seq_t *s2s[6];
+    for (idx_t k=0; k<6; k++) {
+        s2s[k] = data[k];
+    }
+    DTWSettings settings = dtw_settings_default();
+    int level = dtw_simd_level();
+    for (idx_t window=0; window<=10; window+=10) {
+        settings.window = window;
+        settings.max_dist = 0;
+        dtw_simd_set_level(DTW_SIMD_NONE);
+        double full[6];
+        for (idx_t k=0; k<6; k++) {
+            full[k] = dtw_distance(data[0], l[0], data[k], l[k], &settings);
+        }
+        for (int t=1; t<=4; t++) {
+            settings.max_dist = full[t];
+            double expected[6];
+            double output[6];
+            dtw_simd_set_level(DTW_SIMD_NONE);
+            for (idx_t k=0; k<6; k++) {
+                expected[k] = dtw_distance(data[0], l[0], data[k], l[k], &settings);
+                cr_assert_eq(expected[k], (full[k] <= settings.max_dist) ? full[k] : INFINITY);
+            }
+            for (int lvl=DTW_SIMD_NONE; lvl<=DTW_SIMD_AVX512; lvl++) {
+                dtw_simd_set_level(lvl);
+                DTWPruneStats stats = dtw_prune_stats_empty();
+                for (idx_t k=0; k<6; k++) {
+                    cr_assert_eq(dtw_distance_cascade(data[0], l[0], data[k], l[k], &settings, &stats), expected[k]);
+                }
+                cr_assert_eq(stats.pairs, 6);
+                cr_assert_eq(stats.pruned_kim + stats.pruned_keogh + stats.abandoned + stats.kept, 6);
+                DTWWorkspace ws = dtw_workspace_empty();
+                dtw_distance_cascade_batch_ws(data[0], l[0], NULL, s2s, l, NULL, 6, output, &settings, &ws, NULL);
+                for (idx_t k=0; k<6; k++) {
+                    cr_assert_eq(output[k], expected[k]);
+                }
+                dtw_workspace_free(&ws);
+            }
+        }
+    }
+    dtw_simd_set_level(level);
+}
+
+Test(incremental, test_extend_identical) {
+#ifdef SKIPALL
+    cr_skip_test();
+#endif
+    // Random walks that grow by a few points, extended from every earlier boundary
+    double data[2][50];
+    for (idx_t k=0; k<2; k++) {
+        double v = 0;
+        for (idx_t i=0; i<50; i++) {
+            v += sin(i * 0.41 * (k + 1)) + 0.05 * k;
+            data[k][i] = v;
+        }
+    }
+    idx_t l1s[4] = {30, 33, 33, 50};
+    idx_t l2s[4] = {25, 25, 31, 44};
+    DTWSettings settings = dtw_settings_default();
+    DTWWorkspace ws = dtw_workspace_empty();
+    seq_t row[2][50], col[2][50];
+    for (int inner_dist=0; inner_dist<=1; inner_dist++) {
+        settings.inner_dist = inner_dist;
+        double d = dtw_distance_boundary_ws(data[0], l1s[0], data[1], l2s[0], &settings, row[0], col[0], &ws);
+        cr_assert_eq(d, dtw_distance(data[0], l1s[0], data[1], l2s[0], &settings));
+        for (int k=1; k<4; k++) {
+            int cur = k % 2;
+            d = dtw_distance_extend_ws(data[0], l1s[k], data[1], l2s[k], &settings,
+                                       l1s[k-1], l2s[k-1], row[1-cur], col[1-cur], row[cur], col[cur], &ws);
+            cr_assert_eq(d, dtw_distance(data[0], l1s[k], data[1], l2s[k], &settings));
+        }
+    }
+    settings.window = 5;
+    cr_assert(!dtw_incremental_supported(&settings));
+    dtw_workspace_free(&ws);
+}
@@ -0,0 +1,274 @@
+/*
+ * Persistent cache of pair distances.
+ *
+ * This file is part of the DTW aggregation and clustering project.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include "result_cache.h"
+
+
+// Records read per pread when loading, and buffered before an append
+#define RESULT_CACHE_CHUNK 65536
+
+static uint64_t result_cache_mix(uint64_t hash, uint64_t value) {
+    hash ^= value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
+/*
+ * Key of the settings that change the distance of a pair, from the fields and not
+ * from the bytes of the struct (padding).
+ */
+uint64_t result_cache_settings_key(const DTWSettings *settings, ResultCacheKind kind) {
+    double reals[3] = {settings->max_dist, settings->max_step, settings->penalty};
+    uint64_t bits[3];
+    memcpy(bits, reals, sizeof(bits));
+    uint64_t key = 0;
+    key = result_cache_mix(key, RESULT_CACHE_VERSION);
+    key = result_cache_mix(key, (uint64_t)kind);
+    key = result_cache_mix(key, (uint64_t)settings->window);
+    key = result_cache_mix(key, bits[0]);
+    key = result_cache_mix(key, bits[1]);
+    key = result_cache_mix(key, (uint64_t)settings->max_length_diff);
+    key = result_cache_mix(key, bits[2]);
+    key = result_cache_mix(key, (uint64_t)settings->psi_1b);
+    key = result_cache_mix(key, (uint64_t)settings->psi_1e);
+    key = result_cache_mix(key, (uint64_t)settings->psi_2b);
+    key = result_cache_mix(key, (uint64_t)settings->psi_2e);
+    key = result_cache_mix(key, (uint64_t)settings->use_pruning);
+    key = result_cache_mix(key, (uint64_t)settings->only_ub);
+    key = result_cache_mix(key, (uint64_t)settings->inner_dist);
+    key = result_cache_mix(key, (uint64_t)settings->window_type);
+    return key;
+}
+
+static idx_t result_cache_slot(const ResultCache *cache, uint64_t series_r, uint64_t series_c, uint64_t settings) {
+    uint64_t hash = result_cache_mix(result_cache_mix(series_r, series_c), settings);
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    idx_t mask = cache->table_size - 1;
+    idx_t slot = (idx_t)(hash & (uint64_t)mask);
+    while (cache->used[slot]) {
+        const ResultCacheRecord *record = &cache->table[slot];
+        if (record->series_r == series_r && record->series_c == series_c && record->settings == settings) {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+// Keep the load factor of the table below one half
+static int result_cache_reserve(ResultCache *cache, idx_t count) {
+    if (2 * count < cache->table_size) {
+        return 0;
+    }
+    idx_t size = (cache->table_size > 0) ? cache->table_size : 1024;
+    while (2 * count >= size) {
+        size *= 2;
+    }
+    ResultCache grown = *cache;
+    grown.table = malloc(sizeof(ResultCacheRecord) * size);
+    grown.used = calloc(size, sizeof(bool));
+    grown.table_size = size;
+    if (!grown.table || !grown.used) {
+        fprintf(stderr, "Error: cannot allocate memory for a result cache of %zd pairs\n", count);
+        free(grown.table);
+        free(grown.used);
+        return -1;
+    }
+    for (idx_t i = 0; i < cache->table_size; i++) {
+        if (cache->used[i]) {
+            const ResultCacheRecord *record = &cache->table[i];
+            idx_t slot = result_cache_slot(&grown, record->series_r, record->series_c, record->settings);
+            grown.table[slot] = *record;
+            grown.used[slot] = true;
+        }
+    }
+    free(cache->table);
+    free(cache->used);
+    cache->table = grown.table;
+    cache->used = grown.used;
+    cache->table_size = size;
+    return 0;
+}
+
+static int result_cache_insert(ResultCache *cache, const ResultCacheRecord *record) {
+    if (result_cache_reserve(cache, cache->count + 1) != 0) {
+        return -1;
+    }
+    idx_t slot = result_cache_slot(cache, record->series_r, record->series_c, record->settings);
+    if (!cache->used[slot]) {
+        cache->used[slot] = true;
+        cache->count++;
+    }
+    cache->table[slot] = *record;
+    return 0;
+}
+
+static bool result_cache_write(int fd, const void *buf, size_t size) {
+    const char *pos = buf;
+    while (size > 0) {
+        ssize_t written = write(fd, pos, size);
+        if (written <= 0) {
+            return false;
+        }
+        pos += written;
+        size -= (size_t)written;
+    }
+    return true;
+}
+
+// Load the records of filename, the file is created if it does not exist
+static int result_cache_load(ResultCache *cache, const char *filename) {
+    struct stat st;
+    if (fstat(cache->fd, &st) != 0) {
+        perror("fstat");
+        return -1;
+    }
+    ResultCacheHeader header;
+    if (st.st_size == 0) {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, RESULT_CACHE_MAGIC, sizeof(header.magic));
+        header.version = RESULT_CACHE_VERSION;
+        header.byte_order = RESULT_CACHE_BYTE_ORDER;
+        header.record_size = sizeof(ResultCacheRecord);
+        if (!result_cache_write(cache->fd, &header, sizeof(header))) {
+            fprintf(stderr, "Error writing result cache %s\n", filename);
+            return -1;
+        }
+        return 0;
+    }
+    if (st.st_size < (off_t)sizeof(header) || pread(cache->fd, &header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header.magic, RESULT_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != RESULT_CACHE_VERSION || header.byte_order != RESULT_CACHE_BYTE_ORDER ||
+        header.record_size != sizeof(ResultCacheRecord)) {
+        fprintf(stderr, "Error: %s is not a valid result cache\n", filename);
+        return -1;
+    }
+    idx_t num_records = (idx_t)((st.st_size - sizeof(header)) / sizeof(ResultCacheRecord));
+    ResultCacheRecord *chunk = malloc(sizeof(ResultCacheRecord) * RESULT_CACHE_CHUNK);
+    if (!chunk || result_cache_reserve(cache, num_records) != 0) {
+        free(chunk);
+        return -1;
+    }
+    for (idx_t i = 0; i < num_records; i += RESULT_CACHE_CHUNK) {
+        idx_t n = MIN(num_records - i, RESULT_CACHE_CHUNK);
+        size_t bytes = sizeof(ResultCacheRecord) * n;
+        if (pread(cache->fd, chunk, bytes, (off_t)(sizeof(header) + sizeof(ResultCacheRecord) * i)) != (ssize_t)bytes) {
+            fprintf(stderr, "Error reading result cache %s\n", filename);
+            free(chunk);
+            return -1;
+        }
+        for (idx_t k = 0; k < n; k++) {
+            result_cache_insert(cache, &chunk[k]);
+        }
+    }
+    free(chunk);
+    return 0;
+}
+
+int result_cache_open(ResultCache *cache, const char *filename) {
+    memset(cache, 0, sizeof(ResultCache));
+    cache->fd = open(filename, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (cache->fd < 0) {
+        perror("open");
+        return -1;
+    }
+    cache->pending = malloc(sizeof(ResultCacheRecord) * RESULT_CACHE_CHUNK);
+    if (!cache->pending || result_cache_reserve(cache, 0) != 0) {
+        result_cache_close(cache);
+        return -1;
+    }
+    // Exclusive, such that only one process writes the header of a new file
+    if (flock(cache->fd, LOCK_EX) != 0) {
+        perror("flock");
+        result_cache_close(cache);
+        return -1;
+    }
+    int rvalue = result_cache_load(cache, filename);
+    flock(cache->fd, LOCK_UN);
+    if (rvalue != 0) {
+        result_cache_close(cache);
+    }
+    return rvalue;
+}
+
+bool result_cache_get(ResultCache *cache, uint64_t series_r, uint64_t series_c, uint64_t settings, double *value) {
+    idx_t slot = result_cache_slot(cache, series_r, series_c, settings);
+    if (!cache->used[slot]) {
+        return false;
+    }
+    *value = cache->table[slot].value;
+    cache->hits++;
+    return true;
+}
+
+// Add a distance, it is appended to the file with the next RESULT_CACHE_CHUNK ones or at the latest on close
+int result_cache_put(ResultCache *cache, uint64_t series_r, uint64_t series_c, uint64_t settings, double value) {
+    ResultCacheRecord record = {series_r, series_c, settings, value};
+    if (result_cache_insert(cache, &record) != 0) {
+        return -1;
+    }
+    cache->pending[cache->num_pending++] = record;
+    cache->added++;
+    if (cache->num_pending == RESULT_CACHE_CHUNK) {
+        return result_cache_flush(cache);
+    }
+    return 0;
+}
+
+// Append the buffered records with one write under an exclusive lock
+int result_cache_flush(ResultCache *cache) {
+    if (cache->num_pending == 0) {
+        return 0;
+    }
+    if (flock(cache->fd, LOCK_EX) != 0) {
+        perror("flock");
+        return -1;
+    }
+    // Drop an incomplete record of a writer that died during its append
+    struct stat st;
+    bool ok = (fstat(cache->fd, &st) == 0);
+    off_t tail = ok ? (off_t)((st.st_size - sizeof(ResultCacheHeader)) % sizeof(ResultCacheRecord)) : 0;
+    if (ok && tail != 0) {
+        ok = (ftruncate(cache->fd, st.st_size - tail) == 0);
+    }
+    ok = ok && result_cache_write(cache->fd, cache->pending, sizeof(ResultCacheRecord) * cache->num_pending);
+    flock(cache->fd, LOCK_UN);
+    if (!ok) {
+        fprintf(stderr, "Error appending %zd records to the result cache\n", cache->num_pending);
+        return -1;
+    }
+    cache->num_pending = 0;
+    return 0;
+}
+
+int result_cache_close(ResultCache *cache) {
+    int rvalue = 0;
+    if (cache->fd >= 0) {
+        rvalue = result_cache_flush(cache);
+        if (close(cache->fd) != 0) {
+            perror("close");
+            rvalue = -1;
+        }
+    }
+    free(cache->table);
+    free(cache->used);
+    free(cache->pending);
+    memset(cache, 0, sizeof(ResultCache));
+    cache->fd = -1;
+    return rvalue;
+}
+
+void result_cache_print_stats(const ResultCache *cache, idx_t num_pairs) {
+    printf("Result cache: %zd of %zd pairs cached, %zd pairs added (%zd pairs in the cache)\n",
+           cache->hits, num_pairs, cache->added, cache->count);
+}
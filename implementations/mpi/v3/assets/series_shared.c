@@ -0,0 +1,120 @@
+/*
+ * Series collection shared by all MPI ranks of a node.
+ *
+ * This file is part of the DTW aggregation and clustering project.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "series_shared.h"
+
+
+// Largest broadcast of MPI_BYTE per call (the count is an int)
+#define SERIES_SHARED_BCAST_CHUNK (1 << 30)
+
+static size_t series_shared_values_offset(int num_series) {
+    size_t offset = sizeof(idx_t) * (2 * (size_t)num_series + 1);
+    return (offset + SERIES_SHARED_ALIGN - 1) / SERIES_SHARED_ALIGN * SERIES_SHARED_ALIGN;
+}
+
+/*
+ * Distribute the collection of the root rank (collection is only read on root) to
+ * all ranks of comm. The series are sent once to every node, not once per task.
+ *
+ * Returns 0 if ok, -1 otherwise (on all ranks).
+ */
+int series_shared_bcast(const SeriesCollection *collection, int root, MPI_Comm comm, SharedSeries *shared) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    memset(shared, 0, sizeof(SharedSeries));
+    shared->win = MPI_WIN_NULL;
+    shared->node_comm = MPI_COMM_NULL;
+
+    long long sizes[2] = {0, 0};
+    if (rank == root) {
+        sizes[0] = collection->num_series;
+        sizes[1] = collection->num_values;
+    }
+    MPI_Bcast(sizes, 2, MPI_LONG_LONG, root, comm);
+    int num_series = (int)sizes[0];
+    idx_t num_values = (idx_t)sizes[1];
+
+    // The root is rank 0 of its node and of the node leaders
+    int key = (rank == root) ? 0 : 1;
+    int node_rank;
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, key, MPI_INFO_NULL, &shared->node_comm);
+    MPI_Comm_rank(shared->node_comm, &node_rank);
+    MPI_Comm leader_comm;
+    MPI_Comm_split(comm, (node_rank == 0) ? 0 : MPI_UNDEFINED, key, &leader_comm);
+
+    // One segment per node, allocated by the node leader
+    size_t values_offset = series_shared_values_offset(num_series);
+    size_t size = values_offset + sizeof(seq_t) * (size_t)num_values;
+    char *base = NULL;
+    int rvalue = MPI_Win_allocate_shared((node_rank == 0) ? (MPI_Aint)size : 0, 1, MPI_INFO_NULL,
+                                         shared->node_comm, &base, &shared->win);
+    if (rvalue != MPI_SUCCESS) {
+        fprintf(stderr, "Error: cannot allocate shared memory for %d series (%zu bytes)\n", num_series, size);
+        if (leader_comm != MPI_COMM_NULL) MPI_Comm_free(&leader_comm);
+        MPI_Comm_free(&shared->node_comm);
+        return -1;
+    }
+    MPI_Aint qsize;
+    int disp_unit;
+    MPI_Win_shared_query(shared->win, 0, &qsize, &disp_unit, &base);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, shared->win);
+
+    shared->num_series = num_series;
+    shared->num_values = num_values;
+    shared->offsets = (idx_t *)base;
+    shared->lengths = shared->offsets + num_series + 1;
+    shared->values = (seq_t *)(base + values_offset);
+
+    if (rank == root) {
+        memcpy(shared->offsets, collection->offsets, sizeof(idx_t) * num_series);
+        shared->offsets[num_series] = num_values;
+        memcpy(shared->lengths, collection->lengths, sizeof(idx_t) * num_series);
+        memcpy(shared->values, collection->values, sizeof(seq_t) * num_values);
+    }
+
+    // Fill the segments of the other nodes
+    if (leader_comm != MPI_COMM_NULL) {
+        for (size_t pos = 0; pos < size; pos += SERIES_SHARED_BCAST_CHUNK) {
+            size_t count = MIN(size - pos, (size_t)SERIES_SHARED_BCAST_CHUNK);
+            MPI_Bcast(base + pos, (int)count, MPI_BYTE, 0, leader_comm);
+        }
+        MPI_Comm_free(&leader_comm);
+    }
+    MPI_Win_sync(shared->win);
+    MPI_Barrier(shared->node_comm);
+    MPI_Win_sync(shared->win);
+
+    shared->ptrs = malloc(sizeof(seq_t *) * (num_series + 1));
+    int ok = (shared->ptrs != NULL);
+    for (int i = 0; ok && i < num_series; i++) {
+        shared->ptrs[i] = shared->values + shared->offsets[i];
+    }
+    int all_ok;
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, comm);
+    if (!all_ok) {
+        fprintf(stderr, "Error: cannot allocate memory for %d series\n", num_series);
+        series_shared_free(shared);
+        return -1;
+    }
+    return 0;
+}
+
+// Collective over the ranks of the node
+void series_shared_free(SharedSeries *shared) {
+    if (shared->win != MPI_WIN_NULL) {
+        MPI_Win_unlock_all(shared->win);
+        MPI_Win_free(&shared->win);
+    }
+    if (shared->node_comm != MPI_COMM_NULL) {
+        MPI_Comm_free(&shared->node_comm);
+    }
+    free(shared->ptrs);
+    memset(shared, 0, sizeof(SharedSeries));
+    shared->win = MPI_WIN_NULL;
+    shared->node_comm = MPI_COMM_NULL;
+}
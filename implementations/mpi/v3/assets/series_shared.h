@@ -0,0 +1,45 @@
+/*
+ * Series collection shared by all MPI ranks of a node.
+ *
+ * The root rank loads the series once. Every node allocates one shared memory
+ * segment (MPI_Win_allocate_shared on the node communicator) and the segments are
+ * filled with one broadcast between the node leaders. All ranks then read the series
+ * in place, such that work messages only need to carry (r, c) indices.
+ *
+ * Only used by the MPI implementations (needs mpi.h).
+ *
+ * This file is part of the DTW aggregation and clustering project.
+ */
+// series_shared.h
+#ifndef SERIES_SHARED_H
+#define SERIES_SHARED_H
+
+#include <mpi.h>
+
+#include "dd_globals.h"
+#include "series_collection.h"
+
+/*
+ * Layout of the shared segment:
+ *
+ *   offsets   (num_series + 1) idx_t
+ *   lengths   num_series idx_t
+ *   values    num_values doubles, starting on a 64-byte boundary
+ */
+#define SERIES_SHARED_ALIGN 64
+
+typedef struct {
+    MPI_Win win;          // shared window of the node
+    MPI_Comm node_comm;   // ranks on the same node
+    int num_series;
+    idx_t num_values;
+    idx_t *offsets;       // in the shared segment
+    idx_t *lengths;       // in the shared segment
+    seq_t *values;        // in the shared segment
+    seq_t **ptrs;         // num_series pointers into values (local to the rank)
+} SharedSeries;
+
+int series_shared_bcast(const SeriesCollection *collection, int root, MPI_Comm comm, SharedSeries *shared);
+void series_shared_free(SharedSeries *shared);
+
+#endif // SERIES_SHARED_H
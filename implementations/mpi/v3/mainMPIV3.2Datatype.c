@@ -7,11 +7,29 @@
  * and sends single MPI_BYTE message per batch.
  *
  * Usage:
- *   mpirun -np <N> ./example_mpi <csv_path> <max_assets> <batch_size> <result_file>
+ *   mpirun -np <N> ./example_mpi <csv_path> <max_assets> <batch_size> <result_file> [--f32] [--max-dist <value>] [--shared] [--static] [--adaptive] [--cache <cache_file>] [--checkpoint <file>] [--checkpoint-interval <seconds>]
  *
  * Notes:
  *  - Requires dd_dtw.h + assets/load_from_csv.h from your project.
  *  - BATCH size from argv[3]
+ *  - --f32 makes the slaves compute DTW in single precision
+ *  - --max-dist only keeps the pairs with a distance up to the value, the slaves
+ *    use the LB_Kim -> LB_Keogh -> early-abandoning DTW cascade
+ *  - --shared sends the series once to every node (MPI shared memory window),
+ *    a batch is then only the (r, c) of its first pair and the number of pairs
+ *  - --static replaces the master/slave protocol: every rank (rank 0 included)
+ *    loads the series, computes a cost-balanced range of the pairs
+ *    (dtw_distances_partition) and the results are gathered on rank 0
+ *  - --adaptive sizes every batch to about ADAPTIVE_QUANTUM seconds of work of the
+ *    slave (batch_size pairs until it is measured), shrinking near the end
+ *  - --cache skips the pairs of series and settings that an earlier run computed
+ *    (assets/result_cache.h): the master sends the other pairs and adds their
+ *    results, with --static every rank adds the results of its range
+ *  - --checkpoint appends the results the master received to a file that is synced
+ *    every --checkpoint-interval seconds (assets/run_checkpoint.h); a run restarted
+ *    with the same file only sends the pairs that are not in it. Not with --static.
+ *  - the master writes the results while they arrive (assets/result_sink.h), as
+ *    text, or as a binary condensed matrix if result_file ends in .dtwm
  *  - Master rank = 0, slaves = 1..N-1
 
  MPI V3 Zero-Copy Version with contiguous send buffer and explicit header for batch count and byte size.
@@ -20,11 +38,22 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <mpi.h>
 #include <time.h>
+#include <limits.h>
 
 #include "dd_dtw.h"            // dtw_distance, DTWSettings, ...
-#include "assets/load_from_csv.h" // load_series_from_csv, TickerSeries
+#include "dd_dtw_f32.h"        // dtw_distance_f32
+#include "dd_dtw_prune.h"      // dtw_distance_cascade_ws
+#include "assets/load_from_csv.h" // load_series_collection_from_csv, SeriesCollection
+#include "assets/series_store.h" // load_series_collection_from_file (CSV or binary store)
+#include "assets/series_shared.h" // series_shared_bcast (--shared)
+#include "assets/series_batch.h" // series_batch_pack, series_batch_view
+#include "assets/batch_schedule.h" // batch_schedule_next (--adaptive)
+#include "assets/result_sink.h" // result_sink_put (streamed output, text or binary)
+#include "assets/result_cache.h" // result_cache_get (--cache)
+#include "assets/run_checkpoint.h" // run_checkpoint_put (--checkpoint)
 
 #define WORKTAG   1
 #define KILLTAG   2
@@ -32,6 +61,376 @@
 
 #define VERBOSE 0
 
+/* Work message: int header[BATCH_HEADER_INTS] = {batch_count, r, c, 0} followed,
+ * without --shared, from offset BATCH_ALIGN by the pairs in the format of
+ * assets/series_batch.h: every distinct series once, on a BATCH_ALIGN boundary such
+ * that the slaves compute on the receive buffer, and the indices of every pair.
+ * Every slave has BATCH_DEPTH batches in flight: it computes one while the next
+ * one is already received. */
+#define BATCH_HEADER_INTS 4
+#define BATCH_DEPTH       2
+#define BATCH_ALIGN       64
+
+/* --adaptive: wanted compute time of a batch, largest batch and smallest receive
+ * buffer (larger batches are halved until they fit) */
+#define ADAPTIVE_QUANTUM   0.1
+#define ADAPTIVE_MAX_PAIRS 4096
+#define ADAPTIVE_CAPACITY  (16 << 20)
+
+/* sum the pruning counters of all slaves on the master */
+static void reduce_prune_stats(DTWPruneStats *stats, int rank) {
+    unsigned long long local[5] = {stats->pairs, stats->pruned_kim, stats->pruned_keogh,
+                                   stats->abandoned, stats->kept};
+    unsigned long long total[5];
+    MPI_Reduce(local, total, 5, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (rank == 0) {
+        stats->pairs = total[0];
+        stats->pruned_kim = total[1];
+        stats->pruned_keogh = total[2];
+        stats->abandoned = total[3];
+        stats->kept = total[4];
+    }
+}
+
+/* memory of one rank reused over all pairs */
+typedef struct {
+    DTWWorkspace ws;
+    float *f32;         // --f32 copies of the two series
+    int f32_size;
+    DTWWsFnPtr dtw_fn;  // DTW variant for the settings, selected at the first pair
+    DTWEnvelope *envs;  // --max-dist: envelope of every series of the collection or of the batch
+    int num_envs;
+    int envs_size;
+} PairScratch;
+
+static PairScratch pair_scratch_empty(void) {
+    PairScratch scratch = {dtw_workspace_empty(), NULL, 0, NULL, NULL, 0, 0};
+    return scratch;
+}
+
+static void pair_scratch_clear_envelopes(PairScratch *scratch) {
+    for (int k = 0; k < scratch->num_envs; k++) {
+        dtw_envelope_free(&scratch->envs[k]);
+    }
+    scratch->num_envs = 0;
+}
+
+static void pair_scratch_free(PairScratch *scratch) {
+    dtw_workspace_free(&scratch->ws);
+    free(scratch->f32);
+    pair_scratch_clear_envelopes(scratch);
+    free(scratch->envs);
+    *scratch = pair_scratch_empty();
+}
+
+/* --max-dist: room for the envelopes of n series, the previous ones are freed */
+static DTWEnvelope *pair_scratch_envelopes(PairScratch *scratch, int n) {
+    pair_scratch_clear_envelopes(scratch);
+    if (n > scratch->envs_size) {
+        free(scratch->envs);
+        scratch->envs_size = n;
+        scratch->envs = malloc(sizeof(DTWEnvelope) * n);
+        if (!scratch->envs) { fprintf(stderr,"SLAVE OOM envelopes\n"); MPI_Abort(MPI_COMM_WORLD,1); }
+    }
+    return scratch->envs;
+}
+
+static void pair_scratch_add_envelope(PairScratch *scratch, double *series, idx_t length, idx_t radius) {
+    if (!dtw_envelope_init(&scratch->envs[scratch->num_envs], series, length, radius)) {
+        fprintf(stderr,"SLAVE OOM envelopes\n"); MPI_Abort(MPI_COMM_WORLD,1);
+    }
+    scratch->num_envs++;
+}
+
+/* --max-dist: one envelope per series for all pairs of the collection (--static, --shared),
+ * with the radius of the shortest and the longest series as in dtw_distances_ptrs_parallel_pruned */
+static void pair_scratch_collection_envelopes(PairScratch *scratch, double **s, idx_t *lengths, int num_series,
+                                              DTWSettings *settings) {
+    idx_t lmin = 0, lmax = 0;
+    for (int k = 0; k < num_series; k++) {
+        lmin = k == 0 ? lengths[k] : MIN(lmin, lengths[k]);
+        lmax = MAX(lmax, lengths[k]);
+    }
+    idx_t radius = dtw_envelope_radius(lmin, lmax, settings);
+    pair_scratch_envelopes(scratch, num_series);
+    for (int k = 0; k < num_series; k++) {
+        pair_scratch_add_envelope(scratch, s[k], lengths[k], radius);
+    }
+}
+
+/* --max-dist: one envelope per distinct series of a batch, envs[i] for series i of the view */
+static void pair_scratch_batch_envelopes(PairScratch *scratch, const SeriesBatchView *view, DTWSettings *settings) {
+    int lmin = 0, lmax = 0;
+    for (int i = 0; i < view->nb_series; i++) {
+        lmin = i == 0 ? view->lengths[i] : MIN(lmin, view->lengths[i]);
+        lmax = MAX(lmax, view->lengths[i]);
+    }
+    idx_t radius = dtw_envelope_radius((idx_t)lmin, (idx_t)lmax, settings);
+    pair_scratch_envelopes(scratch, view->nb_series);
+    for (int i = 0; i < view->nb_series; i++) {
+        int length;
+        double *series = series_batch_distinct(view, i, &length);
+        pair_scratch_add_envelope(scratch, series, (idx_t)length, radius);
+    }
+}
+
+/* DTW of one pair on a slave, with the options of the command line. With --max-dist,
+ * env_r and env_c are the envelopes of the two series (pair_scratch_*_envelopes). */
+static float compute_pair(double *series_r, int len_r, DTWEnvelope *env_r,
+                          double *series_c, int len_c, DTWEnvelope *env_c, int use_f32, double max_dist,
+                          DTWSettings *settings, PairScratch *scratch, DTWPruneStats *stats) {
+    DTWWorkspace *ws = &scratch->ws;
+    if (use_f32) {
+        if (len_r + len_c > scratch->f32_size) {
+            free(scratch->f32);
+            scratch->f32_size = len_r + len_c;
+            scratch->f32 = malloc(sizeof(float) * scratch->f32_size);
+            if (!scratch->f32) { fprintf(stderr,"SLAVE OOM f32\n"); MPI_Abort(MPI_COMM_WORLD,1); }
+        }
+        float *series_r32 = scratch->f32;
+        float *series_c32 = series_r32 + len_r;
+        dtw_seq_to_f32(series_r, (idx_t)len_r, series_r32);
+        dtw_seq_to_f32(series_c, (idx_t)len_c, series_c32);
+        return dtw_distance_f32_ws(series_r32, (idx_t)len_r, series_c32, (idx_t)len_c, settings, ws);
+    } else if (max_dist > 0) {
+        /* LB_Kim -> LB_Keogh -> early-abandoning DTW, INFINITY if pruned */
+        return (float) dtw_distance_cascade_ws(series_r, (idx_t)len_r, env_r,
+                                               series_c, (idx_t)len_c, env_c,
+                                               settings, ws, stats);
+    }
+    if (!scratch->dtw_fn) {
+        scratch->dtw_fn = dtw_distance_kernel(settings);
+    }
+    return (float) scratch->dtw_fn(series_r, (idx_t)len_r, series_c, (idx_t)len_c, settings, ws);
+}
+
+static size_t batch_align(size_t bytes) {
+    return (bytes + BATCH_ALIGN - 1) / BATCH_ALIGN * BATCH_ALIGN;
+}
+
+/* BATCH_ALIGN aligned buffer of (at least) bytes, the slaves compute on it */
+static char *batch_buffer_alloc(size_t bytes) {
+    void *buf = NULL;
+    if (posix_memalign(&buf, BATCH_ALIGN, batch_align(bytes > 0 ? bytes : 1)) != 0) {
+        return NULL;
+    }
+    return buf;
+}
+
+/* pack the pairs first, ..., first+batch_count-1 into buf as one self-describing
+ * message (see BATCH_HEADER_INTS). Returns the size. */
+static size_t pack_batch(SeriesBatchBuilder *builder, char *buf, int (*tasks)[2], int first, int batch_count,
+                         double **s, int *lengths, int use_shared) {
+    int header[BATCH_HEADER_INTS] = {batch_count, tasks[first][0], tasks[first][1], 0};
+    memcpy(buf, header, sizeof(header));
+    if (use_shared) {
+        return sizeof(header);
+    }
+    memset(buf + sizeof(header), 0, BATCH_ALIGN - sizeof(header));
+    return BATCH_ALIGN + series_batch_pack(builder, buf + BATCH_ALIGN, tasks, first, batch_count, s, lengths);
+}
+
+/* put the results of the pairs first, ..., first+count-1 of tasks in the sink, one
+ * run of consecutive pairs of the upper triangle at a time, and in the checkpoint
+ * if not NULL */
+static void sink_batch(ResultSink *sink, RunCheckpoint *checkpoint, int (*tasks)[2], int first,
+                       const float *values, int count, int num_series) {
+    int i = 0;
+    while (i < count) {
+        int run = 1;
+        while (i + run < count && tasks[first + i + run][0] == tasks[first + i][0] &&
+               tasks[first + i + run][1] == tasks[first + i][1] + run) {
+            run++;
+        }
+        idx_t index = result_matrix_pair_index(tasks[first + i][0], tasks[first + i][1], num_series);
+        if (result_sink_put(sink, index, values + i, run) != 0 ||
+            (checkpoint && run_checkpoint_put(checkpoint, index, values + i, run) != 0)) {
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        i += run;
+    }
+}
+
+/* --cache: put the cached pairs of tasks in the sink and keep the other tasks, in
+ * their order; returns the number of tasks left */
+static int take_cached_pairs(ResultCache *cache, const uint64_t *keys, uint64_t cache_settings, ResultSink *sink,
+                             int (*tasks)[2], int total_tasks, int num_series) {
+    int (*hits)[2] = malloc(sizeof(int[2]) * (total_tasks + 1));
+    float *values = malloc(sizeof(float) * (total_tasks + 1));
+    if (!hits || !values) { fprintf(stderr, "MASTER: cannot alloc cached pairs\n"); MPI_Abort(MPI_COMM_WORLD, 1); }
+    int nb_hits = 0, kept = 0;
+    for (int t = 0; t < total_tasks; t++) {
+        double value;
+        if (result_cache_get(cache, keys[tasks[t][0]], keys[tasks[t][1]], cache_settings, &value)) {
+            hits[nb_hits][0] = tasks[t][0];
+            hits[nb_hits][1] = tasks[t][1];
+            values[nb_hits++] = (float)value;
+        } else {
+            tasks[kept][0] = tasks[t][0];
+            tasks[kept][1] = tasks[t][1];
+            kept++;
+        }
+    }
+    sink_batch(sink, NULL, hits, 0, values, nb_hits, num_series);
+    free(hits);
+    free(values);
+    return kept;
+}
+
+/* --checkpoint: keep the tasks of the pairs that are not done, in their order;
+ * returns the number of tasks left */
+static int take_restored_pairs(const bool *done, int (*tasks)[2], int total_tasks, int num_series) {
+    int kept = 0;
+    for (int t = 0; t < total_tasks; t++) {
+        if (!done[result_matrix_pair_index(tasks[t][0], tasks[t][1], num_series)]) {
+            tasks[kept][0] = tasks[t][0];
+            tasks[kept][1] = tasks[t][1];
+            kept++;
+        }
+    }
+    return kept;
+}
+
+/* number of tasks from first on, at most count, that follow each other in the upper
+ * triangle: a --shared batch only has its first pair (--cache leaves gaps) */
+static int consecutive_tasks(int (*tasks)[2], int first, int count, int num_series) {
+    int run = 1;
+    while (run < count) {
+        int r = tasks[first + run - 1][0], c = tasks[first + run - 1][1] + 1;
+        if (c == num_series) {
+            r++;
+            c = r + 1;
+        }
+        if (tasks[first + run][0] != r || tasks[first + run][1] != c) break;
+        run++;
+    }
+    return run;
+}
+
+/* number of pairs of the next batch of rank: batch_size, or with --adaptive about
+ * ADAPTIVE_QUANTUM seconds of work (assets/batch_schedule.h) that fits in capacity */
+static int next_batch_count(BatchSchedule *schedule, SeriesBatchBuilder *builder, int use_adaptive,
+                            int batch_size, int rank, int (*tasks)[2], int next_task, int total_tasks,
+                            int *lengths, int use_shared, size_t capacity, int num_series) {
+    int batch_count;
+    if (!use_adaptive) {
+        batch_count = (total_tasks - next_task < batch_size) ? (total_tasks - next_task) : batch_size;
+    } else {
+        batch_count = batch_schedule_next(schedule, rank, tasks, next_task, total_tasks, lengths);
+        while (!use_shared && batch_count > 1 &&
+               BATCH_ALIGN + series_batch_packed_size(builder, tasks, next_task, batch_count, lengths) > capacity) {
+            batch_count /= 2;
+        }
+    }
+    if (use_shared && batch_count > 1) {
+        batch_count = consecutive_tasks(tasks, next_task, batch_count, num_series);
+    }
+    return batch_count;
+}
+
+/* print the time the slaves waited for a batch after their first one, and the
+ * balance of their compute time */
+static void report_slaves(double wait, double compute, int rank, int nprocs) {
+    double local[2] = {wait, compute};
+    double *all = (rank == 0) ? malloc(sizeof(double) * 2 * nprocs) : NULL;
+    MPI_Gather(local, 2, MPI_DOUBLE, all, 2, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    if (rank == 0 && nprocs > 1) {
+        double total = 0, max = 0, sum = 0, cmin = all[3], cmax = 0;
+        for (int p = 1; p < nprocs; p++) {
+            total += all[2 * p];
+            max = MAX(max, all[2 * p]);
+            sum += all[2 * p + 1];
+            cmin = MIN(cmin, all[2 * p + 1]);
+            cmax = MAX(cmax, all[2 * p + 1]);
+        }
+        printf("Slave idle time between batches: total = %f s, max = %f s\n", total, max);
+        printf("Slave compute time: min = %f s, max = %f s, max/mean = %.3f\n",
+               cmin, cmax, (sum > 0) ? cmax / (sum / (nprocs - 1)) : 0.0);
+    }
+    free(all);
+}
+
+/* --static: rank p computes the pairs [bounds[p], bounds[p+1]) of the upper triangle,
+ * the ranges have about the same cost and only depend on the lengths. The results
+ * are gathered on rank 0, which returns them (NULL on the other ranks). */
+static float *run_static(double **s, idx_t *lengths, int num_series, int rank, int nprocs,
+                         int use_f32, double max_dist, DTWSettings *settings, DTWPruneStats *stats,
+                         ResultCache *cache, const uint64_t *keys, uint64_t cache_settings) {
+    idx_t *bounds = malloc(sizeof(idx_t) * (nprocs + 1));
+    if (!bounds) { fprintf(stderr, "RANK %d: bounds OOM\n", rank); MPI_Abort(MPI_COMM_WORLD, 1); }
+    idx_t total_tasks = dtw_distances_partition(lengths, num_series, nprocs, bounds);
+    if (total_tasks > INT_MAX) {
+        fprintf(stderr, "RANK %d: %zd pairs do not fit in MPI_Gatherv counts\n", rank, total_tasks);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    idx_t first = bounds[rank];
+    int count = (int)(bounds[rank + 1] - first);
+    float *local = malloc(sizeof(float) * (count + 1));
+    if (!local) { fprintf(stderr, "RANK %d: results OOM\n", rank); MPI_Abort(MPI_COMM_WORLD, 1); }
+
+    /* (r, c) of the first pair of the range */
+    int r = 0;
+    idx_t base = 0;
+    while (r < num_series - 1 && base + (num_series - r - 1) <= first) {
+        base += num_series - r - 1;
+        r++;
+    }
+    int c = r + 1 + (int)(first - base);
+
+    double t_start = MPI_Wtime();
+    PairScratch scratch = pair_scratch_empty();
+    int use_envs = max_dist > 0 && !use_f32;
+    if (use_envs) {
+        pair_scratch_collection_envelopes(&scratch, s, lengths, num_series, settings);
+    }
+    for (int b = 0; b < count; b++) {
+        /* --cache: every rank adds the pairs of its range that it computed */
+        double cached;
+        if (cache && result_cache_get(cache, keys[r], keys[c], cache_settings, &cached)) {
+            local[b] = (float)cached;
+        } else {
+            local[b] = compute_pair(s[r], (int)lengths[r], use_envs ? &scratch.envs[r] : NULL,
+                                    s[c], (int)lengths[c], use_envs ? &scratch.envs[c] : NULL,
+                                    use_f32, max_dist, settings, &scratch, stats);
+            if (cache) result_cache_put(cache, keys[r], keys[c], cache_settings, local[b]);
+        }
+        if (++c == num_series) {
+            r++;
+            c = r + 1;
+        }
+    }
+    pair_scratch_free(&scratch);
+    double t_compute = MPI_Wtime() - t_start;
+
+    /* compute time of the slowest and the fastest rank */
+    double t_max, t_min;
+    MPI_Reduce(&t_compute, &t_max, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&t_compute, &t_min, 1, MPI_DOUBLE, MPI_MIN, 0, MPI_COMM_WORLD);
+
+    float *result = NULL;
+    int *counts = NULL, *displs = NULL;
+    if (rank == 0) {
+        result = malloc(sizeof(float) * (total_tasks + 1));
+        counts = malloc(sizeof(int) * nprocs);
+        displs = malloc(sizeof(int) * nprocs);
+        if (!result || !counts || !displs) { fprintf(stderr, "MASTER: cannot alloc result\n"); MPI_Abort(MPI_COMM_WORLD, 1); }
+        for (int p = 0; p < nprocs; p++) {
+            counts[p] = (int)(bounds[p + 1] - bounds[p]);
+            displs[p] = (int)bounds[p];
+        }
+    }
+    MPI_Gatherv(local, count, MPI_FLOAT, result, counts, displs, MPI_FLOAT, 0, MPI_COMM_WORLD);
+    if (rank == 0) {
+        printf("Static partition: %zd pairs over %d ranks, compute time min = %f s, max = %f s\n",
+               total_tasks, nprocs, t_min, t_max);
+    }
+    free(counts);
+    free(displs);
+    free(local);
+    free(bounds);
+    return result;
+}
+
 int main(int argc, char *argv[]) {
     MPI_Init(&argc, &argv);
 
@@ -41,7 +440,7 @@ int main(int argc, char *argv[]) {
 
     if (argc < 5) {
         if (rank == 0) {
-            fprintf(stderr, "Usage: %s <csv_path> <max_assets> <batch_size> <result_file>\n", argv[0]);
+            fprintf(stderr, "Usage: %s <csv_path> <max_assets> <batch_size> <result_file> [--f32] [--max-dist <value>] [--shared] [--static] [--adaptive] [--cache <cache_file>] [--checkpoint <file>] [--checkpoint-interval <seconds>]\n", argv[0]);
         }
         MPI_Finalize();
         return 1;
@@ -57,24 +456,126 @@ int main(int argc, char *argv[]) {
     int max_assets = atoi(argv[2]);
     int BATCH_SIZE = atoi(argv[3]);
     const char *result_file = argv[4];
+    int use_f32 = 0;
+    int use_shared = 0;
+    int use_static = 0;
+    int use_adaptive = 0;
+    double max_dist = 0;
+    const char *cache_file = NULL;
+    const char *checkpoint_file = NULL;
+    double checkpoint_interval = RUN_CHECKPOINT_INTERVAL;
+    for (int a = 5; a < argc; a++) {
+        if (strcmp(argv[a], "--f32") == 0) use_f32 = 1;
+        else if (strcmp(argv[a], "--max-dist") == 0 && a + 1 < argc) max_dist = atof(argv[++a]);
+        else if (strcmp(argv[a], "--shared") == 0) use_shared = 1;
+        else if (strcmp(argv[a], "--static") == 0) use_static = 1;
+        else if (strcmp(argv[a], "--adaptive") == 0) use_adaptive = 1;
+        else if (strcmp(argv[a], "--cache") == 0 && a + 1 < argc) cache_file = argv[++a];
+        else if (strcmp(argv[a], "--checkpoint") == 0 && a + 1 < argc) checkpoint_file = argv[++a];
+        else if (strcmp(argv[a], "--checkpoint-interval") == 0 && a + 1 < argc) checkpoint_interval = atof(argv[++a]);
+    }
+    if (use_static && checkpoint_file) {
+        if (rank == 0) fprintf(stderr, "--checkpoint needs the master of the dynamic protocol, not --static\n");
+        MPI_Finalize();
+        return 1;
+    }
 
     DTWSettings settings = dtw_settings_default();
-
-    if (rank == 0) {
-        /**************** MASTER ****************/
-        printf("MASTER: loading CSV...\n");
-        TickerSeries *series = malloc(sizeof(TickerSeries) * max_assets);
-        if (!series) {
-            fprintf(stderr, "MASTER: memory error\n");
+    settings.max_dist = max_dist;
+    DTWPruneStats stats = dtw_prune_stats_empty();
+    ResultCache cache;
+    uint64_t cache_settings = result_cache_settings_key(&settings, use_f32 ? RESULT_CACHE_F32 : RESULT_CACHE_F64_AS_F32);
+
+    SeriesCollection collection;
+    series_collection_init(&collection);
+    /* --static without --shared: every rank loads (or maps) the series itself */
+    if (rank == 0 || (use_static && !use_shared)) {
+        if (rank == 0) printf("MASTER: loading CSV...\n");
+        if (load_series_collection_from_file(csv_path, &collection, max_assets) != 0) {
+            fprintf(stderr, "RANK %d: error loading CSV\n", rank);
             MPI_Abort(MPI_COMM_WORLD, 1);
         }
+    }
 
-        int num_series = 0;
-        if (load_series_from_csv(csv_path, series, &num_series, max_assets) != 0) {
-            fprintf(stderr, "MASTER: error loading CSV\n");
-            free(series);
+    /* --shared: one copy of the series per node instead of one per task */
+    SharedSeries shared;
+    if (use_shared && series_shared_bcast(&collection, 0, MPI_COMM_WORLD, &shared) != 0) {
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    /* size of the largest work message and largest number of pairs of a batch,
+     * the slaves post their receives with them */
+    size_t capacity = 0;
+    int max_pairs = use_adaptive ? MAX(BATCH_SIZE, ADAPTIVE_MAX_PAIRS) : BATCH_SIZE;
+    if (!use_static) {
+        uint64_t bytes = 0;
+        if (rank == 0) {
+            idx_t max_len = 0;
+            for (int i = 0; i < collection.num_series; i++) {
+                if (collection.lengths[i] > max_len) max_len = collection.lengths[i];
+            }
+            bytes = sizeof(int) * BATCH_HEADER_INTS;
+            if (!use_shared) bytes = BATCH_ALIGN + series_batch_max_size(BATCH_SIZE, max_len);
+            if (!use_shared && use_adaptive && bytes < ADAPTIVE_CAPACITY) bytes = ADAPTIVE_CAPACITY;
+        }
+        MPI_Bcast(&bytes, 1, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+        if (bytes > INT_MAX) {
+            if (rank == 0) fprintf(stderr, "MASTER: batches of %d pairs need %llu bytes, use a smaller batch size\n",
+                                   BATCH_SIZE, (unsigned long long)bytes);
             MPI_Abort(MPI_COMM_WORLD, 1);
         }
+        capacity = (size_t)bytes;
+    }
+
+    if (use_static) {
+        /**************** STATIC PARTITION ****************/
+        int num_series = use_shared ? shared.num_series : collection.num_series;
+        double *s[num_series + 1];
+        idx_t *lengths = use_shared ? shared.lengths : collection.lengths;
+        for (int i = 0; i < num_series; i++) {
+            s[i] = use_shared ? shared.ptrs[i] : series_collection_series(&collection, i);
+        }
+        if (rank == 0) printf("Loaded %d series.\n", num_series);
+
+        /* --cache: every rank reads the cache and appends the results it computed */
+        uint64_t keys[num_series + 1];
+        if (cache_file) {
+            if (result_cache_open(&cache, cache_file) != 0) MPI_Abort(MPI_COMM_WORLD, 1);
+            for (int i = 0; i < num_series; i++) keys[i] = series_hash(s[i], lengths[i]);
+        }
+
+        float *result = run_static(s, lengths, num_series, rank, nprocs, use_f32, max_dist, &settings, &stats,
+                                   cache_file ? &cache : NULL, keys, cache_settings);
+        if (cache_file) {
+            long long local[2] = {cache.hits, cache.added}, total[2];
+            MPI_Reduce(local, total, 2, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+            if (rank == 0) printf("Result cache: %lld of %zd pairs cached, %lld pairs added\n",
+                                  total[0], (idx_t)num_series * (num_series - 1) / 2, total[1]);
+            if (result_cache_close(&cache) != 0) fprintf(stderr, "RANK %d: cannot write cache %s\n", rank, cache_file);
+        }
+
+        end_time = MPI_Wtime();
+        if (max_dist > 0) {
+            reduce_prune_stats(&stats, rank);
+        }
+        if (rank == 0) {
+            printf("Process %d: Elapsed time = %f seconds\n", rank, end_time - start_time);
+            if (max_dist > 0 && stats.pairs > 0) dtw_print_prune_stats(&stats);
+            ResultSink sink;
+            if (result_sink_open(&sink, result_file, result_sink_format_of(result_file), &collection,
+                                 num_series, max_dist) != 0 ||
+                result_sink_put(&sink, 0, result, sink.num_pairs) != 0 || result_sink_close(&sink) != 0) {
+                fprintf(stderr, "MASTER: cannot write %s\n", result_file);
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            printf("MASTER: Done. Results saved to %s\n", result_file);
+        }
+        free(result);
+    }
+
+    else if (rank == 0) {
+        /**************** MASTER ****************/
+        int num_series = collection.num_series;
 
         printf("Loaded %d series.\n", num_series);
 
@@ -82,84 +583,118 @@ int main(int argc, char *argv[]) {
         double *s[num_series];
         int lengths[num_series];
         for (int i = 0; i < num_series; i++) {
-            s[i] = series[i].close;
-            lengths[i] = series[i].count;
+            s[i] = series_collection_series(&collection, i);
+            lengths[i] = collection.lengths[i];
         }
 
-        /* build tasks (upper triangular pairs) */
+        /* build tasks (upper triangular pairs). Without --shared in tiles of about
+         * BATCH_SIZE pairs, such that the pairs of a batch share their series. */
         int total_tasks = num_series * (num_series - 1) / 2;
-        int (*tasks)[2] = malloc(sizeof(int[2]) * total_tasks);
-        int t = 0;
-        for (int r = 0; r < num_series; r++) {
-            for (int c = r + 1; c < num_series; c++) {
-                tasks[t][0] = r;
-                tasks[t][1] = c;
-                t++;
-            }
+        int (*tasks)[2] = malloc(sizeof(int[2]) * (total_tasks + 1));
+        SeriesBatchBuilder builder;
+        if (!tasks || series_batch_builder_init(&builder, num_series) != 0) {
+            fprintf(stderr, "MASTER: cannot alloc tasks\n"); MPI_Abort(MPI_COMM_WORLD,1);
         }
-
-        /* output buffer (float results) */
-        float *result = calloc(total_tasks, sizeof(float));
-        if (!result) { fprintf(stderr, "MASTER: cannot alloc result\n"); MPI_Abort(MPI_COMM_WORLD,1); }
-
-        /* last_send map: for each slave, index of first task of its last batch */
-        int *last_send = malloc(sizeof(int) * nprocs);
-        for (int i = 0; i < nprocs; i++) last_send[i] = -1;
-
-        int next_task = 0;
-        /* send initial batch to each slave */
-        for (int p = 1; p < nprocs && next_task < total_tasks; p++) {
-            int batch_count = (total_tasks - next_task < BATCH_SIZE) ? (total_tasks - next_task) : BATCH_SIZE;
-
-            /* compute total bytes needed for this batch */
-            size_t total_bytes = 0;
-            for (int b = 0; b < batch_count; b++) {
-                int r_idx = tasks[next_task + b][0];
-                int c_idx = tasks[next_task + b][1];
-                total_bytes += sizeof(int);                         // len_r
-                total_bytes += sizeof(double) * lengths[r_idx];    // series_r
-                total_bytes += sizeof(int);                         // len_c
-                total_bytes += sizeof(double) * lengths[c_idx];    // series_c
+        if (use_shared) {
+            int t = 0;
+            for (int r = 0; r < num_series; r++) {
+                for (int c = r + 1; c < num_series; c++) {
+                    tasks[t][0] = r;
+                    tasks[t][1] = c;
+                    t++;
+                }
             }
+        } else {
+            series_batch_tile_order(num_series, (int)ceil(sqrt((double)BATCH_SIZE)), tasks);
+        }
+        /* bytes of the work messages, and of the same pairs with both series per pair */
+        double wire_bytes = 0, pairwise_bytes = 0;
 
-            /* allocate contiguous buffer */
-            char *sendbuf = malloc(total_bytes);
-            if (!sendbuf) { fprintf(stderr, "MASTER: sendbuf OOM\n"); MPI_Abort(MPI_COMM_WORLD,1); }
-
-            /* fill buffer sequentially */
-            size_t pos = 0;
-            for (int b = 0; b < batch_count; b++) {
-                int r_idx = tasks[next_task + b][0];
-                int c_idx = tasks[next_task + b][1];
-                int len_r = lengths[r_idx];
-                int len_c = lengths[c_idx];
-
-                memcpy(sendbuf + pos, &len_r, sizeof(int)); pos += sizeof(int);
-                memcpy(sendbuf + pos, s[r_idx], sizeof(double) * len_r); pos += sizeof(double) * len_r;
-                memcpy(sendbuf + pos, &len_c, sizeof(int)); pos += sizeof(int);
-                memcpy(sendbuf + pos, s[c_idx], sizeof(double) * len_c); pos += sizeof(double) * len_c;
+        /* results are written while they arrive, out of order batches wait in the sink */
+        ResultSink sink;
+        if (result_sink_open(&sink, result_file, result_sink_format_of(result_file), &collection,
+                             num_series, max_dist) != 0) {
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        double sink_time = 0;
+
+        /* --checkpoint: the pairs of an earlier run go to the sink, only the others are sent */
+        RunCheckpoint checkpoint;
+        if (checkpoint_file) {
+            bool *done = calloc(sink.num_pairs + 1, sizeof(bool));
+            uint64_t key = run_checkpoint_key(&collection, num_series, cache_settings);
+            if (!done || run_checkpoint_open(&checkpoint, checkpoint_file, num_series, key, checkpoint_interval,
+                                             &sink, done) != 0) {
+                MPI_Abort(MPI_COMM_WORLD, 1);
             }
+            total_tasks = take_restored_pairs(done, tasks, total_tasks, num_series);
+            free(done);
+        }
 
-            /* send header: batch_count(int) and total_bytes (size_t as uint64) */
-            int header[1];
-            header[0] = batch_count;
-            MPI_Send(header, 1, MPI_INT, p, WORKTAG, MPI_COMM_WORLD);
+        /* --cache: the cached pairs go to the sink, only the others are sent */
+        uint64_t keys[num_series + 1];
+        if (cache_file) {
+            if (result_cache_open(&cache, cache_file) != 0) MPI_Abort(MPI_COMM_WORLD, 1);
+            for (int i = 0; i < num_series; i++) keys[i] = series_hash(s[i], lengths[i]);
+            total_tasks = take_cached_pairs(&cache, keys, cache_settings, &sink, tasks, total_tasks, num_series);
+        }
 
-            /* send buffer length as 64-bit so 32-bit/64-bit safe */
-            uint64_t tbytes = (uint64_t) total_bytes;
-            MPI_Send(&tbytes, 1, MPI_UINT64_T, p, WORKTAG, MPI_COMM_WORLD);
+        /* --adaptive: batches sized from the measured DTW cells per second of
+         * every slave, shrinking near the end */
+        BatchSchedule schedule;
+        if (batch_schedule_init(&schedule, nprocs, ADAPTIVE_QUANTUM, BATCH_SIZE, 1, max_pairs,
+                                tasks, total_tasks, lengths) != 0) {
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
 
-            /* send actual bytes as a single message */
-            MPI_Send(sendbuf, (int)total_bytes, MPI_BYTE, p, WORKTAG, MPI_COMM_WORLD);
+        /* batches sent to every slave and not answered yet (first task and number
+         * of tasks), in the order they were sent */
+        int (*pending)[BATCH_DEPTH][2] = malloc(sizeof(int[BATCH_DEPTH][2]) * nprocs);
+        int *pending_head = calloc(nprocs, sizeof(int));
+        int *pending_len = calloc(nprocs, sizeof(int));
+
+        /* send buffers, one per batch in flight (reused, sent with MPI_Isend) */
+        char **sendbufs = malloc(sizeof(char *) * nprocs * BATCH_DEPTH);
+        MPI_Request *send_reqs = malloc(sizeof(MPI_Request) * nprocs * BATCH_DEPTH);
+        if (!pending || !pending_head || !pending_len || !sendbufs || !send_reqs) {
+            fprintf(stderr, "MASTER: cannot alloc send buffers\n"); MPI_Abort(MPI_COMM_WORLD,1);
+        }
+        for (int i = 0; i < nprocs * BATCH_DEPTH; i++) {
+            sendbufs[i] = (i >= BATCH_DEPTH) ? batch_buffer_alloc(capacity) : NULL;
+            send_reqs[i] = MPI_REQUEST_NULL;
+            if (i >= BATCH_DEPTH && !sendbufs[i]) { fprintf(stderr, "MASTER: sendbuf OOM\n"); MPI_Abort(MPI_COMM_WORLD,1); }
+        }
 
-            last_send[p] = next_task;
-            next_task += batch_count;
+        int next_task = 0;
+        int kill_count = nprocs - 1;
 
-            free(sendbuf);
+        /* send the initial batches, BATCH_DEPTH per slave */
+        for (int d = 0; d < BATCH_DEPTH; d++) {
+            for (int p = 1; p < nprocs && next_task < total_tasks; p++) {
+                int batch_count = next_batch_count(&schedule, &builder, use_adaptive, BATCH_SIZE, p, tasks,
+                                                   next_task, total_tasks, lengths, use_shared, capacity, num_series);
+                int slot = (pending_head[p] + pending_len[p]++) % BATCH_DEPTH;
+                char *sendbuf = sendbufs[p * BATCH_DEPTH + slot];
+                size_t bytes = pack_batch(&builder, sendbuf, tasks, next_task, batch_count, s, lengths, use_shared);
+                wire_bytes += bytes;
+                pairwise_bytes += series_batch_pairwise_size(tasks, next_task, batch_count, lengths);
+                MPI_Isend(sendbuf, (int)bytes, MPI_BYTE, p, WORKTAG, MPI_COMM_WORLD, &send_reqs[p * BATCH_DEPTH + slot]);
+                pending[p][slot][0] = next_task;
+                pending[p][slot][1] = batch_count;
+                batch_schedule_sent(&schedule, p, batch_count,
+                                    batch_schedule_cells(tasks, next_task, batch_count, lengths), MPI_Wtime());
+                next_task += batch_count;
+            }
+        }
+        /* slaves without work */
+        for (int p = 1; p < nprocs; p++) {
+            if (pending_len[p] == 0) {
+                MPI_Send(NULL, 0, MPI_BYTE, p, KILLTAG, MPI_COMM_WORLD);
+                kill_count--;
+            }
         }
 
         /* dynamic loop: receive results and feed new batches until done */
-        int kill_count = nprocs - 1;
         MPI_Status status;
         while (kill_count > 0) {
             /* receive result array (float[]) from any slave */
@@ -171,70 +706,53 @@ int main(int argc, char *argv[]) {
             float *batch_results = malloc(sizeof(float) * count);
             MPI_Recv(batch_results, count, MPI_FLOAT, source, RESULTTAG, MPI_COMM_WORLD, &status);
 
-            /* write results into global result[] using last_send mapping */
-            int start_task = last_send[source];
-            if (start_task < 0) {
-                fprintf(stderr, "MASTER: bad last_send for %d\n", source);
-                start_task = 0;
+            /* the results answer the oldest batch in flight of the slave */
+            if (pending_len[source] == 0) {
+                fprintf(stderr, "MASTER: unexpected results from %d\n", source);
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            int start_task = pending[source][pending_head[source]][0];
+            int expected = pending[source][pending_head[source]][1];
+            pending_head[source] = (pending_head[source] + 1) % BATCH_DEPTH;
+            pending_len[source]--;
+            batch_schedule_done(&schedule, source, batch_schedule_cells(tasks, start_task, count, lengths), MPI_Wtime());
+            if (count != expected) {
+                fprintf(stderr, "MASTER: %d results from %d for a batch of %d pairs\n", count, source, expected);
+                MPI_Abort(MPI_COMM_WORLD, 1);
             }
-            for (int i = 0; i < count; i++) {
-                int idx_task = start_task + i;
-                if (idx_task >= 0 && idx_task < total_tasks) result[idx_task] = batch_results[i];
+            double sink_start = MPI_Wtime();
+            sink_batch(&sink, checkpoint_file ? &checkpoint : NULL, tasks, start_task, batch_results, count, num_series);
+            sink_time += MPI_Wtime() - sink_start;
+            for (int i = 0; cache_file && i < count; i++) {
+                result_cache_put(&cache, keys[tasks[start_task + i][0]], keys[tasks[start_task + i][1]],
+                                 cache_settings, batch_results[i]);
             }
             free(batch_results);
 
-            /* assign next batch, or send KILLTAG */
+            /* assign next batch, or send KILLTAG once the slave has no batch left */
             if (next_task < total_tasks) {
-                int batch_count = (total_tasks - next_task < BATCH_SIZE) ? (total_tasks - next_task) : BATCH_SIZE;
-
-                /* compute total bytes for batch_count */
-                size_t total_bytes = 0;
-                for (int b = 0; b < batch_count; b++) {
-                    int r_idx = tasks[next_task + b][0];
-                    int c_idx = tasks[next_task + b][1];
-                    total_bytes += sizeof(int);
-                    total_bytes += sizeof(double) * lengths[r_idx];
-                    total_bytes += sizeof(int);
-                    total_bytes += sizeof(double) * lengths[c_idx];
-                }
-
-                char *sendbuf = malloc(total_bytes);
-                if (!sendbuf) { fprintf(stderr, "MASTER: sendbuf OOM2\n"); MPI_Abort(MPI_COMM_WORLD,1); }
-
-                size_t pos = 0;
-                for (int b = 0; b < batch_count; b++) {
-                    int r_idx = tasks[next_task + b][0];
-                    int c_idx = tasks[next_task + b][1];
-                    int len_r = lengths[r_idx];
-                    int len_c = lengths[c_idx];
-
-                    memcpy(sendbuf + pos, &len_r, sizeof(int)); pos += sizeof(int);
-                    memcpy(sendbuf + pos, s[r_idx], sizeof(double)*len_r); pos += sizeof(double)*len_r;
-                    memcpy(sendbuf + pos, &len_c, sizeof(int)); pos += sizeof(int);
-                    memcpy(sendbuf + pos, s[c_idx], sizeof(double)*len_c); pos += sizeof(double)*len_c;
-                }
-
-                /* header */
-                int header[1];
-                header[0] = batch_count;
-                MPI_Send(header, 1, MPI_INT, source, WORKTAG, MPI_COMM_WORLD);
-
-                uint64_t tbytes = (uint64_t) total_bytes;
-                MPI_Send(&tbytes, 1, MPI_UINT64_T, source, WORKTAG, MPI_COMM_WORLD);
-
-                /* send bytes */
-                MPI_Send(sendbuf, (int)total_bytes, MPI_BYTE, source, WORKTAG, MPI_COMM_WORLD);
-
-                last_send[source] = next_task;
+                int batch_count = next_batch_count(&schedule, &builder, use_adaptive, BATCH_SIZE, source, tasks,
+                                                   next_task, total_tasks, lengths, use_shared, capacity, num_series);
+                int slot = (pending_head[source] + pending_len[source]++) % BATCH_DEPTH;
+                int buf_idx = source * BATCH_DEPTH + slot;
+                /* the previous send from this buffer was answered, so it is complete */
+                MPI_Wait(&send_reqs[buf_idx], MPI_STATUS_IGNORE);
+                size_t bytes = pack_batch(&builder, sendbufs[buf_idx], tasks, next_task, batch_count, s, lengths, use_shared);
+                wire_bytes += bytes;
+                pairwise_bytes += series_batch_pairwise_size(tasks, next_task, batch_count, lengths);
+                MPI_Isend(sendbufs[buf_idx], (int)bytes, MPI_BYTE, source, WORKTAG, MPI_COMM_WORLD, &send_reqs[buf_idx]);
+                pending[source][slot][0] = next_task;
+                pending[source][slot][1] = batch_count;
+                batch_schedule_sent(&schedule, source, batch_count,
+                                    batch_schedule_cells(tasks, next_task, batch_count, lengths), MPI_Wtime());
                 next_task += batch_count;
-
-                free(sendbuf);
-            } else {
+            } else if (pending_len[source] == 0) {
                 /* no more work */
-                MPI_Send(NULL, 0, MPI_INT, source, KILLTAG, MPI_COMM_WORLD);
+                MPI_Send(NULL, 0, MPI_BYTE, source, KILLTAG, MPI_COMM_WORLD);
                 kill_count--;
             }
         } /* end dynamic loop */
+        MPI_Waitall(nprocs * BATCH_DEPTH, send_reqs, MPI_STATUSES_IGNORE);
 
 
         // Record the end time
@@ -242,96 +760,166 @@ int main(int argc, char *argv[]) {
 
         // Calculate and print the elapsed time for each process
         printf("Process %d: Elapsed time = %f seconds\n", rank, end_time - start_time);
+        printf("Batches: %d, %d to %d pairs per batch\n", schedule.nb_batches, schedule.smallest, schedule.largest);
+        printf("Wire: %.3f MB for %d pairs (%.2f pairs/KB), with both series per pair %.3f MB (%.2f pairs/KB)\n",
+               wire_bytes / 1e6, total_tasks, (wire_bytes > 0) ? total_tasks / (wire_bytes / 1e3) : 0.0,
+               pairwise_bytes / 1e6, (pairwise_bytes > 0) ? total_tasks / (pairwise_bytes / 1e3) : 0.0);
+
+        report_slaves(0, 0, rank, nprocs);
+        if (max_dist > 0) {
+            reduce_prune_stats(&stats, rank);
+            if (stats.pairs > 0) dtw_print_prune_stats(&stats);
+        }
 
 
-        /* Save results to file (ticker names) */
-        FILE *fp = fopen(result_file, "w");
-        if (!fp) { fprintf(stderr, "MASTER: cannot open output file\n"); }
-        int idx = 0;
-        for (int r = 0; r < num_series; r++) {
-            for (int c = r + 1; c < num_series; c++) {
-                fprintf(fp, "%s;%s;%.6f\n", series[r].ticker, series[c].ticker, result[idx++]);
-            }
+        /* the results are already written, only the buffered tail is left */
+        double close_start = MPI_Wtime();
+        result_sink_print_stats(&sink);
+        if (result_sink_close(&sink) != 0) {
+            fprintf(stderr, "MASTER: cannot write %s\n", result_file);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        printf("Result write: %f s during the run, %f s after it\n", sink_time, MPI_Wtime() - close_start);
+        if (checkpoint_file) {
+            /* the result is complete, a restart is no longer needed */
+            run_checkpoint_print_stats(&checkpoint, end_time - start_time);
+            run_checkpoint_close(&checkpoint, checkpoint_file, true);
+        }
+        if (cache_file) {
+            result_cache_print_stats(&cache, sink.num_pairs);
+            if (result_cache_close(&cache) != 0) fprintf(stderr, "MASTER: cannot write cache %s\n", cache_file);
         }
-        if (fp) fclose(fp);
 
         printf("MASTER: Done. Results saved to %s\n", result_file);
 
-        free(result);
-        free(last_send);
+        for (int i = 0; i < nprocs * BATCH_DEPTH; i++) free(sendbufs[i]);
+        free(sendbufs);
+        free(send_reqs);
+        free(pending_len);
+        free(pending_head);
+        free(pending);
+        batch_schedule_free(&schedule);
+        series_batch_builder_free(&builder);
         free(tasks);
-        free(series);
     } /* end master */
 
     else {
         /**************** SLAVE ****************/
         MPI_Status status;
-        while (1) {
-            /* wait header or kill */
-            MPI_Probe(0, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+        PairScratch scratch = pair_scratch_empty(); /* DTW memory reused over all batches */
+        int use_envs = max_dist > 0 && !use_f32;
+        if (use_envs && use_shared) {
+            /* --max-dist: the envelopes of the shared series are built once per rank */
+            pair_scratch_collection_envelopes(&scratch, shared.ptrs, shared.lengths, shared.num_series, &settings);
+        }
+
+        /* BATCH_DEPTH receives are posted ahead: the next batch arrives while the
+         * current one is computed */
+        char *recvbufs[BATCH_DEPTH];
+        float *results[BATCH_DEPTH];
+        MPI_Request recv_reqs[BATCH_DEPTH], result_reqs[BATCH_DEPTH];
+        for (int d = 0; d < BATCH_DEPTH; d++) {
+            recvbufs[d] = batch_buffer_alloc(capacity);
+            results[d] = malloc(sizeof(float) * (max_pairs + 1));
+            if (!recvbufs[d] || !results[d]) { fprintf(stderr, "SLAVE %d: recvbuf OOM\n", rank); MPI_Abort(MPI_COMM_WORLD, 1); }
+            MPI_Irecv(recvbufs[d], (int)capacity, MPI_BYTE, 0, MPI_ANY_TAG, MPI_COMM_WORLD, &recv_reqs[d]);
+            result_reqs[d] = MPI_REQUEST_NULL;
+        }
+
+        double wait_time = 0, compute_time = 0;
+        int nb_batches = 0;
+        for (int cur = 0; ; cur = (cur + 1) % BATCH_DEPTH) {
+            /* wait batch or kill */
+            double t_wait = MPI_Wtime();
+            MPI_Wait(&recv_reqs[cur], &status);
+            if (nb_batches > 0) wait_time += MPI_Wtime() - t_wait;
 
             if (status.MPI_TAG == KILLTAG) {
-                /* receive the kill (empty) to clear the message */
-                MPI_Recv(NULL, 0, MPI_INT, 0, KILLTAG, MPI_COMM_WORLD, &status);
                 if (VERBOSE) printf("SLAVE %d: got KILLTAG, exiting\n", rank);
                 break;
             }
-            else if (status.MPI_TAG == WORKTAG) {
-                /* receive header */
-                int header[1];
-                MPI_Recv(header, 1, MPI_INT, 0, WORKTAG, MPI_COMM_WORLD, &status);
-                int batch_count = header[0];
-
-                uint64_t tbytes;
-                MPI_Recv(&tbytes, 1, MPI_UINT64_T, 0, WORKTAG, MPI_COMM_WORLD, &status);
-                size_t total_bytes = (size_t) tbytes;
-
-                /* now receive contiguous buffer */
-                char *recvbuf = malloc(total_bytes);
-                if (!recvbuf) { fprintf(stderr, "SLAVE %d: recvbuf OOM\n", rank); MPI_Abort(MPI_COMM_WORLD, 1); }
-                MPI_Recv(recvbuf, (int)total_bytes, MPI_BYTE, 0, WORKTAG, MPI_COMM_WORLD, &status);
-
-                /* unpack sequentially */
-                size_t pos = 0;
-                float *results = malloc(sizeof(float) * batch_count);
-                if (!results) { fprintf(stderr, "SLAVE %d: results OOM\n", rank); MPI_Abort(MPI_COMM_WORLD,1); }
+            nb_batches++;
 
+            int header[BATCH_HEADER_INTS];
+            memcpy(header, recvbufs[cur], sizeof(header));
+            int batch_count = header[0];
+            if (batch_count < 0 || batch_count > max_pairs) {
+                fprintf(stderr, "SLAVE %d: batch of %d pairs\n", rank, batch_count); MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            /* the results of the previous batch in this slot are sent */
+            MPI_Wait(&result_reqs[cur], MPI_STATUS_IGNORE);
+            float *res = results[cur];
+            double t_compute = MPI_Wtime();
+
+            if (use_shared) {
+                /* pairs (r, c), (r, c+1), ... of the upper triangle, read from the shared series */
+                int r = header[1], c = header[2];
                 for (int b = 0; b < batch_count; b++) {
-                    /* read len_r */
-                    int len_r = 0;
-                    memcpy(&len_r, recvbuf + pos, sizeof(int)); pos += sizeof(int);
-
-                    double *series_r = malloc(sizeof(double) * len_r);
-                    if (!series_r) { fprintf(stderr,"SLAVE OOM r\n"); MPI_Abort(MPI_COMM_WORLD,1); }
-                    memcpy(series_r, recvbuf + pos, sizeof(double) * len_r); pos += sizeof(double) * len_r;
-
-                    int len_c = 0;
-                    memcpy(&len_c, recvbuf + pos, sizeof(int)); pos += sizeof(int);
+                    res[b] = compute_pair(shared.ptrs[r], (int)shared.lengths[r], use_envs ? &scratch.envs[r] : NULL,
+                                          shared.ptrs[c], (int)shared.lengths[c], use_envs ? &scratch.envs[c] : NULL,
+                                          use_f32, max_dist, &settings, &scratch, &stats);
+                    if (++c == shared.num_series) {
+                        r++;
+                        c = r + 1;
+                    }
+                }
+            } else {
+                /* the series stay in the (aligned) receive buffer */
+                int bytes = 0;
+                MPI_Get_count(&status, MPI_BYTE, &bytes);
+                SeriesBatchView view;
+                if (bytes < BATCH_ALIGN || series_batch_view(recvbufs[cur] + BATCH_ALIGN, bytes - BATCH_ALIGN, &view) != 0
+                    || view.nb_pairs != batch_count) {
+                    fprintf(stderr, "SLAVE %d: malformed batch\n", rank); MPI_Abort(MPI_COMM_WORLD, 1);
+                }
 
-                    double *series_c = malloc(sizeof(double) * len_c);
-                    if (!series_c) { fprintf(stderr,"SLAVE OOM c\n"); MPI_Abort(MPI_COMM_WORLD,1); }
-                    memcpy(series_c, recvbuf + pos, sizeof(double) * len_c); pos += sizeof(double) * len_c;
+                /* --max-dist: one envelope per distinct series of the batch */
+                if (use_envs) {
+                    pair_scratch_batch_envelopes(&scratch, &view, &settings);
+                }
+                for (int b = 0; b < batch_count; b++) {
+                    int len_r, len_c;
+                    double *series_r = series_batch_series(&view, b, 0, &len_r);
+                    double *series_c = series_batch_series(&view, b, 1, &len_c);
 
                     /* compute DTW */
-                    double d = dtw_distance(series_r, (idx_t)len_r, series_c, (idx_t)len_c, &settings);
-                    results[b] = (float) d;
-
-                    free(series_r);
-                    free(series_c);
+                    res[b] = compute_pair(series_r, len_r, use_envs ? &scratch.envs[view.pairs[2 * b]] : NULL,
+                                          series_c, len_c, use_envs ? &scratch.envs[view.pairs[2 * b + 1]] : NULL,
+                                          use_f32, max_dist, &settings, &scratch, &stats);
                 }
+            }
 
-                /* send results array back */
-                MPI_Send(results, batch_count, MPI_FLOAT, 0, RESULTTAG, MPI_COMM_WORLD);
+            compute_time += MPI_Wtime() - t_compute;
 
-                free(results);
-                free(recvbuf);
-            } else {
-                /* other tags (should not happen) */
-                MPI_Recv(NULL, 0, MPI_INT, 0, status.MPI_TAG, MPI_COMM_WORLD, &status);
-            }
+            /* send results array back, the buffer is free for the batch after the next one */
+            MPI_Isend(res, batch_count, MPI_FLOAT, 0, RESULTTAG, MPI_COMM_WORLD, &result_reqs[cur]);
+            MPI_Irecv(recvbufs[cur], (int)capacity, MPI_BYTE, 0, MPI_ANY_TAG, MPI_COMM_WORLD, &recv_reqs[cur]);
         } /* end while */
+
+        /* the receives posted after the kill never match */
+        for (int d = 0; d < BATCH_DEPTH; d++) {
+            if (recv_reqs[d] != MPI_REQUEST_NULL) {
+                MPI_Cancel(&recv_reqs[d]);
+                MPI_Wait(&recv_reqs[d], MPI_STATUS_IGNORE);
+            }
+        }
+        MPI_Waitall(BATCH_DEPTH, result_reqs, MPI_STATUSES_IGNORE);
+        for (int d = 0; d < BATCH_DEPTH; d++) {
+            free(recvbufs[d]);
+            free(results[d]);
+        }
+        pair_scratch_free(&scratch);
+        report_slaves(wait_time, compute_time, rank, nprocs);
+        if (max_dist > 0) {
+            reduce_prune_stats(&stats, rank);
+        }
     } /* end slave */
 
+    if (use_shared) {
+        series_shared_free(&shared);
+    }
+    series_collection_free(&collection);
+
     MPI_Finalize();
     return 0;
 }
@@ -0,0 +1,62 @@
+/*!
+@header dtw_f32.h
+@brief DTAIDistance.dtw : Single-precision Dynamic Time Warping
+
+Both precisions are available in the same binary: the functions without suffix work
+on seq_t (double), the functions with the _f32 suffix work on seq32_t (float) and
+take the same DTWSettings. The precision can thus be chosen at runtime by the caller
+(e.g. the --f32 option of the drivers) or at link time by calling the _f32 symbols.
+
+Error bound with respect to dtw_distance, for settings without penalty, max_step
+or psi-relaxation, to first order in u = 2^-24 (see dtw_distance_f32_error_bound):
+
+  |d32 - d64| <= (l1 + l2 + 3) / 2 * u * d64 + 2 * u * max_abs * sqrt(l1 + l2 - 1)
+
+with max_abs the largest absolute value in both series. For two series of 5000
+values the relative term is 3e-4 in the worst case; in practice the rounding
+errors partly cancel out and the observed error is orders of magnitude smaller.
+Pruning (max_dist, use_pruning) compares single-precision values and can thus
+differ for distances within this bound of max_dist.
+
+@copyright Apache License, Version 2.0, see LICENSE for details.
+*/
+
+#ifndef dtw_f32_h
+#define dtw_f32_h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include "dd_globals.h"
+#include "dd_dtw.h"
+#include "dd_dtw_simd.h"
+
+
+// Conversion
+void  dtw_seq_to_f32(seq_t *src, idx_t l, seq32_t *dst);
+seq_t dtw_distance_f32_error_bound(idx_t l1, idx_t l2, seq_t max_abs, seq_t d64);
+
+// DTW
+typedef seq32_t (*DTWFnPtrF32)(seq32_t *s1, idx_t l1, seq32_t *s2, idx_t l2, DTWSettings *settings);
+
+seq32_t dtw_distance_f32(seq32_t *s1, idx_t l1, seq32_t *s2, idx_t l2, DTWSettings *settings);
+seq32_t dtw_distance_euclidean_f32(seq32_t *s1, idx_t l1, seq32_t *s2, idx_t l2, DTWSettings *settings);
+seq32_t dtw_distance_f32_ws(seq32_t *s1, idx_t l1, seq32_t *s2, idx_t l2, DTWSettings *settings, DTWWorkspace *ws);
+seq32_t dtw_distance_euclidean_f32_ws(seq32_t *s1, idx_t l1, seq32_t *s2, idx_t l2, DTWSettings *settings, DTWWorkspace *ws);
+
+// Bounds
+seq32_t ub_euclidean_f32(seq32_t *s1, idx_t l1, seq32_t *s2, idx_t l2);
+seq32_t ub_euclidean_euclidean_f32(seq32_t *s1, idx_t l1, seq32_t *s2, idx_t l2);
+seq32_t lb_keogh_f32(seq32_t *s1, idx_t l1, seq32_t *s2, idx_t l2, DTWSettings *settings);
+seq32_t lb_keogh_euclidean_f32(seq32_t *s1, idx_t l1, seq32_t *s2, idx_t l2, DTWSettings *settings);
+
+// Distance matrices
+idx_t dtw_distances_ptrs_f32(seq32_t **ptrs, idx_t nb_ptrs, idx_t* lengths,
+                             seq32_t* output, DTWBlock* block, DTWSettings* settings);
+idx_t dtw_distances_matrix_f32(seq32_t *matrix, idx_t nb_rows, idx_t nb_cols,
+                               seq32_t* output, DTWBlock* block, DTWSettings* settings);
+
+#endif /* dtw_f32_h */
@@ -0,0 +1,381 @@
+/*!
+@file dtw_knn.c
+@brief DTAIDistance.dtw : k nearest and k farthest neighbours with DTW
+
+@copyright Apache License, Version 2.0, see LICENSE for details.
+*/
+
+#include "dd_dtw_knn.h"
+#include "dd_dtw_simd.h"
+
+
+struct dtw_knn_candidate_s {
+    idx_t idx;
+    seq_t bound;
+    bool exact;     // bound is the DTW distance, from the cache
+};
+
+static int dtw_knn_candidate_cmp_asc(const void *a, const void *b) {
+    const struct dtw_knn_candidate_s *ca = (const struct dtw_knn_candidate_s *)a;
+    const struct dtw_knn_candidate_s *cb = (const struct dtw_knn_candidate_s *)b;
+    if (ca->bound < cb->bound) return -1;
+    if (ca->bound > cb->bound) return 1;
+    return (ca->idx > cb->idx) - (ca->idx < cb->idx);
+}
+
+static int dtw_knn_candidate_cmp_desc(const void *a, const void *b) {
+    const struct dtw_knn_candidate_s *ca = (const struct dtw_knn_candidate_s *)a;
+    const struct dtw_knn_candidate_s *cb = (const struct dtw_knn_candidate_s *)b;
+    if (ca->bound > cb->bound) return -1;
+    if (ca->bound < cb->bound) return 1;
+    return (ca->idx > cb->idx) - (ca->idx < cb->idx);
+}
+
+static int dtw_knn_neighbour_cmp_asc(const void *a, const void *b) {
+    const DTWNeighbour *na = (const DTWNeighbour *)a;
+    const DTWNeighbour *nb = (const DTWNeighbour *)b;
+    if (na->dist < nb->dist) return -1;
+    if (na->dist > nb->dist) return 1;
+    return (na->idx > nb->idx) - (na->idx < nb->idx);
+}
+
+static int dtw_knn_neighbour_cmp_desc(const void *a, const void *b) {
+    const DTWNeighbour *na = (const DTWNeighbour *)a;
+    const DTWNeighbour *nb = (const DTWNeighbour *)b;
+    if (na->dist > nb->dist) return -1;
+    if (na->dist < nb->dist) return 1;
+    return (na->idx > nb->idx) - (na->idx < nb->idx);
+}
+
+
+// MARK: Bounded heap
+
+/* True if distance a belongs above b in the heap: a max-heap (order > 0) keeps the
+   k smallest distances with the largest on top, a min-heap (order < 0) the k largest. */
+static inline bool dtw_knn_above(seq_t a, seq_t b, int order) {
+    return (order > 0) ? (a > b) : (a < b);
+}
+
+/* Add a neighbour to a heap of at most k elements, the top is dropped if the heap is full. */
+static void dtw_knn_heap_offer(DTWNeighbour *heap, idx_t *size, idx_t k,
+                               idx_t idx, seq_t dist, int order) {
+    idx_t i, parent, child;
+    if (*size < k) {
+        i = (*size)++;
+        while (i > 0) {
+            parent = (i - 1) / 2;
+            if (!dtw_knn_above(dist, heap[parent].dist, order)) {
+                break;
+            }
+            heap[i] = heap[parent];
+            i = parent;
+        }
+    } else {
+        if (!dtw_knn_above(heap[0].dist, dist, order)) {
+            return;
+        }
+        i = 0;
+        while ((child = 2 * i + 1) < *size) {
+            if (child + 1 < *size && dtw_knn_above(heap[child + 1].dist, heap[child].dist, order)) {
+                child++;
+            }
+            if (!dtw_knn_above(heap[child].dist, dist, order)) {
+                break;
+            }
+            heap[i] = heap[child];
+            i = child;
+        }
+    }
+    heap[i].idx = idx;
+    heap[i].dist = dist;
+}
+
+
+// MARK: Distance cache
+
+/* Position of pair (a, b), a != b, in the condensed upper triangle of nb_ptrs series. */
+static inline idx_t dtw_knn_cache_idx(idx_t nb_ptrs, idx_t a, idx_t b) {
+    if (a > b) {
+        idx_t t = a;
+        a = b;
+        b = t;
+    }
+    return a * nb_ptrs - a * (a + 1) / 2 + (b - a - 1);
+}
+
+/* What the search knows about d(a, b) = d(b, a): NAN if nothing, the distance if it
+   is >= 0, and -v if the distance exceeds v > 0 (a DTW computation was abandoned at v).
+   The entries are read and written by all threads, a lost update only loses knowledge. */
+static inline seq_t dtw_knn_cache_get(seq_t *cache, idx_t i) {
+    seq_t v;
+    #pragma omp atomic read
+    v = cache[i];
+    return v;
+}
+
+static inline void dtw_knn_cache_set(seq_t *cache, idx_t i, seq_t v) {
+    #pragma omp atomic write
+    cache[i] = v;
+}
+
+
+// MARK: Search
+
+DTWKnnStats dtw_knn_stats_empty(void) {
+    DTWKnnStats stats = {
+        .pairs = 0,
+        .pruned_lb = 0,
+        .abandoned = 0,
+        .pruned_ub = 0,
+        .reused = 0,
+        .computed = 0
+    };
+    return stats;
+}
+
+void dtw_print_knn_stats(DTWKnnStats *stats) {
+    printf("kNN: %zu pairs, LB pruned %zu, DTW abandoned %zu, UB pruned %zu, reused %zu, DTW computed %zu\n",
+           stats->pairs, stats->pruned_lb, stats->abandoned, stats->pruned_ub, stats->reused, stats->computed);
+}
+
+/*!
+ Find the k nearest and the k farthest neighbours of every series, in parallel over
+ the query series.
+
+ The max_dist option of the settings is not used, it is set per pair by the search.
+
+ @param ptrs Pointers to arrays. The arrays are expected to be 1-dimensional.
+ @param nb_ptrs Length of ptrs array
+ @param lengths Array of length nb_ptrs with all lengths of the arrays in ptrs.
+ @param k Number of neighbours per series.
+ @param nearest Array of length nb_ptrs * k, nearest[i*k + r] is the r-th nearest
+    neighbour of series i (increasing distance).
+ @param farthest Array of length nb_ptrs * k, farthest[i*k + r] is the r-th farthest
+    neighbour of series i (decreasing distance), or NULL to skip this search.
+ @param settings A DTWSettings struct with options for the DTW algorithm.
+ @param stats Work done by the search, or NULL.
+ @return Number of neighbours per series, MIN(k, nb_ptrs - 1). Other slots have
+    idx = nb_ptrs and dist = INFINITY.
+ */
+idx_t dtw_knn_ptrs_parallel(seq_t **ptrs, idx_t nb_ptrs, idx_t *lengths, idx_t k,
+                            DTWNeighbour *nearest, DTWNeighbour *farthest,
+                            DTWSettings *settings, DTWKnnStats *stats) {
+    idx_t i;
+    idx_t kk = (nb_ptrs > 1) ? MIN(k, nb_ptrs - 1) : 0;
+    for (i=0; i<nb_ptrs*k; i++) {
+        nearest[i].idx = nb_ptrs;
+        nearest[i].dist = INFINITY;
+        if (farthest != NULL) {
+            farthest[i].idx = nb_ptrs;
+            farthest[i].dist = INFINITY;
+        }
+    }
+    if (stats != NULL) {
+        *stats = dtw_knn_stats_empty();
+    }
+    if (kk == 0) {
+        return 0;
+    }
+    // One envelope per series, with a radius that is valid for all pairs
+    idx_t lmin = lengths[0];
+    idx_t lmax = lengths[0];
+    for (i=1; i<nb_ptrs; i++) {
+        lmin = MIN(lmin, lengths[i]);
+        lmax = MAX(lmax, lengths[i]);
+    }
+    idx_t radius = dtw_envelope_radius(lmin, lmax, settings);
+    DTWEnvelope *envs = (DTWEnvelope *)malloc(sizeof(DTWEnvelope) * nb_ptrs);
+    if (!envs) {
+        printf("Error: dtw_knn_ptrs_parallel - cannot allocate memory (envelopes = %zu)\n", nb_ptrs);
+        return 0;
+    }
+    // d(q, j) = d(j, q): what one query learned about a pair is used by the other
+    idx_t cache_size = nb_ptrs * (nb_ptrs - 1) / 2;
+    seq_t *cache = (seq_t *)malloc(sizeof(seq_t) * cache_size);
+    if (!cache) {
+        printf("Error: dtw_knn_ptrs_parallel - cannot allocate memory (cache = %zu)\n", cache_size);
+        free(envs);
+        return 0;
+    }
+    for (i=0; i<cache_size; i++) {
+        cache[i] = NAN;
+    }
+    #pragma omp parallel for schedule(static)
+    for (i=0; i<nb_ptrs; i++) {
+        if (!dtw_envelope_init(&envs[i], ptrs[i], lengths[i], radius)) {
+            envs[i].radius = 0;
+        }
+    }
+
+    #pragma omp parallel
+    {
+        // Per thread: workspace, counters, candidates, one heap and one group of
+        // pairs that is computed in the SIMD lanes of dtw_distance_batch
+        DTWWorkspace ws = dtw_workspace_empty();
+        DTWKnnStats thread_stats = dtw_knn_stats_empty();
+        DTWSettings query_settings = *settings;
+        idx_t width = (idx_t)dtw_simd_lanes();
+        struct dtw_knn_candidate_s *cands = (struct dtw_knn_candidate_s *)malloc(sizeof(struct dtw_knn_candidate_s) * nb_ptrs);
+        DTWNeighbour *heap = (DTWNeighbour *)malloc(sizeof(DTWNeighbour) * kk);
+        idx_t *group = (idx_t *)malloc(sizeof(idx_t) * width);
+        seq_t **group_ptrs = (seq_t **)malloc(sizeof(seq_t *) * width);
+        idx_t *group_lengths = (idx_t *)malloc(sizeof(idx_t) * width);
+        seq_t *group_dists = (seq_t *)malloc(sizeof(seq_t) * width);
+        bool ok = (cands && heap && group && group_ptrs && group_lengths && group_dists);
+        if (!ok) {
+            printf("Error: dtw_knn_ptrs_parallel - cannot allocate memory (size = %zu)\n", nb_ptrs);
+        }
+        idx_t q, j, c, g, nb, ng, size;
+        seq_t cached;
+        bool full;
+        #pragma omp for schedule(dynamic)
+        for (q=0; q<nb_ptrs; q++) {
+            if (!ok) {
+                continue;
+            }
+            // Nearest: increasing lower bound, the k-th best distance is the threshold.
+            // A cached distance is its own bound, an abandoned pair raises the bound.
+            nb = 0;
+            for (j=0; j<nb_ptrs; j++) {
+                if (j == q) {
+                    continue;
+                }
+                cached = dtw_knn_cache_get(cache, dtw_knn_cache_idx(nb_ptrs, q, j));
+                cands[nb].idx = j;
+                cands[nb].exact = (cached >= 0);
+                if (cands[nb].exact) {
+                    cands[nb].bound = cached;
+                } else {
+                    cands[nb].bound = dtw_lower_bound(ptrs[q], lengths[q], &envs[q],
+                                                      ptrs[j], lengths[j], &envs[j], settings);
+                    if (cached < 0) {
+                        cands[nb].bound = MAX(cands[nb].bound, -cached);
+                    }
+                }
+                nb++;
+            }
+            thread_stats.pairs += nb;
+            qsort(cands, nb, sizeof(struct dtw_knn_candidate_s), dtw_knn_candidate_cmp_asc);
+            size = 0;
+            c = 0;
+            while (c < nb) {
+                full = (size == kk);
+                if (full && (cands[c].bound > heap[0].dist || heap[0].dist == 0)) {
+                    thread_stats.pruned_lb += nb - c;
+                    break;
+                }
+                query_settings.max_dist = full ? heap[0].dist : 0;
+                ng = 0;
+                while (c < nb && ng < width && !(full && cands[c].bound > heap[0].dist)) {
+                    j = cands[c].idx;
+                    if (cands[c++].exact) {
+                        thread_stats.reused++;
+                        dtw_knn_heap_offer(heap, &size, kk, j, cands[c - 1].bound, 1);
+                        continue;
+                    }
+                    group[ng] = j;
+                    group_ptrs[ng] = ptrs[j];
+                    group_lengths[ng] = lengths[j];
+                    ng++;
+                }
+                if (ng == 0) {
+                    continue;
+                }
+                dtw_distance_batch_ws(ptrs[q], lengths[q], group_ptrs, group_lengths, ng,
+                                      group_dists, &query_settings, &ws);
+                thread_stats.computed += ng;
+                for (g=0; g<ng; g++) {
+                    if (full && group_dists[g] == INFINITY) {
+                        thread_stats.abandoned++;
+                        dtw_knn_cache_set(cache, dtw_knn_cache_idx(nb_ptrs, q, group[g]), -query_settings.max_dist);
+                        continue;
+                    }
+                    dtw_knn_cache_set(cache, dtw_knn_cache_idx(nb_ptrs, q, group[g]), group_dists[g]);
+                    dtw_knn_heap_offer(heap, &size, kk, group[g], group_dists[g], 1);
+                }
+            }
+            qsort(heap, size, sizeof(DTWNeighbour), dtw_knn_neighbour_cmp_asc);
+            for (c=0; c<size; c++) {
+                nearest[q * k + c] = heap[c];
+            }
+            if (farthest == NULL) {
+                continue;
+            }
+            // Farthest: decreasing upper bound, reuse the cached distances
+            nb = 0;
+            for (j=0; j<nb_ptrs; j++) {
+                if (j == q) {
+                    continue;
+                }
+                cands[nb].idx = j;
+                cands[nb].bound = dtw_upper_bound(ptrs[q], lengths[q], ptrs[j], lengths[j], settings);
+                nb++;
+            }
+            thread_stats.pairs += nb;
+            qsort(cands, nb, sizeof(struct dtw_knn_candidate_s), dtw_knn_candidate_cmp_desc);
+            size = 0;
+            c = 0;
+            query_settings.max_dist = 0;
+            while (c < nb) {
+                full = (size == kk);
+                if (full && cands[c].bound < heap[0].dist) {
+                    thread_stats.pruned_ub += nb - c;
+                    break;
+                }
+                ng = 0;
+                while (c < nb && ng < width && !(full && cands[c].bound < heap[0].dist)) {
+                    j = cands[c++].idx;
+                    cached = dtw_knn_cache_get(cache, dtw_knn_cache_idx(nb_ptrs, q, j));
+                    if (cached >= 0) {
+                        thread_stats.reused++;
+                        dtw_knn_heap_offer(heap, &size, kk, j, cached, -1);
+                        continue;
+                    }
+                    group[ng] = j;
+                    group_ptrs[ng] = ptrs[j];
+                    group_lengths[ng] = lengths[j];
+                    ng++;
+                }
+                if (ng == 0) {
+                    continue;
+                }
+                dtw_distance_batch_ws(ptrs[q], lengths[q], group_ptrs, group_lengths, ng,
+                                      group_dists, &query_settings, &ws);
+                thread_stats.computed += ng;
+                for (g=0; g<ng; g++) {
+                    dtw_knn_cache_set(cache, dtw_knn_cache_idx(nb_ptrs, q, group[g]), group_dists[g]);
+                    dtw_knn_heap_offer(heap, &size, kk, group[g], group_dists[g], -1);
+                }
+            }
+            qsort(heap, size, sizeof(DTWNeighbour), dtw_knn_neighbour_cmp_desc);
+            for (c=0; c<size; c++) {
+                farthest[q * k + c] = heap[c];
+            }
+        }
+        free(group_dists);
+        free(group_lengths);
+        free(group_ptrs);
+        free(group);
+        free(heap);
+        free(cands);
+        dtw_workspace_free(&ws);
+        if (stats != NULL) {
+            #pragma omp critical
+            {
+                stats->pairs += thread_stats.pairs;
+                stats->pruned_lb += thread_stats.pruned_lb;
+                stats->abandoned += thread_stats.abandoned;
+                stats->pruned_ub += thread_stats.pruned_ub;
+                stats->reused += thread_stats.reused;
+                stats->computed += thread_stats.computed;
+            }
+        }
+    }
+
+    for (i=0; i<nb_ptrs; i++) {
+        dtw_envelope_free(&envs[i]);
+    }
+    free(envs);
+    free(cache);
+    return kk;
+}
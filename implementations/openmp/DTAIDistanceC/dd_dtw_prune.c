@@ -0,0 +1,423 @@
+/*!
+@file dtw_prune.c
+@brief DTAIDistance.dtw : Lower-bound cascade for thresholded DTW
+
+@copyright Apache License, Version 2.0, see LICENSE for details.
+*/
+
+#include "dd_dtw_prune.h"
+#include "dd_dtw_simd.h"
+#include "dd_ed.h"
+
+
+// MARK: Envelopes
+
+/*!
+ Compute the upper and lower envelope of a series.
+
+ Uses a monotone queue for the maximum and the minimum (Lemire's streaming
+ algorithm), such that the envelope is computed in O(l) for any radius.
+
+ @param env Envelope to initialize, free with dtw_envelope_free.
+ @param s Sequence
+ @param l Length of the sequence
+ @param radius Half-width of the window, see dtw_envelope_radius.
+ @return false if the memory could not be allocated.
+ */
+bool dtw_envelope_init(DTWEnvelope *env, seq_t *s, idx_t l, idx_t radius) {
+    env->lower = NULL;
+    env->upper = NULL;
+    env->length = 0;
+    env->radius = radius;
+    if (l == 0) {
+        return true;
+    }
+    seq_t *buffer = (seq_t *)malloc(sizeof(seq_t) * 2 * l);
+    idx_t *queues = (idx_t *)malloc(sizeof(idx_t) * 2 * l);
+    if (!buffer || !queues) {
+        printf("Error: dtw_envelope_init - Cannot allocate memory (size=%zu)\n", 2*l);
+        free(buffer);
+        free(queues);
+        return false;
+    }
+    env->lower = buffer;
+    env->upper = buffer + l;
+    env->length = l;
+    idx_t *maxq = queues;
+    idx_t *minq = queues + l;
+    idx_t maxh = 0, maxt = 0, minh = 0, mint = 0;
+    idx_t j = 0;
+    idx_t end;
+    for (idx_t i=0; i<l; i++) {
+        // Add all values up to i + radius
+        end = (l - 1 - i > radius) ? (i + radius) : (l - 1);
+        for (; j<=end; j++) {
+            while (maxt > maxh && s[maxq[maxt - 1]] <= s[j]) {
+                maxt--;
+            }
+            maxq[maxt++] = j;
+            while (mint > minh && s[minq[mint - 1]] >= s[j]) {
+                mint--;
+            }
+            minq[mint++] = j;
+        }
+        // Remove all values before i - radius
+        while (maxq[maxh] + radius < i) {
+            maxh++;
+        }
+        while (minq[minh] + radius < i) {
+            minh++;
+        }
+        env->upper[i] = s[maxq[maxh]];
+        env->lower[i] = s[minq[minh]];
+    }
+    free(queues);
+    return true;
+}
+
+/*!
+ Free the memory of an envelope.
+ */
+void dtw_envelope_free(DTWEnvelope *env) {
+    free(env->lower);
+    env->lower = NULL;
+    env->upper = NULL;
+    env->length = 0;
+}
+
+/*!
+ Radius of the envelope that covers all cells of the warping band.
+
+ For a row i of the first series, the band allowed by the window contains the
+ columns j with |i - j| < window + |l1 - l2|. An envelope with a larger radius
+ is also valid, but gives a less tight bound. Pass the shortest and longest
+ length of a set of series to get a radius that is valid for all pairs.
+
+ @param l1 Length of first sequence
+ @param l2 Length of second sequence
+ @param settings A DTWSettings struct with options for the DTW algorithm.
+ */
+idx_t dtw_envelope_radius(idx_t l1, idx_t l2, DTWSettings *settings) {
+    if (settings->window == 0) {
+        return MAX(l1, l2);
+    }
+    idx_t ldiff = (l1 > l2) ? (l1 - l2) : (l2 - l1);
+    return settings->window - 1 + ldiff;
+}
+
+
+// MARK: Bounds
+
+/*!
+ Kim lower bound for DTW.
+
+ The first and the last pair of points are part of every warping path (without
+ psi-relaxation).
+ */
+seq_t lb_kim(seq_t *s1, idx_t l1, seq_t *s2, idx_t l2, DTWSettings *settings) {
+    if (l1 == 0 || l2 == 0) {
+        return 0;
+    }
+    seq_t t;
+    if (settings->inner_dist == 1) {
+        t = fabs(s1[0] - s2[0]);
+        if (l1 > 1 || l2 > 1) {
+            t += fabs(s1[l1 - 1] - s2[l2 - 1]);
+        }
+        return t;
+    }
+    t = SEDIST(s1[0], s2[0]);
+    if (l1 > 1 || l2 > 1) {
+        t += SEDIST(s1[l1 - 1], s2[l2 - 1]);
+    }
+    return sqrt(t);
+}
+
+/*!
+ Keogh lower bound for DTW, using a precomputed envelope of the second series.
+
+ Same bound as lb_keogh, but in O(l1) instead of O(l1 * window). The radius of
+ the envelope should be at least dtw_envelope_radius(l1, l2, settings).
+
+ @param s1 First sequence
+ @param l1 Length of first sequence
+ @param env2 Envelope of the second sequence
+ @param settings A DTWSettings struct with options for the DTW algorithm.
+ */
+seq_t lb_keogh_envelope(seq_t *s1, idx_t l1, DTWEnvelope *env2, DTWSettings *settings) {
+    if (env2->length == 0) {
+        return 0;
+    }
+    seq_t t = 0;
+    seq_t ci;
+    idx_t ei;
+    for (idx_t i=0; i<l1; i++) {
+        // Rows past the end of series 2 are covered by the envelope of its last point
+        ei = (i < env2->length) ? i : (env2->length - 1);
+        ci = s1[i];
+        if (settings->inner_dist == 1) {
+            if (ci > env2->upper[ei]) {
+                t += ci - env2->upper[ei];
+            } else if (ci < env2->lower[ei]) {
+                t += env2->lower[ei] - ci;
+            }
+        } else {
+            if (ci > env2->upper[ei]) {
+                t += (ci - env2->upper[ei])*(ci - env2->upper[ei]);
+            } else if (ci < env2->lower[ei]) {
+                t += (env2->lower[ei] - ci)*(env2->lower[ei] - ci);
+            }
+        }
+    }
+    if (settings->inner_dist == 1) {
+        return t;
+    }
+    return sqrt(t);
+}
+
+
+/*!
+ Best lower bound for DTW from LB_Kim and LB_Keogh (in both directions).
+
+ Envelopes are optional (NULL). Returns 0 if no bound is valid for these settings.
+
+ @see lb_kim, lb_keogh_envelope
+ */
+seq_t dtw_lower_bound(seq_t *s1, idx_t l1, DTWEnvelope *env1,
+                      seq_t *s2, idx_t l2, DTWEnvelope *env2, DTWSettings *settings) {
+    if (!dtw_cascade_bounds_supported(settings)) {
+        return 0;
+    }
+    seq_t lb = lb_kim(s1, l1, s2, l2, settings);
+    seq_t t;
+    idx_t radius = dtw_envelope_radius(l1, l2, settings);
+    if (env2 != NULL && env2->radius >= radius) {
+        t = lb_keogh_envelope(s1, l1, env2, settings);
+        if (t > lb) {
+            lb = t;
+        }
+    }
+    if (env1 != NULL && env1->radius >= radius) {
+        t = lb_keogh_envelope(s2, l2, env1, settings);
+        if (t > lb) {
+            lb = t;
+        }
+    }
+    return lb;
+}
+
+/*!
+ Euclidean upper bound for DTW, or INFINITY if it is not valid for these settings.
+
+ The Euclidean distance is the cost of the diagonal warping path (followed by the
+ last row or column if the lengths differ). This path does not exist with a maximal
+ step and costs more with a penalty if the lengths differ.
+
+ @see ub_euclidean
+ */
+seq_t dtw_upper_bound(seq_t *s1, idx_t l1, seq_t *s2, idx_t l2, DTWSettings *settings) {
+    idx_t ldiff = (l1 > l2) ? (l1 - l2) : (l2 - l1);
+    if (settings->max_step != 0 || (settings->penalty != 0 && ldiff != 0)) {
+        return INFINITY;
+    }
+    if (settings->max_length_diff != 0 && ldiff > settings->max_length_diff) {
+        return INFINITY;
+    }
+    if (settings->inner_dist == 1) {
+        return ub_euclidean_euclidean(s1, l1, s2, l2);
+    }
+    return ub_euclidean(s1, l1, s2, l2);
+}
+
+
+// MARK: Cascade
+
+DTWPruneStats dtw_prune_stats_empty(void) {
+    DTWPruneStats stats = {
+        .pairs = 0,
+        .pruned_kim = 0,
+        .pruned_keogh = 0,
+        .abandoned = 0,
+        .kept = 0
+    };
+    return stats;
+}
+
+/*!
+ Add the counts of other to stats.
+ */
+void dtw_prune_stats_add(DTWPruneStats *stats, DTWPruneStats *other) {
+    stats->pairs += other->pairs;
+    stats->pruned_kim += other->pruned_kim;
+    stats->pruned_keogh += other->pruned_keogh;
+    stats->abandoned += other->abandoned;
+    stats->kept += other->kept;
+}
+
+void dtw_print_prune_stats(DTWPruneStats *stats) {
+    printf("Pruning: %zu pairs, LB_Kim pruned %zu, LB_Keogh pruned %zu, DTW abandoned %zu, kept %zu\n",
+           stats->pairs, stats->pruned_kim, stats->pruned_keogh, stats->abandoned, stats->kept);
+}
+
+/*!
+ Check if the lower bounds are valid for these settings. Psi-relaxation allows
+ warping paths that skip the first and last points.
+ */
+bool dtw_cascade_bounds_supported(DTWSettings *settings) {
+    if (settings->psi_1b != 0 || settings->psi_1e != 0 ||
+        settings->psi_2b != 0 || settings->psi_2e != 0) {
+        return false;
+    }
+    return true;
+}
+
+/* Run the lower bounds of the cascade, true if the pair can be discarded. */
+static bool dtw_cascade_bounds(seq_t *s1, idx_t l1, DTWEnvelope *env1,
+                               seq_t *s2, idx_t l2, DTWEnvelope *env2,
+                               DTWSettings *settings, DTWPruneStats *stats) {
+    if (settings->max_dist == 0 || !dtw_cascade_bounds_supported(settings)) {
+        return false;
+    }
+    if (lb_kim(s1, l1, s2, l2, settings) > settings->max_dist) {
+        stats->pruned_kim++;
+        return true;
+    }
+    idx_t radius = dtw_envelope_radius(l1, l2, settings);
+    if ((env2 != NULL && env2->radius >= radius &&
+         lb_keogh_envelope(s1, l1, env2, settings) > settings->max_dist) ||
+        (env1 != NULL && env1->radius >= radius &&
+         lb_keogh_envelope(s2, l2, env1, settings) > settings->max_dist)) {
+        stats->pruned_keogh++;
+        return true;
+    }
+    return false;
+}
+
+/*!
+ Compute the DTW between two series if it is at most settings->max_dist,
+ using the LB_Kim, LB_Keogh, early-abandoning DTW cascade.
+
+ The envelopes are optional (NULL), the LB_Keogh stage is skipped in a
+ direction for which there is no envelope with a large enough radius.
+
+ @param s1 First sequence
+ @param l1 Length of first sequence
+ @param env1 Envelope of the first sequence, or NULL.
+ @param s2 Second sequence
+ @param l2 Length of second sequence
+ @param env2 Envelope of the second sequence, or NULL.
+ @param settings A DTWSettings struct with options for the DTW algorithm.
+ @param ws Workspace that provides (and keeps) the memory for the DTW computation.
+ @param stats Counts of the stage that decided the pair are incremented, or NULL.
+ @return The DTW distance, or INFINITY if it is larger than settings->max_dist.
+ */
+seq_t dtw_distance_cascade_ws(seq_t *s1, idx_t l1, DTWEnvelope *env1,
+                              seq_t *s2, idx_t l2, DTWEnvelope *env2,
+                              DTWSettings *settings, DTWWorkspace *ws, DTWPruneStats *stats) {
+    DTWPruneStats dummy;
+    if (stats == NULL) {
+        stats = &dummy;
+    }
+    stats->pairs++;
+    if (dtw_cascade_bounds(s1, l1, env1, s2, l2, env2, settings, stats)) {
+        return INFINITY;
+    }
+    seq_t d = dtw_distance_ws(s1, l1, s2, l2, settings, ws);
+    if (d == INFINITY) {
+        stats->abandoned++;
+    } else {
+        stats->kept++;
+    }
+    return d;
+}
+
+/*!
+ Compute the DTW between one series and a list of other series if it is at most
+ settings->max_dist, using the LB_Kim, LB_Keogh, early-abandoning DTW cascade.
+
+ The lower bounds are evaluated for every pair, the remaining pairs are computed
+ together with dtw_distance_batch_ws such that they share the SIMD lanes.
+
+ @param s1 First sequence
+ @param l1 Length of first sequence
+ @param env1 Envelope of the first sequence, or NULL.
+ @param s2s Array of n pointers to the other sequences
+ @param l2s Array of n lengths of the other sequences
+ @param env2s Array of n envelopes of the other sequences, or NULL.
+ @param n Number of other sequences
+ @param output Array of length n to store the distances (INFINITY if pruned)
+ @param settings A DTWSettings struct with options for the DTW algorithm.
+ @param ws Workspace that provides (and keeps) the memory for the DTW computation.
+ @param stats Counts of the stage that decided the pairs are incremented, or NULL.
+ @return Number of pairs with a distance up to settings->max_dist.
+ */
+idx_t dtw_distance_cascade_batch_ws(seq_t *s1, idx_t l1, DTWEnvelope *env1,
+                                    seq_t **s2s, idx_t *l2s, DTWEnvelope *env2s, idx_t n,
+                                    seq_t *output, DTWSettings *settings, DTWWorkspace *ws,
+                                    DTWPruneStats *stats) {
+    DTWPruneStats dummy;
+    if (stats == NULL) {
+        stats = &dummy;
+    }
+    idx_t i;
+    idx_t nb_left = 0;
+    idx_t nb_kept = 0;
+    if (n == 0) {
+        return 0;
+    }
+    // Pointers, lengths, output index and distances of the pairs left after the bounds
+    void *buffer = malloc((sizeof(seq_t *) + 2 * sizeof(idx_t) + sizeof(seq_t)) * n);
+    if (!buffer) {
+        printf("Error: dtw_distance_cascade_batch_ws - Cannot allocate memory (size=%zu)\n", n);
+        return 0;
+    }
+    seq_t **left_s2s = (seq_t **)buffer;
+    idx_t *left_l2s = (idx_t *)(left_s2s + n);
+    idx_t *left_idx = left_l2s + n;
+    seq_t *left_output = (seq_t *)(left_idx + n);
+    stats->pairs += n;
+    for (i=0; i<n; i++) {
+        if (dtw_cascade_bounds(s1, l1, env1, s2s[i], l2s[i], env2s == NULL ? NULL : &env2s[i],
+                               settings, stats)) {
+            output[i] = INFINITY;
+        } else {
+            left_s2s[nb_left] = s2s[i];
+            left_l2s[nb_left] = l2s[i];
+            left_idx[nb_left] = i;
+            nb_left++;
+        }
+    }
+    dtw_distance_batch_ws(s1, l1, left_s2s, left_l2s, nb_left, left_output, settings, ws);
+    for (i=0; i<nb_left; i++) {
+        output[left_idx[i]] = left_output[i];
+        if (left_output[i] == INFINITY) {
+            stats->abandoned++;
+        } else {
+            stats->kept++;
+            nb_kept++;
+        }
+    }
+    free(buffer);
+    return nb_kept;
+}
+
+/*!
+ Compute the DTW between two series if it is at most settings->max_dist,
+ using temporary envelopes and workspace.
+
+ @see dtw_distance_cascade_ws
+ */
+seq_t dtw_distance_cascade(seq_t *s1, idx_t l1, seq_t *s2, idx_t l2,
+                           DTWSettings *settings, DTWPruneStats *stats) {
+    DTWEnvelope env1, env2;
+    DTWWorkspace ws = dtw_workspace_empty();
+    idx_t radius = dtw_envelope_radius(l1, l2, settings);
+    bool ok1 = dtw_envelope_init(&env1, s1, l1, radius);
+    bool ok2 = dtw_envelope_init(&env2, s2, l2, radius);
+    seq_t d = dtw_distance_cascade_ws(s1, l1, ok1 ? &env1 : NULL, s2, l2, ok2 ? &env2 : NULL,
+                                      settings, &ws, stats);
+    dtw_envelope_free(&env1);
+    dtw_envelope_free(&env2);
+    dtw_workspace_free(&ws);
+    return d;
+}
@@ -18,6 +18,9 @@
 /* The sequence type type can be customized by changing the typedef. */
 typedef double seq_t;
 
+/* Single-precision sequence type, used by the _f32 functions (see dtw_f32.h). */
+typedef float seq32_t;
+
 /*! The index type
  
  The advantage of using ssize_t instead of size_t is that this is
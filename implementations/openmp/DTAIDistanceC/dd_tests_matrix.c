@@ -15,6 +15,8 @@
 
 #include "dd_dtw.h"
 #include "dd_dtw_openmp.h"
+#include "dd_dtw_knn.h"
+#include "dd_dtw_simd.h"
 
 
 //#define SKIPALL
@@ -162,6 +164,176 @@ Test(matrix, test_c_block_ptrs_parallel) {
     }
 }
 
+Test(matrix, test_c_block_ptrs_parallel_tiled) {
+    #ifdef SKIPALL
+    cr_skip_test();
+    #endif
+    // Same output as the row scheduler for tiles that do not divide the block
+    double data[23][20];
+    double *s[23];
+    idx_t lengths[23];
+    for (idx_t i=0; i<23; i++) {
+        for (idx_t j=0; j<20; j++) {
+            data[i][j] = sin(j * 0.3 * (i + 1)) + 0.1 * i;
+        }
+        s[i] = data[i];
+        lengths[i] = 20;
+    }
+    double expected[23 * 23];
+    double result[23 * 23];
+    DTWSettings settings = dtw_settings_default();
+    DTWBlock blocks[3] = {
+        {.rb=0, .re=0, .cb=0, .ce=0, .triu=true},
+        {.rb=2, .re=17, .cb=5, .ce=21, .triu=true},
+        {.rb=2, .re=17, .cb=5, .ce=21, .triu=false}};
+    for (int b=0; b<3; b++) {
+        DTWBlock block = blocks[b];
+        idx_t length = dtw_distances_ptrs_parallel_d(s, 23, lengths, expected, &block, &settings);
+        for (idx_t tile=1; tile<=24; tile+=(tile < 4 ? 1 : 5)) {
+            block = blocks[b];
+            for (idx_t i=0; i<length; i++) {
+                result[i] = -1;
+            }
+            cr_assert_eq(dtw_distances_ptrs_parallel_tiled(s, 23, lengths, result, &block, &settings, tile), length);
+            for (idx_t i=0; i<length; i++) {
+                cr_assert_eq(result[i], expected[i]);
+            }
+        }
+    }
+    cr_assert_eq(dtw_distances_tile_size(23, lengths, 4 * 20 * sizeof(seq_t) * 16) % dtw_simd_lanes(), 0);
+    cr_assert_eq(dtw_distances_tile_size(23, lengths, 4 * 20 * sizeof(seq_t) * 100), 23);
+}
+
+Test(matrix, test_c_block_ptrs_parallel_steal) {
+    #ifdef SKIPALL
+    cr_skip_test();
+    #endif
+    // Same output as the row scheduler, with lengths that make the cost of rows differ
+    double data[41][30];
+    double *s[41];
+    idx_t lengths[41];
+    for (idx_t i=0; i<41; i++) {
+        lengths[i] = 5 + (i * 13) % 26;
+        for (idx_t j=0; j<lengths[i]; j++) {
+            data[i][j] = sin(j * 0.3 * (i + 1)) + 0.1 * i;
+        }
+        s[i] = data[i];
+    }
+    double expected[41 * 41];
+    double result[41 * 41];
+    DTWSettings settings = dtw_settings_default();
+    DTWBlock blocks[3] = {
+        {.rb=0, .re=0, .cb=0, .ce=0, .triu=true},
+        {.rb=2, .re=37, .cb=5, .ce=40, .triu=true},
+        {.rb=2, .re=37, .cb=5, .ce=40, .triu=false}};
+    for (int b=0; b<3; b++) {
+        DTWBlock block = blocks[b];
+        idx_t length = dtw_distances_ptrs_parallel_d(s, 41, lengths, expected, &block, &settings);
+        for (idx_t i=0; i<length; i++) {
+            result[i] = -1;
+        }
+        block = blocks[b];
+        DTWStealStats stats;
+        cr_assert_eq(dtw_distances_ptrs_parallel_steal(s, 41, lengths, result, &block, &settings, &stats), length);
+        for (idx_t i=0; i<length; i++) {
+            cr_assert_eq(result[i], expected[i]);
+        }
+        // Every split adds one task to the initial task of every thread
+        cr_assert_gt(stats.tasks, stats.splits);
+        cr_assert_leq(stats.tasks, stats.splits + omp_get_max_threads());
+        cr_assert_leq(stats.tail_time, stats.total_time);
+    }
+}
+
+Test(matrix, test_c_block_ptrs_parallel_pruned) {
+    #ifdef SKIPALL
+    cr_skip_test();
+    #endif
+    double s1[] = {0., 0, 1, 2, 1, 0, 1, 0, 0};
+    double s2[] = {0., 1, 2, 0, 0, 0, 0, 0, 0};
+    double s3[] = {1., 2, 0, 0, 0, 0, 0, 1, 1};
+    double s4[] = {0., 0, 1, 2, 1, 0, 1, 0, 0};
+    double s5[] = {0., 1, 2, 0, 0, 0, 0, 0, 0};
+    double s6[] = {1., 2, 0, 0, 0, 0, 0, 1, 1};
+    double *s[] = {s1, s2, s3, s4, s5, s6};
+    idx_t lengths[] = {9, 9, 9, 9, 9, 9};
+    double result[5];
+    DTWSettings settings = dtw_settings_default();
+    settings.max_dist = 1.5;
+    DTWBlock block = {.rb=1, .re=4, .cb=3, .ce=5, .triu=true};
+    DTWPruneStats stats;
+    dtw_distances_ptrs_parallel_pruned(s, 6, lengths, result, &block, &settings, &stats);
+    cr_assert_float_eq(result[0], 1.41421356, 0.001);
+    cr_assert_float_eq(result[1], 0.00000000, 0.001);
+    cr_assert(isinf(result[2]));
+    cr_assert(isinf(result[3]));
+    cr_assert_float_eq(result[4], 1.41421356, 0.001);
+    cr_assert_eq(stats.pairs, 5);
+    cr_assert_eq(stats.kept, 3);
+    cr_assert_eq(stats.pruned_kim + stats.pruned_keogh + stats.abandoned, 2);
+    // dtw_distances_ptrs_parallel_d uses the same cascade when max_dist is set
+    double result_d[5];
+    dtw_distances_ptrs_parallel_d(s, 6, lengths, result_d, &block, &settings);
+    for (int i=0; i<5; i++) {
+        cr_assert_eq(result_d[i], result[i]);
+    }
+}
+
+Test(matrix, test_c_knn_ptrs_parallel) {
+    #ifdef SKIPALL
+    cr_skip_test();
+    #endif
+    // Random walks of different lengths, compared with all distances
+    double data[12][40];
+    double *s[12];
+    idx_t lengths[12];
+    for (idx_t i=0; i<12; i++) {
+        double v = 0;
+        lengths[i] = 30 + (i * 7) % 11;
+        for (idx_t j=0; j<lengths[i]; j++) {
+            v += sin(j * 0.31 * (i + 1)) + 0.05 * i;
+            data[i][j] = v;
+        }
+        s[i] = data[i];
+    }
+    idx_t k = 3;
+    DTWNeighbour nearest[12 * 3];
+    DTWNeighbour farthest[12 * 3];
+    double all[12];
+    DTWSettings settings = dtw_settings_default();
+    for (idx_t window=0; window<=5; window+=5) {
+        settings.window = window;
+        DTWKnnStats stats;
+        cr_assert_eq(dtw_knn_ptrs_parallel(s, 12, lengths, k, nearest, farthest, &settings, &stats), k);
+        cr_assert_eq(stats.pairs, 2 * 12 * 11);
+        for (idx_t i=0; i<12; i++) {
+            for (idx_t j=0; j<12; j++) {
+                all[j] = (i == j) ? NAN : dtw_distance(s[i], lengths[i], s[j], lengths[j], &settings);
+            }
+            for (idx_t r=0; r<k; r++) {
+                // Number of other series that are strictly closer (or farther)
+                idx_t nb_closer = 0;
+                idx_t nb_farther = 0;
+                for (idx_t j=0; j<12; j++) {
+                    if (j == i) {
+                        continue;
+                    }
+                    nb_closer += (all[j] < nearest[i * k + r].dist);
+                    nb_farther += (all[j] > farthest[i * k + r].dist);
+                }
+                cr_assert_eq(all[nearest[i * k + r].idx], nearest[i * k + r].dist);
+                cr_assert_eq(all[farthest[i * k + r].idx], farthest[i * k + r].dist);
+                cr_assert_leq(nb_closer, r);
+                cr_assert_leq(nb_farther, r);
+            }
+        }
+    }
+    // More neighbours than series
+    cr_assert_eq(dtw_knn_ptrs_parallel(s, 3, lengths, k, nearest, NULL, &settings, NULL), 2);
+    cr_assert_eq(nearest[2].idx, 3);
+    cr_assert(isinf(nearest[2].dist));
+}
+
 Test(matrix, test_c_block_matrix_parallel) {
     #ifdef SKIPALL
     cr_skip_test();
@@ -542,3 +714,50 @@ Test(aux, test_length_nooverflow_block) {
 //    printf("nb_series = %zu / length = %zu / expected = %zu / b = %zu\n", nb_series, length, expected_length, b);
     cr_assert_eq(length, expected_length); // no overflow
 }
+
+Test(aux, test_distances_partition) {
+    #ifdef SKIPALL
+    cr_skip_test();
+    #endif
+    // Ranges cover all pairs in order and differ at most one pair cost from the mean
+    idx_t lengths[41];
+    idx_t max_length = 0;
+    for (idx_t i=0; i<41; i++) {
+        lengths[i] = 5 + (i * 13) % 26;
+        max_length = MAX(max_length, lengths[i]);
+    }
+    idx_t nb_pairs = 41 * 40 / 2;
+    idx_t costs[41 * 40 / 2];
+    idx_t total = 0, i = 0;
+    for (idx_t r=0; r<41; r++) {
+        for (idx_t c=r+1; c<41; c++, i++) {
+            costs[i] = lengths[r] * lengths[c];
+            total += costs[i];
+        }
+    }
+    idx_t parts[] = {1, 3, 7, 64, 1000};
+    for (int k=0; k<5; k++) {
+        idx_t nb_parts = parts[k];
+        idx_t bounds[1001];
+        cr_assert_eq(dtw_distances_partition(lengths, 41, nb_parts, bounds), nb_pairs);
+        cr_assert_eq(bounds[0], 0);
+        cr_assert_eq(bounds[nb_parts], nb_pairs);
+        for (idx_t p=0; p<nb_parts; p++) {
+            cr_assert_leq(bounds[p], bounds[p + 1]);
+            idx_t cost = 0;
+            for (i=bounds[p]; i<bounds[p + 1]; i++) {
+                cost += costs[i];
+            }
+            cr_assert_leq(cost, total / nb_parts + max_length * max_length + 1);
+        }
+    }
+    // Same lengths: same number of pairs per range
+    idx_t same[10] = {7, 7, 7, 7, 7, 7, 7, 7, 7, 7};
+    idx_t bounds[6];
+    cr_assert_eq(dtw_distances_partition(same, 10, 5, bounds), 45);
+    for (idx_t p=0; p<5; p++) {
+        cr_assert_eq(bounds[p + 1] - bounds[p], 9);
+    }
+    cr_assert_eq(dtw_distances_partition(same, 1, 5, bounds), 0);
+    cr_assert_eq(bounds[5], 0);
+}
@@ -0,0 +1,97 @@
+/*
+ * Cost-aware batch sizing for the master of the MPI implementations.
+ *
+ * This file is part of the DTW aggregation and clustering project.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "batch_schedule.h"
+#include "dd_globals.h"
+
+
+int batch_schedule_init(BatchSchedule *schedule, int nprocs, double quantum, int first_batch,
+                        int min_batch, int max_batch, int (*tasks)[2], int total_tasks, const int *lengths) {
+    memset(schedule, 0, sizeof(BatchSchedule));
+    schedule->nb_workers = MAX(nprocs - 1, 1);
+    schedule->quantum = quantum;
+    schedule->min_batch = MAX(min_batch, 1);
+    schedule->max_batch = MAX(max_batch, schedule->min_batch);
+    schedule->first_batch = MIN(MAX(first_batch, schedule->min_batch), schedule->max_batch);
+    schedule->remaining = batch_schedule_cells(tasks, 0, total_tasks, lengths);
+    schedule->smallest = total_tasks;
+    schedule->rate = calloc(nprocs, sizeof(double));
+    schedule->last_time = calloc(nprocs, sizeof(double));
+    if (!schedule->rate || !schedule->last_time) {
+        fprintf(stderr, "Error: cannot allocate memory for %d ranks\n", nprocs);
+        batch_schedule_free(schedule);
+        return -1;
+    }
+    return 0;
+}
+
+void batch_schedule_free(BatchSchedule *schedule) {
+    free(schedule->rate);
+    free(schedule->last_time);
+    schedule->rate = NULL;
+    schedule->last_time = NULL;
+}
+
+// DTW cells of the pairs first, ..., first+count-1
+double batch_schedule_cells(int (*tasks)[2], int first, int count, const int *lengths) {
+    double cells = 0;
+    for (int b = first; b < first + count; b++) {
+        cells += (double)lengths[tasks[b][0]] * lengths[tasks[b][1]];
+    }
+    return cells;
+}
+
+/*
+ * Number of pairs of the next batch of rank, starting at next_task: about quantum
+ * seconds of work at the measured rate of the rank (first_batch pairs before the
+ * first measurement), at most 1 / (2 * workers) of the remaining cells.
+ */
+int batch_schedule_next(BatchSchedule *schedule, int rank, int (*tasks)[2], int next_task,
+                        int total_tasks, const int *lengths) {
+    int left = total_tasks - next_task;
+    if (left <= 0) {
+        return 0;
+    }
+    double rate = schedule->rate[rank];
+    double target = schedule->remaining / (2.0 * schedule->nb_workers);
+    if (rate > 0 && rate * schedule->quantum < target) {
+        target = rate * schedule->quantum;
+    }
+    int limit = MIN(left, schedule->max_batch);
+    if (rate <= 0) {
+        limit = MIN(limit, schedule->first_batch);
+    }
+    int batch = 0;
+    double cells = 0;
+    while (batch < limit && (batch < schedule->min_batch || cells < target)) {
+        cells += (double)lengths[tasks[next_task + batch][0]] * lengths[tasks[next_task + batch][1]];
+        batch++;
+    }
+    return batch;
+}
+
+// The master sent a batch of count pairs and cells cells to rank at time now
+void batch_schedule_sent(BatchSchedule *schedule, int rank, int count, double cells, double now) {
+    schedule->remaining -= cells;
+    if (schedule->last_time[rank] <= 0) {
+        schedule->last_time[rank] = now;
+    }
+    schedule->nb_batches++;
+    schedule->smallest = MIN(schedule->smallest, count);
+    schedule->largest = MAX(schedule->largest, count);
+}
+
+// The master received the results of a batch of cells cells from rank at time now
+void batch_schedule_done(BatchSchedule *schedule, int rank, double cells, double now) {
+    double elapsed = now - schedule->last_time[rank];
+    if (elapsed > 0) {
+        double rate = cells / elapsed;
+        schedule->rate[rank] = (schedule->rate[rank] > 0) ? 0.5 * (schedule->rate[rank] + rate) : rate;
+    }
+    schedule->last_time[rank] = now;
+}
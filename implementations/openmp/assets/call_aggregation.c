@@ -4,11 +4,12 @@
 #include "call_aggregation.h"
 #include "aggregation.h"
 #include "load_from_csv.h"
+#include "result_matrix.h"
 
 void run_aggregation(int num_series, double *result_dtw, TickerSeries *series, int aggregation_type, bool result_already_computed) {
     if (!result_already_computed) {
         printf("Loading DTW result from file...\n");
-        if (!load_result_from_csv("dtw_result.csv", result_dtw, num_series)) {
+        if (!load_result_from_file("dtw_result.csv", result_dtw, num_series)) {
             printf("Error: failed to load dtw_result.csv.\n");
             return;
         }
@@ -0,0 +1,60 @@
+/*
+ * Wire format of a batch of pairs with every series packed once.
+ *
+ * The master orders the pairs in tiles of tile x tile series (series_batch_tile_order),
+ * such that consecutive pairs share their row and column series. A batch lists its
+ * distinct series once, followed by an index table of the pairs, instead of both
+ * series of every pair.
+ *
+ * Layout (offsets from the start of the batch, which is 64-byte aligned):
+ *
+ *   int32 nb_pairs, nb_series, 0, 0
+ *   int64 offsets[nb_series]   start of every series
+ *   int32 lengths[nb_series]
+ *   int32 pairs[2 * nb_pairs]  (row, column) index into the series of every pair
+ *   series, each starting on a SERIES_BATCH_ALIGN boundary (zero padded)
+ *
+ * Used by the MPI implementations (no MPI calls, the buffers are sent as MPI_BYTE).
+ *
+ * This file is part of the DTW aggregation and clustering project.
+ */
+// series_batch.h
+#ifndef SERIES_BATCH_H
+#define SERIES_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dd_globals.h"
+
+#define SERIES_BATCH_ALIGN 64
+
+typedef struct {
+    int num_series;
+    int *slot;            // index of a series in the batch being packed, -1 if absent
+    int *ids;             // series of the batch being packed, in order of first use
+} SeriesBatchBuilder;
+
+typedef struct {
+    int nb_pairs;
+    int nb_series;
+    const int64_t *offsets;
+    const int32_t *lengths;
+    const int32_t *pairs;
+    char *base;
+} SeriesBatchView;
+
+int    series_batch_tile_order(int num_series, int tile, int (*tasks)[2]);
+int    series_batch_builder_init(SeriesBatchBuilder *builder, int num_series);
+void   series_batch_builder_free(SeriesBatchBuilder *builder);
+size_t series_batch_max_size(int nb_pairs, idx_t max_length);
+size_t series_batch_pairwise_size(int (*tasks)[2], int first, int count, const int *lengths);
+size_t series_batch_pack(SeriesBatchBuilder *builder, char *buf, int (*tasks)[2], int first, int count,
+                         double **s, const int *lengths);
+size_t series_batch_packed_size(SeriesBatchBuilder *builder, int (*tasks)[2], int first, int count,
+                                const int *lengths);
+int    series_batch_view(char *buf, size_t size, SeriesBatchView *view);
+double *series_batch_distinct(const SeriesBatchView *view, int i, int *length);
+double *series_batch_series(const SeriesBatchView *view, int k, int side, int *length);
+
+#endif // SERIES_BATCH_H
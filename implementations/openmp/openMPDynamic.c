@@ -7,19 +7,35 @@
 #include <time.h>
 #include <inttypes.h>
 #include <string.h>
+#include <math.h>
 
 #include "dd_dtw.h"
 #include "dd_dtw_openmp.h"
+#include "dd_dtw_f32.h"
+#include "dd_dtw_simd.h"
+#include "dd_dtw_knn.h"
+#include "dd_dtw_incremental.h"
 
 #include "assets/load_from_csv.h"
+#include "assets/series_store.h"
+#include "assets/result_matrix.h"
+#include "assets/dtw_checkpoint.h"
+#include "assets/result_cache.h"
 #include <stdio.h>
+#include <unistd.h>
 
 
 #define VERBOSE 0
 
 
-// n is the number of time series
-bool save_result(int n, double *result, TickerSeries *series_list, const char *filename) {
+// n is the number of time series, a filename ending in .dtwm gets a binary condensed matrix
+// with values of value_size bytes (sizeof(float) for the --f32 kernels)
+// max_dist > 0 skips the pairs that were pruned (distance larger than max_dist)
+bool save_result(int n, double *result, const SeriesCollection *collection, const char *filename, double max_dist,
+                 int value_size) {
+    if (result_matrix_is_matrix_name(filename)) {
+        return result_matrix_save(filename, collection, n, result, value_size, max_dist) != 0;
+    }
     FILE *fptr;
     fptr = fopen(filename, "w");
     if (fptr == NULL) {
@@ -29,8 +45,11 @@ bool save_result(int n, double *result, TickerSeries *series_list, const char *f
 
     int idx = 0;
     for (int r=0; r<n; r++) {
-        for (int c=r+1; c<n; c++) {
-            fprintf(fptr, "%s; %s; %f;\n", series_list[r].ticker, series_list[c].ticker, result[idx++]);
+        for (int c=r+1; c<n; c++, idx++) {
+            if (max_dist > 0 && isinf(result[idx])) {
+                continue;
+            }
+            fprintf(fptr, "%s; %s; %f;\n", series_collection_ticker(collection, r), series_collection_ticker(collection, c), result[idx]);
         }
     }
 
@@ -38,14 +57,192 @@ bool save_result(int n, double *result, TickerSeries *series_list, const char *f
     return 0;
 }
 
+// k rows per ticker for the nearest and for the farthest neighbours
+bool save_knn_result(int n, idx_t k, DTWNeighbour *nearest, DTWNeighbour *farthest,
+                     const SeriesCollection *collection, const char *filename) {
+    FILE *fptr;
+    fptr = fopen(filename, "w");
+    if (fptr == NULL) {
+        printf("Error opening file!\n");
+        return 1; // Indicate an error
+    }
+
+    for (int r=0; r<n; r++) {
+        for (idx_t c=0; c<k; c++) {
+            DTWNeighbour *near = &nearest[r * k + c];
+            if (near->idx < (idx_t)n) {
+                fprintf(fptr, "%s; %s; %f; near;\n", series_collection_ticker(collection, r),
+                        series_collection_ticker(collection, near->idx), near->dist);
+            }
+        }
+        for (idx_t c=0; c<k; c++) {
+            DTWNeighbour *far = &farthest[r * k + c];
+            if (far->idx < (idx_t)n) {
+                fprintf(fptr, "%s; %s; %f; far;\n", series_collection_ticker(collection, r),
+                        series_collection_ticker(collection, far->idx), far->dist);
+            }
+        }
+    }
+
+    fclose(fptr);
+    return 0;
+}
+
+// k nearest and k farthest neighbours per ticker instead of all pairs
+void example_knn(SeriesCollection *collection, const char *file_result_destination, idx_t k) {
+    int num_series = collection->num_series;
+    double *s[num_series];
+    idx_t *lengths = collection->lengths;
+
+    for (int i = 0; i < num_series; i++) {
+        s[i] = series_collection_series(collection, i);
+    }
+
+    DTWNeighbour *nearest = malloc(sizeof(DTWNeighbour) * num_series * k);
+    DTWNeighbour *farthest = malloc(sizeof(DTWNeighbour) * num_series * k);
+    if (!nearest || !farthest) {
+        printf("Error: cannot allocate memory for neighbours (size=%zu)\n", num_series * k);
+        free(nearest);
+        free(farthest);
+        return;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_REALTIME, &start);
+
+    DTWSettings settings = dtw_settings_default();
+    DTWKnnStats stats;
+    dtw_knn_ptrs_parallel(s, num_series, lengths, k, nearest, farthest, &settings, &stats);
+
+    clock_gettime(CLOCK_REALTIME, &end);
+    double diff_t = ((double)end.tv_sec * 1e9 + end.tv_nsec) - ((double)start.tv_sec * 1e9 + start.tv_nsec);
+    printf("Execution time = %f ms\n", diff_t / 1000000);
+    dtw_print_knn_stats(&stats);
+
+    save_knn_result(num_series, k, nearest, farthest, collection, file_result_destination);
+    printf("Result saved\n");
+
+    free(nearest);
+    free(farthest);
+}
+
+// --cache: fill result from the cache and compute the other pairs, row by row with the
+// kernel of parallel_type (the scheduler variants of --tiled and --steal fall back to rows)
+int compute_with_cache(double **s, int num_series, idx_t *lengths, double *result, int parallel_type,
+                       DTWSettings *settings, const char *cache_file) {
+    ResultCache cache;
+    if (result_cache_open(&cache, cache_file) != 0) {
+        printf("Error opening cache %s\n", cache_file);
+        return 1;
+    }
+    uint64_t cache_settings = result_cache_settings_key(settings, parallel_type == 1 ? RESULT_CACHE_F32 : RESULT_CACHE_F64);
+    uint64_t keys[num_series];
+    for (int i = 0; i < num_series; i++) {
+        keys[i] = series_hash(s[i], lengths[i]);
+    }
+    idx_t result_length = (idx_t)num_series * (num_series - 1) / 2;
+    bool *missing = malloc(sizeof(bool) * (result_length + 1));
+    if (!missing) {
+        printf("Error: cannot allocate memory (size=%zu)\n", result_length);
+        result_cache_close(&cache);
+        return 1;
+    }
+    for (int r = 0; r < num_series; r++) {
+        for (int c = r + 1; c < num_series; c++) {
+            idx_t idx = result_matrix_pair_index(r, c, num_series);
+            missing[idx] = !result_cache_get(&cache, keys[r], keys[c], cache_settings, &result[idx]);
+        }
+    }
+
+    // --f32: every series is converted once, not once per row
+    float **s32 = NULL;
+    if (parallel_type == 1) {
+        s32 = malloc(sizeof(float *) * num_series);
+        for (int i = 0; i < num_series; i++) {
+            s32[i] = malloc(sizeof(float) * lengths[i]);
+            dtw_seq_to_f32(s[i], lengths[i], s32[i]);
+        }
+    }
+
+    DTWWsFnPtr dtw_fn = dtw_distance_kernel(settings);
+    #pragma omp parallel
+    {
+        DTWWorkspace ws = dtw_workspace_empty();
+        double **cols = malloc(sizeof(double *) * num_series);
+        idx_t *col_lengths = malloc(sizeof(idx_t) * num_series);
+        idx_t *col_idx = malloc(sizeof(idx_t) * num_series);
+        idx_t *col_ids = malloc(sizeof(idx_t) * num_series);
+        double *values = malloc(sizeof(double) * num_series);
+        #pragma omp for schedule(dynamic)
+        for (int r = 0; r < num_series; r++) {
+            // the missing columns of the row, in one batch such that they share the SIMD lanes
+            idx_t n = 0;
+            for (int c = r + 1; c < num_series; c++) {
+                idx_t idx = result_matrix_pair_index(r, c, num_series);
+                if (missing[idx]) {
+                    cols[n] = s[c];
+                    col_lengths[n] = lengths[c];
+                    col_idx[n] = idx;
+                    col_ids[n] = c;
+                    n++;
+                }
+            }
+            if (n == 0) {
+                continue;
+            }
+            if (parallel_type == 1) {
+                for (idx_t k = 0; k < n; k++) {
+                    values[k] = dtw_distance_f32_ws(s32[r], lengths[r], s32[col_ids[k]], col_lengths[k], settings, &ws);
+                }
+            } else if (settings->max_dist != 0) {
+                for (idx_t k = 0; k < n; k++) {
+                    values[k] = dtw_fn(s[r], lengths[r], cols[k], col_lengths[k], settings, &ws);
+                }
+            } else {
+                dtw_distance_batch_ws(s[r], lengths[r], cols, col_lengths, n, values, settings, &ws);
+            }
+            for (idx_t k = 0; k < n; k++) {
+                result[col_idx[k]] = values[k];
+            }
+        }
+        free(cols);
+        free(col_lengths);
+        free(col_idx);
+        free(col_ids);
+        free(values);
+        dtw_workspace_free(&ws);
+    }
+    if (s32) {
+        for (int i = 0; i < num_series; i++) free(s32[i]);
+        free(s32);
+    }
+
+    for (int r = 0; r < num_series; r++) {
+        for (int c = r + 1; c < num_series; c++) {
+            idx_t idx = result_matrix_pair_index(r, c, num_series);
+            if (missing[idx]) {
+                result_cache_put(&cache, keys[r], keys[c], cache_settings, result[idx]);
+            }
+        }
+    }
+    result_cache_print_stats(&cache, result_length);
+    free(missing);
+    if (result_cache_close(&cache) != 0) {
+        printf("Error writing cache %s\n", cache_file);
+    }
+    return 0;
+}
+
 // function to run the dtw algorithm from dtaidistance
-void example(TickerSeries *series, int num_series, const char *file_result_destination, int parallel_type) {
+// max_dist > 0 only keeps the pairs with a distance up to max_dist (lower-bound cascade)
+void example(SeriesCollection *collection, const char *file_result_destination, int parallel_type,
+             double max_dist, const char *cache_file) {
+    int num_series = collection->num_series;
     double *s[num_series];
-    idx_t lengths[num_series];
+    idx_t *lengths = collection->lengths;
 
     for (int i = 0; i < num_series; i++) {
-        s[i] = series[i].close;
-        lengths[i] = series[i].count;
+        s[i] = series_collection_series(collection, i);
     }
 
     idx_t result_length = num_series * (num_series - 1) / 2;
@@ -67,13 +264,60 @@ void example(TickerSeries *series, int num_series, const char *file_result_desti
 
     DTWSettings settings = dtw_settings_default();
     DTWBlock block = dtw_block_empty();
+    settings.max_dist = max_dist;
+    DTWPruneStats stats = dtw_prune_stats_empty();
 
-    if (parallel_type == 0) {
+    if (cache_file) {
+        // Only the pairs that are not in the cache
+        if (compute_with_cache(s, num_series, lengths, result, parallel_type, &settings, cache_file) != 0) {
+            free(result);
+            return;
+        }
+    } else if (parallel_type == 0 && max_dist > 0) {
+        // OpenMP version with LB_Kim, LB_Keogh and early-abandoning DTW
+        #if VERBOSE
+          printf("DTW OpenMP pruned...\n");
+        #endif
+        dtw_distances_ptrs_parallel_pruned(s, num_series, lengths, result, &block, &settings, &stats);
+    } else if (parallel_type == 0) {
         // OpenMP version
         #if VERBOSE
           printf("DTW OpenMP...\n");
         #endif
         dtw_distances_ptrs_parallel_d(s, num_series, lengths, result, &block, &settings);
+    } else if (parallel_type == 1) {
+        // OpenMP version in single precision
+        #if VERBOSE
+          printf("DTW OpenMP float32...\n");
+        #endif
+        float *s32[num_series];
+        for (int i = 0; i < num_series; i++) {
+            s32[i] = malloc(sizeof(float) * lengths[i]);
+            dtw_seq_to_f32(s[i], lengths[i], s32[i]);
+        }
+        float *result32 = malloc(sizeof(float) * result_length);
+        dtw_distances_ptrs_parallel_f32(s32, num_series, lengths, result32, &block, &settings);
+        for (idx_t i = 0; i < result_length; i++) {
+            result[i] = result32[i];
+        }
+        free(result32);
+        for (int i = 0; i < num_series; i++) {
+            free(s32[i]);
+        }
+    } else if (parallel_type == 2) {
+        // OpenMP version over cache-sized tiles of the matrix
+        #if VERBOSE
+          printf("DTW OpenMP tiled...\n");
+        #endif
+        dtw_distances_ptrs_parallel_tiled(s, num_series, lengths, result, &block, &settings, 0);
+    } else if (parallel_type == 3) {
+        // OpenMP version with work stealing
+        #if VERBOSE
+          printf("DTW OpenMP work stealing...\n");
+        #endif
+        DTWStealStats steal_stats;
+        dtw_distances_ptrs_parallel_steal(s, num_series, lengths, result, &block, &settings, &steal_stats);
+        dtw_print_steal_stats(&steal_stats);
     } // MPI version implemented separeted
 
 
@@ -82,22 +326,304 @@ void example(TickerSeries *series, int num_series, const char *file_result_desti
     diff_t = difftime(end_t, start_t);
     diff_t2 = ((double)end.tv_sec * 1e9 + end.tv_nsec) - ((double)start.tv_sec * 1e9 + start.tv_nsec);
     printf("Execution time = %f sec = %f ms\n", diff_t, diff_t2 / 1000000);
+    if (stats.pairs > 0) {
+        dtw_print_prune_stats(&stats);
+    }
 
-    save_result(num_series, result, series, file_result_destination);
+    save_result(num_series, result, collection, file_result_destination, max_dist,
+                parallel_type == 1 ? sizeof(float) : sizeof(double));
     printf("Result saved\n");
 
     free(result);
 }
 
+// Refresh from the cost matrix boundaries of the previous run in checkpoint_file: pairs of
+// series that only got points appended are extended, the other pairs are computed in full.
+// The boundaries of this run replace the checkpoint for the next refresh.
+int example_incremental(SeriesCollection *collection, const char *file_result_destination,
+                         const char *checkpoint_file, double max_dist) {
+    int num_series = collection->num_series;
+    double *s[num_series];
+    idx_t *lengths = collection->lengths;
+    idx_t max_length = 0;
+
+    for (int i = 0; i < num_series; i++) {
+        s[i] = series_collection_series(collection, i);
+        max_length = MAX(max_length, lengths[i]);
+    }
+
+    idx_t result_length = num_series * (num_series - 1) / 2;
+    double *result = malloc(sizeof(double) * result_length);
+    int *old = malloc(sizeof(int) * num_series);
+    char checkpoint_tmp[strlen(checkpoint_file) + 5];
+    snprintf(checkpoint_tmp, sizeof(checkpoint_tmp), "%s.tmp", checkpoint_file);
+    if (!result || !old) {
+        printf("Error: cannot allocate memory for result (size=%zu)\n", result_length);
+        free(result);
+        free(old);
+        return 1;
+    }
+
+    DTWSettings settings = dtw_settings_default();
+    settings.max_dist = max_dist;
+    if (!dtw_incremental_supported(&settings)) {
+        printf("Error: the incremental mode does not support these DTW settings\n");
+        free(result);
+        free(old);
+        return 1;
+    }
+
+    // Old index of every series whose values in the checkpoint are a prefix of the new ones
+    DTWCheckpoint checkpoint;
+    bool have_checkpoint = access(checkpoint_file, F_OK) == 0 && dtw_checkpoint_open(checkpoint_file, &checkpoint) == 0;
+    if (have_checkpoint && !dtw_checkpoint_compatible(&checkpoint, &settings)) {
+        printf("Checkpoint %s has other DTW settings, computing all pairs\n", checkpoint_file);
+        dtw_checkpoint_close(&checkpoint);
+        have_checkpoint = false;
+    }
+    int appended = 0;
+    for (int i = 0; i < num_series; i++) {
+        old[i] = have_checkpoint ? dtw_checkpoint_find(&checkpoint, series_collection_ticker(collection, i), s[i], lengths[i]) : -1;
+        appended += (old[i] >= 0);
+    }
+    printf("Checkpoint: %d of %d series only got points appended\n", appended, num_series);
+
+    DTWCheckpointWriter writer;
+    if (dtw_checkpoint_writer_create(&writer, checkpoint_tmp, collection, num_series, &settings) != 0) {
+        unlink(checkpoint_tmp);
+        if (have_checkpoint) {
+            dtw_checkpoint_close(&checkpoint);
+        }
+        free(result);
+        free(old);
+        return 1;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_REALTIME, &start);
+
+    idx_t extended = 0, full = 0;
+    int errors = 0, oom = 0;
+    #pragma omp parallel reduction(+:extended, full, errors, oom)
+    {
+        DTWWorkspace ws = dtw_workspace_empty();
+        seq_t *row = malloc(sizeof(seq_t) * max_length);
+        seq_t *col = malloc(sizeof(seq_t) * max_length);
+        if (!row || !col) {
+            oom++;
+        }
+        #pragma omp for schedule(dynamic)
+        for (int r = 0; r < num_series; r++) {
+            for (int c = r + 1; c < num_series && row && col; c++) {
+                idx_t idx = result_matrix_pair_index(r, c, num_series);
+                if (old[r] >= 0 && old[c] >= 0) {
+                    const seq_t *old_row, *old_col;
+                    dtw_checkpoint_boundary(&checkpoint, old[r], old[c], &old_row, &old_col);
+                    result[idx] = dtw_distance_extend_ws(s[r], lengths[r], s[c], lengths[c], &settings,
+                                                         (idx_t)checkpoint.series[old[r]].length,
+                                                         (idx_t)checkpoint.series[old[c]].length,
+                                                         old_row, old_col, row, col, &ws);
+                    extended++;
+                } else {
+                    result[idx] = dtw_distance_boundary_ws(s[r], lengths[r], s[c], lengths[c], &settings,
+                                                           row, col, &ws);
+                    full++;
+                }
+                if (dtw_checkpoint_writer_put(&writer, idx, row, lengths[c], col, lengths[r]) != 0) {
+                    errors++;
+                }
+            }
+        }
+        free(row);
+        free(col);
+        dtw_workspace_free(&ws);
+    }
+
+    clock_gettime(CLOCK_REALTIME, &end);
+    double diff_t = ((double)end.tv_sec * 1e9 + end.tv_nsec) - ((double)start.tv_sec * 1e9 + start.tv_nsec);
+    printf("Execution time = %f ms\n", diff_t / 1000000);
+    printf("Incremental: %zd pairs extended, %zd pairs computed in full\n", extended, full);
+
+    if (have_checkpoint) {
+        dtw_checkpoint_close(&checkpoint);
+    }
+    if (oom > 0) {
+        // the pairs of the rows of a thread without boundary buffers were not computed
+        printf("Error: cannot allocate memory for the boundaries (size=%zu), no result saved\n", max_length);
+        dtw_checkpoint_writer_close(&writer);
+        unlink(checkpoint_tmp);
+        free(result);
+        free(old);
+        return 1;
+    }
+    if (dtw_checkpoint_writer_close(&writer) != 0 || errors > 0) {
+        printf("Error writing checkpoint %s, the previous one is kept\n", checkpoint_tmp);
+        unlink(checkpoint_tmp);
+    } else if (rename(checkpoint_tmp, checkpoint_file) != 0) {
+        perror("rename");
+    } else {
+        printf("Checkpoint saved\n");
+    }
+
+    save_result(num_series, result, collection, file_result_destination, max_dist, sizeof(double));
+    printf("Result saved\n");
+
+    free(result);
+    free(old);
+    return 0;
+}
+
+// Add the series of the input that are not in the result matrix matrix_file: only the pairs
+// with a new series are computed (one DTWBlock over the columns of the new series), the other
+// distances are copied from the matrix. The merged matrix replaces file_result_destination.
+// Write the merged matrix next to the destination first, which can be the matrix file itself
+void save_appended(ResultMatrix *matrix, const SeriesCollection *collection,
+                   const char *file_result_destination, const double *result) {
+    char matrix_tmp[strlen(file_result_destination) + 5];
+    snprintf(matrix_tmp, sizeof(matrix_tmp), "%s.tmp", file_result_destination);
+    if (result_matrix_append(matrix, matrix_tmp, collection, result) != 0) {
+        unlink(matrix_tmp);
+    } else if (rename(matrix_tmp, file_result_destination) != 0) {
+        perror("rename");
+    } else {
+        printf("Result saved\n");
+    }
+}
+
+void example_append(SeriesCollection *collection, const char *file_result_destination,
+                    const char *matrix_file, int parallel_type, double max_dist) {
+    int num_series = collection->num_series;
+    ResultMatrix matrix;
+    if (result_matrix_open(matrix_file, &matrix) != 0) {
+        return;
+    }
+    // The new pairs are computed like the pairs of the matrix: float32 values come
+    // from the --f32 kernels, and --max-dist can only repeat the one of the matrix
+    if ((parallel_type == 1) != (matrix.value_size == sizeof(float))) {
+        fprintf(stderr, "Error: %s holds float%d values, %s\n", matrix_file, 8 * matrix.value_size,
+                parallel_type == 1 ? "--f32 cannot be appended to it" : "it can only be appended to with --f32");
+        result_matrix_close(&matrix);
+        return;
+    }
+    if (max_dist > 0 && max_dist != matrix.max_dist) {
+        fprintf(stderr, "Error: --max-dist %g differs from the max_dist %g of %s\n", max_dist, matrix.max_dist, matrix_file);
+        result_matrix_close(&matrix);
+        return;
+    }
+    int *order = malloc(sizeof(int) * num_series);
+    int num_old = order ? result_matrix_append_order(&matrix, collection, order) : -1;
+    if (num_old < 0 || series_collection_reorder(collection, order) != 0) {
+        result_matrix_close(&matrix);
+        free(order);
+        return;
+    }
+    free(order);
+    printf("Append: %d new series to the %d series of %s\n", num_series - num_old, num_old, matrix_file);
+    if (num_old == num_series) {
+        // Nothing to compute, the destination still gets the matrix
+        save_appended(&matrix, collection, file_result_destination, NULL);
+        result_matrix_close(&matrix);
+        return;
+    }
+
+    double *s[num_series];
+    idx_t *lengths = collection->lengths;
+    for (int i = 0; i < num_series; i++) {
+        s[i] = series_collection_series(collection, i);
+    }
+
+    // Every row, the columns of the new series, upper triangle: new x old and new x new
+    DTWSettings settings = dtw_settings_default();
+    settings.max_dist = matrix.max_dist;
+    DTWBlock block = dtw_block_empty();
+    block.re = num_series;
+    block.cb = num_old;
+    block.ce = num_series;
+    idx_t block_length = dtw_distances_length(&block, num_series, num_series);
+    double *result = malloc(sizeof(double) * block_length);
+    if (!result) {
+        printf("Error: cannot allocate memory for result (size=%zu)\n", block_length);
+        result_matrix_close(&matrix);
+        return;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_REALTIME, &start);
+
+    DTWPruneStats stats = dtw_prune_stats_empty();
+    if (parallel_type == 1) {
+        float *s32[num_series];
+        for (int i = 0; i < num_series; i++) {
+            s32[i] = malloc(sizeof(float) * lengths[i]);
+            dtw_seq_to_f32(s[i], lengths[i], s32[i]);
+        }
+        float *result32 = malloc(sizeof(float) * block_length);
+        dtw_distances_ptrs_parallel_f32(s32, num_series, lengths, result32, &block, &settings);
+        for (idx_t i = 0; i < block_length; i++) {
+            result[i] = result32[i];
+        }
+        free(result32);
+        for (int i = 0; i < num_series; i++) {
+            free(s32[i]);
+        }
+    } else if (settings.max_dist > 0) {
+        dtw_distances_ptrs_parallel_pruned(s, num_series, lengths, result, &block, &settings, &stats);
+    } else {
+        dtw_distances_ptrs_parallel_d(s, num_series, lengths, result, &block, &settings);
+    }
+
+    clock_gettime(CLOCK_REALTIME, &end);
+    double diff_t = ((double)end.tv_sec * 1e9 + end.tv_nsec) - ((double)start.tv_sec * 1e9 + start.tv_nsec);
+    printf("Execution time = %f ms\n", diff_t / 1000000);
+    printf("Append: %zd pairs computed, %zd pairs kept\n", block_length, matrix.num_pairs);
+    if (stats.pairs > 0) {
+        dtw_print_prune_stats(&stats);
+    }
+
+    save_appended(&matrix, collection, file_result_destination, result);
+    result_matrix_close(&matrix);
+    free(result);
+}
+
 int main(int argc, char *argv[]) {
     if (argc < 4) {
-        fprintf(stderr, "Usage: %s <csv_path> <series_quantity> <output_file>\n", argv[0]);
+        fprintf(stderr, "Usage: %s <csv_path> <series_quantity> <output_file> [--f32 | --tiled | --steal] [--max-dist <value>] [--knn <k> | --incremental <checkpoint> | --append <matrix.dtwm>] [--cache <cache_file>]\n", argv[0]);
         return 1;
     }
 
     const char *file_path = argv[1];
     int max_assets = atoi(argv[2]);
     const char *result_file = argv[3];
+    int parallel_type = 0;
+    double max_dist = 0;
+    int knn = 0;
+    const char *checkpoint_file = NULL;
+    const char *cache_file = NULL;
+    const char *matrix_file = NULL;
+    for (int a = 4; a < argc; a++) {
+        if (strcmp(argv[a], "--f32") == 0) {
+            parallel_type = 1;
+        } else if (strcmp(argv[a], "--tiled") == 0) {
+            parallel_type = 2;
+        } else if (strcmp(argv[a], "--steal") == 0) {
+            parallel_type = 3;
+        } else if (strcmp(argv[a], "--max-dist") == 0 && a + 1 < argc) {
+            max_dist = atof(argv[++a]);
+        } else if (strcmp(argv[a], "--knn") == 0 && a + 1 < argc) {
+            knn = atoi(argv[++a]);
+        } else if (strcmp(argv[a], "--incremental") == 0 && a + 1 < argc) {
+            checkpoint_file = argv[++a];
+        } else if (strcmp(argv[a], "--cache") == 0 && a + 1 < argc) {
+            cache_file = argv[++a];
+        } else if (strcmp(argv[a], "--append") == 0 && a + 1 < argc) {
+            matrix_file = argv[++a];
+        }
+    }
+
+    if (matrix_file && !result_matrix_is_matrix_name(result_file)) {
+        fprintf(stderr, "Error: --append writes a binary matrix, the output file must end in %s\n", RESULT_MATRIX_SUFFIX);
+        return 1;
+    }
 
     #if VERBOSE
       printf("Max OpenMP threads = %d\n", omp_get_max_threads());
@@ -111,24 +637,26 @@ int main(int argc, char *argv[]) {
     #if VERBOSE
         printf("Loading time series...\n");
     #endif
-    TickerSeries *series = malloc(sizeof(TickerSeries) * max_assets);
-    if (!series) {
-        fprintf(stderr, "Error: cannot allocate memory for series\n");
-        return 1;
-    }
-
-    int num_series = 0;
-    if (load_series_from_csv(file_path, series, &num_series, max_assets) != 0) {
+    SeriesCollection collection;
+    if (load_series_collection_from_file(file_path, &collection, max_assets) != 0) {
         fprintf(stderr, "Error loading CSV\n");
-        free(series);
         return 1;
     }
     #if VERBOSE
-      printf("Loaded %d time series\n", num_series);
+      printf("Loaded %d time series\n", collection.num_series);
     #endif
 
-    example(series, num_series, result_file, 0);
+    int rvalue = 0;
+    if (knn > 0) {
+        example_knn(&collection, result_file, knn);
+    } else if (matrix_file) {
+        example_append(&collection, result_file, matrix_file, parallel_type, max_dist);
+    } else if (checkpoint_file) {
+        rvalue = example_incremental(&collection, result_file, checkpoint_file, max_dist);
+    } else {
+        example(&collection, result_file, parallel_type, max_dist, cache_file);
+    }
 
-    free(series);
-    return 0;
+    series_collection_free(&collection);
+    return rvalue;
 }
\ No newline at end of file
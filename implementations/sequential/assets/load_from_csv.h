@@ -9,7 +9,9 @@
 #define LOAD_SERIES_FROM_CSV_H
 
 #include "types.h"
+#include "series_collection.h"
 
+int load_series_collection_from_csv(const char *filename, SeriesCollection *collection, int max_assets);
 int load_series_from_csv(const char *filename, TickerSeries *series_list, int *num_series, int max_assets);
 bool load_result_from_csv(const char *filename, double *result, int num_series);
 
@@ -0,0 +1,89 @@
+/*
+ * Binary condensed distance matrix: the distances of all pairs (r, c), r < c, of
+ * the upper triangle, row by row, after a header and the ticker table.
+ *
+ * This file is part of the DTW aggregation and clustering project.
+ */
+// result_matrix.h
+#ifndef RESULT_MATRIX_H
+#define RESULT_MATRIX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "dd_globals.h"
+#include "types.h"
+#include "series_collection.h"
+
+/*
+ * Layout of a matrix file (native byte order, checked with byte_order):
+ *
+ *   ResultMatrixHeader                     64 bytes
+ *   ticker table        num_series * name_size bytes, '\0'-terminated names
+ *   values              num_pairs floats (value_size 4) or doubles (value_size 8),
+ *                       starting on a 64-byte boundary
+ *
+ * The distance of (r, c) is values[result_matrix_pair_index(r, c, num_series)].
+ * Pairs pruned by a maximum distance (max_dist > 0) are INFINITY.
+ */
+#define RESULT_MATRIX_MAGIC "DTWMATRX"
+#define RESULT_MATRIX_VERSION 1
+#define RESULT_MATRIX_BYTE_ORDER 0x01020304u
+#define RESULT_MATRIX_ALIGN 64
+#define RESULT_MATRIX_SUFFIX ".dtwm"
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t name_size;
+    uint32_t value_size;
+    uint64_t num_series;
+    uint64_t num_pairs;
+    uint64_t names_offset;
+    uint64_t values_offset;
+    double max_dist;
+} ResultMatrixHeader;
+
+typedef struct {
+    int fd;
+    ResultMatrixHeader header;
+} ResultMatrixWriter;
+
+// A matrix file mapped read-only, names and values point into the mapping
+typedef struct {
+    int num_series;
+    idx_t num_pairs;
+    int value_size;
+    double max_dist;
+    const char *names;     // ticker i is the '\0'-terminated string at names + i * name_size
+    int name_size;
+    const void *values;
+    void *map;
+    size_t map_size;
+} ResultMatrix;
+
+idx_t result_matrix_pair_index(idx_t r, idx_t c, idx_t num_series);
+bool  result_matrix_is_matrix_name(const char *filename);
+bool  result_matrix_is_matrix(const char *filename);
+
+int   result_matrix_writer_create(ResultMatrixWriter *writer, const char *filename, const SeriesCollection *collection,
+                                  int num_series, int value_size, double max_dist);
+int   result_matrix_writer_write(ResultMatrixWriter *writer, idx_t first, const float *values, idx_t count);
+int   result_matrix_writer_write_f64(ResultMatrixWriter *writer, idx_t first, const double *values, idx_t count);
+int   result_matrix_writer_close(ResultMatrixWriter *writer);
+int   result_matrix_save(const char *filename, const SeriesCollection *collection, int num_series,
+                         const double *result, int value_size, double max_dist);
+
+int         result_matrix_open(const char *filename, ResultMatrix *matrix);
+const char *result_matrix_ticker(const ResultMatrix *matrix, int i);
+double      result_matrix_value(const ResultMatrix *matrix, idx_t index);
+int         result_matrix_read(const ResultMatrix *matrix, double *result, idx_t num_pairs);
+void        result_matrix_close(ResultMatrix *matrix);
+int         result_matrix_append_order(const ResultMatrix *matrix, const SeriesCollection *collection, int *order);
+int         result_matrix_append(const ResultMatrix *matrix, const char *filename, const SeriesCollection *collection,
+                                 const double *block);
+bool        load_result_from_file(const char *filename, double *result, int num_series);
+
+#endif // RESULT_MATRIX_H
@@ -0,0 +1,59 @@
+/*
+ * Streaming result sink of the MPI masters: the distances of the pairs are
+ * written while they arrive, in any order, instead of being held in an array of
+ * all pairs that is written once the computation is over.
+ *
+ * A text sink writes ticker_r;ticker_c;distance lines in the order of the upper
+ * triangle, row by row. Results that arrive ahead of the first missing pair wait
+ * in a window (a ring buffer that grows when needed), so its size is about the
+ * pairs between the oldest batch in flight and the newest one. A binary sink
+ * (assets/result_matrix.h) writes every run of pairs at its place in the file and
+ * only keeps one bit per pair, such that missing pairs are found when it is closed.
+ *
+ * This file is part of the DTW aggregation and clustering project.
+ */
+// result_sink.h
+#ifndef RESULT_SINK_H
+#define RESULT_SINK_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "dd_globals.h"
+#include "series_collection.h"
+#include "result_matrix.h"
+
+typedef enum {
+    RESULT_SINK_TEXT,
+    RESULT_SINK_BINARY
+} ResultSinkFormat;
+
+typedef struct {
+    ResultSinkFormat format;
+    const SeriesCollection *collection;
+    int num_series;
+    idx_t num_pairs;
+    double max_dist;       // > 0: pairs with an infinite distance are not written as text
+    FILE *fp;              // text
+    char *fp_buffer;
+    ResultMatrixWriter matrix;   // binary
+    unsigned char *written;      // binary: bit i is set once pair i was written
+    idx_t num_written;           // binary: pairs with their bit set
+    idx_t next;            // text: first pair not written yet, which is (next_r, next_c)
+    int next_r;
+    int next_c;
+    float *window;         // text: pair next + i is in window[(next + i) & (window_size - 1)]
+    bool *ready;
+    idx_t window_size;     // power of two
+    idx_t waiting;         // pairs in the window
+    idx_t peak_waiting;
+} ResultSink;
+
+ResultSinkFormat result_sink_format_of(const char *filename);
+int  result_sink_open(ResultSink *sink, const char *filename, ResultSinkFormat format,
+                      const SeriesCollection *collection, int num_series, double max_dist);
+int  result_sink_put(ResultSink *sink, idx_t first, const float *values, idx_t count);
+int  result_sink_close(ResultSink *sink);
+void result_sink_print_stats(const ResultSink *sink);
+
+#endif // RESULT_SINK_H
@@ -0,0 +1,92 @@
+/*
+ * Variable-length collection of close series.
+ *
+ * This file is part of the DTW aggregation and clustering project.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "series_collection.h"
+
+
+void series_collection_init(SeriesCollection *collection) {
+    memset(collection, 0, sizeof(SeriesCollection));
+}
+
+void series_collection_free(SeriesCollection *collection) {
+    if (collection->map != NULL) {
+        munmap(collection->map, collection->map_size);
+    } else {
+        free(collection->values);
+        free(collection->names);
+    }
+    free(collection->offsets);
+    free(collection->lengths);
+    free(collection->name_offsets);
+    series_collection_init(collection);
+}
+
+const char *series_collection_ticker(const SeriesCollection *collection, int i) {
+    return collection->names + collection->name_offsets[i];
+}
+
+double *series_collection_series(const SeriesCollection *collection, int i) {
+    return collection->values + collection->offsets[i];
+}
+
+// FNV-1a over the bytes of the values, identifies a series across runs
+uint64_t series_hash(const double *values, idx_t length) {
+    const unsigned char *bytes = (const unsigned char *)values;
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < sizeof(double) * (size_t)length; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/*
+ * Reorder the series without moving their values: series i becomes the series that
+ * was at index order[i]. order is a permutation of 0..num_series-1.
+ */
+int series_collection_reorder(SeriesCollection *collection, const int *order) {
+    int n = collection->num_series;
+    idx_t *offsets = malloc(sizeof(idx_t) * (n > 0 ? n : 1));
+    idx_t *lengths = malloc(sizeof(idx_t) * (n > 0 ? n : 1));
+    idx_t *name_offsets = malloc(sizeof(idx_t) * (n > 0 ? n : 1));
+    if (!offsets || !lengths || !name_offsets) {
+        fprintf(stderr, "Error: cannot allocate memory to reorder %d series\n", n);
+        free(offsets);
+        free(lengths);
+        free(name_offsets);
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        offsets[i] = collection->offsets[order[i]];
+        lengths[i] = collection->lengths[order[i]];
+        name_offsets[i] = collection->name_offsets[order[i]];
+    }
+    memcpy(collection->offsets, offsets, sizeof(idx_t) * n);
+    memcpy(collection->lengths, lengths, sizeof(idx_t) * n);
+    memcpy(collection->name_offsets, name_offsets, sizeof(idx_t) * n);
+    free(offsets);
+    free(lengths);
+    free(name_offsets);
+    return 0;
+}
+
+// Copy into fixed TickerSeries structs, series longer than MAX_TIMEPOINTS are truncated
+int series_collection_to_ticker_series(const SeriesCollection *collection, TickerSeries *series_list,
+                                       int *num_series, int max_assets) {
+    int n = (collection->num_series < max_assets) ? collection->num_series : max_assets;
+    for (int i = 0; i < n; i++) {
+        idx_t count = (collection->lengths[i] < MAX_TIMEPOINTS) ? collection->lengths[i] : MAX_TIMEPOINTS;
+        strncpy(series_list[i].ticker, series_collection_ticker(collection, i), MAX_TICKER_NAME - 1);
+        series_list[i].ticker[MAX_TICKER_NAME - 1] = '\0';
+        memcpy(series_list[i].close, series_collection_series(collection, i), sizeof(double) * count);
+        series_list[i].count = (int)count;
+    }
+    *num_series = n;
+    return 0;
+}
@@ -0,0 +1,66 @@
+/*
+ * Binary columnar store for the close series of all tickers.
+ *
+ * This file is part of the DTW aggregation and clustering project.
+ */
+// series_store.h
+#ifndef SERIES_STORE_H
+#define SERIES_STORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "dd_globals.h"
+#include "types.h"
+#include "series_collection.h"
+
+/*
+ * Layout of a store file (native byte order, checked with byte_order):
+ *
+ *   SeriesStoreHeader                      64 bytes
+ *   ticker dictionary   num_series * name_size bytes, '\0'-terminated names
+ *   offsets             (num_series + 1) uint64_t, series i is values[offsets[i]..offsets[i+1])
+ *   values              num_values doubles, starting on a 64-byte boundary
+ *
+ * series_store_open maps the file read-only, the series are used in place.
+ */
+#define SERIES_STORE_MAGIC "DTWSTORE"
+#define SERIES_STORE_VERSION 1
+#define SERIES_STORE_BYTE_ORDER 0x01020304u
+#define SERIES_STORE_ALIGN 64
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t name_size;
+    uint32_t value_size;
+    uint64_t num_series;
+    uint64_t num_values;
+    uint64_t names_offset;
+    uint64_t offsets_offset;
+    uint64_t values_offset;
+} SeriesStoreHeader;
+
+typedef struct {
+    void *map;
+    size_t map_size;
+    int num_series;
+    idx_t num_values;
+    int name_size;
+    const char *names;  // ticker i is names + i * name_size
+    seq_t **ptrs;       // num_series pointers into the mapped values
+    idx_t *lengths;
+} SeriesStore;
+
+bool series_store_is_store(const char *filename);
+int series_store_write(const char *filename, const char **names, seq_t **ptrs, idx_t *lengths, int num_series);
+int series_store_write_collection(const char *filename, const SeriesCollection *collection);
+int series_store_open(const char *filename, SeriesStore *store, int max_assets);
+const char *series_store_ticker(SeriesStore *store, int i);
+void series_store_close(SeriesStore *store);
+int series_store_load_collection(const char *filename, SeriesCollection *collection, int max_assets);
+int load_series_collection_from_file(const char *filename, SeriesCollection *collection, int max_assets);
+
+#endif // SERIES_STORE_H
@@ -0,0 +1,58 @@
+// =======================================================
+// Converts the Yahoo CSV into a binary series store
+// (see assets/series_store.h), which all drivers accept
+// in place of the CSV file.
+// =======================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include "assets/load_from_csv.h"
+#include "assets/series_store.h"
+
+
+int main(int argc, char *argv[]) {
+
+    if (argc < 4) {
+        printf("Usage: %s <csv_file> <max_assets> <store_file>\n", argv[0]);
+        return 1;
+    }
+
+    const char *csv_path   = argv[1];
+    int max_assets         = atoi(argv[2]);
+    const char *store_path = argv[3];
+
+    struct timespec t1, t2;
+    clock_gettime(CLOCK_REALTIME, &t1);
+    SeriesCollection collection;
+    if (load_series_collection_from_csv(csv_path, &collection, max_assets) != 0) {
+        printf("ERROR loading CSV!\n");
+        return 1;
+    }
+    clock_gettime(CLOCK_REALTIME, &t2);
+    printf("Loaded %d time series (%zd values) from CSV in %.2f ms\n", collection.num_series, collection.num_values,
+           (double)(t2.tv_sec * 1e9 + t2.tv_nsec - t1.tv_sec * 1e9 - t1.tv_nsec) / 1e6);
+
+    // The series are written with their full length
+    int rvalue = series_store_write_collection(store_path, &collection);
+    series_collection_free(&collection);
+    if (rvalue != 0) {
+        printf("ERROR writing store!\n");
+        return 1;
+    }
+
+    // Check the store by mapping it again
+    SeriesStore store;
+    clock_gettime(CLOCK_REALTIME, &t1);
+    if (series_store_open(store_path, &store, max_assets) != 0) {
+        printf("ERROR reading store!\n");
+        return 1;
+    }
+    clock_gettime(CLOCK_REALTIME, &t2);
+    printf("Wrote %s: %d series, %zd values, mapped in %.3f ms\n", store_path, store.num_series,
+           store.num_values, (double)(t2.tv_sec * 1e9 + t2.tv_nsec - t1.tv_sec * 1e9 - t1.tv_nsec) / 1e6);
+    series_store_close(&store);
+
+    return 0;
+}
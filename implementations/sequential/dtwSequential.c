@@ -2,6 +2,7 @@
 // Sequential DTW Distance Computation
 // Computes DTW for all pairs of time series
 // Saves: distance, time(ms), len_r, len_c
+// (only the distances for a binary .dtwm output)
 // Modified by Daniela Rigoli - 2025
 // =======================================================
 
@@ -11,7 +12,11 @@
 #include <string.h>
 #include <inttypes.h>
 #include "dd_dtw.h"
+#include "dd_dtw_f32.h"
 #include "assets/load_from_csv.h"
+#include "assets/series_store.h"
+#include "assets/result_matrix.h"
+#include "assets/result_cache.h"
 
 #define COUNTPAIR 0
 
@@ -24,7 +29,7 @@ bool save_result_extended(
         double *time_ms,
         int *len_r_arr,
         int *len_c_arr,
-        TickerSeries *series_list,
+        const char **names,
         const char *filename)
 {
     FILE *fptr = fopen(filename, "w");
@@ -38,8 +43,8 @@ bool save_result_extended(
         for (int c = r + 1; c < n; c++) {
 
             fprintf(fptr, "%s;%s;%f;%f;%d;%d;\n",
-                series_list[r].ticker,
-                series_list[c].ticker,
+                names[r],
+                names[c],
                 result[idx],
                 time_ms[idx],
                 len_r_arr[idx],
@@ -61,15 +66,24 @@ bool save_result_extended(
 int main(int argc, char *argv[]) {
 
     if (argc < 4) {
-        printf("Usage: %s <csv_file> <max_assets> <output_file>\n", argv[0]);
+        printf("Usage: %s <csv_file|store_file> <max_assets> <output_file> [--f32] [--cache <cache_file>]\n", argv[0]);
         return 1;
     }
 
     const char *csv_path     = argv[1];
     int max_assets           = atoi(argv[2]);
     const char *output_file  = argv[3];
+    bool use_f32             = false;
+    const char *cache_file   = NULL;
+    for (int a = 4; a < argc; a++) {
+        if (strcmp(argv[a], "--f32") == 0) {
+            use_f32 = true;
+        } else if (strcmp(argv[a], "--cache") == 0 && a + 1 < argc) {
+            cache_file = argv[++a];
+        }
+    }
 
-    printf("Sequential DTW Computation\n");
+    printf("Sequential DTW Computation (%s)\n", use_f32 ? "float32" : "float64");
     printf("Loading CSV: %s\n", csv_path);
 
     // =============================
@@ -79,24 +93,35 @@ int main(int argc, char *argv[]) {
         struct timespec t1, t2;
         clock_gettime(CLOCK_REALTIME, &t1);
     #endif
-    TickerSeries *series = malloc(sizeof(TickerSeries) * max_assets);
-
-    int num_series = 0;
-    if (load_series_from_csv(csv_path, series, &num_series, max_assets) != 0) {
-        printf("ERROR loading CSV!\n");
-        free(series);
+    // A store written by csv_to_store is mapped, the series are used in place
+    SeriesCollection collection;
+    if (load_series_collection_from_file(csv_path, &collection, max_assets) != 0) {
+        printf("ERROR loading series!\n");
         return 1;
     }
+    int num_series = collection.num_series;
 
     printf("Loaded %d time series\n", num_series);
 
-    // pointers and lengths
+    // pointers, lengths and names
     double *s[num_series];
     int lengths[num_series];
+    const char *names[num_series];
 
     for (int i = 0; i < num_series; i++) {
-        s[i] = series[i].close;
-        lengths[i] = series[i].count;
+        s[i] = series_collection_series(&collection, i);
+        lengths[i] = collection.lengths[i];
+        names[i] = series_collection_ticker(&collection, i);
+    }
+
+    // single-precision copies of the series (--f32)
+    float *s32[num_series];
+    for (int i = 0; i < num_series; i++) {
+        s32[i] = NULL;
+        if (use_f32) {
+            s32[i] = malloc(sizeof(float) * lengths[i]);
+            dtw_seq_to_f32(s[i], lengths[i], s32[i]);
+        }
     }
 
     int total_pairs = num_series * (num_series - 1) / 2;
@@ -109,6 +134,20 @@ int main(int argc, char *argv[]) {
 
     DTWSettings settings = dtw_settings_default();
 
+    // --cache: pairs of series with the same values and settings as in an earlier run are not computed
+    ResultCache cache;
+    uint64_t cache_settings = result_cache_settings_key(&settings, use_f32 ? RESULT_CACHE_F32 : RESULT_CACHE_F64);
+    uint64_t keys[num_series];
+    if (cache_file) {
+        if (result_cache_open(&cache, cache_file) != 0) {
+            printf("ERROR opening cache %s!\n", cache_file);
+            return 1;
+        }
+        for (int i = 0; i < num_series; i++) {
+            keys[i] = series_hash(s[i], lengths[i]);
+        }
+    }
+
     printf("Computing DTW sequentially for %d pairs...\n", total_pairs);
 
     // =============================
@@ -125,11 +164,26 @@ int main(int argc, char *argv[]) {
                 clock_gettime(CLOCK_REALTIME, &t1);
             #endif
 
-            double dist = dtw_distance(
-                s[r], lengths[r],
-                s[c], lengths[c],
-                &settings
-            );
+            double dist;
+            bool cached = cache_file && result_cache_get(&cache, keys[r], keys[c], cache_settings, &dist);
+            if (cached) {
+                // computed in an earlier run
+            } else if (use_f32) {
+                dist = dtw_distance_f32(
+                    s32[r], lengths[r],
+                    s32[c], lengths[c],
+                    &settings
+                );
+            } else {
+                dist = dtw_distance(
+                    s[r], lengths[r],
+                    s[c], lengths[c],
+                    &settings
+                );
+            }
+            if (!cached && cache_file) {
+                result_cache_put(&cache, keys[r], keys[c], cache_settings, dist);
+            }
 
             result[idx]     = dist;
 
@@ -160,20 +214,32 @@ int main(int argc, char *argv[]) {
                     - t1.tv_sec * 1e9 - t1.tv_nsec) / 1e6;
             printf("Total time for %d pairs: %.2f ms\n", total_pairs, ms);
     #endif
+    if (cache_file) {
+        result_cache_print_stats(&cache, total_pairs);
+        if (result_cache_close(&cache) != 0) {
+            printf("ERROR writing cache %s!\n", cache_file);
+        }
+    }
 
     // =============================
     // SAVE TO FILE
     // =============================
     printf("Saving results to: %s\n", output_file);
 
-    if (!save_result_extended(
+    bool saved;
+    if (result_matrix_is_matrix_name(output_file)) {
+        saved = (result_matrix_save(output_file, &collection, num_series, result, sizeof(double), 0) == 0);
+    } else {
+        saved = save_result_extended(
             num_series,
             result,
             time_ms,
             len_r_arr,
             len_c_arr,
-            series,
-            output_file))
+            names,
+            output_file);
+    }
+    if (!saved)
     {
         printf("ERROR saving file!\n");
     } else {
@@ -182,11 +248,14 @@ int main(int argc, char *argv[]) {
     
 
     // cleanup
+    for (int i = 0; i < num_series; i++) {
+        free(s32[i]);
+    }
     free(result);
     free(time_ms);
     free(len_r_arr);
     free(len_c_arr);
-    free(series);
+    series_collection_free(&collection);
 
     return 0;
 }
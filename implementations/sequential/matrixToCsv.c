@@ -0,0 +1,60 @@
+// =======================================================
+// Converts a binary result matrix (see assets/result_matrix.h)
+// into the CSV result: ticker_r;ticker_c;distance per pair.
+// Pairs pruned by --max-dist (infinite) are not written.
+// =======================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+#include "assets/result_matrix.h"
+
+
+int main(int argc, char *argv[]) {
+
+    if (argc < 3) {
+        printf("Usage: %s <matrix_file> <csv_file>\n", argv[0]);
+        return 1;
+    }
+
+    const char *matrix_path = argv[1];
+    const char *csv_path    = argv[2];
+
+    struct timespec t1, t2;
+    clock_gettime(CLOCK_REALTIME, &t1);
+    ResultMatrix matrix;
+    if (result_matrix_open(matrix_path, &matrix) != 0) {
+        printf("ERROR reading matrix!\n");
+        return 1;
+    }
+    clock_gettime(CLOCK_REALTIME, &t2);
+    printf("Mapped %s: %d series, %zd pairs (float%d) in %.3f ms\n", matrix_path, matrix.num_series,
+           matrix.num_pairs, 8 * matrix.value_size,
+           (double)(t2.tv_sec * 1e9 + t2.tv_nsec - t1.tv_sec * 1e9 - t1.tv_nsec) / 1e6);
+
+    FILE *fptr = fopen(csv_path, "w");
+    if (fptr == NULL) {
+        printf("Error opening file: %s\n", csv_path);
+        result_matrix_close(&matrix);
+        return 1;
+    }
+    idx_t idx = 0;
+    for (int r = 0; r < matrix.num_series; r++) {
+        for (int c = r + 1; c < matrix.num_series; c++, idx++) {
+            double value = result_matrix_value(&matrix, idx);
+            if (matrix.max_dist > 0 && isinf(value)) {
+                continue;
+            }
+            fprintf(fptr, "%s;%s;%.6f\n", result_matrix_ticker(&matrix, r), result_matrix_ticker(&matrix, c), value);
+        }
+    }
+    bool ok = (fclose(fptr) == 0);
+    clock_gettime(CLOCK_REALTIME, &t1);
+    printf("Wrote %s in %.2f ms\n", csv_path,
+           (double)(t1.tv_sec * 1e9 + t1.tv_nsec - t2.tv_sec * 1e9 - t2.tv_nsec) / 1e6);
+    result_matrix_close(&matrix);
+
+    return ok ? 0 : 1;
+}
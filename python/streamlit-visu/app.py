@@ -1,4 +1,6 @@
+import struct
 import streamlit as st
+import numpy as np
 import pandas as pd
 import plotly.graph_objects as go
 from pathlib import Path
@@ -12,20 +14,65 @@ st.set_page_config(
 
 # File paths
 DTW_FILE = Path(__file__).parent.parent / "../dtw" / "master_tickers_br_EUA_2years_1d.csv"
+MATRIX_FILE = Path(__file__).parent.parent / "../dtw" / "master_tickers_br_EUA_2years_1d.dtwm"
+KNN_FILE = Path(__file__).parent.parent / "../dtw" / "master_tickers_br_EUA_2years_1d_knn.csv"
 ORIGINAL_DATA_FILE = Path(__file__).parent.parent / "../data" / "master_tickers_br_EUA_2years_1d.csv"
 NORMALIZED_DATA_FILE = Path(__file__).parent.parent / "../normalized" / "master_tickers_br_EUA_2years_1d.csv"
 
+# Header of a binary result matrix (implementations/*/assets/result_matrix.h)
+RESULT_MATRIX_HEADER = struct.Struct('=8sIIIIQQQQd')
+RESULT_MATRIX_MAGIC = b'DTWMATRX'
+RESULT_MATRIX_BYTE_ORDER = 0x01020304
+
+def load_result_matrix(file_path):
+    """Load a binary result matrix (.dtwm) as ticker1, ticker2, distance rows, pruned pairs excluded."""
+    with open(file_path, 'rb') as f:
+        (magic, version, byte_order, name_size, value_size, num_series, num_pairs,
+         names_offset, values_offset, max_dist) = RESULT_MATRIX_HEADER.unpack(f.read(RESULT_MATRIX_HEADER.size))
+    if magic != RESULT_MATRIX_MAGIC or byte_order != RESULT_MATRIX_BYTE_ORDER or value_size not in (4, 8):
+        raise ValueError(f"{file_path} is not a result matrix written on this architecture")
+
+    names = np.fromfile(file_path, dtype=f'S{name_size}', count=num_series, offset=names_offset)
+    names = np.char.decode(names, 'utf-8')
+    values = np.fromfile(file_path, dtype=np.float32 if value_size == 4 else np.float64,
+                         count=num_pairs, offset=values_offset)
+    # The pairs (r, c), r < c, row by row: the order of np.triu_indices. The tickers
+    # are categorical columns on the ticker table instead of one string per pair.
+    rows, cols = np.triu_indices(num_series, k=1)
+    finite = np.isfinite(values)
+    return pd.DataFrame({
+        'ticker1': pd.Categorical.from_codes(rows[finite], categories=names),
+        'ticker2': pd.Categorical.from_codes(cols[finite], categories=names),
+        'distance': values[finite].astype(np.float64),
+    })
+
 @st.cache_data
 def load_dtw_distances():
-    df = pd.read_csv(
-        DTW_FILE,
-        sep=';',
-        header=None,
-        names=['ticker1', 'ticker2', 'distance', 'extra'],
-        skipinitialspace=True
-    )
-
-    df = df[['ticker1', 'ticker2', 'distance']]
+    """Load the k-NN output (openMPDynamic --knn) if it exists, else all pairwise distances
+    from the binary result matrix or the CSV."""
+    if KNN_FILE.exists():
+        df = pd.read_csv(
+            KNN_FILE,
+            sep=';',
+            header=None,
+            names=['ticker1', 'ticker2', 'distance', 'kind', 'extra'],
+            skipinitialspace=True
+        )
+        df = df[['ticker1', 'ticker2', 'distance', 'kind']]
+        df['kind'] = df['kind'].astype(str).str.strip()
+    elif MATRIX_FILE.exists():
+        df = load_result_matrix(MATRIX_FILE)
+        all_tickers = sorted(set(df['ticker1'].unique()) | set(df['ticker2'].unique()))
+        return df, all_tickers
+    else:
+        df = pd.read_csv(
+            DTW_FILE,
+            sep=';',
+            header=None,
+            names=['ticker1', 'ticker2', 'distance', 'extra'],
+            skipinitialspace=True
+        )
+        df = df[['ticker1', 'ticker2', 'distance']]
 
     df['ticker1'] = df['ticker1'].astype(str).str.strip()
     df['ticker2'] = df['ticker2'].astype(str).str.strip()
@@ -50,6 +97,13 @@ def load_time_series(file_path):
 
 def find_similar_tickers(dtw_df, selected_ticker, n=1):
     """Find the n most similar and least similar tickers."""
+    if 'kind' in dtw_df.columns:
+        # k-NN rows are already per ticker and sorted by the C code
+        filtered = dtw_df[dtw_df['ticker1'] == selected_ticker]
+        most_similar = filtered[filtered['kind'] == 'near'].sort_values('distance').head(n)['ticker2'].tolist()
+        least_similar = filtered[filtered['kind'] == 'far'].sort_values('distance').tail(n)['ticker2'].tolist()
+        return most_similar, least_similar
+
     # Filter rows where selected ticker is either ticker1 or ticker2
     filtered = dtw_df[(dtw_df['ticker1'] == selected_ticker) | (dtw_df['ticker2'] == selected_ticker)].copy()
     